@@ -0,0 +1,152 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "autotune.h"
+#include "program_cache.h"
+
+#define AUTOTUNE_PATH_LEN 1024
+#define AUTOTUNE_LINE_LEN 512
+#define AUTOTUNE_MAX_ENTRIES 256
+
+
+
+// Work-group shapes tried for 2D kernels: square, wide (row-friendly) and tall tiles
+static const size_t shapes_2d[][2] = {
+    {8, 8}, {16, 8}, {8, 16}, {16, 16}, {32, 4}, {32, 8}, {8, 32}, {32, 16}, {16, 32},
+    {64, 1}, {64, 2}, {64, 4}, {128, 1}, {128, 2}, {32, 32}, {256, 1}
+};
+
+// Shapes tried for 1D kernels
+static const size_t shapes_1d[] = { 32, 64, 128, 256, 512, 1024 };
+
+int autotune_candidates(ocl_runtime* rt, cl_kernel kernel, int dims, int pixels_per_item, tune_config* candidates, int count)
+{
+    const size_t* max_items = rt->profile.max_work_item_sizes;
+    size_t kernel_limit = rt->max_work_group_size;
+    size_t limit = rt->max_work_group_size;
+    if (clGetKernelWorkGroupInfo(kernel, rt->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(kernel_limit), &kernel_limit, NULL) == CL_SUCCESS &&
+        kernel_limit < limit)
+        limit = kernel_limit;
+
+    int num_shapes = (dims == 1) ? (int)(sizeof(shapes_1d) / sizeof(shapes_1d[0])) : (int)(sizeof(shapes_2d) / sizeof(shapes_2d[0]));
+    for (int i = 0; i < num_shapes && count < AUTOTUNE_MAX_CANDIDATES; i++)
+    {
+        size_t lx = (dims == 1) ? shapes_1d[i] : shapes_2d[i][0];
+        size_t ly = (dims == 1) ? 1 : shapes_2d[i][1];
+        if (lx * ly > limit || (max_items[0] && lx > max_items[0]) || (dims > 1 && max_items[1] && ly > max_items[1]))
+            continue;
+        candidates[count].local_size[0] = lx;
+        candidates[count].local_size[1] = ly;
+        candidates[count].pixels_per_item = pixels_per_item;
+        candidates[count].time_sec = 0.0;
+        count++;
+    }
+    return count;
+}
+
+int autotune_sweep(tune_config* candidates, int num_candidates, int repeats, autotune_run_fn run, void* ctx, int verbose)
+{
+    int best = -1;
+    for (int i = 0; i < num_candidates; i++)
+    {
+        tune_config* config = &candidates[i];
+        config->time_sec = 0.0;
+        for (int r = 0; r < repeats; r++)
+        {
+            double time_sec;
+            if (run(ctx, config, &time_sec) != CL_SUCCESS)
+            {
+                config->time_sec = 0.0;
+                break;
+            }
+            if (config->time_sec == 0.0 || time_sec < config->time_sec)
+                config->time_sec = time_sec;
+        }
+        if (verbose)
+        {
+            if (config->time_sec > 0.0)
+                printf("  %4zux%-4zu %d px/item : %f seconds\n", config->local_size[0], config->local_size[1], config->pixels_per_item, config->time_sec);
+            else
+                printf("  %4zux%-4zu %d px/item : failed\n", config->local_size[0], config->local_size[1], config->pixels_per_item);
+        }
+        if (config->time_sec > 0.0 && (best < 0 || config->time_sec < candidates[best].time_sec))
+            best = i;
+    }
+    return best;
+}
+
+static int autotune_file(ocl_runtime* rt, char* dir, size_t dir_size, char* path, size_t path_size)
+{
+    program_cache_dir(dir, dir_size);
+    if (dir[0] == '\0')
+        return 0;
+    snprintf(path, path_size, "%s/autotune_%016llx.txt", dir, device_cache_key(rt->device));
+    return 1;
+}
+
+int autotune_load(ocl_runtime* rt, const char* key, tune_config* config)
+{
+    char dir[AUTOTUNE_PATH_LEN], path[AUTOTUNE_PATH_LEN + 64], line[AUTOTUNE_LINE_LEN], entry_key[AUTOTUNE_LINE_LEN];
+    int found = 0;
+    if (!autotune_file(rt, dir, sizeof(dir), path, sizeof(path)))
+        return 0;
+
+    FILE* file = fopen(path, "r");
+    if (!file)
+        return 0;
+    while (!found && fgets(line, sizeof(line), file))
+    {
+        tune_config entry;
+        if (sscanf(line, "%511s %zu %zu %d %lf", entry_key, &entry.local_size[0], &entry.local_size[1], &entry.pixels_per_item, &entry.time_sec) == 5 &&
+            strcmp(entry_key, key) == 0 && entry.local_size[0] > 0 && entry.local_size[1] > 0 && entry.pixels_per_item > 0)
+        {
+            *config = entry;
+            found = 1;
+        }
+    }
+    fclose(file);
+    return found;
+}
+
+void autotune_store(ocl_runtime* rt, const char* key, const tune_config* config)
+{
+    char dir[AUTOTUNE_PATH_LEN], path[AUTOTUNE_PATH_LEN + 64], temp_path[AUTOTUNE_PATH_LEN + 96];
+    char line[AUTOTUNE_LINE_LEN], entry_key[AUTOTUNE_LINE_LEN];
+    if (!autotune_file(rt, dir, sizeof(dir), path, sizeof(path)) || program_cache_make_dirs(dir) != 0)
+        return;
+
+    // Rewrite the file with the other keys kept, then swap it in atomically. New entries are appended,
+    // so when the file is full the oldest lines at the top are the ones dropped.
+    snprintf(temp_path, sizeof(temp_path), "%s.%ld.tmp", path, (long)getpid());
+    FILE* out = fopen(temp_path, "w");
+    if (!out)
+        return;
+    FILE* in = fopen(path, "r");
+    if (in)
+    {
+        int others = 0;
+        while (fgets(line, sizeof(line), in))
+        {
+            if (sscanf(line, "%511s", entry_key) == 1 && strcmp(entry_key, key) != 0)
+                others++;
+        }
+        int skip = others - (AUTOTUNE_MAX_ENTRIES - 1);
+        rewind(in);
+        while (fgets(line, sizeof(line), in))
+        {
+            if (sscanf(line, "%511s", entry_key) != 1 || strcmp(entry_key, key) == 0)
+                continue;
+            if (skip > 0)
+                skip--;
+            else
+                fputs(line, out);
+        }
+        fclose(in);
+    }
+    fprintf(out, "%s %zu %zu %d %.9f\n", key, config->local_size[0], config->local_size[1], config->pixels_per_item, config->time_sec);
+    if (fclose(out) != 0 || rename(temp_path, path) != 0)
+        remove(temp_path);
+}
@@ -0,0 +1,40 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <CL/cl.h>
+
+#include "ocl_runtime.h"
+
+// Work-group autotuning: candidate shapes, timing sweeps and per-device persistence.
+// Winners live next to the program binaries in <cache dir>/autotune_<device key>.txt, one
+// "<config key> <local x> <local y> <pixels per item> <seconds>" line per tuned kernel configuration.
+// Config keys name the kernel and everything that changes its best shape (variant, radius, channels, ...).
+
+#define AUTOTUNE_MAX_CANDIDATES 128
+
+typedef struct
+{
+    size_t local_size[2];   // local_size[1] is 1 for 1D kernels
+    int pixels_per_item;    // Output pixels (rows) computed by one work-item
+    double time_sec;        // Best measured time, 0 when not measured
+} tune_config;
+
+// Times one configuration: returns CL_SUCCESS and the elapsed seconds, or an error to skip the candidate
+typedef cl_int (*autotune_run_fn)(void* ctx, const tune_config* config, double* time_sec);
+
+// Appends the local shapes (1D when dims == 1) the kernel can launch with on this device, each
+// paired with pixels_per_item, after the first *count entries. Shapes respect CL_DEVICE_MAX_WORK_GROUP_SIZE,
+// CL_DEVICE_MAX_WORK_ITEM_SIZES and the kernel's CL_KERNEL_WORK_GROUP_SIZE. Returns the new count.
+int autotune_candidates(ocl_runtime* rt, cl_kernel kernel, int dims, int pixels_per_item, tune_config* candidates, int count);
+
+// Runs every candidate repeats times, keeps the fastest time of each in time_sec and returns the
+// index of the overall fastest (-1 when none ran). Prints one line per candidate when verbose.
+int autotune_sweep(tune_config* candidates, int num_candidates, int repeats, autotune_run_fn run, void* ctx, int verbose);
+
+// Looks up a stored winner for key on the runtime's device. Returns 1 when found.
+int autotune_load(ocl_runtime* rt, const char* key, tune_config* config);
+
+// Stores (or replaces) the winner for key. Silently does nothing when the cache is disabled.
+void autotune_store(ocl_runtime* rt, const char* key, const tune_config* config);
+
+#endif
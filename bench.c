@@ -0,0 +1,545 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+// OpenCL Include
+#include <CL/cl.h>
+
+#include "commons.h"
+#include "gaussian_mask.h"
+#include "cpu_blur.h"
+#include "ocl_runtime.h"
+#include "blur_engine.h"
+
+#define BENCH_MAX_SWEEP 16
+#define BENCH_MAX_RESULTS 1024
+
+
+
+// Summary of repeated trials, in seconds
+typedef struct
+{
+    double median;
+    double p95;
+    double mean;
+    double stddev;
+    double min;
+} bench_stats;
+
+// One measured configuration. end_to_end covers upload, kernels and download (device) or the whole
+// host blur; kernel covers the kernels only (device, profiling events).
+typedef struct
+{
+    const char* engine;  // "device" or "host"
+    int width;
+    int height;
+    int channels;
+    int radius;
+    const char* path;    // Blur path used by the engine
+    const char* metric;  // "end_to_end" or "kernel"
+    bench_stats stats;
+} bench_result;
+
+typedef struct
+{
+    int sizes[BENCH_MAX_SWEEP][2];
+    int num_sizes;
+    int radii[BENCH_MAX_SWEEP];
+    int num_radii;
+    int channels[BENCH_MAX_SWEEP];
+    int num_channels;
+    int warmup;
+    int trials;
+} bench_config;
+
+// Function to return a monotonic wall-clock time in seconds
+double wall_time_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+static int compare_double(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Function to summarize trial samples (sorts them in place)
+bench_stats compute_stats(double* samples, int count)
+{
+    bench_stats stats;
+    qsort(samples, count, sizeof(double), compare_double);
+    double sum = 0.0, sum_sq = 0.0;
+    for (int i = 0; i < count; i++)
+    {
+        sum += samples[i];
+    }
+    stats.mean = sum / count;
+    for (int i = 0; i < count; i++)
+    {
+        sum_sq += (samples[i] - stats.mean) * (samples[i] - stats.mean);
+    }
+    stats.stddev = (count > 1) ? sqrt(sum_sq / (count - 1)) : 0.0;
+    stats.median = (count % 2) ? samples[count / 2] : 0.5 * (samples[(count / 2) - 1] + samples[count / 2]);
+    int rank = ((95 * count) + 99) / 100; // Nearest rank
+    stats.p95 = samples[(rank > 0) ? rank - 1 : 0];
+    stats.min = samples[0];
+    return stats;
+}
+
+// Megapixels and gigabytes (one read and one write of every byte) per second at the median time
+static double mpix_per_sec(const bench_result* r)
+{
+    return ((double)r->width * r->height) / r->stats.median * 1e-6;
+}
+
+static double gb_per_sec(const bench_result* r)
+{
+    return (2.0 * r->width * r->height * r->channels) / r->stats.median * 1e-9;
+}
+
+static void print_result(const bench_result* r)
+{
+    printf("%-6s %5dx%-5d c%d r%-2d %-10s %-10s median %10.6f s  p95 %10.6f s  stddev %9.6f s  %9.1f MPix/s  %7.2f GB/s\n",
+           r->engine, r->width, r->height, r->channels, r->radius, r->path, r->metric, r->stats.median, r->stats.p95, r->stats.stddev,
+           mpix_per_sec(r), gb_per_sec(r));
+}
+
+// Writes a driver-reported string as a quoted JSON or CSV field
+static void write_quoted(FILE* file, const char* text, int json)
+{
+    fputc('"', file);
+    for (const unsigned char* p = (const unsigned char*)text; *p; p++)
+    {
+        if (!json)
+        {
+            if (*p == '"')
+                fputc('"', file);
+            fputc(*p, file);
+        }
+        else if (*p == '"' || *p == '\\')
+            fprintf(file, "\\%c", *p);
+        else if (*p < 0x20)
+            fprintf(file, "\\u%04x", *p);
+        else
+            fputc(*p, file);
+    }
+    fputc('"', file);
+}
+
+// Function to write the results as CSV, or as JSON for .json paths
+int write_results(const char* path, const char* device_name, const bench_config* config, const bench_result* results, int num_results)
+{
+    const char* dot = strrchr(path, '.');
+    int json = dot && strcmp(dot, ".json") == 0;
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        fprintf(stderr, "Error: Could not write %s\n", path);
+        return -1;
+    }
+    if (json)
+    {
+        fprintf(file, "{\n  \"device\": ");
+        write_quoted(file, device_name, 1);
+        fprintf(file, ",\n  \"warmup\": %d,\n  \"trials\": %d,\n  \"results\": [\n", config->warmup, config->trials);
+    }
+    else
+    {
+        fprintf(file, "engine,device,width,height,channels,radius,path,metric,median_s,p95_s,mean_s,stddev_s,min_s,mpix_per_s,gb_per_s\n");
+    }
+    for (int i = 0; i < num_results; i++)
+    {
+        const bench_result* r = &results[i];
+        if (json)
+        {
+            fprintf(file, "    {\"engine\": \"%s\", \"width\": %d, \"height\": %d, \"channels\": %d, \"radius\": %d, \"path\": \"%s\", \"metric\": \"%s\", "
+                          "\"median_s\": %.9f, \"p95_s\": %.9f, \"mean_s\": %.9f, \"stddev_s\": %.9f, \"min_s\": %.9f, \"mpix_per_s\": %.3f, \"gb_per_s\": %.4f}%s\n",
+                    r->engine, r->width, r->height, r->channels, r->radius, r->path, r->metric, r->stats.median, r->stats.p95, r->stats.mean,
+                    r->stats.stddev, r->stats.min, mpix_per_sec(r), gb_per_sec(r), (i == num_results - 1) ? "" : ",");
+        }
+        else
+        {
+            fprintf(file, "%s,", r->engine);
+            write_quoted(file, device_name, 0);
+            fprintf(file, ",%d,%d,%d,%d,%s,%s,%.9f,%.9f,%.9f,%.9f,%.9f,%.3f,%.4f\n", r->width, r->height,
+                    r->channels, r->radius, r->path, r->metric, r->stats.median, r->stats.p95, r->stats.mean, r->stats.stddev, r->stats.min,
+                    mpix_per_sec(r), gb_per_sec(r));
+        }
+    }
+    if (json)
+    {
+        fprintf(file, "  ]\n}\n");
+    }
+    return (fclose(file) == 0) ? 0 : -1;
+}
+
+// Parses "a,b,c" into values; returns the count (0 on a malformed list)
+static int parse_int_list(const char* text, int* values, int max_values)
+{
+    int count = 0;
+    const char* p = text;
+    while (*p && count < max_values)
+    {
+        char* end;
+        long value = strtol(p, &end, 10);
+        if (end == p || value <= 0)
+            return 0;
+        values[count++] = (int)value;
+        p = (*end == ',') ? end + 1 : end;
+        if (*end && *end != ',')
+            return 0;
+    }
+    return count;
+}
+
+static int parse_size_list(const char* text, int sizes[][2], int max_sizes)
+{
+    int count = 0;
+    const char* p = text;
+    while (*p && count < max_sizes)
+    {
+        int consumed = 0;
+        if (sscanf(p, "%dx%d%n", &sizes[count][0], &sizes[count][1], &consumed) != 2 || sizes[count][0] <= 0 || sizes[count][1] <= 0)
+            return 0;
+        count++;
+        p += consumed;
+        if (*p == ',')
+            p++;
+        else if (*p)
+            return 0;
+    }
+    return count;
+}
+
+// Function to time one device configuration: warm-up requests, then trials of end-to-end wall time and kernel time
+int bench_device(blur_engine* engine, const bench_config* config, const unsigned char* input, unsigned char* output, int width, int height,
+                 bench_result* end_to_end, bench_result* kernel)
+{
+    double* wall_samples = (double*)malloc(config->trials * sizeof(double));
+    double* kernel_samples = (double*)malloc(config->trials * sizeof(double));
+    int status = -1;
+    for (int i = 0; i < config->warmup; i++)
+    {
+        if (blur_engine_run(engine, input, output, width, height, NULL) != CL_SUCCESS)
+            goto cleanup;
+    }
+    for (int i = 0; i < config->trials; i++)
+    {
+        blur_events events;
+        double start = wall_time_sec();
+        if (blur_engine_run(engine, input, output, width, height, &events) != CL_SUCCESS)
+            goto cleanup;
+        wall_samples[i] = wall_time_sec() - start;
+        kernel_samples[i] = blur_events_kernel_time(&events);
+        blur_events_release(&events);
+    }
+    end_to_end->stats = compute_stats(wall_samples, config->trials);
+    kernel->stats = compute_stats(kernel_samples, config->trials);
+    status = 0;
+
+cleanup:
+    free(wall_samples);
+    free(kernel_samples);
+    return status;
+}
+
+// Function to name a path in the results: "2d" or "separable", "_image" for image storage, "_fixed" or "_half" for reduced precision
+static const char* path_name(int separable, int images, blur_precision precision)
+{
+    if (images)
+        return separable ? "sep_image" : "2d_image";
+    switch (precision)
+    {
+    case BLUR_PRECISION_FIXED:
+        return separable ? "sep_fixed" : "2d_fixed";
+    case BLUR_PRECISION_HALF:
+        return separable ? "sep_half" : "2d_half";
+    default:
+        return separable ? "separable" : "2d";
+    }
+}
+
+// Function to time the host engine: warm-up runs, then trials of wall time. fixed_mask, fixed_row_weights
+// and fixed_col_weights (Q14) select the fixed-point blur when not NULL.
+bench_stats bench_host(cpu_thread_pool* pool, const bench_config* config, const unsigned char* input, unsigned char* output, int width, int height,
+                       int channels, const float* mask, const float* row_weights, const float* col_weights,
+                       const short* fixed_mask, const short* fixed_row_weights, const short* fixed_col_weights, int radius, int separable)
+{
+    double* samples = (double*)malloc(config->trials * sizeof(double));
+    for (int i = 0; i < config->warmup + config->trials; i++)
+    {
+        double start = wall_time_sec();
+        if (fixed_mask && separable)
+            cpu_gaussian_blur_separable_fixed(pool, input, output, width, height, channels, fixed_row_weights, fixed_col_weights, radius);
+        else if (fixed_mask)
+            cpu_gaussian_blur_fixed(pool, input, output, width, height, channels, fixed_mask, radius);
+        else if (separable)
+            cpu_gaussian_blur_separable(pool, input, output, width, height, channels, row_weights, col_weights, radius);
+        else
+            cpu_gaussian_blur(pool, input, output, width, height, channels, mask, radius);
+        if (i >= config->warmup)
+            samples[i - config->warmup] = wall_time_sec() - start;
+    }
+    bench_stats stats = compute_stats(samples, config->trials);
+    free(samples);
+    return stats;
+}
+
+
+
+// Main Code
+int main(int argc, char** argv)
+{
+    // --sizes WxH,...     image sizes to sweep (default 512x512,1024x1024,2048x2048)
+    // --radii r,...       kernel radii to sweep, sigma = radius / 3 (default 3,5,9)
+    // --channels c,...    channel counts to sweep (default 1,4)
+    // --warmup N          untimed runs before each measurement (default 3)
+    // --trials N          timed runs per measurement (default 20)
+    // --host exact|separable|none   host engine to measure next to the device (default separable)
+    // --cpu               host engine only; --threads N sets its thread count
+    // --device spec       device override, as in run (or OCL_DEVICE)
+    // --jit               bake radius and weights into the device program
+    // --precision float|fixed|half  kernel precision (the host runs fixed point too; half is device-only)
+    // --out file.csv|file.json      machine-readable results for regression tracking
+    bench_config config;
+    memset(&config, 0, sizeof(config));
+    config.num_sizes = parse_size_list("512x512,1024x1024,2048x2048", config.sizes, BENCH_MAX_SWEEP);
+    config.num_radii = parse_int_list("3,5,9", config.radii, BENCH_MAX_SWEEP);
+    config.num_channels = parse_int_list("1,4", config.channels, BENCH_MAX_SWEEP);
+    config.warmup = 3;
+    config.trials = 20;
+    const char* device_spec = NULL;
+    const char* out_path = NULL;
+    const char* host_mode = "separable";
+    int cpu_only = 0;
+    int num_threads = 0;
+    int use_jit = 0;
+    blur_precision precision = BLUR_PRECISION_FLOAT;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc)
+        {
+            config.num_sizes = parse_size_list(argv[++i], config.sizes, BENCH_MAX_SWEEP);
+        }
+        else if (strcmp(argv[i], "--radii") == 0 && i + 1 < argc)
+        {
+            config.num_radii = parse_int_list(argv[++i], config.radii, BENCH_MAX_SWEEP);
+        }
+        else if (strcmp(argv[i], "--channels") == 0 && i + 1 < argc)
+        {
+            config.num_channels = parse_int_list(argv[++i], config.channels, BENCH_MAX_SWEEP);
+        }
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+        {
+            config.warmup = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--trials") == 0 && i + 1 < argc)
+        {
+            config.trials = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--host") == 0 && i + 1 < argc)
+        {
+            host_mode = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cpu") == 0)
+        {
+            cpu_only = 1;
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            num_threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc)
+        {
+            device_spec = argv[++i];
+        }
+        else if (strcmp(argv[i], "--jit") == 0)
+        {
+            use_jit = 1;
+        }
+        else if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc)
+        {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "fixed") == 0)
+                precision = BLUR_PRECISION_FIXED;
+            else if (strcmp(mode, "half") == 0)
+                precision = BLUR_PRECISION_HALF;
+            else if (strcmp(mode, "float") != 0)
+            {
+                fprintf(stderr, "Error: Unknown precision %s\n", mode);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+        {
+            out_path = argv[++i];
+        }
+    }
+    if (config.num_sizes == 0 || config.num_radii == 0 || config.num_channels == 0 || config.trials < 1 || config.warmup < 0)
+    {
+        fprintf(stderr, "Error: Invalid sweep (--sizes WxH,..., --radii r,..., --channels c,..., --trials >= 1, --warmup >= 0)\n");
+        return -1;
+    }
+    for (int c = 0; c < config.num_channels; c++)
+    {
+        if (config.channels[c] != 1 && config.channels[c] != 3 && config.channels[c] != 4)
+        {
+            fprintf(stderr, "Error: --channels takes 1, 3 or 4\n");
+            return -1;
+        }
+    }
+    int host_separable = strcmp(host_mode, "separable") == 0;
+    int run_host = host_separable || strcmp(host_mode, "exact") == 0;
+
+    //------------------------------------------------------
+    // Device and host engines
+    //------------------------------------------------------
+    ocl_runtime rt;
+    const char* device_name = "none";
+    if (!cpu_only && ocl_runtime_init(&rt, device_spec, CL_QUEUE_PROFILING_ENABLE) != CL_SUCCESS)
+    {
+        printf("No usable OpenCL device, measuring the CPU engine only\n");
+        cpu_only = 1;
+    }
+    if (!cpu_only)
+    {
+        device_name = rt.selected.device_name;
+    }
+    if (cpu_only)
+    {
+        run_host = 1;
+    }
+    cpu_thread_pool* pool = cpu_thread_pool_create(num_threads);
+    printf("Device: %s, host: %d threads (%s), %d warm-up + %d timed runs per measurement\n\n", device_name, cpu_thread_pool_size(pool),
+           cpu_blur_simd_name(), config.warmup, config.trials);
+
+    size_t max_pixels = 0;
+    for (int s = 0; s < config.num_sizes; s++)
+    {
+        if ((size_t)config.sizes[s][0] * config.sizes[s][1] > max_pixels)
+            max_pixels = (size_t)config.sizes[s][0] * config.sizes[s][1];
+    }
+    unsigned char* input = (unsigned char*)malloc(max_pixels * 4);
+    unsigned char* output = (unsigned char*)malloc(max_pixels * 4);
+    bench_result* results = (bench_result*)calloc(BENCH_MAX_RESULTS, sizeof(bench_result));
+    int num_results = 0;
+    int status = 0;
+
+    //------------------------------------------------------
+    // Sweep channels x radii x sizes
+    //------------------------------------------------------
+    for (int c = 0; c < config.num_channels && status == 0; c++)
+    {
+        for (int r = 0; r < config.num_radii && status == 0; r++)
+        {
+            int channels = config.channels[c];
+            int radius = config.radii[r];
+            float sigma = radius / 3.0f;
+            int kernel_size = (2 * radius) + 1;
+            float* mask = (float*)malloc(kernel_size * kernel_size * sizeof(float));
+            float* row_weights = (float*)malloc(kernel_size * sizeof(float));
+            float* col_weights = (float*)malloc(kernel_size * sizeof(float));
+            generate_gaussian_kernel(mask, sigma, radius);
+            int separable = extract_separable_kernel(mask, radius, row_weights, col_weights);
+            short* fixed_mask = NULL;
+            short* fixed_row_weights = NULL;
+            short* fixed_col_weights = NULL;
+            if (precision == BLUR_PRECISION_FIXED)
+            {
+                fixed_mask = (short*)malloc(kernel_size * kernel_size * sizeof(short));
+                fixed_row_weights = (short*)malloc(kernel_size * sizeof(short));
+                fixed_col_weights = (short*)malloc(kernel_size * sizeof(short));
+                quantize_weights(mask, kernel_size * kernel_size, fixed_mask);
+                quantize_weights(row_weights, kernel_size, fixed_row_weights);
+                quantize_weights(col_weights, kernel_size, fixed_col_weights);
+            }
+
+            // One engine per mask and channel count, reused across sizes. Releasing it gives its program back
+            // to the registry, so sweeps of any length run on the one runtime.
+            blur_engine engine;
+            int have_engine = 0;
+            if (!cpu_only)
+            {
+                blur_params params = { sigma, radius, 0, use_jit, channels, BLUR_STORAGE_AUTO, precision };
+                have_engine = blur_engine_init(&engine, &rt, &params) == CL_SUCCESS;
+                if (!have_engine)
+                {
+                    fprintf(stderr, "Error: Could not set up the device blur (c%d r%d)\n", channels, radius);
+                    blur_engine_release(&engine);
+                    status = -1;
+                }
+            }
+
+            for (int s = 0; s < config.num_sizes && status == 0 && num_results + 3 <= BENCH_MAX_RESULTS; s++)
+            {
+                int width = config.sizes[s][0];
+                int height = config.sizes[s][1];
+                generate_noisy_image(input, width, height, channels);
+                bench_result base = { "device", width, height, channels, radius, "", "end_to_end", {0.0, 0.0, 0.0, 0.0, 0.0} };
+
+                if (have_engine)
+                {
+                    bench_result* e2e = &results[num_results];
+                    bench_result* kernel = &results[num_results + 1];
+                    *e2e = base;
+                    e2e->path = path_name(engine.separable, engine.use_images, engine.precision);
+                    *kernel = *e2e;
+                    kernel->metric = "kernel";
+                    if (bench_device(&engine, &config, input, output, width, height, e2e, kernel) != 0)
+                    {
+                        fprintf(stderr, "Error: Device blur failed (%dx%d c%d r%d)\n", width, height, channels, radius);
+                        status = -1;
+                        break;
+                    }
+                    print_result(e2e);
+                    print_result(kernel);
+                    num_results += 2;
+                }
+                if (run_host)
+                {
+                    bench_result* host = &results[num_results++];
+                    *host = base;
+                    host->engine = "host";
+                    host->path = path_name(host_separable && separable, 0, fixed_mask ? BLUR_PRECISION_FIXED : BLUR_PRECISION_FLOAT);
+                    host->stats = bench_host(pool, &config, input, output, width, height, channels, mask, row_weights, col_weights,
+                                             fixed_mask, fixed_row_weights, fixed_col_weights, radius, host_separable && separable);
+                    print_result(host);
+                }
+            }
+
+            if (have_engine)
+            {
+                blur_engine_release(&engine);
+            }
+            free(mask);
+            free(row_weights);
+            free(col_weights);
+            free(fixed_mask);
+            free(fixed_row_weights);
+            free(fixed_col_weights);
+        }
+    }
+
+    if (status == 0 && out_path && write_results(out_path, device_name, &config, results, num_results) == 0)
+    {
+        printf("\nResults written to %s\n", out_path);
+    }
+
+    // Clean up
+    free(results);
+    free(input);
+    free(output);
+    cpu_thread_pool_destroy(pool);
+    if (!cpu_only)
+    {
+        ocl_runtime_release(&rt);
+    }
+    return status;
+}
@@ -0,0 +1,1004 @@
+// Standard includes
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "blur_engine.h"
+#include "gaussian_mask.h"
+#include "autotune.h"
+
+#define BLUR_KERNEL_FILE "gaussian_blur.cl"
+#define BLUR_TUNE_REPEATS 3
+
+
+
+static size_t round_up(size_t value, size_t multiple)
+{
+    return ((value + multiple - 1) / multiple) * multiple;
+}
+
+static cl_image_format image_format(const blur_engine* engine, cl_channel_type type)
+{
+    cl_image_format format;
+    format.image_channel_order = (engine->channels == 1) ? CL_R : CL_RGBA;
+    format.image_channel_data_type = type;
+    return format;
+}
+
+static int image_format_supported(ocl_runtime* rt, cl_mem_flags flags, cl_image_format format)
+{
+    cl_uint num_formats = 0;
+    int supported = 0;
+    if (clGetSupportedImageFormats(rt->context, flags, CL_MEM_OBJECT_IMAGE2D, 0, NULL, &num_formats) != CL_SUCCESS || num_formats == 0)
+        return 0;
+    cl_image_format* formats = (cl_image_format*)malloc(num_formats * sizeof(cl_image_format));
+    if (clGetSupportedImageFormats(rt->context, flags, CL_MEM_OBJECT_IMAGE2D, num_formats, formats, NULL) == CL_SUCCESS)
+    {
+        for (cl_uint i = 0; i < num_formats && !supported; i++)
+            supported = formats[i].image_channel_order == format.image_channel_order &&
+                        formats[i].image_channel_data_type == format.image_channel_data_type;
+    }
+    free(formats);
+    return supported;
+}
+
+// Image path needs image support, 8-bit CL_R/CL_RGBA images and, for the separable path, a float intermediate
+static int images_supported(blur_engine* engine)
+{
+    ocl_runtime* rt = engine->rt;
+    if (engine->channels == 3 || !rt->profile.image_support)
+        return 0;
+    engine->image_max_width = rt->profile.image2d_max_width;
+    engine->image_max_height = rt->profile.image2d_max_height;
+
+    cl_image_format pixel_format = image_format(engine, CL_UNSIGNED_INT8);
+    if (!image_format_supported(rt, CL_MEM_READ_ONLY, pixel_format) || !image_format_supported(rt, CL_MEM_WRITE_ONLY, pixel_format))
+        return 0;
+    if (engine->separable && !image_format_supported(rt, CL_MEM_READ_WRITE, image_format(engine, CL_FLOAT)))
+        return 0;
+    return 1;
+}
+
+const char* blur_precision_name(blur_precision precision)
+{
+    switch (precision)
+    {
+    case BLUR_PRECISION_FIXED:
+        return "fixed";
+    case BLUR_PRECISION_HALF:
+        return "half";
+    default:
+        return "float";
+    }
+}
+
+// Gives the current program and kernels back to the runtime registry
+static void release_kernels(blur_engine* engine)
+{
+    ocl_runtime_release_kernel(engine->rt, engine->kernel_2d);
+    ocl_runtime_release_kernel(engine->rt, engine->kernel_horizontal);
+    ocl_runtime_release_kernel(engine->rt, engine->kernel_vertical);
+    ocl_runtime_release_program(engine->rt, engine->program);
+    engine->kernel_2d = NULL;
+    engine->kernel_horizontal = NULL;
+    engine->kernel_vertical = NULL;
+    engine->program = NULL;
+}
+
+// Assembles the build options for the current path, channels, precision, storage and pixels per work-item,
+// then fetches the program and kernels from the runtime registry (built on first use)
+static cl_int build_kernels(blur_engine* engine)
+{
+    cl_int err;
+    ocl_runtime* rt = engine->rt;
+    char* options = engine->build_options;
+    size_t options_size = engine->build_options_size;
+    int kernel_size = engine->kernel_size;
+
+    options[0] = '\0';
+    if (engine->channels > 1)
+    {
+        snprintf(options, options_size, "-D CHANNELS=%d ", engine->channels);
+    }
+    if (engine->precision == BLUR_PRECISION_FIXED)
+    {
+        size_t length = strlen(options);
+        snprintf(options + length, options_size - length, "-D FIXED_POINT -D FIXED_BITS=%d -D FIXED_TEMP_BITS=%d ",
+                 GAUSSIAN_FIXED_BITS, GAUSSIAN_FIXED_TEMP_BITS);
+    }
+    else if (engine->precision == BLUR_PRECISION_HALF)
+    {
+        strcat(options, "-D HALF_PRECISION ");
+    }
+    if (engine->use_images)
+    {
+        strcat(options, "-D USE_IMAGES ");
+    }
+    if (!engine->separable && engine->pixels_per_item > 1)
+    {
+        size_t length = strlen(options);
+        snprintf(options + length, options_size - length, "-D PIXELS_PER_ITEM=%d ", engine->pixels_per_item);
+    }
+    // JIT: bake the radius and the weights used by the selected path into the build options
+    if (engine->params.use_jit)
+    {
+        size_t length = strlen(options);
+        snprintf(options + length, options_size - length, "-D KERNEL_RADIUS=%d", engine->kernel_radius);
+        if (engine->precision == BLUR_PRECISION_FIXED && engine->separable)
+        {
+            append_fixed_weights_define(options, options_size, "ROW_WEIGHTS", engine->fixed_row_weights, kernel_size);
+            append_fixed_weights_define(options, options_size, "COL_WEIGHTS", engine->fixed_col_weights, kernel_size);
+        }
+        else if (engine->precision == BLUR_PRECISION_FIXED)
+        {
+            append_fixed_weights_define(options, options_size, "MASK_WEIGHTS", engine->fixed_mask, kernel_size * kernel_size);
+        }
+        else if (engine->separable)
+        {
+            append_weights_define(options, options_size, "ROW_WEIGHTS", engine->row_weights, kernel_size);
+            append_weights_define(options, options_size, "COL_WEIGHTS", engine->col_weights, kernel_size);
+        }
+        else
+        {
+            append_weights_define(options, options_size, "MASK_WEIGHTS", engine->mask, kernel_size * kernel_size);
+        }
+    }
+
+    // The new program is fetched before the old one is given back, so an unchanged program is not rebuilt
+    cl_program program = ocl_runtime_program_file(rt, BLUR_KERNEL_FILE, options, &err);
+    if (!program)
+        return err;
+    release_kernels(engine);
+    engine->program = program;
+
+    if (engine->separable)
+    {
+        engine->kernel_horizontal = ocl_runtime_kernel(rt, engine->program, engine->use_images ? "gaussian_blur_image_horizontal" : "gaussian_blur_horizontal", &err);
+        if (!engine->kernel_horizontal)
+            return err;
+        engine->kernel_vertical = ocl_runtime_kernel(rt, engine->program, engine->use_images ? "gaussian_blur_image_vertical" : "gaussian_blur_vertical", &err);
+        if (!engine->kernel_vertical)
+            return err;
+    }
+    else
+    {
+        engine->kernel_2d = ocl_runtime_kernel(rt, engine->program, engine->use_images ? "gaussian_blur_image" : "gaussian_blur", &err);
+        if (!engine->kernel_2d)
+            return err;
+    }
+    return CL_SUCCESS;
+}
+
+static int kernel_accepts(blur_engine* engine, cl_kernel kernel, size_t group_size)
+{
+    size_t limit = 0;
+    if (!kernel)
+        return 1;
+    if (clGetKernelWorkGroupInfo(kernel, engine->rt->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(limit), &limit, NULL) != CL_SUCCESS)
+        return 1;
+    return group_size <= limit;
+}
+
+// Checks a local shape against the device limit, every active kernel's limit and, on the separable
+// buffer path, the local memory taken by the tiles
+static int local_size_fits(blur_engine* engine, size_t lx, size_t ly)
+{
+    size_t group_size = lx * ly;
+    if (group_size == 0 || group_size > engine->rt->max_work_group_size)
+        return 0;
+    if (engine->separable)
+    {
+        if (!kernel_accepts(engine, engine->kernel_horizontal, group_size) || !kernel_accepts(engine, engine->kernel_vertical, group_size))
+            return 0;
+        if (!engine->use_images)
+        {
+            size_t r2 = 2 * engine->kernel_radius;
+            size_t horizontal_tile = (lx + r2) * ly * engine->tile_element_size;
+            size_t vertical_tile = lx * (ly + r2) * engine->tile_element_size;
+            if (horizontal_tile > engine->rt->local_mem_size || vertical_tile > engine->rt->local_mem_size)
+                return 0;
+        }
+        return 1;
+    }
+    return kernel_accepts(engine, engine->kernel_2d, group_size);
+}
+
+// Switches to a tuned configuration, rebuilding the 2D kernels when pixels per work-item changes
+static cl_int apply_config(blur_engine* engine, const tune_config* config)
+{
+    int pixels_per_item = engine->separable ? 1 : config->pixels_per_item;
+    if (pixels_per_item != engine->pixels_per_item)
+    {
+        engine->pixels_per_item = pixels_per_item;
+        cl_int err = build_kernels(engine);
+        if (err != CL_SUCCESS)
+            return err;
+    }
+    engine->local_work_size[0] = config->local_size[0];
+    engine->local_work_size[1] = config->local_size[1];
+    return CL_SUCCESS;
+}
+
+// Weights (float, or Q14 short in the fixed-point mode) go into a pooled buffer, so engines created per
+// request reuse the same small allocations
+static cl_mem upload_weights(ocl_runtime* rt, const void* weights, size_t size, cl_int* err)
+{
+    cl_mem buffer = ocl_runtime_acquire(rt, CL_MEM_READ_ONLY, size, err);
+    if (!buffer)
+        return NULL;
+    *err = clEnqueueWriteBuffer(rt->queue, buffer, CL_TRUE, 0, size, weights, 0, NULL, NULL);
+    if (*err != CL_SUCCESS)
+    {
+        ocl_report_error("clEnqueueWriteBuffer", *err, __FILE__, __LINE__);
+        ocl_runtime_recycle(rt, buffer);
+        return NULL;
+    }
+    return buffer;
+}
+
+cl_int blur_engine_init(blur_engine* engine, ocl_runtime* rt, const blur_params* params)
+{
+    cl_int err;
+    memset(engine, 0, sizeof(*engine));
+    engine->rt = rt;
+    engine->params = *params;
+    if (params->sigma <= 0.0f)
+    {
+        fprintf(stderr, "Error: sigma must be positive\n");
+        return CL_INVALID_VALUE;
+    }
+
+    // Generate the Gaussian mask, then split it into 1D row/column weights when it is separable
+    engine->kernel_radius = (params->kernel_radius > 0) ? params->kernel_radius : gaussian_kernel_radius(params->sigma);
+    engine->kernel_size = (2 * engine->kernel_radius) + 1;
+    int kernel_size = engine->kernel_size;
+    engine->mask = (float*)malloc(kernel_size * kernel_size * sizeof(float));
+    engine->row_weights = (float*)malloc(kernel_size * sizeof(float));
+    engine->col_weights = (float*)malloc(kernel_size * sizeof(float));
+    generate_gaussian_kernel(engine->mask, params->sigma, engine->kernel_radius);
+    engine->mask_separable = extract_separable_kernel(engine->mask, engine->kernel_radius, engine->row_weights, engine->col_weights);
+    engine->separable = !params->use_reference && engine->mask_separable;
+    engine->channels = (params->channels > 1) ? params->channels : 1;
+    if (engine->channels != 1 && engine->channels != 3 && engine->channels != 4)
+    {
+        fprintf(stderr, "Error: Unsupported channel count %d (use 1, 3 or 4)\n", engine->channels);
+        return CL_INVALID_VALUE;
+    }
+
+    // Reduced precision: Q14 weights for the fixed-point kernels (each 1D vector on its own, so the
+    // separable passes shift by 14 each); half needs the device extension
+    engine->precision = params->precision;
+    if (engine->precision == BLUR_PRECISION_HALF && !rt->profile.fp16)
+    {
+        printf("Half precision needs cl_khr_fp16, which this device lacks; using float\n");
+        engine->precision = BLUR_PRECISION_FLOAT;
+    }
+    if (engine->precision == BLUR_PRECISION_FIXED)
+    {
+        engine->fixed_mask = (short*)malloc(kernel_size * kernel_size * sizeof(short));
+        engine->fixed_row_weights = (short*)malloc(kernel_size * sizeof(short));
+        engine->fixed_col_weights = (short*)malloc(kernel_size * sizeof(short));
+        quantize_weights(engine->mask, kernel_size * kernel_size, engine->fixed_mask);
+        quantize_weights(engine->row_weights, kernel_size, engine->fixed_row_weights);
+        quantize_weights(engine->col_weights, kernel_size, engine->fixed_col_weights);
+    }
+    // Tiles hold the accumulator type (int for fixed point); a 3-vector takes the space of a 4-vector
+    size_t accumulator_size = (engine->precision == BLUR_PRECISION_HALF) ? sizeof(cl_half) : sizeof(cl_float);
+    engine->tile_element_size = (engine->channels == 1) ? accumulator_size : 4 * accumulator_size;
+    engine->temp_sample_size = (engine->precision == BLUR_PRECISION_FIXED) ? sizeof(cl_short)
+                             : (engine->precision == BLUR_PRECISION_HALF) ? sizeof(cl_half) : sizeof(cl_float);
+
+    // Frames as images when asked for or when the device can (the sampler then does the edge clamping).
+    // The image kernels only run in float.
+    if (params->storage != BLUR_STORAGE_BUFFER && engine->precision == BLUR_PRECISION_FLOAT)
+    {
+        engine->use_images = images_supported(engine);
+        if (params->storage == BLUR_STORAGE_IMAGE && !engine->use_images)
+            printf("Image path not available on this device for %d channel(s), using buffers\n", engine->channels);
+    }
+    else if (params->storage == BLUR_STORAGE_IMAGE)
+    {
+        printf("Image path only runs in float precision, using buffers\n");
+    }
+
+    // Each separable buffer pass stages a 16x16 block plus its halo in local memory
+    engine->local_work_size[0] = 16;
+    engine->local_work_size[1] = 16;
+    size_t tile_bytes = (engine->local_work_size[0] + (2 * engine->kernel_radius)) * engine->local_work_size[1] * engine->tile_element_size;
+    if (engine->separable && !engine->use_images && tile_bytes > rt->local_mem_size)
+    {
+        engine->separable = 0;
+    }
+
+    // Autotuning results are stored per device under a key naming everything that changes the best shape
+    snprintf(engine->tune_key, sizeof(engine->tune_key), "gaussian_blur:%s:%s:c%d:r%d:%s%s%s", engine->separable ? "separable" : "2d",
+             engine->use_images ? "image" : "buffer", engine->channels, engine->kernel_radius, params->use_jit ? "jit" : "args",
+             (engine->precision != BLUR_PRECISION_FLOAT) ? ":" : "", (engine->precision != BLUR_PRECISION_FLOAT) ? blur_precision_name(engine->precision) : "");
+
+    size_t build_options_size = 128 + (2 * kernel_size * kernel_size * 20);
+    engine->build_options = (char*)malloc(build_options_size);
+    engine->build_options_size = build_options_size;
+    engine->pixels_per_item = 1;
+    err = build_kernels(engine);
+    if (err != CL_SUCCESS)
+        return err;
+
+    int fixed = engine->precision == BLUR_PRECISION_FIXED;
+    size_t weight_size = fixed ? sizeof(cl_short) : sizeof(cl_float);
+    if (engine->separable)
+    {
+        engine->row_weights_buffer = upload_weights(rt, fixed ? (const void*)engine->fixed_row_weights : engine->row_weights, kernel_size * weight_size, &err);
+        if (!engine->row_weights_buffer)
+            return err;
+        engine->col_weights_buffer = upload_weights(rt, fixed ? (const void*)engine->fixed_col_weights : engine->col_weights, kernel_size * weight_size, &err);
+        if (!engine->col_weights_buffer)
+            return err;
+    }
+    else
+    {
+        engine->mask_buffer = upload_weights(rt, fixed ? (const void*)engine->fixed_mask : engine->mask, kernel_size * kernel_size * weight_size, &err);
+        if (!engine->mask_buffer)
+            return err;
+    }
+
+    // The default 16x16 shrinks until the device and the kernels accept it; a stored autotuning result replaces it
+    while (!local_size_fits(engine, engine->local_work_size[0], engine->local_work_size[1]) && engine->local_work_size[0] > 1)
+    {
+        engine->local_work_size[0] /= 2;
+        engine->local_work_size[1] /= 2;
+    }
+    tune_config config;
+    if (autotune_load(rt, engine->tune_key, &config) &&
+        local_size_fits(engine, config.local_size[0], config.local_size[1]) && apply_config(engine, &config) == CL_SUCCESS)
+    {
+        engine->tuned = 1;
+    }
+    return CL_SUCCESS;
+}
+
+// Images are released; buffers go back to the runtime's pool
+static void release_image_buffers(blur_engine* engine)
+{
+    ocl_runtime_recycle(engine->rt, engine->input_buffer);
+    ocl_runtime_recycle(engine->rt, engine->output_buffer);
+    ocl_runtime_recycle(engine->rt, engine->temp_buffer);
+    engine->input_buffer = NULL;
+    engine->output_buffer = NULL;
+    engine->temp_buffer = NULL;
+    engine->buffer_pixels = 0;
+    engine->temp_pixels = 0;
+    engine->image_width = 0;
+    engine->image_height = 0;
+}
+
+void blur_engine_release(blur_engine* engine)
+{
+    release_kernels(engine);
+    release_image_buffers(engine);
+    ocl_runtime_recycle(engine->rt, engine->mask_buffer);
+    ocl_runtime_recycle(engine->rt, engine->row_weights_buffer);
+    ocl_runtime_recycle(engine->rt, engine->col_weights_buffer);
+    free(engine->mask);
+    free(engine->row_weights);
+    free(engine->col_weights);
+    free(engine->fixed_mask);
+    free(engine->fixed_row_weights);
+    free(engine->fixed_col_weights);
+    free(engine->build_options);
+    memset(engine, 0, sizeof(*engine));
+}
+
+// The intermediate of the separable path, grown separately so zero-copy runs only need this one
+static cl_int reserve_temp(blur_engine* engine, size_t pixels)
+{
+    cl_int err;
+    if (!engine->separable || pixels <= engine->temp_pixels)
+        return CL_SUCCESS;
+
+    ocl_runtime_recycle(engine->rt, engine->temp_buffer);
+    engine->temp_pixels = 0;
+    engine->temp_buffer = ocl_runtime_acquire(engine->rt, CL_MEM_READ_WRITE, pixels * engine->channels * engine->temp_sample_size, &err);
+    if (!engine->temp_buffer)
+        return err;
+    engine->temp_pixels = pixels;
+    return CL_SUCCESS;
+}
+
+static cl_mem create_image(blur_engine* engine, cl_mem_flags flags, cl_channel_type type, int width, int height, cl_int* err)
+{
+    cl_image_format format = image_format(engine, type);
+    cl_image_desc desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.image_type = CL_MEM_OBJECT_IMAGE2D;
+    desc.image_width = width;
+    desc.image_height = height;
+
+    cl_mem image = clCreateImage(engine->rt->context, flags, &format, &desc, NULL, err);
+    if (!image)
+        ocl_report_error("clCreateImage", *err, __FILE__, __LINE__);
+    return image;
+}
+
+cl_int blur_engine_create_frame(blur_engine* engine, int width, int height, cl_mem* input, cl_mem* output, cl_mem* temp)
+{
+    cl_int err;
+    size_t samples = (size_t)width * height * engine->channels;
+    *input = *output = *temp = NULL;
+
+    if (engine->use_images)
+    {
+        if ((size_t)width > engine->image_max_width || (size_t)height > engine->image_max_height)
+        {
+            fprintf(stderr, "Error: %dx%d exceeds the device image size limit %zux%zu\n", width, height, engine->image_max_width, engine->image_max_height);
+            return CL_INVALID_IMAGE_SIZE;
+        }
+        if (!(*input = create_image(engine, CL_MEM_READ_ONLY, CL_UNSIGNED_INT8, width, height, &err)) ||
+            !(*output = create_image(engine, CL_MEM_WRITE_ONLY, CL_UNSIGNED_INT8, width, height, &err)) ||
+            (engine->separable && !(*temp = create_image(engine, CL_MEM_READ_WRITE, CL_FLOAT, width, height, &err))))
+            return err;
+        return CL_SUCCESS;
+    }
+
+    if (!(*input = ocl_runtime_acquire(engine->rt, CL_MEM_READ_ONLY, samples * sizeof(cl_uchar), &err)) ||
+        !(*output = ocl_runtime_acquire(engine->rt, CL_MEM_WRITE_ONLY, samples * sizeof(cl_uchar), &err)) ||
+        (engine->separable && !(*temp = ocl_runtime_acquire(engine->rt, CL_MEM_READ_WRITE, samples * engine->temp_sample_size, &err))))
+        return err;
+    return CL_SUCCESS;
+}
+
+cl_int blur_engine_enqueue_write(blur_engine* engine, cl_command_queue queue, cl_mem input, int width, int height,
+                                 const unsigned char* host, cl_uint num_wait_events, const cl_event* wait_events, cl_event* event)
+{
+    if (engine->use_images)
+    {
+        size_t origin[3] = {0, 0, 0};
+        size_t region[3] = {width, height, 1};
+        OCL_CHECK(clEnqueueWriteImage(queue, input, CL_FALSE, origin, region, (size_t)width * engine->channels, 0, host,
+                                      num_wait_events, wait_events, event));
+        return CL_SUCCESS;
+    }
+    OCL_CHECK(clEnqueueWriteBuffer(queue, input, CL_FALSE, 0, (size_t)width * height * engine->channels * sizeof(cl_uchar), host,
+                                   num_wait_events, wait_events, event));
+    return CL_SUCCESS;
+}
+
+// Reads rows [first_row, first_row + rows) of a frame into host
+static cl_int enqueue_read_rows(blur_engine* engine, cl_command_queue queue, cl_mem output, int width, int first_row, int rows,
+                                unsigned char* host, cl_uint num_wait_events, const cl_event* wait_events, cl_event* event)
+{
+    size_t row_bytes = (size_t)width * engine->channels * sizeof(cl_uchar);
+    if (engine->use_images)
+    {
+        size_t origin[3] = {0, first_row, 0};
+        size_t region[3] = {width, rows, 1};
+        OCL_CHECK(clEnqueueReadImage(queue, output, CL_FALSE, origin, region, row_bytes, 0, host,
+                                     num_wait_events, wait_events, event));
+        return CL_SUCCESS;
+    }
+    OCL_CHECK(clEnqueueReadBuffer(queue, output, CL_FALSE, first_row * row_bytes, rows * row_bytes, host,
+                                  num_wait_events, wait_events, event));
+    return CL_SUCCESS;
+}
+
+cl_int blur_engine_enqueue_read(blur_engine* engine, cl_command_queue queue, cl_mem output, int width, int height,
+                                unsigned char* host, cl_uint num_wait_events, const cl_event* wait_events, cl_event* event)
+{
+    return enqueue_read_rows(engine, queue, output, width, 0, height, host, num_wait_events, wait_events, event);
+}
+
+cl_int blur_engine_reserve(blur_engine* engine, int width, int height)
+{
+    cl_int err;
+    size_t pixels = (size_t)width * height;
+
+    // Images have a fixed size, so they are recreated whenever it changes
+    if (engine->use_images)
+    {
+        if (width == engine->image_width && height == engine->image_height)
+            return CL_SUCCESS;
+        release_image_buffers(engine);
+        err = blur_engine_create_frame(engine, width, height, &engine->input_buffer, &engine->output_buffer, &engine->temp_buffer);
+        if (err != CL_SUCCESS)
+            return err;
+        engine->image_width = width;
+        engine->image_height = height;
+        return CL_SUCCESS;
+    }
+
+    if (pixels > engine->buffer_pixels)
+    {
+        ocl_runtime_recycle(engine->rt, engine->input_buffer);
+        ocl_runtime_recycle(engine->rt, engine->output_buffer);
+        engine->output_buffer = NULL;
+        engine->buffer_pixels = 0;
+        engine->input_buffer = ocl_runtime_acquire(engine->rt, CL_MEM_READ_ONLY, pixels * engine->channels * sizeof(cl_uchar), &err);
+        if (!engine->input_buffer)
+            return err;
+        engine->output_buffer = ocl_runtime_acquire(engine->rt, CL_MEM_WRITE_ONLY, pixels * engine->channels * sizeof(cl_uchar), &err);
+        if (!engine->output_buffer)
+            return err;
+        engine->buffer_pixels = pixels;
+    }
+    return reserve_temp(engine, pixels);
+}
+
+cl_int blur_engine_enqueue(blur_engine* engine, cl_command_queue queue, cl_mem input, cl_mem output, cl_mem temp,
+                           int width, int height, cl_uint num_wait_events, const cl_event* wait_events, blur_events* events)
+{
+    // Global sizes are rounded up to whole work-groups; the kernels skip the items outside the image
+    size_t rows = engine->separable ? (size_t)height : ((size_t)height + engine->pixels_per_item - 1) / engine->pixels_per_item;
+    size_t global_work_size[2] = {round_up(width, engine->local_work_size[0]), round_up(rows, engine->local_work_size[1])};
+    int kernel_radius = engine->kernel_radius;
+    cl_event* first_event = events ? &events->kernel_events[0] : NULL;
+    cl_event* second_event = events ? &events->kernel_events[1] : NULL;
+
+    if (engine->separable)
+    {
+        cl_kernel kh = engine->kernel_horizontal;
+        cl_kernel kv = engine->kernel_vertical;
+        cl_event horizontal_event;
+        size_t horizontal_tile = (engine->local_work_size[0] + (2 * kernel_radius)) * engine->local_work_size[1] * engine->tile_element_size;
+        size_t vertical_tile = engine->local_work_size[0] * (engine->local_work_size[1] + (2 * kernel_radius)) * engine->tile_element_size;
+
+        OCL_CHECK(clSetKernelArg(kh, 0, sizeof(cl_mem), &input));
+        OCL_CHECK(clSetKernelArg(kh, 1, sizeof(cl_mem), &temp));
+        OCL_CHECK(clSetKernelArg(kh, 2, sizeof(int), &width));
+        OCL_CHECK(clSetKernelArg(kh, 3, sizeof(int), &height));
+        OCL_CHECK(clSetKernelArg(kh, 4, sizeof(cl_mem), &engine->row_weights_buffer));
+        OCL_CHECK(clSetKernelArg(kh, 5, sizeof(int), &kernel_radius));
+        if (!engine->use_images)
+            OCL_CHECK(clSetKernelArg(kh, 6, horizontal_tile, NULL));
+
+        OCL_CHECK(clSetKernelArg(kv, 0, sizeof(cl_mem), &temp));
+        OCL_CHECK(clSetKernelArg(kv, 1, sizeof(cl_mem), &output));
+        OCL_CHECK(clSetKernelArg(kv, 2, sizeof(int), &width));
+        OCL_CHECK(clSetKernelArg(kv, 3, sizeof(int), &height));
+        OCL_CHECK(clSetKernelArg(kv, 4, sizeof(cl_mem), &engine->col_weights_buffer));
+        OCL_CHECK(clSetKernelArg(kv, 5, sizeof(int), &kernel_radius));
+        if (!engine->use_images)
+            OCL_CHECK(clSetKernelArg(kv, 6, vertical_tile, NULL));
+
+        // The vertical pass waits on the horizontal one, which matters on out-of-order queues
+        OCL_CHECK(clEnqueueNDRangeKernel(queue, kh, 2, NULL, global_work_size, engine->local_work_size, num_wait_events, wait_events, &horizontal_event));
+        cl_int err = clEnqueueNDRangeKernel(queue, kv, 2, NULL, global_work_size, engine->local_work_size, 1, &horizontal_event, second_event);
+        if (first_event)
+            *first_event = horizontal_event;
+        else
+            clReleaseEvent(horizontal_event);
+        if (err != CL_SUCCESS)
+        {
+            ocl_report_error("clEnqueueNDRangeKernel(gaussian_blur_vertical)", err, __FILE__, __LINE__);
+            return err;
+        }
+        if (events)
+            events->num_kernel_events = 2;
+    }
+    else
+    {
+        cl_kernel k = engine->kernel_2d;
+        OCL_CHECK(clSetKernelArg(k, 0, sizeof(cl_mem), &input));
+        OCL_CHECK(clSetKernelArg(k, 1, sizeof(cl_mem), &output));
+        OCL_CHECK(clSetKernelArg(k, 2, sizeof(int), &width));
+        OCL_CHECK(clSetKernelArg(k, 3, sizeof(int), &height));
+        OCL_CHECK(clSetKernelArg(k, 4, sizeof(cl_mem), &engine->mask_buffer));
+        OCL_CHECK(clSetKernelArg(k, 5, sizeof(int), &kernel_radius));
+        OCL_CHECK(clEnqueueNDRangeKernel(queue, k, 2, NULL, global_work_size, engine->local_work_size, num_wait_events, wait_events, first_event));
+        if (events)
+            events->num_kernel_events = 1;
+    }
+    return CL_SUCCESS;
+}
+
+cl_int blur_engine_run(blur_engine* engine, const unsigned char* input, unsigned char* output, int width, int height, blur_events* events)
+{
+    cl_command_queue queue = engine->rt->queue;
+    blur_events local_events;
+    blur_events* ev = events ? events : &local_events;
+    memset(ev, 0, sizeof(*ev));
+
+    cl_int err = blur_engine_reserve(engine, width, height);
+    if (err != CL_SUCCESS)
+        return err;
+
+    err = blur_engine_enqueue_write(engine, queue, engine->input_buffer, width, height, input, 0, NULL, &ev->write_event);
+    if (err != CL_SUCCESS)
+        goto done;
+    err = blur_engine_enqueue(engine, queue, engine->input_buffer, engine->output_buffer, engine->temp_buffer,
+                              width, height, 1, &ev->write_event, ev);
+    if (err != CL_SUCCESS)
+        goto done;
+    err = blur_engine_enqueue_read(engine, queue, engine->output_buffer, width, height, output,
+                                   1, &ev->kernel_events[ev->num_kernel_events - 1], &ev->read_event);
+    if (err != CL_SUCCESS)
+        goto done;
+    // Wait for read operation to complete
+    OCL_CHECK_GOTO(clWaitForEvents(1, &ev->read_event), err, done);
+
+done:
+    if (!events || err != CL_SUCCESS)
+    {
+        // Drain whatever was enqueued before dropping the events
+        clFinish(queue);
+        blur_events_release(ev);
+    }
+    return err;
+}
+
+cl_int blur_engine_run_host(blur_engine* engine, ocl_host_buffer* input, ocl_host_buffer* output, int width, int height, blur_events* events)
+{
+    ocl_runtime* rt = engine->rt;
+    size_t image_bytes = (size_t)width * height * engine->channels * sizeof(cl_uchar);
+    blur_events local_events;
+    blur_events* ev = events ? events : &local_events;
+    memset(ev, 0, sizeof(*ev));
+
+    // Images cannot alias host memory: copy the frames through the engine's images
+    if (engine->use_images)
+    {
+        cl_int err = ocl_host_buffer_map(rt, input, CL_MAP_READ | CL_MAP_WRITE, 0, NULL, NULL);
+        if (err == CL_SUCCESS)
+            err = ocl_host_buffer_map(rt, output, CL_MAP_READ | CL_MAP_WRITE, 0, NULL, NULL);
+        if (err == CL_SUCCESS)
+            err = blur_engine_run(engine, (const unsigned char*)input->host_ptr, (unsigned char*)output->host_ptr, width, height, events);
+        return err;
+    }
+
+    cl_int err = (input->zero_copy && output->zero_copy) ? reserve_temp(engine, (size_t)width * height)
+                                                         : blur_engine_reserve(engine, width, height);
+    if (err != CL_SUCCESS)
+        return err;
+    cl_mem input_buffer = ocl_host_buffer_device_mem(input, engine->input_buffer);
+    cl_mem output_buffer = ocl_host_buffer_device_mem(output, engine->output_buffer);
+
+    // The write stage is an unmap for zero-copy input, a copy from pinned memory otherwise
+    err = ocl_host_buffer_upload(rt, input, input_buffer, image_bytes, &ev->write_event);
+    if (err == CL_SUCCESS)
+        err = ocl_host_buffer_unmap(rt, output, NULL);
+    if (err == CL_SUCCESS)
+        err = blur_engine_enqueue(engine, rt->queue, input_buffer, output_buffer, engine->temp_buffer, width, height,
+                                  ev->write_event ? 1 : 0, ev->write_event ? &ev->write_event : NULL, ev);
+    // The read stage maps zero-copy output, or reads into pinned memory
+    if (err == CL_SUCCESS)
+        err = ocl_host_buffer_download(rt, output, output_buffer, image_bytes,
+                                       1, &ev->kernel_events[ev->num_kernel_events - 1], &ev->read_event);
+
+    if (!events || err != CL_SUCCESS)
+    {
+        clFinish(rt->queue);
+        blur_events_release(ev);
+    }
+    return err;
+}
+
+// One blur submitted through an ocl_async submitter, with its own frame buffers from the pool
+typedef struct
+{
+    blur_engine* engine;
+    const unsigned char* input;
+    unsigned char* output;
+    int width;
+    int height;
+    cl_mem input_frame;
+    cl_mem output_frame;
+    cl_mem temp_frame;
+} blur_submission;
+
+// ocl_async_enqueue_fn: upload, kernels and download on the submitter's in-order queue. The frames are
+// taken here, once the submission has its slot, so only submissions in flight hold device memory.
+static cl_int enqueue_submission(void* ctx, cl_command_queue queue, cl_event* done_event)
+{
+    blur_submission* job = (blur_submission*)ctx;
+    blur_events events;
+    memset(&events, 0, sizeof(events));
+
+    cl_int err = blur_engine_create_frame(job->engine, job->width, job->height, &job->input_frame, &job->output_frame, &job->temp_frame);
+    if (err != CL_SUCCESS)
+        return err;
+    err = blur_engine_enqueue_write(job->engine, queue, job->input_frame, job->width, job->height, job->input, 0, NULL, &events.write_event);
+    if (err == CL_SUCCESS)
+        err = blur_engine_enqueue(job->engine, queue, job->input_frame, job->output_frame, job->temp_frame,
+                                  job->width, job->height, 1, &events.write_event, &events);
+    if (err == CL_SUCCESS)
+        err = blur_engine_enqueue_read(job->engine, queue, job->output_frame, job->width, job->height, job->output,
+                                       1, &events.kernel_events[events.num_kernel_events - 1], &events.read_event);
+    if (err == CL_SUCCESS)
+    {
+        *done_event = events.read_event;
+        events.read_event = NULL;
+    }
+    blur_events_release(&events);
+    return err;
+}
+
+// ocl_async_cleanup_fn: the commands are done with the frames (some may be NULL after a failed enqueue)
+static void release_submission(void* ctx)
+{
+    blur_submission* job = (blur_submission*)ctx;
+    ocl_runtime_recycle(job->engine->rt, job->input_frame);
+    ocl_runtime_recycle(job->engine->rt, job->output_frame);
+    ocl_runtime_recycle(job->engine->rt, job->temp_frame);
+    free(job);
+}
+
+cl_int blur_engine_submit(blur_engine* engine, ocl_async* async, const unsigned char* input, unsigned char* output, int width, int height,
+                          ocl_async_complete_fn on_complete, void* user, ocl_future** future)
+{
+    if (future)
+        *future = NULL;
+    blur_submission* job = (blur_submission*)calloc(1, sizeof(blur_submission));
+    if (!job)
+        return CL_OUT_OF_HOST_MEMORY;
+    job->engine = engine;
+    job->input = input;
+    job->output = output;
+    job->width = width;
+    job->height = height;
+    // The submitter owns job from here and releases it through release_submission, also on failure
+    return ocl_async_submit(async, enqueue_submission, release_submission, job, on_complete, user, future);
+}
+
+typedef struct
+{
+    blur_engine* engine;
+    int width;
+    int height;
+    int profiling;
+} tune_job;
+
+static double wall_clock_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+// autotune_run_fn: one blur of the tuning frame already on the device
+static cl_int tune_run(void* ctx, const tune_config* config, double* time_sec)
+{
+    tune_job* job = (tune_job*)ctx;
+    blur_engine* engine = job->engine;
+    cl_command_queue queue = engine->rt->queue;
+    blur_events events;
+    memset(&events, 0, sizeof(events));
+
+    cl_int err = apply_config(engine, config);
+    if (err != CL_SUCCESS)
+        return err;
+    double start = wall_clock_sec();
+    err = blur_engine_enqueue(engine, queue, engine->input_buffer, engine->output_buffer, engine->temp_buffer,
+                              job->width, job->height, 0, NULL, &events);
+    if (err == CL_SUCCESS)
+        err = clFinish(queue);
+    double elapsed = wall_clock_sec() - start;
+    if (err == CL_SUCCESS)
+        *time_sec = job->profiling ? blur_events_kernel_time(&events) : elapsed;
+    blur_events_release(&events);
+    return err;
+}
+
+cl_int blur_engine_autotune(blur_engine* engine, int width, int height, int verbose)
+{
+    static const int pixels_per_item_2d[] = {1, 2, 4};
+    ocl_runtime* rt = engine->rt;
+    tune_config candidates[AUTOTUNE_MAX_CANDIDATES];
+    tune_config previous;
+    int num_candidates = 0;
+    tune_job job = {engine, width, height, 0};
+
+    cl_command_queue_properties properties = 0;
+    clGetCommandQueueInfo(rt->queue, CL_QUEUE_PROPERTIES, sizeof(properties), &properties, NULL);
+    job.profiling = (properties & CL_QUEUE_PROFILING_ENABLE) != 0;
+
+    previous.local_size[0] = engine->local_work_size[0];
+    previous.local_size[1] = engine->local_work_size[1];
+    previous.pixels_per_item = engine->pixels_per_item;
+    previous.time_sec = 0.0;
+
+    // Tune on a noise frame; the data does not change the timing but keeps the kernels honest
+    cl_int err = blur_engine_reserve(engine, width, height);
+    if (err != CL_SUCCESS)
+        return err;
+    size_t frame_bytes = (size_t)width * height * engine->channels;
+    unsigned char* frame = (unsigned char*)malloc(frame_bytes);
+    for (size_t i = 0; i < frame_bytes; i++)
+        frame[i] = (unsigned char)(rand() % 256);
+    err = blur_engine_enqueue_write(engine, rt->queue, engine->input_buffer, width, height, frame, 0, NULL, NULL);
+    if (err == CL_SUCCESS)
+        err = clFinish(rt->queue);
+    free(frame);
+    if (err != CL_SUCCESS)
+        return err;
+
+    int num_variants = engine->separable ? 1 : (int)(sizeof(pixels_per_item_2d) / sizeof(pixels_per_item_2d[0]));
+    for (int v = 0; v < num_variants; v++)
+    {
+        int pixels_per_item = engine->separable ? 1 : pixels_per_item_2d[v];
+        tune_config variant = previous;
+        variant.pixels_per_item = pixels_per_item;
+        if (apply_config(engine, &variant) != CL_SUCCESS)
+            continue;
+        int first = num_candidates;
+        num_candidates = autotune_candidates(rt, engine->separable ? engine->kernel_horizontal : engine->kernel_2d, 2,
+                                             pixels_per_item, candidates, num_candidates);
+        int kept = first;
+        for (int i = first; i < num_candidates; i++)
+        {
+            if (local_size_fits(engine, candidates[i].local_size[0], candidates[i].local_size[1]))
+                candidates[kept++] = candidates[i];
+        }
+        num_candidates = kept;
+    }
+
+    int best = autotune_sweep(candidates, num_candidates, BLUR_TUNE_REPEATS, tune_run, &job, verbose);
+    if (best < 0)
+    {
+        apply_config(engine, &previous);
+        fprintf(stderr, "Error: No work-group shape could be timed on this device\n");
+        return CL_INVALID_WORK_GROUP_SIZE;
+    }
+    err = apply_config(engine, &candidates[best]);
+    if (err != CL_SUCCESS)
+        return err;
+    autotune_store(rt, engine->tune_key, &candidates[best]);
+    engine->tuned = 1;
+    return CL_SUCCESS;
+}
+
+// Device bytes a buffer of size bytes takes: buffers come from the runtime's pool, which rounds them up
+// to its size classes; images are created at their exact size
+static size_t device_bytes(const blur_engine* engine, size_t size)
+{
+    return engine->use_images ? size : buffer_pool_alloc_size(&engine->rt->buffers, size);
+}
+
+// Whether a strip of rows fits: every buffer within the largest allocation, all of them within the budget
+static int strip_fits(const blur_engine* engine, int width, size_t mem_budget, size_t rows)
+{
+    size_t frame_bytes = device_bytes(engine, rows * width * engine->channels * sizeof(cl_uchar));
+    size_t temp_bytes = engine->separable ? device_bytes(engine, rows * width * engine->channels * engine->temp_sample_size) : 0;
+    size_t largest = (temp_bytes > frame_bytes) ? temp_bytes : frame_bytes;
+    if (largest > engine->rt->max_mem_alloc_size)
+        return 0;
+    return mem_budget == 0 || (2 * frame_bytes) + temp_bytes <= mem_budget;
+}
+
+int blur_engine_strip_rows(const blur_engine* engine, int width, size_t mem_budget)
+{
+    // Device bytes per pixel: input and output frames, plus the intermediate of the separable path
+    size_t pixel_bytes = engine->channels * sizeof(cl_uchar);
+    size_t temp_pixel_bytes = engine->separable ? engine->channels * engine->temp_sample_size : 0;
+    size_t row_bytes = (size_t)width * ((2 * pixel_bytes) + temp_pixel_bytes);
+    size_t largest_row = (size_t)width * (temp_pixel_bytes > pixel_bytes ? temp_pixel_bytes : pixel_bytes);
+
+    // Exact sizes bound the rows from above; the pool's rounding can take a quarter more, so the
+    // largest row count that still fits once rounded is searched below that bound
+    size_t rows = engine->rt->max_mem_alloc_size / largest_row;
+    if (mem_budget > 0 && mem_budget / row_bytes < rows)
+        rows = mem_budget / row_bytes;
+    if (engine->use_images && engine->image_max_height < rows)
+        rows = engine->image_max_height;
+    if (rows > INT_MAX)
+        rows = INT_MAX;
+    size_t low = 0;
+    while (low < rows)
+    {
+        size_t mid = low + ((rows - low + 1) / 2);
+        if (strip_fits(engine, width, mem_budget, mid))
+            low = mid;
+        else
+            rows = mid - 1;
+    }
+    return (int)rows;
+}
+
+cl_int blur_engine_run_tiled(blur_engine* engine, const unsigned char* input, unsigned char* output, int width, int height,
+                             size_t mem_budget, int* num_strips)
+{
+    cl_int err;
+    int radius = engine->kernel_radius;
+    int strip_rows = blur_engine_strip_rows(engine, width, mem_budget);
+    int step = strip_rows - (2 * radius);
+    if (num_strips)
+        *num_strips = 0;
+
+    if (strip_rows >= height)
+    {
+        if (num_strips)
+            *num_strips = 1;
+        return blur_engine_run(engine, input, output, width, height, NULL);
+    }
+    if (step < 1)
+    {
+        fprintf(stderr, "Error: A %d pixel wide strip with a %d row halo does not fit the memory budget\n", width, radius);
+        return CL_INVALID_BUFFER_SIZE;
+    }
+
+    for (int y0 = 0; y0 < height; y0 += step)
+    {
+        int y1 = (y0 + step < height) ? y0 + step : height;
+        err = blur_engine_run_rows(engine, input, output, width, height, y0, y1);
+        if (err != CL_SUCCESS)
+            return err;
+        if (num_strips)
+            (*num_strips)++;
+    }
+    return CL_SUCCESS;
+}
+
+cl_int blur_engine_run_rows(blur_engine* engine, const unsigned char* input, unsigned char* output, int width, int height, int y0, int y1)
+{
+    cl_int err;
+    cl_command_queue queue = engine->rt->queue;
+    size_t row_bytes = (size_t)width * engine->channels * sizeof(cl_uchar);
+    int radius = engine->kernel_radius;
+
+    // The strip carries kernel_radius halo rows above and below (fewer at the image edges), so the
+    // blur of its own rows sees the same neighbourhood as a single pass; only those rows are read back
+    int halo_y0 = (y0 - radius > 0) ? y0 - radius : 0;
+    int halo_y1 = (y1 + radius < height) ? y1 + radius : height;
+    int rows = halo_y1 - halo_y0;
+
+    err = blur_engine_reserve(engine, width, rows);
+    if (err != CL_SUCCESS)
+        return err;
+    err = blur_engine_enqueue_write(engine, queue, engine->input_buffer, width, rows, input + (halo_y0 * row_bytes), 0, NULL, NULL);
+    if (err == CL_SUCCESS)
+        err = blur_engine_enqueue(engine, queue, engine->input_buffer, engine->output_buffer, engine->temp_buffer, width, rows, 0, NULL, NULL);
+    if (err == CL_SUCCESS)
+        err = enqueue_read_rows(engine, queue, engine->output_buffer, width, y0 - halo_y0, y1 - y0, output + (y0 * row_bytes), 0, NULL, NULL);
+    // The in-order queue runs the three in turn; the strip buffers are reused by the next strip
+    if (err == CL_SUCCESS)
+        err = clFinish(queue);
+    if (err != CL_SUCCESS)
+        clFinish(queue);
+    return err;
+}
+
+void blur_events_release(blur_events* events)
+{
+    if (events->write_event)
+        clReleaseEvent(events->write_event);
+    for (int i = 0; i < 2; i++)
+    {
+        if (events->kernel_events[i])
+            clReleaseEvent(events->kernel_events[i]);
+    }
+    if (events->read_event)
+        clReleaseEvent(events->read_event);
+    memset(events, 0, sizeof(*events));
+}
+
+void blur_events_record(const blur_events* events, ocl_profiler* profiler, int iteration)
+{
+    ocl_profiler_record(profiler, "write", iteration, events->write_event);
+    if (events->num_kernel_events == 2)
+    {
+        ocl_profiler_record(profiler, "blur_horizontal", iteration, events->kernel_events[0]);
+        ocl_profiler_record(profiler, "blur_vertical", iteration, events->kernel_events[1]);
+    }
+    else
+    {
+        ocl_profiler_record(profiler, "blur_2d", iteration, events->kernel_events[0]);
+    }
+    ocl_profiler_record(profiler, "read", iteration, events->read_event);
+}
+
+double event_time_sec(cl_event event)
+{
+    cl_ulong start = 0, end = 0;
+    if (!event)
+        return 0.0;
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+    return (end - start) * 1e-9; // Convert from nanoseconds to seconds
+}
+
+double blur_events_kernel_time(const blur_events* events)
+{
+    double total = 0.0;
+    for (int i = 0; i < events->num_kernel_events; i++)
+        total += event_time_sec(events->kernel_events[i]);
+    return total;
+}
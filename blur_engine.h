@@ -0,0 +1,183 @@
+#ifndef BLUR_ENGINE_H
+#define BLUR_ENGINE_H
+
+#include <CL/cl.h>
+
+#include "ocl_runtime.h"
+#include "host_buffer.h"
+#include "ocl_profiler.h"
+#include "ocl_async.h"
+
+// Device Gaussian blur on top of an ocl_runtime. The mask, program, kernels and weight buffers are
+// set up once; image buffers grow on demand and are reused by later requests of the same or smaller size.
+
+// Where frames live on the device. AUTO takes image2d_t objects when the device has image support
+// and the formats exist (never for RGB, which has no 8-bit image format), buffers otherwise.
+typedef enum
+{
+    BLUR_STORAGE_AUTO,
+    BLUR_STORAGE_BUFFER,
+    BLUR_STORAGE_IMAGE
+} blur_storage;
+
+// Arithmetic of the blur kernels. FIXED quantizes the mask to Q14 shorts (gaussian_mask.h) and
+// accumulates in int, bit-identical to the host fixed-point blur (cpu_blur.h); HALF multiplies and sums
+// in half precision and needs cl_khr_fp16. Both halve the separable intermediate and run on buffers only.
+typedef enum
+{
+    BLUR_PRECISION_FLOAT,
+    BLUR_PRECISION_FIXED,
+    BLUR_PRECISION_HALF
+} blur_precision;
+
+typedef struct
+{
+    float sigma;
+    int kernel_radius;   // <= 0 picks ceil(3 * sigma)
+    int use_reference;   // Force the full 2D kernel even for separable masks
+    int use_jit;         // Bake the radius and weights into the program (-D constants)
+    int channels;        // Interleaved channels per pixel: 1 (grayscale, also for 0), 3 (RGB) or 4 (RGBA)
+    blur_storage storage;
+    blur_precision precision;
+} blur_params;
+
+// Events of one blur, for profiling. kernel_events[0] is the 2D or horizontal pass,
+// kernel_events[1] the vertical pass (separable path only).
+typedef struct
+{
+    cl_event write_event;
+    cl_event kernel_events[2];
+    int num_kernel_events;
+    cl_event read_event;
+} blur_events;
+
+typedef struct
+{
+    ocl_runtime* rt;
+    blur_params params;
+    int kernel_radius;
+    int kernel_size;
+    int channels;
+    blur_precision precision; // Precision the kernels run in (params.precision unless the device lacks cl_khr_fp16)
+    size_t tile_element_size; // Local memory per staged pixel (accumulator type, times 4 for RGB/RGBA)
+    size_t temp_sample_size;  // Bytes per sample of the separable intermediate
+    float* mask;              // 2D mask, also used by the host reference
+    float* row_weights;
+    float* col_weights;
+    short* fixed_mask;        // Q14 weights of the fixed-point mode (NULL otherwise); each vector sums to 1 << 14
+    short* fixed_row_weights;
+    short* fixed_col_weights;
+    int mask_separable;
+    int separable;            // Path used on the device
+    int use_images;           // Frames are image2d_t objects read through a clamp-to-edge sampler
+    size_t image_max_width;
+    size_t image_max_height;
+    char* build_options;
+    size_t build_options_size;
+
+    cl_program program;
+    cl_kernel kernel_2d;
+    cl_kernel kernel_horizontal;
+    cl_kernel kernel_vertical;
+    cl_mem mask_buffer;
+    cl_mem row_weights_buffer;
+    cl_mem col_weights_buffer;
+
+    size_t local_work_size[2];
+    int pixels_per_item;      // Output rows per work-item on the 2D path (PIXELS_PER_ITEM in the kernel)
+    int tuned;                // local_work_size and pixels_per_item come from an autotuning result
+    char tune_key[128];       // Key of this configuration in the per-device autotuning file
+
+    // Frame buffers (or images), reused while large enough (images: while the size matches)
+    cl_mem input_buffer;
+    cl_mem output_buffer;
+    cl_mem temp_buffer;
+    size_t buffer_pixels;
+    size_t temp_pixels;
+    int image_width;
+    int image_height;
+} blur_engine;
+
+// Name of a precision mode ("float", "fixed" or "half")
+const char* blur_precision_name(blur_precision precision);
+
+// Generates the mask, picks the separable or 2D path and builds the program.
+// Kernel file lookup follows ocl_kernel_path. Returns CL_SUCCESS or the failing OpenCL error.
+cl_int blur_engine_init(blur_engine* engine, ocl_runtime* rt, const blur_params* params);
+
+// Times the work-group shapes (and, on the 2D path, 1, 2 and 4 rows per work-item) the device accepts
+// on a width x height frame, switches to the fastest and stores it for the device, so later engines with
+// the same configuration start from it. Kernel times come from profiling events when the runtime queue
+// has profiling enabled, from the wall clock otherwise. Prints every candidate when verbose.
+cl_int blur_engine_autotune(blur_engine* engine, int width, int height, int verbose);
+
+// Releases the engine's buffers and host memory, and gives its program and kernels back to the runtime
+void blur_engine_release(blur_engine* engine);
+
+// Makes sure the image buffers hold at least width * height pixels of engine->channels bytes
+cl_int blur_engine_reserve(blur_engine* engine, int width, int height);
+
+// Creates one set of frame objects in the engine's storage (buffers or images) for width x height
+// frames. temp is only created for the separable path. The caller hands them back with ocl_runtime_recycle.
+cl_int blur_engine_create_frame(blur_engine* engine, int width, int height, cl_mem* input, cl_mem* output, cl_mem* temp);
+
+// Non-blocking upload of a host frame into input / download of output into a host frame, as a
+// buffer or an image transfer depending on the storage
+cl_int blur_engine_enqueue_write(blur_engine* engine, cl_command_queue queue, cl_mem input, int width, int height,
+                                 const unsigned char* host, cl_uint num_wait_events, const cl_event* wait_events, cl_event* event);
+cl_int blur_engine_enqueue_read(blur_engine* engine, cl_command_queue queue, cl_mem output, int width, int height,
+                                unsigned char* host, cl_uint num_wait_events, const cl_event* wait_events, cl_event* event);
+
+// Enqueues the blur kernels from input to output (temp is the float intermediate of the
+// separable path and may be NULL for the 2D path) after the given wait list. All three come from
+// blur_engine_reserve or blur_engine_create_frame, so they match the engine's storage.
+// The kernel events are returned in events->kernel_events when events is not NULL.
+cl_int blur_engine_enqueue(blur_engine* engine, cl_command_queue queue, cl_mem input, cl_mem output, cl_mem temp,
+                           int width, int height, cl_uint num_wait_events, const cl_event* wait_events, blur_events* events);
+
+// Blurs one image: write, kernels and read on the runtime queue, then waits for the read.
+// When events is not NULL it receives the events of every stage (release with blur_events_release).
+cl_int blur_engine_run(blur_engine* engine, const unsigned char* input, unsigned char* output, int width, int height, blur_events* events);
+
+// Same, on host buffers (see host_buffer.h). Zero-copy buffers are used by the kernels in place and
+// the engine's own input/output buffers are not allocated; staging buffers are copied from and to them.
+// On return output is mapped for the host, while a zero-copy input stays with the device until it is mapped again.
+// On the image path both are plain host memory and the frames are copied into the engine's images.
+cl_int blur_engine_run_host(blur_engine* engine, ocl_host_buffer* input, ocl_host_buffer* output, int width, int height, blur_events* events);
+
+// Non-blocking blur of one host frame through an asynchronous submitter (see ocl_async.h): the upload,
+// kernels and download go to one of its queues with frame buffers from the runtime's pool, and the call
+// returns once they are flushed, after waiting for a free slot when max_in_flight blurs are outstanding.
+// input and output must stay valid until the submission completes. on_complete and future are optional.
+cl_int blur_engine_submit(blur_engine* engine, ocl_async* async, const unsigned char* input, unsigned char* output, int width, int height,
+                          ocl_async_complete_fn on_complete, void* user, ocl_future** future);
+
+// Rows of a width pixel wide strip (halos included) whose device buffers, at the size the buffer pool
+// creates them, fit mem_budget bytes (0: no budget), CL_DEVICE_MAX_MEM_ALLOC_SIZE for each buffer and,
+// on the image path, the image height limit
+int blur_engine_strip_rows(const blur_engine* engine, int width, size_t mem_budget);
+
+// Blurs an image of any height in horizontal strips that fit mem_budget (see blur_engine_strip_rows).
+// Each strip is uploaded with kernel_radius halo rows on both sides, so the result matches a single
+// blur_engine_run. Falls back to one blur_engine_run when the whole image fits. num_strips is optional.
+cl_int blur_engine_run_tiled(blur_engine* engine, const unsigned char* input, unsigned char* output, int width, int height,
+                             size_t mem_budget, int* num_strips);
+
+// Blurs rows y0 to y1 - 1 of a width x height image as one strip with its halos and reads back only
+// those rows into the same rows of output. Blocks until they are there. The strip must fit the device
+// (see blur_engine_strip_rows).
+cl_int blur_engine_run_rows(blur_engine* engine, const unsigned char* input, unsigned char* output, int width, int height, int y0, int y1);
+
+void blur_events_release(blur_events* events);
+
+// Adds the completed commands of one blur to a profiler as stages "write", "blur_2d" or
+// "blur_horizontal" + "blur_vertical", and "read" (needs a profiling queue)
+void blur_events_record(const blur_events* events, ocl_profiler* profiler, int iteration);
+
+// Sum of the kernel execution times in seconds (needs a profiling queue)
+double blur_events_kernel_time(const blur_events* events);
+
+// Execution time of one event in seconds (needs a profiling queue)
+double event_time_sec(cl_event event);
+
+#endif
@@ -0,0 +1,167 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "blur_stream.h"
+
+
+
+static double wall_clock_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+static cl_command_queue create_stream_queue(ocl_runtime* rt, cl_int* err)
+{
+    cl_command_queue_properties properties = 0;
+    clGetCommandQueueInfo(rt->queue, CL_QUEUE_PROPERTIES, sizeof(properties), &properties, NULL);
+    cl_command_queue queue = clCreateCommandQueue(rt->context, rt->device, properties, err);
+    if (!queue)
+        ocl_report_error("clCreateCommandQueue", *err, __FILE__, __LINE__);
+    return queue;
+}
+
+cl_int blur_stream_init(blur_stream* stream, blur_engine* engine, int width, int height, int num_slots)
+{
+    cl_int err;
+    ocl_runtime* rt = engine->rt;
+
+    memset(stream, 0, sizeof(*stream));
+    stream->engine = engine;
+    stream->width = width;
+    stream->height = height;
+    stream->num_slots = (num_slots < 1) ? 1 : (num_slots > BLUR_STREAM_MAX_SLOTS) ? BLUR_STREAM_MAX_SLOTS : num_slots;
+
+    if (!(stream->upload_queue = create_stream_queue(rt, &err)) ||
+        !(stream->compute_queue = create_stream_queue(rt, &err)) ||
+        !(stream->download_queue = create_stream_queue(rt, &err)))
+        return err;
+
+    for (int i = 0; i < stream->num_slots; i++)
+    {
+        blur_stream_slot* slot = &stream->slots[i];
+        err = blur_engine_create_frame(engine, width, height, &slot->input, &slot->output, &slot->temp);
+        if (err != CL_SUCCESS)
+            return err;
+    }
+    return CL_SUCCESS;
+}
+
+void blur_stream_release(blur_stream* stream)
+{
+    // The frame buffers go back to the pool, so nothing may still be using them
+    cl_command_queue queues[3] = {stream->upload_queue, stream->compute_queue, stream->download_queue};
+    for (int i = 0; i < 3; i++)
+    {
+        if (queues[i])
+            clFinish(queues[i]);
+    }
+    for (int i = 0; i < stream->num_slots; i++)
+    {
+        blur_stream_slot* slot = &stream->slots[i];
+        blur_events_release(&slot->events);
+        ocl_runtime_recycle(stream->engine->rt, slot->input);
+        ocl_runtime_recycle(stream->engine->rt, slot->output);
+        ocl_runtime_recycle(stream->engine->rt, slot->temp);
+    }
+    if (stream->upload_queue)
+        clReleaseCommandQueue(stream->upload_queue);
+    if (stream->compute_queue)
+        clReleaseCommandQueue(stream->compute_queue);
+    if (stream->download_queue)
+        clReleaseCommandQueue(stream->download_queue);
+    memset(stream, 0, sizeof(*stream));
+}
+
+// Waits for the slot's previous frame and adds its stage times to the stats
+static void retire_slot(blur_stream* stream, blur_stream_slot* slot, int profiling, blur_stream_stats* stats)
+{
+    if (!slot->events.read_event)
+        return;
+    clWaitForEvents(1, &slot->events.read_event);
+    if (stream->profiler && profiling)
+        blur_events_record(&slot->events, stream->profiler, slot->frame);
+    if (stats && profiling)
+    {
+        stats->upload_time_sec += event_time_sec(slot->events.write_event);
+        stats->kernel_time_sec += blur_events_kernel_time(&slot->events);
+        stats->download_time_sec += event_time_sec(slot->events.read_event);
+    }
+    blur_events_release(&slot->events);
+}
+
+// Enqueues one frame into a free slot. The stages are linked by events across the queues:
+// the kernels wait for the upload, the download waits for the last kernel.
+static cl_int enqueue_frame(blur_stream* stream, blur_stream_slot* slot, const unsigned char* input, unsigned char* output)
+{
+    blur_events* events = &slot->events;
+
+    cl_int err = blur_engine_enqueue_write(stream->engine, stream->upload_queue, slot->input, stream->width, stream->height, input,
+                                           0, NULL, &events->write_event);
+    if (err != CL_SUCCESS)
+        return err;
+
+    cl_event upload_event = events->write_event;
+    err = blur_engine_enqueue(stream->engine, stream->compute_queue, slot->input, slot->output, slot->temp,
+                                     stream->width, stream->height, 1, &upload_event, events);
+    if (err != CL_SUCCESS)
+        return err;
+
+    err = blur_engine_enqueue_read(stream->engine, stream->download_queue, slot->output, stream->width, stream->height, output,
+                                   1, &events->kernel_events[events->num_kernel_events - 1], &events->read_event);
+    if (err != CL_SUCCESS)
+        return err;
+
+    // Submit now so the device starts on this frame while the host enqueues the next one
+    clFlush(stream->upload_queue);
+    clFlush(stream->compute_queue);
+    clFlush(stream->download_queue);
+    return CL_SUCCESS;
+}
+
+cl_int blur_stream_process(blur_stream* stream, const unsigned char* const* inputs, unsigned char* const* outputs,
+                           int num_frames, blur_stream_stats* stats)
+{
+    cl_int err = CL_SUCCESS;
+    cl_command_queue_properties properties = 0;
+    clGetCommandQueueInfo(stream->compute_queue, CL_QUEUE_PROPERTIES, sizeof(properties), &properties, NULL);
+    int profiling = (properties & CL_QUEUE_PROFILING_ENABLE) != 0;
+
+    if (stats)
+        memset(stats, 0, sizeof(*stats));
+    if (stream->profiler)
+    {
+        ocl_profiler_name_queue(stream->profiler, stream->upload_queue, "upload queue");
+        ocl_profiler_name_queue(stream->profiler, stream->compute_queue, "compute queue");
+        ocl_profiler_name_queue(stream->profiler, stream->download_queue, "download queue");
+    }
+
+    double start = wall_clock_sec();
+    for (int frame = 0; frame < num_frames; frame++)
+    {
+        blur_stream_slot* slot = &stream->slots[frame % stream->num_slots];
+        retire_slot(stream, slot, profiling, stats);
+        slot->frame = frame;
+        err = enqueue_frame(stream, slot, inputs[frame], outputs[frame]);
+        if (err != CL_SUCCESS)
+            break;
+    }
+
+    // Drain the slots still in flight
+    clFinish(stream->upload_queue);
+    clFinish(stream->compute_queue);
+    clFinish(stream->download_queue);
+    for (int i = 0; i < stream->num_slots; i++)
+        retire_slot(stream, &stream->slots[i], profiling, stats);
+
+    if (stats)
+    {
+        stats->num_frames = num_frames;
+        stats->wall_time_sec = wall_clock_sec() - start;
+    }
+    return err;
+}
@@ -0,0 +1,58 @@
+#ifndef BLUR_STREAM_H
+#define BLUR_STREAM_H
+
+#include <CL/cl.h>
+
+#include "blur_engine.h"
+#include "ocl_profiler.h"
+
+// Pipelined blur over a batch of frames. Uploads, kernels and downloads run on three in-order
+// queues linked by events, with num_slots buffer sets in flight, so the upload of frame N+1,
+// the kernels of frame N and the download of frame N-1 overlap.
+
+#define BLUR_STREAM_MAX_SLOTS 8
+
+typedef struct
+{
+    cl_mem input;
+    cl_mem output;
+    cl_mem temp;          // Separable intermediate (NULL for the 2D path)
+    blur_events events;   // Upload (write_event), kernels and download (read_event) of the slot's last frame
+    int frame;            // Index of that frame in the batch
+} blur_stream_slot;
+
+typedef struct
+{
+    blur_engine* engine;
+    cl_command_queue upload_queue;
+    cl_command_queue compute_queue;
+    cl_command_queue download_queue;
+    int width;
+    int height;
+    int num_slots;
+    blur_stream_slot slots[BLUR_STREAM_MAX_SLOTS];
+    ocl_profiler* profiler;  // Optional: set after init to record every command of every frame
+} blur_stream;
+
+typedef struct
+{
+    int num_frames;
+    double wall_time_sec;    // Host wall time from the first upload to the last download
+    double upload_time_sec;  // Summed device times per stage (profiling queues only)
+    double kernel_time_sec;
+    double download_time_sec;
+} blur_stream_stats;
+
+// Creates the three queues (with the runtime queue's properties) and num_slots buffer sets
+// (1..BLUR_STREAM_MAX_SLOTS; 3 gives full upload/compute/download overlap) for width x height frames.
+cl_int blur_stream_init(blur_stream* stream, blur_engine* engine, int width, int height, int num_slots);
+
+void blur_stream_release(blur_stream* stream);
+
+// Blurs inputs[i] into outputs[i] for every frame and returns when all downloads are done.
+// At most num_slots frames are in flight; the host only blocks when it needs a slot back.
+// The host arrays must stay valid until the call returns. stats is optional.
+cl_int blur_stream_process(blur_stream* stream, const unsigned char* const* inputs, unsigned char* const* outputs,
+                           int num_frames, blur_stream_stats* stats);
+
+#endif
@@ -0,0 +1,271 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "buffer_pool.h"
+#include "ocl_runtime.h"
+
+#define BUFFER_POOL_CLASSES_PER_OCTAVE 4
+
+
+
+static double wall_clock_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+size_t buffer_pool_class_size(size_t size)
+{
+    if (size <= BUFFER_POOL_MIN_CLASS)
+        return BUFFER_POOL_MIN_CLASS;
+
+    // octave < size <= 2 * octave, split into equal steps
+    size_t octave = BUFFER_POOL_MIN_CLASS;
+    while (octave * 2 < size)
+        octave *= 2;
+    size_t step = octave / BUFFER_POOL_CLASSES_PER_OCTAVE;
+    return (size + step - 1) / step * step;
+}
+
+size_t buffer_pool_alloc_size(const buffer_pool* pool, size_t size)
+{
+    size_t class_size = buffer_pool_class_size(size);
+    if (pool->max_alloc_size > 0 && class_size > pool->max_alloc_size)
+        return size;
+    return class_size;
+}
+
+void buffer_pool_init(buffer_pool* pool, cl_context context, size_t cache_limit, size_t max_alloc_size)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->context = context;
+    pool->cache_limit = cache_limit;
+    pool->max_alloc_size = max_alloc_size;
+    const char* env = getenv("OCL_BUFFER_POOL_MB");
+    if (env && env[0] != '\0')
+        pool->cache_limit = (size_t)strtoull(env, NULL, 10) * 1024 * 1024;
+    pthread_mutex_init(&pool->lock, NULL);
+}
+
+void buffer_pool_release(buffer_pool* pool)
+{
+    if (!pool->context)
+        return;
+    buffer_pool_trim(pool);
+    free(pool->in_use);
+    pthread_mutex_destroy(&pool->lock);
+    memset(pool, 0, sizeof(*pool));
+}
+
+// Takes the newest free buffer of (flags, size) off the free list, or returns NULL. Caller holds the lock.
+static cl_mem take_free(buffer_pool* pool, cl_mem_flags flags, size_t size)
+{
+    int best = -1;
+    for (int i = 0; i < pool->num_free; i++)
+    {
+        const buffer_pool_entry* entry = &pool->free_list[i];
+        if (entry->flags == flags && entry->size == size && (best < 0 || entry->stamp > pool->free_list[best].stamp))
+            best = i;
+    }
+    if (best < 0)
+        return NULL;
+    cl_mem buffer = pool->free_list[best].buffer;
+    pool->free_list[best] = pool->free_list[--pool->num_free];
+    pool->stats.bytes_cached -= size;
+    return buffer;
+}
+
+// Removes the oldest free buffer and returns it for the caller to release outside the lock
+static cl_mem evict_oldest(buffer_pool* pool)
+{
+    int oldest = 0;
+    for (int i = 1; i < pool->num_free; i++)
+    {
+        if (pool->free_list[i].stamp < pool->free_list[oldest].stamp)
+            oldest = i;
+    }
+    cl_mem buffer = pool->free_list[oldest].buffer;
+    pool->stats.bytes_cached -= pool->free_list[oldest].size;
+    pool->stats.evictions++;
+    pool->free_list[oldest] = pool->free_list[--pool->num_free];
+    return buffer;
+}
+
+// Records a handed-out buffer. Caller holds the lock. An untracked buffer (out of memory) is
+// released rather than recycled when it comes back, which is still correct.
+static void track_in_use(buffer_pool* pool, cl_mem buffer, cl_mem_flags flags, size_t size)
+{
+    if (pool->num_in_use == pool->in_use_capacity)
+    {
+        int capacity = (pool->in_use_capacity > 0) ? 2 * pool->in_use_capacity : 16;
+        buffer_pool_entry* entries = (buffer_pool_entry*)realloc(pool->in_use, capacity * sizeof(buffer_pool_entry));
+        if (!entries)
+            return;
+        pool->in_use = entries;
+        pool->in_use_capacity = capacity;
+    }
+    buffer_pool_entry* entry = &pool->in_use[pool->num_in_use++];
+    entry->buffer = buffer;
+    entry->flags = flags;
+    entry->size = size;
+    entry->stamp = 0;
+
+    buffer_pool_stats* stats = &pool->stats;
+    stats->bytes_in_use += size;
+    if (stats->bytes_in_use > stats->peak_bytes_in_use)
+        stats->peak_bytes_in_use = stats->bytes_in_use;
+    if (stats->bytes_in_use + stats->bytes_cached > stats->peak_bytes_allocated)
+        stats->peak_bytes_allocated = stats->bytes_in_use + stats->bytes_cached;
+}
+
+cl_mem buffer_pool_acquire(buffer_pool* pool, cl_mem_flags flags, size_t size, cl_int* err)
+{
+    if (flags & (CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR))
+    {
+        fprintf(stderr, "Error: Pooled buffers cannot use or copy host memory\n");
+        if (err)
+            *err = CL_INVALID_VALUE;
+        return NULL;
+    }
+    size_t alloc_size = buffer_pool_alloc_size(pool, size);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stats.requests++;
+    cl_mem buffer = take_free(pool, flags, alloc_size);
+    if (buffer)
+    {
+        pool->stats.hits++;
+        track_in_use(pool, buffer, flags, alloc_size);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if (buffer)
+    {
+        if (err)
+            *err = CL_SUCCESS;
+        return buffer;
+    }
+
+    // A miss: create outside the lock. When the device is out of memory, the free buffers of other
+    // classes are given back and the allocation is tried once more.
+    cl_int status;
+    double start = wall_clock_sec();
+    buffer = clCreateBuffer(pool->context, flags, alloc_size, NULL, &status);
+    if (!buffer && (status == CL_MEM_OBJECT_ALLOCATION_FAILURE || status == CL_OUT_OF_RESOURCES) && pool->num_free > 0)
+    {
+        buffer_pool_trim(pool);
+        buffer = clCreateBuffer(pool->context, flags, alloc_size, NULL, &status);
+    }
+    double elapsed = wall_clock_sec() - start;
+    if (err)
+        *err = status;
+    if (!buffer)
+    {
+        fprintf(stderr, "Error: Could not create a %zu byte buffer: %s (%d)\n", alloc_size, ocl_error_string(status), status);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stats.misses++;
+    pool->stats.create_sec += elapsed;
+    if (elapsed > pool->stats.max_create_sec)
+        pool->stats.max_create_sec = elapsed;
+    track_in_use(pool, buffer, flags, alloc_size);
+    pthread_mutex_unlock(&pool->lock);
+    return buffer;
+}
+
+void buffer_pool_recycle(buffer_pool* pool, cl_mem buffer)
+{
+    if (!buffer)
+        return;
+    if (!pool->context)
+    {
+        clReleaseMemObject(buffer);
+        return;
+    }
+
+    cl_mem evicted[BUFFER_POOL_MAX_FREE + 1];
+    int num_evicted = 0;
+    pthread_mutex_lock(&pool->lock);
+    int index = -1;
+    for (int i = pool->num_in_use - 1; i >= 0; i--)
+    {
+        if (pool->in_use[i].buffer == buffer)
+        {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0)
+    {
+        evicted[num_evicted++] = buffer;
+    }
+    else
+    {
+        buffer_pool_entry entry = pool->in_use[index];
+        pool->in_use[index] = pool->in_use[--pool->num_in_use];
+        pool->stats.bytes_in_use -= entry.size;
+        if (entry.size > pool->cache_limit)
+        {
+            evicted[num_evicted++] = buffer;
+        }
+        else
+        {
+            while (pool->num_free > 0 && (pool->num_free == BUFFER_POOL_MAX_FREE || pool->stats.bytes_cached + entry.size > pool->cache_limit))
+                evicted[num_evicted++] = evict_oldest(pool);
+            entry.stamp = ++pool->next_stamp;
+            pool->free_list[pool->num_free++] = entry;
+            pool->stats.bytes_cached += entry.size;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < num_evicted; i++)
+        clReleaseMemObject(evicted[i]);
+}
+
+void buffer_pool_trim(buffer_pool* pool)
+{
+    cl_mem evicted[BUFFER_POOL_MAX_FREE];
+    pthread_mutex_lock(&pool->lock);
+    int num_evicted = pool->num_free;
+    for (int i = 0; i < num_evicted; i++)
+        evicted[i] = pool->free_list[i].buffer;
+    pool->num_free = 0;
+    pool->stats.bytes_cached = 0;
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < num_evicted; i++)
+        clReleaseMemObject(evicted[i]);
+}
+
+void buffer_pool_get_stats(buffer_pool* pool, buffer_pool_stats* stats)
+{
+    if (!pool->context)
+    {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    *stats = pool->stats;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void buffer_pool_print_stats(buffer_pool* pool)
+{
+    buffer_pool_stats stats;
+    buffer_pool_get_stats(pool, &stats);
+    double hit_rate = (stats.requests > 0) ? (100.0 * stats.hits) / stats.requests : 0.0;
+    printf("Buffer pool requests                                : %llu (%llu hits, %llu misses, %.1f%% hit rate)\n",
+           stats.requests, stats.hits, stats.misses, hit_rate);
+    printf("Buffer pool high-water mark                         : %.2f MB in use, %.2f MB allocated\n",
+           stats.peak_bytes_in_use / (1024.0 * 1024.0), stats.peak_bytes_allocated / (1024.0 * 1024.0));
+    printf("Buffer pool cache                                   : %.2f MB free, %llu eviction(s)\n",
+           stats.bytes_cached / (1024.0 * 1024.0), stats.evictions);
+    printf("Time in clCreateBuffer                              : %f seconds (slowest %f seconds)\n",
+           stats.create_sec, stats.max_create_sec);
+}
@@ -0,0 +1,91 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include <CL/cl.h>
+
+// Recycles cl_mem buffers of one context between requests, so a long-running process stops paying
+// clCreateBuffer (and device allocator churn) on every frame. Sizes are rounded up to size classes,
+// four per power of two from BUFFER_POOL_MIN_CLASS, so at most a quarter of a buffer is slack.
+// A class above the device's largest allocation falls back to the exact size, so any request the
+// device takes is still created.
+// A recycled buffer goes to a free list keyed by (flags, class) and is handed out again by the next
+// acquire of that class. Free buffers beyond the cache limit are released, oldest first.
+// Device buffers and pinned host buffers (CL_MEM_ALLOC_HOST_PTR) are pooled alike; buffers that wrap
+// caller memory (CL_MEM_USE_HOST_PTR, CL_MEM_COPY_HOST_PTR) are not.
+// OCL_BUFFER_POOL_MB sets the cache limit; 0 turns reuse off (every acquire creates a buffer).
+
+#define BUFFER_POOL_MIN_CLASS 4096
+#define BUFFER_POOL_DEFAULT_CACHE_MB 256
+#define BUFFER_POOL_MAX_FREE 64
+
+typedef struct
+{
+    cl_mem buffer;
+    cl_mem_flags flags;
+    size_t size;                    // Class size, the size the buffer was created with
+    unsigned long long stamp;       // Recycle order, for evicting the oldest first
+} buffer_pool_entry;
+
+typedef struct
+{
+    unsigned long long requests;
+    unsigned long long hits;        // Served from a free list
+    unsigned long long misses;      // Needed clCreateBuffer
+    unsigned long long evictions;   // Free buffers released to stay under the cache limit
+    size_t bytes_in_use;            // Handed out and not recycled yet
+    size_t peak_bytes_in_use;
+    size_t bytes_cached;            // On the free lists
+    size_t peak_bytes_allocated;    // High-water mark of in use + cached, the pool's device footprint
+    double create_sec;              // Time spent in clCreateBuffer
+    double max_create_sec;          // Slowest single clCreateBuffer
+} buffer_pool_stats;
+
+typedef struct
+{
+    cl_context context;
+    size_t cache_limit;             // Bytes kept on the free lists
+    size_t max_alloc_size;          // CL_DEVICE_MAX_MEM_ALLOC_SIZE (0: no limit)
+    pthread_mutex_t lock;
+
+    buffer_pool_entry free_list[BUFFER_POOL_MAX_FREE];
+    int num_free;
+    buffer_pool_entry* in_use;      // Buffers handed out, so recycle can tell pooled buffers from others
+    int num_in_use;
+    int in_use_capacity;
+    unsigned long long next_stamp;
+    buffer_pool_stats stats;
+} buffer_pool;
+
+// Size a request of size bytes is rounded up to
+size_t buffer_pool_class_size(size_t size);
+
+// Size buffer_pool_acquire creates for a request of size bytes: the class size, or size itself when
+// the class is above max_alloc_size. Memory budgets should count this rather than size.
+size_t buffer_pool_alloc_size(const buffer_pool* pool, size_t size);
+
+// cache_limit is in bytes; OCL_BUFFER_POOL_MB overrides it when set
+void buffer_pool_init(buffer_pool* pool, cl_context context, size_t cache_limit, size_t max_alloc_size);
+
+// Releases the free buffers. Buffers still handed out stay valid and are released by their holders.
+void buffer_pool_release(buffer_pool* pool);
+
+// Returns a buffer of at least size bytes, reused when one of its class is free.
+// flags must not contain CL_MEM_USE_HOST_PTR or CL_MEM_COPY_HOST_PTR. Returns NULL on error.
+cl_mem buffer_pool_acquire(buffer_pool* pool, cl_mem_flags flags, size_t size, cl_int* err);
+
+// Hands a buffer back for reuse. Commands that use it must have completed, or be on the in-order queue
+// that its next user enqueues to. Objects the pool did not hand out (images, buffers from
+// ocl_runtime_buffer) are released instead. NULL is ignored.
+void buffer_pool_recycle(buffer_pool* pool, cl_mem buffer);
+
+// Releases every free buffer
+void buffer_pool_trim(buffer_pool* pool);
+
+void buffer_pool_get_stats(buffer_pool* pool, buffer_pool_stats* stats);
+
+// Prints requests, hit rate, high-water marks and clCreateBuffer time
+void buffer_pool_print_stats(buffer_pool* pool);
+
+#endif
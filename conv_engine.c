@@ -0,0 +1,574 @@
+// Standard includes
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "conv_engine.h"
+
+// Taps the separable path must save before it wins: its second pass writes and reads a float intermediate
+#define CONV_SEPARABLE_PASS_COST 4
+#define CONV_MEASURE_REPEATS 3
+
+
+
+void conv_emit(conv_source* text, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int needed = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (text->length + needed + 1 > text->capacity)
+    {
+        size_t capacity = text->capacity ? text->capacity : 4096;
+        while (text->length + needed + 1 > capacity)
+            capacity *= 2;
+        text->data = (char*)realloc(text->data, capacity);
+        text->capacity = capacity;
+    }
+    va_start(args, format);
+    vsnprintf(text->data + text->length, needed + 1, format, args);
+    va_end(args);
+    text->length += needed;
+}
+
+void conv_emit_pixel_types(conv_source* text, int channels)
+{
+    if (channels == 4)
+    {
+        conv_emit(text, "typedef float4 pixel_t;\n"
+                        "#define LOAD_PIXEL(p, i) convert_float4(vload4((i), (p)))\n"
+                        "#define STORE_PIXEL(v, p, i) vstore4(convert_uchar4_sat(v), (i), (p))\n"
+                        "#define LOAD_SUM(p, i) vload4((i), (p))\n"
+                        "#define STORE_SUM(v, p, i) vstore4((v), (i), (p))\n"
+                        "#define QUANTIZE(v) convert_float4(convert_uchar4_sat(v))\n");
+    }
+    else if (channels == 3)
+    {
+        conv_emit(text, "typedef float3 pixel_t;\n"
+                        "#define LOAD_PIXEL(p, i) convert_float3(vload3((i), (p)))\n"
+                        "#define STORE_PIXEL(v, p, i) vstore3(convert_uchar3_sat(v), (i), (p))\n"
+                        "#define LOAD_SUM(p, i) vload3((i), (p))\n"
+                        "#define STORE_SUM(v, p, i) vstore3((v), (i), (p))\n"
+                        "#define QUANTIZE(v) convert_float3(convert_uchar3_sat(v))\n");
+    }
+    else
+    {
+        conv_emit(text, "typedef float pixel_t;\n"
+                        "#define LOAD_PIXEL(p, i) ((float)(p)[i])\n"
+                        "#define STORE_PIXEL(v, p, i) ((p)[i] = convert_uchar_sat(v))\n"
+                        "#define LOAD_SUM(p, i) ((p)[i])\n"
+                        "#define STORE_SUM(v, p, i) ((p)[i] = (v))\n"
+                        "#define QUANTIZE(v) convert_float(convert_uchar_sat(v))\n");
+    }
+    conv_emit(text, "\n");
+}
+
+static void emit_prelude(conv_source* text, const conv_filter* filter, int channels, int separable, int use_local_tile)
+{
+    conv_emit(text, "// Generated for filter \"%s\": radius %d, %s path, %s\n", filter->name, filter->radius,
+              separable ? "separable" : "2D", use_local_tile ? "local memory tiles" : "direct global reads");
+    conv_emit(text, "#pragma OPENCL FP_CONTRACT OFF\n");
+    conv_emit(text, "#define R %d\n\n", filter->radius);
+    conv_emit_pixel_types(text, channels);
+}
+
+// sum + bias, absolute value for edge filters, then the saturating (truncating) store
+static void emit_store_result(conv_source* text, const conv_filter* filter)
+{
+    if (filter->bias != 0.0f)
+        conv_emit(text, "    sum += %.9ef;\n", filter->bias);
+    if (filter->output == CONV_OUTPUT_ABS)
+        conv_emit(text, "    sum = fabs(sum);\n");
+    conv_emit(text, "    STORE_PIXEL(sum, output, (y * width) + x);\n}\n\n");
+}
+
+// The work-group's block plus R pixels of halo on every side, edges clamped
+static void emit_tile_load_2d(conv_source* text)
+{
+    conv_emit(text, "    int tile_width = group_width + (2 * R);\n"
+                    "    int tile_height = group_height + (2 * R);\n"
+                    "    int tile_x = (get_group_id(0) * group_width) - R;\n"
+                    "    int tile_y = (get_group_id(1) * group_height) - R;\n"
+                    "    for (int ty = ly; ty < tile_height; ty += group_height)\n"
+                    "    {\n"
+                    "        int iy = clamp(tile_y + ty, 0, height - 1);\n"
+                    "        for (int tx = lx; tx < tile_width; tx += group_width)\n"
+                    "            tile[(ty * tile_width) + tx] = LOAD_PIXEL(input, (iy * width) + clamp(tile_x + tx, 0, width - 1));\n"
+                    "    }\n"
+                    "    barrier(CLK_LOCAL_MEM_FENCE);\n");
+}
+
+static void emit_kernel_header(conv_source* text, const char* name, const char* input_type, const char* output_type, int use_local_tile)
+{
+    conv_emit(text, "__kernel void %s(__global const %s* input, __global %s* output, int width, int height%s)\n{\n", name, input_type,
+              output_type, use_local_tile ? ", __local pixel_t* tile" : "");
+    conv_emit(text, "    int x = get_global_id(0);\n"
+                    "    int y = get_global_id(1);\n"
+                    "    int lx = get_local_id(0);\n"
+                    "    int ly = get_local_id(1);\n"
+                    "    int group_width = get_local_size(0);\n"
+                    "    int group_height = get_local_size(1);\n");
+}
+
+static void emit_2d_kernel(conv_source* text, const conv_filter* filter, int use_local_tile)
+{
+    int size = filter->size;
+    emit_kernel_header(text, "conv_2d", "uchar", "uchar", use_local_tile);
+    if (use_local_tile)
+    {
+        emit_tile_load_2d(text);
+        conv_emit(text, "    if (x >= width || y >= height)\n        return;\n\n");
+        conv_emit(text, "    __local const pixel_t* window = tile + (ly * tile_width) + lx;\n");
+    }
+    else
+    {
+        conv_emit(text, "    if (x >= width || y >= height)\n        return;\n\n");
+        conv_emit(text, "    int rows[%d], cols[%d];\n", size, size);
+        conv_emit(text, "    for (int k = 0; k < %d; k++)\n    {\n"
+                        "        rows[k] = clamp(y + k - R, 0, height - 1) * width;\n"
+                        "        cols[k] = clamp(x + k - R, 0, width - 1);\n    }\n", size);
+    }
+
+    // One statement per non-zero tap, in row-major order
+    conv_emit(text, "    pixel_t sum = 0.0f;\n");
+    for (int ky = 0; ky < size; ky++)
+    {
+        for (int kx = 0; kx < size; kx++)
+        {
+            float weight = filter->mask[(ky * size) + kx];
+            if (weight == 0.0f)
+                continue;
+            if (use_local_tile)
+                conv_emit(text, "    sum += window[(%d * tile_width) + %d] * %.9ef;\n", ky, kx, weight);
+            else
+                conv_emit(text, "    sum += LOAD_PIXEL(input, rows[%d] + cols[%d]) * %.9ef;\n", ky, kx, weight);
+        }
+    }
+    emit_store_result(text, filter);
+}
+
+// Pass 1: rows of uchar pixels into the float intermediate
+static void emit_horizontal_kernel(conv_source* text, const conv_filter* filter, int use_local_tile)
+{
+    emit_kernel_header(text, "conv_horizontal", "uchar", "float", use_local_tile);
+    if (use_local_tile)
+    {
+        conv_emit(text, "    int tile_width = group_width + (2 * R);\n"
+                        "    int tile_x = (get_group_id(0) * group_width) - R;\n"
+                        "    int iy = min(y, height - 1);\n"
+                        "    for (int i = lx; i < tile_width; i += group_width)\n"
+                        "        tile[(ly * tile_width) + i] = LOAD_PIXEL(input, (iy * width) + clamp(tile_x + i, 0, width - 1));\n"
+                        "    barrier(CLK_LOCAL_MEM_FENCE);\n");
+    }
+    conv_emit(text, "    if (x >= width || y >= height)\n        return;\n\n");
+    conv_emit(text, use_local_tile ? "    __local const pixel_t* window = tile + (ly * tile_width) + lx;\n" : "    int row = y * width;\n");
+    conv_emit(text, "    pixel_t sum = 0.0f;\n");
+    for (int k = 0; k < filter->size; k++)
+    {
+        float weight = filter->row_weights[k];
+        if (weight == 0.0f)
+            continue;
+        if (use_local_tile)
+            conv_emit(text, "    sum += window[%d] * %.9ef;\n", k, weight);
+        else
+            conv_emit(text, "    sum += LOAD_PIXEL(input, row + clamp(x %c %d, 0, width - 1)) * %.9ef;\n", (k < filter->radius) ? '-' : '+',
+                      abs(k - filter->radius), weight);
+    }
+    conv_emit(text, "    STORE_SUM(sum, output, (y * width) + x);\n}\n\n");
+}
+
+// Pass 2: columns of the float intermediate into uchar pixels
+static void emit_vertical_kernel(conv_source* text, const conv_filter* filter, int use_local_tile)
+{
+    emit_kernel_header(text, "conv_vertical", "float", "uchar", use_local_tile);
+    if (use_local_tile)
+    {
+        conv_emit(text, "    int tile_height = group_height + (2 * R);\n"
+                        "    int tile_y = (get_group_id(1) * group_height) - R;\n"
+                        "    int ix = min(x, width - 1);\n"
+                        "    for (int i = ly; i < tile_height; i += group_height)\n"
+                        "        tile[(i * group_width) + lx] = LOAD_SUM(input, (clamp(tile_y + i, 0, height - 1) * width) + ix);\n"
+                        "    barrier(CLK_LOCAL_MEM_FENCE);\n");
+    }
+    conv_emit(text, "    if (x >= width || y >= height)\n        return;\n\n");
+    if (use_local_tile)
+        conv_emit(text, "    __local const pixel_t* window = tile + (ly * group_width) + lx;\n");
+    conv_emit(text, "    pixel_t sum = 0.0f;\n");
+    for (int k = 0; k < filter->size; k++)
+    {
+        float weight = filter->col_weights[k];
+        if (weight == 0.0f)
+            continue;
+        if (use_local_tile)
+            conv_emit(text, "    sum += window[%d * group_width] * %.9ef;\n", k, weight);
+        else
+            conv_emit(text, "    sum += LOAD_SUM(input, (clamp(y %c %d, 0, height - 1) * width) + x) * %.9ef;\n", (k < filter->radius) ? '-' : '+',
+                      abs(k - filter->radius), weight);
+    }
+    emit_store_result(text, filter);
+}
+
+char* conv_engine_generate_source(const conv_filter* filter, int channels, int separable, int use_local_tile)
+{
+    conv_source text = {NULL, 0, 0};
+    emit_prelude(&text, filter, channels, separable, use_local_tile);
+    if (separable)
+    {
+        emit_horizontal_kernel(&text, filter, use_local_tile);
+        emit_vertical_kernel(&text, filter, use_local_tile);
+    }
+    else
+    {
+        emit_2d_kernel(&text, filter, use_local_tile);
+    }
+    return text.data;
+}
+
+static size_t round_up(size_t value, size_t multiple)
+{
+    return ((value + multiple - 1) / multiple) * multiple;
+}
+
+// FNV-1a, to give every generated source its own name in the program registry
+static unsigned long long source_hash(const char* source)
+{
+    unsigned long long hash = 1469598103934665603ULL;
+    for (const char* p = source; *p; p++)
+    {
+        hash ^= (unsigned char)*p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Local memory of the tiles of the current path for an lx x ly work-group
+static size_t tile_bytes(const conv_engine* engine, size_t lx, size_t ly)
+{
+    size_t r2 = 2 * engine->filter->radius;
+    if (!engine->use_local_tile)
+        return 0;
+    if (engine->separable)
+    {
+        size_t horizontal = (lx + r2) * ly;
+        size_t vertical = lx * (ly + r2);
+        return ((horizontal > vertical) ? horizontal : vertical) * engine->tile_element_size;
+    }
+    return (lx + r2) * (ly + r2) * engine->tile_element_size;
+}
+
+static int kernel_accepts(conv_engine* engine, cl_kernel kernel, size_t group_size)
+{
+    size_t limit = 0;
+    if (!kernel)
+        return 1;
+    if (clGetKernelWorkGroupInfo(kernel, engine->rt->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(limit), &limit, NULL) != CL_SUCCESS)
+        return 1;
+    return group_size <= limit;
+}
+
+static int local_size_fits(conv_engine* engine, size_t lx, size_t ly)
+{
+    size_t group_size = lx * ly;
+    if (group_size == 0 || group_size > engine->rt->max_work_group_size)
+        return 0;
+    if (tile_bytes(engine, lx, ly) > engine->rt->local_mem_size)
+        return 0;
+    if (engine->separable)
+        return kernel_accepts(engine, engine->kernel_horizontal, group_size) && kernel_accepts(engine, engine->kernel_vertical, group_size);
+    return kernel_accepts(engine, engine->kernel_2d, group_size);
+}
+
+// Gives the current path's program and kernels back to the runtime registry
+static void release_kernels(conv_engine* engine)
+{
+    ocl_runtime_release_kernel(engine->rt, engine->kernel_2d);
+    ocl_runtime_release_kernel(engine->rt, engine->kernel_horizontal);
+    ocl_runtime_release_kernel(engine->rt, engine->kernel_vertical);
+    ocl_runtime_release_program(engine->rt, engine->program);
+    engine->kernel_2d = NULL;
+    engine->kernel_horizontal = NULL;
+    engine->kernel_vertical = NULL;
+    engine->program = NULL;
+}
+
+static cl_int build_kernels(conv_engine* engine)
+{
+    cl_int err;
+    char name[CONV_FILTER_NAME_LEN + 32];
+    free(engine->source);
+    engine->source = conv_engine_generate_source(engine->filter, engine->channels, engine->separable, engine->use_local_tile);
+    snprintf(name, sizeof(name), "conv_%s_%016llx", engine->filter->name, source_hash(engine->source));
+
+    // The previous path is given back after the new program is taken, so reselecting it does not rebuild
+    cl_program program = ocl_runtime_program(engine->rt, name, engine->source, "", &err);
+    if (!program)
+        return err;
+    release_kernels(engine);
+    engine->program = program;
+    if (engine->separable)
+    {
+        engine->kernel_horizontal = ocl_runtime_kernel(engine->rt, engine->program, "conv_horizontal", &err);
+        if (!engine->kernel_horizontal)
+            return err;
+        engine->kernel_vertical = ocl_runtime_kernel(engine->rt, engine->program, "conv_vertical", &err);
+        if (!engine->kernel_vertical)
+            return err;
+    }
+    else
+    {
+        engine->kernel_2d = ocl_runtime_kernel(engine->rt, engine->program, "conv_2d", &err);
+        if (!engine->kernel_2d)
+            return err;
+    }
+    return CL_SUCCESS;
+}
+
+// Switches to the 2D or separable path: local memory tiles when an 8x8 block and its halo fit, then the
+// largest square work-group up to 16x16 that the device and the kernels take
+static cl_int select_path(conv_engine* engine, int separable)
+{
+    engine->separable = separable;
+    engine->use_local_tile = 1;
+    if (tile_bytes(engine, 8, 8) > engine->rt->local_mem_size)
+        engine->use_local_tile = 0;
+
+    cl_int err = build_kernels(engine);
+    if (err != CL_SUCCESS)
+        return err;
+    engine->local_work_size[0] = 16;
+    engine->local_work_size[1] = 16;
+    while (!local_size_fits(engine, engine->local_work_size[0], engine->local_work_size[1]) && engine->local_work_size[0] > 1)
+    {
+        engine->local_work_size[0] /= 2;
+        engine->local_work_size[1] /= 2;
+    }
+    return CL_SUCCESS;
+}
+
+cl_int conv_engine_init(conv_engine* engine, ocl_runtime* rt, const conv_filter* filter, int channels, conv_strategy strategy)
+{
+    memset(engine, 0, sizeof(*engine));
+    engine->rt = rt;
+    engine->filter = filter;
+    engine->channels = (channels > 1) ? channels : 1;
+    if (engine->channels != 1 && engine->channels != 3 && engine->channels != 4)
+    {
+        fprintf(stderr, "Error: Unsupported channel count %d (use 1, 3 or 4)\n", engine->channels);
+        return CL_INVALID_VALUE;
+    }
+    // float3 takes the space of a float4 in local memory
+    engine->tile_element_size = (engine->channels == 1) ? sizeof(cl_float) : sizeof(cl_float4);
+
+    int separable = 0;
+    if (strategy == CONV_STRATEGY_SEPARABLE)
+    {
+        separable = filter->separable;
+        if (!separable)
+            printf("Filter %s is not separable, using the 2D path\n", filter->name);
+    }
+    else if (strategy != CONV_STRATEGY_2D)
+    {
+        separable = filter->separable && conv_filter_separable_taps(filter) + CONV_SEPARABLE_PASS_COST < conv_filter_taps(filter);
+    }
+    return select_path(engine, separable);
+}
+
+void conv_engine_release(conv_engine* engine)
+{
+    release_kernels(engine);
+    ocl_runtime_recycle(engine->rt, engine->input_buffer);
+    ocl_runtime_recycle(engine->rt, engine->output_buffer);
+    ocl_runtime_recycle(engine->rt, engine->temp_buffer);
+    free(engine->source);
+    memset(engine, 0, sizeof(*engine));
+}
+
+cl_int conv_engine_reserve(conv_engine* engine, int width, int height)
+{
+    cl_int err;
+    size_t pixels = (size_t)width * height;
+    if (pixels > engine->buffer_pixels)
+    {
+        ocl_runtime_recycle(engine->rt, engine->input_buffer);
+        ocl_runtime_recycle(engine->rt, engine->output_buffer);
+        engine->output_buffer = NULL;
+        engine->buffer_pixels = 0;
+        engine->input_buffer = ocl_runtime_acquire(engine->rt, CL_MEM_READ_ONLY, pixels * engine->channels * sizeof(cl_uchar), &err);
+        if (!engine->input_buffer)
+            return err;
+        engine->output_buffer = ocl_runtime_acquire(engine->rt, CL_MEM_WRITE_ONLY, pixels * engine->channels * sizeof(cl_uchar), &err);
+        if (!engine->output_buffer)
+            return err;
+        engine->buffer_pixels = pixels;
+    }
+    if (engine->separable && pixels > engine->temp_pixels)
+    {
+        ocl_runtime_recycle(engine->rt, engine->temp_buffer);
+        engine->temp_pixels = 0;
+        engine->temp_buffer = ocl_runtime_acquire(engine->rt, CL_MEM_READ_WRITE, pixels * engine->channels * sizeof(cl_float), &err);
+        if (!engine->temp_buffer)
+            return err;
+        engine->temp_pixels = pixels;
+    }
+    return CL_SUCCESS;
+}
+
+static cl_int set_frame_args(cl_kernel kernel, cl_mem input, cl_mem output, int width, int height, size_t local_bytes)
+{
+    OCL_CHECK(clSetKernelArg(kernel, 0, sizeof(cl_mem), &input));
+    OCL_CHECK(clSetKernelArg(kernel, 1, sizeof(cl_mem), &output));
+    OCL_CHECK(clSetKernelArg(kernel, 2, sizeof(int), &width));
+    OCL_CHECK(clSetKernelArg(kernel, 3, sizeof(int), &height));
+    if (local_bytes)
+        OCL_CHECK(clSetKernelArg(kernel, 4, local_bytes, NULL));
+    return CL_SUCCESS;
+}
+
+cl_int conv_engine_enqueue(conv_engine* engine, cl_command_queue queue, cl_mem input, cl_mem output, cl_mem temp,
+                           int width, int height, cl_uint num_wait_events, const cl_event* wait_events, blur_events* events)
+{
+    cl_int err;
+    size_t* local = engine->local_work_size;
+    size_t global_work_size[2] = {round_up(width, local[0]), round_up(height, local[1])};
+    size_t r2 = 2 * engine->filter->radius;
+    cl_event* first_event = events ? &events->kernel_events[0] : NULL;
+    cl_event* second_event = events ? &events->kernel_events[1] : NULL;
+
+    if (engine->separable)
+    {
+        cl_event horizontal_event;
+        size_t horizontal_tile = engine->use_local_tile ? (local[0] + r2) * local[1] * engine->tile_element_size : 0;
+        size_t vertical_tile = engine->use_local_tile ? local[0] * (local[1] + r2) * engine->tile_element_size : 0;
+        err = set_frame_args(engine->kernel_horizontal, input, temp, width, height, horizontal_tile);
+        if (err != CL_SUCCESS)
+            return err;
+        err = set_frame_args(engine->kernel_vertical, temp, output, width, height, vertical_tile);
+        if (err != CL_SUCCESS)
+            return err;
+
+        OCL_CHECK(clEnqueueNDRangeKernel(queue, engine->kernel_horizontal, 2, NULL, global_work_size, local, num_wait_events, wait_events, &horizontal_event));
+        err = clEnqueueNDRangeKernel(queue, engine->kernel_vertical, 2, NULL, global_work_size, local, 1, &horizontal_event, second_event);
+        if (first_event)
+            *first_event = horizontal_event;
+        else
+            clReleaseEvent(horizontal_event);
+        if (err != CL_SUCCESS)
+        {
+            ocl_report_error("clEnqueueNDRangeKernel(conv_vertical)", err, __FILE__, __LINE__);
+            return err;
+        }
+        if (events)
+            events->num_kernel_events = 2;
+    }
+    else
+    {
+        err = set_frame_args(engine->kernel_2d, input, output, width, height, tile_bytes(engine, local[0], local[1]));
+        if (err != CL_SUCCESS)
+            return err;
+        OCL_CHECK(clEnqueueNDRangeKernel(queue, engine->kernel_2d, 2, NULL, global_work_size, local, num_wait_events, wait_events, first_event));
+        if (events)
+            events->num_kernel_events = 1;
+    }
+    return CL_SUCCESS;
+}
+
+cl_int conv_engine_run(conv_engine* engine, const unsigned char* input, unsigned char* output, int width, int height, blur_events* events)
+{
+    cl_command_queue queue = engine->rt->queue;
+    size_t image_bytes = (size_t)width * height * engine->channels * sizeof(cl_uchar);
+    blur_events local_events;
+    blur_events* ev = events ? events : &local_events;
+    memset(ev, 0, sizeof(*ev));
+
+    cl_int err = conv_engine_reserve(engine, width, height);
+    if (err != CL_SUCCESS)
+        return err;
+
+    OCL_CHECK_GOTO(clEnqueueWriteBuffer(queue, engine->input_buffer, CL_FALSE, 0, image_bytes, input, 0, NULL, &ev->write_event), err, done);
+    err = conv_engine_enqueue(engine, queue, engine->input_buffer, engine->output_buffer, engine->temp_buffer,
+                              width, height, 1, &ev->write_event, ev);
+    if (err != CL_SUCCESS)
+        goto done;
+    OCL_CHECK_GOTO(clEnqueueReadBuffer(queue, engine->output_buffer, CL_FALSE, 0, image_bytes, output,
+                                       1, &ev->kernel_events[ev->num_kernel_events - 1], &ev->read_event), err, done);
+    OCL_CHECK_GOTO(clWaitForEvents(1, &ev->read_event), err, done);
+
+done:
+    if (!events || err != CL_SUCCESS)
+    {
+        // Drain whatever was enqueued before dropping the events
+        clFinish(queue);
+        blur_events_release(ev);
+    }
+    return err;
+}
+
+static double wall_clock_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+// Best of CONV_MEASURE_REPEATS runs of the current path on the frame already on the device
+static cl_int time_path(conv_engine* engine, int width, int height, int profiling, double* best)
+{
+    cl_command_queue queue = engine->rt->queue;
+    *best = 0.0;
+    for (int i = 0; i < CONV_MEASURE_REPEATS; i++)
+    {
+        blur_events events;
+        memset(&events, 0, sizeof(events));
+        double start = wall_clock_sec();
+        cl_int err = conv_engine_enqueue(engine, queue, engine->input_buffer, engine->output_buffer, engine->temp_buffer,
+                                         width, height, 0, NULL, &events);
+        if (err == CL_SUCCESS)
+            err = clFinish(queue);
+        double elapsed = wall_clock_sec() - start;
+        if (err == CL_SUCCESS && profiling)
+            elapsed = blur_events_kernel_time(&events);
+        blur_events_release(&events);
+        if (err != CL_SUCCESS)
+            return err;
+        if (i == 0 || elapsed < *best)
+            *best = elapsed;
+    }
+    return CL_SUCCESS;
+}
+
+cl_int conv_engine_measure(conv_engine* engine, int width, int height, int verbose)
+{
+    ocl_runtime* rt = engine->rt;
+    double times[2] = {0.0, 0.0};
+    int num_paths = engine->filter->separable ? 2 : 1;
+    cl_command_queue_properties properties = 0;
+    clGetCommandQueueInfo(rt->queue, CL_QUEUE_PROPERTIES, sizeof(properties), &properties, NULL);
+    int profiling = (properties & CL_QUEUE_PROFILING_ENABLE) != 0;
+
+    // Noise frame: the data does not change the timing
+    size_t frame_bytes = (size_t)width * height * engine->channels;
+    unsigned char* frame = (unsigned char*)malloc(frame_bytes);
+    for (size_t i = 0; i < frame_bytes; i++)
+        frame[i] = (unsigned char)(rand() % 256);
+
+    cl_int err = CL_SUCCESS;
+    for (int path = 0; path < num_paths && err == CL_SUCCESS; path++)
+    {
+        err = select_path(engine, path);
+        if (err == CL_SUCCESS)
+            err = conv_engine_reserve(engine, width, height);
+        if (err == CL_SUCCESS && path == 0)
+            err = clEnqueueWriteBuffer(rt->queue, engine->input_buffer, CL_TRUE, 0, frame_bytes, frame, 0, NULL, NULL);
+        if (err == CL_SUCCESS)
+            err = time_path(engine, width, height, profiling, &times[path]);
+        if (err == CL_SUCCESS && verbose)
+            printf("  %-10s (%2d taps) : %f seconds\n", path ? "separable" : "2d",
+                   path ? conv_filter_separable_taps(engine->filter) : conv_filter_taps(engine->filter), times[path]);
+    }
+    free(frame);
+    if (err != CL_SUCCESS)
+        return err;
+    return select_path(engine, num_paths == 2 && times[1] < times[0]);
+}
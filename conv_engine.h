@@ -0,0 +1,93 @@
+#ifndef CONV_ENGINE_H
+#define CONV_ENGINE_H
+
+#include <CL/cl.h>
+
+#include "ocl_runtime.h"
+#include "conv_filter.h"
+#include "blur_engine.h"
+
+// Device convolution engine for any conv_filter. OpenCL source is generated per filter with the radius
+// and every non-zero weight baked in as constants, so each tap is one unrolled multiply-add and zero
+// taps (half of a Sobel mask) cost nothing. Separable filters can run as a horizontal pass into a
+// float intermediate and a vertical pass; the generated kernels stage each work-group's pixels plus
+// the halo in local memory, or read global memory directly when the tile does not fit.
+// Programs go through the runtime registry and the binary cache like the Gaussian kernels, and the
+// buffer handling and events follow blur_engine (blur_events is reused for profiling).
+// The generated code disables FP contraction, so the 2D path matches conv_filter_apply_host exactly.
+
+typedef enum
+{
+    CONV_STRATEGY_AUTO,        // Cost model on the tap counts (the separable path pays for its extra pass)
+    CONV_STRATEGY_2D,          // Always the full 2D kernel
+    CONV_STRATEGY_SEPARABLE,   // Two 1D passes (2D when the mask is not separable)
+    CONV_STRATEGY_MEASURE      // Time both paths on the first frame size given to conv_engine_measure
+} conv_strategy;
+
+typedef struct
+{
+    ocl_runtime* rt;
+    const conv_filter* filter;   // Owned by the caller, must outlive the engine
+    int channels;
+    int separable;               // Path in use
+    int use_local_tile;          // Kernels stage pixels in local memory
+    size_t tile_element_size;    // Local memory per staged pixel (float, or float4 for RGB/RGBA)
+    size_t local_work_size[2];
+    char* source;                // Generated source of the path in use
+
+    cl_program program;
+    cl_kernel kernel_2d;
+    cl_kernel kernel_horizontal;
+    cl_kernel kernel_vertical;
+
+    // Frame buffers, reused while large enough
+    cl_mem input_buffer;
+    cl_mem output_buffer;
+    cl_mem temp_buffer;
+    size_t buffer_pixels;
+    size_t temp_pixels;
+} conv_engine;
+
+// Picks the path for the strategy (MEASURE starts on the cost model's choice) and builds its kernels.
+// Returns CL_SUCCESS or the failing OpenCL error.
+cl_int conv_engine_init(conv_engine* engine, ocl_runtime* rt, const conv_filter* filter, int channels, conv_strategy strategy);
+
+// Times the 2D and, for separable masks, the separable path on a width x height frame and keeps the
+// faster one; the slower path's program is given back to the runtime. Kernel times come from profiling
+// events when the queue has profiling enabled.
+cl_int conv_engine_measure(conv_engine* engine, int width, int height, int verbose);
+
+// Releases the engine's buffers and gives its program and kernels back to the runtime
+void conv_engine_release(conv_engine* engine);
+
+// Growable string for generated OpenCL source, shared with the pipeline generator
+typedef struct
+{
+    char* data;
+    size_t length;
+    size_t capacity;
+} conv_source;
+
+// Appends printf-style text
+void conv_emit(conv_source* text, const char* format, ...);
+
+// pixel_t and the LOAD_PIXEL / STORE_PIXEL (uchar), LOAD_SUM / STORE_SUM (float) and QUANTIZE
+// (round to 8 bits like a store and reload) macros for 1, 3 or 4 interleaved channels
+void conv_emit_pixel_types(conv_source* text, int channels);
+
+// Generated OpenCL source for a filter and path (malloc'd, the caller frees it)
+char* conv_engine_generate_source(const conv_filter* filter, int channels, int separable, int use_local_tile);
+
+// Makes sure the frame buffers hold width * height pixels (and the float intermediate on the separable path)
+cl_int conv_engine_reserve(conv_engine* engine, int width, int height);
+
+// Enqueues the filter kernels from input to output after the wait list (temp is only used on the
+// separable path). Kernel events go to events->kernel_events when events is not NULL.
+cl_int conv_engine_enqueue(conv_engine* engine, cl_command_queue queue, cl_mem input, cl_mem output, cl_mem temp,
+                           int width, int height, cl_uint num_wait_events, const cl_event* wait_events, blur_events* events);
+
+// Filters one image: write, kernels and read on the runtime queue, then waits for the read.
+// When events is not NULL it receives the events of every stage (release with blur_events_release).
+cl_int conv_engine_run(conv_engine* engine, const unsigned char* input, unsigned char* output, int width, int height, blur_events* events);
+
+#endif
@@ -0,0 +1,324 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#include "conv_filter.h"
+#include "gaussian_mask.h"
+
+#define CONV_HOST_BAND_ROWS 16
+
+
+
+int conv_filter_init(conv_filter* filter, const char* name, const float* mask, int radius, float bias, conv_output output)
+{
+    memset(filter, 0, sizeof(*filter));
+    if (radius < 0 || radius > CONV_FILTER_MAX_RADIUS)
+    {
+        fprintf(stderr, "Error: Filter radius %d is out of range (0 to %d)\n", radius, CONV_FILTER_MAX_RADIUS);
+        return -1;
+    }
+    snprintf(filter->name, sizeof(filter->name), "%s", name);
+    filter->radius = radius;
+    filter->size = (2 * radius) + 1;
+    filter->bias = bias;
+    filter->output = output;
+    filter->mask = (float*)malloc(filter->size * filter->size * sizeof(float));
+    filter->row_weights = (float*)malloc(filter->size * sizeof(float));
+    filter->col_weights = (float*)malloc(filter->size * sizeof(float));
+    memcpy(filter->mask, mask, filter->size * filter->size * sizeof(float));
+    filter->separable = extract_separable_kernel(filter->mask, radius, filter->row_weights, filter->col_weights);
+    return 0;
+}
+
+void conv_filter_release(conv_filter* filter)
+{
+    free(filter->mask);
+    free(filter->row_weights);
+    free(filter->col_weights);
+    memset(filter, 0, sizeof(*filter));
+}
+
+int conv_filter_box(conv_filter* filter, int radius)
+{
+    if (radius < 1 || radius > CONV_FILTER_MAX_RADIUS)
+    {
+        fprintf(stderr, "Error: Box radius %d is out of range (1 to %d)\n", radius, CONV_FILTER_MAX_RADIUS);
+        return -1;
+    }
+    int size = (2 * radius) + 1;
+    float* mask = (float*)malloc(size * size * sizeof(float));
+    for (int i = 0; i < size * size; i++)
+        mask[i] = 1.0f / (float)(size * size);
+    int result = conv_filter_init(filter, "box", mask, radius, 0.0f, CONV_OUTPUT_CLAMP);
+    free(mask);
+    return result;
+}
+
+int conv_filter_gaussian(conv_filter* filter, float sigma, int radius)
+{
+    if (sigma <= 0.0f)
+    {
+        fprintf(stderr, "Error: sigma must be positive\n");
+        return -1;
+    }
+    if (radius <= 0)
+        radius = gaussian_kernel_radius(sigma);
+    if (radius > CONV_FILTER_MAX_RADIUS)
+    {
+        fprintf(stderr, "Error: Gaussian radius %d is out of range (at most %d)\n", radius, CONV_FILTER_MAX_RADIUS);
+        return -1;
+    }
+    int size = (2 * radius) + 1;
+    float* mask = (float*)malloc(size * size * sizeof(float));
+    generate_gaussian_kernel(mask, sigma, radius);
+    int result = conv_filter_init(filter, "gaussian", mask, radius, 0.0f, CONV_OUTPUT_CLAMP);
+    free(mask);
+    return result;
+}
+
+int conv_filter_sharpen(conv_filter* filter, float amount)
+{
+    const float mask[9] = {
+        0.0f,    -amount,                 0.0f,
+        -amount, 1.0f + (4.0f * amount),  -amount,
+        0.0f,    -amount,                 0.0f
+    };
+    return conv_filter_init(filter, "sharpen", mask, 1, 0.0f, CONV_OUTPUT_CLAMP);
+}
+
+int conv_filter_sobel(conv_filter* filter, int vertical)
+{
+    static const float sobel_x[9] = {
+        -1.0f, 0.0f, 1.0f,
+        -2.0f, 0.0f, 2.0f,
+        -1.0f, 0.0f, 1.0f
+    };
+    static const float sobel_y[9] = {
+        -1.0f, -2.0f, -1.0f,
+        0.0f,  0.0f,  0.0f,
+        1.0f,  2.0f,  1.0f
+    };
+    return conv_filter_init(filter, vertical ? "sobel_y" : "sobel_x", vertical ? sobel_y : sobel_x, 1, 0.0f, CONV_OUTPUT_ABS);
+}
+
+int conv_filter_laplacian(conv_filter* filter)
+{
+    static const float laplacian[9] = {
+        0.0f, 1.0f,  0.0f,
+        1.0f, -4.0f, 1.0f,
+        0.0f, 1.0f,  0.0f
+    };
+    return conv_filter_init(filter, "laplacian", laplacian, 1, 0.0f, CONV_OUTPUT_ABS);
+}
+
+// mask:R:w0,w1,...[/DIVISOR]
+static int parse_user_mask(conv_filter* filter, const char* spec)
+{
+    char* end = NULL;
+    long radius = strtol(spec, &end, 10);
+    if (end == spec || *end != ':' || radius < 0 || radius > CONV_FILTER_MAX_RADIUS)
+    {
+        fprintf(stderr, "Error: Expected mask:R:w0,w1,... with R in 0 to %d\n", CONV_FILTER_MAX_RADIUS);
+        return -1;
+    }
+    int size = (2 * (int)radius) + 1;
+    int count = size * size;
+    float* mask = (float*)malloc(count * sizeof(float));
+    const char* p = end + 1;
+    for (int i = 0; i < count; i++)
+    {
+        mask[i] = strtof(p, &end);
+        if (end == p || (i < count - 1 && *end != ','))
+        {
+            fprintf(stderr, "Error: Mask of radius %ld needs %d comma-separated weights\n", radius, count);
+            free(mask);
+            return -1;
+        }
+        p = end + 1;
+    }
+    float divisor = 1.0f;
+    if (*end == '/')
+    {
+        p = end + 1;
+        divisor = strtof(p, &end);
+        if (end == p || divisor == 0.0f)
+        {
+            fprintf(stderr, "Error: Bad mask divisor in %s\n", spec);
+            free(mask);
+            return -1;
+        }
+    }
+    if (*end != '\0')
+    {
+        fprintf(stderr, "Error: Unexpected \"%s\" after the mask weights\n", end);
+        free(mask);
+        return -1;
+    }
+    for (int i = 0; i < count; i++)
+        mask[i] /= divisor;
+    int result = conv_filter_init(filter, "mask", mask, (int)radius, 0.0f, CONV_OUTPUT_CLAMP);
+    free(mask);
+    return result;
+}
+
+int conv_filter_parse(conv_filter* filter, const char* spec)
+{
+    const char* args = strchr(spec, ':');
+    size_t name_length = args ? (size_t)(args - spec) : strlen(spec);
+    if (args)
+        args++;
+
+    if (strncmp(spec, "box", name_length) == 0 && name_length == 3)
+        return conv_filter_box(filter, args ? atoi(args) : 1);
+    if (strncmp(spec, "gaussian", name_length) == 0 && name_length == 8)
+    {
+        float sigma = args ? strtof(args, NULL) : 1.0f;
+        const char* radius = args ? strchr(args, ':') : NULL;
+        return conv_filter_gaussian(filter, sigma, radius ? atoi(radius + 1) : 0);
+    }
+    if (strncmp(spec, "sharpen", name_length) == 0 && name_length == 7)
+        return conv_filter_sharpen(filter, args ? strtof(args, NULL) : 1.0f);
+    if (strcmp(spec, "sobel-x") == 0)
+        return conv_filter_sobel(filter, 0);
+    if (strcmp(spec, "sobel-y") == 0)
+        return conv_filter_sobel(filter, 1);
+    if (strcmp(spec, "laplacian") == 0)
+        return conv_filter_laplacian(filter);
+    if (strncmp(spec, "mask", name_length) == 0 && name_length == 4 && args)
+        return parse_user_mask(filter, args);
+
+    fprintf(stderr, "Error: Unknown filter %s (box, gaussian, sharpen, sobel-x, sobel-y, laplacian or mask:R:w0,w1,...)\n", spec);
+    return -1;
+}
+
+int conv_filter_taps(const conv_filter* filter)
+{
+    int taps = 0;
+    for (int i = 0; i < filter->size * filter->size; i++)
+        taps += filter->mask[i] != 0.0f;
+    return taps;
+}
+
+int conv_filter_separable_taps(const conv_filter* filter)
+{
+    int taps = 0;
+    for (int i = 0; i < filter->size; i++)
+        taps += (filter->row_weights[i] != 0.0f) + (filter->col_weights[i] != 0.0f);
+    return taps;
+}
+
+typedef struct
+{
+    const conv_filter* filter;
+    const unsigned char* input;
+    unsigned char* output;
+    int width;
+    int height;
+    int channels;
+    int num_taps;
+    int* tap_dx;
+    int* tap_dy;
+    ptrdiff_t* tap_offsets;   // (dy * width + dx) * channels
+    float* tap_weights;
+} conv_host_job;
+
+static void conv_band_task(void* ctx, int item, int thread_index)
+{
+    const conv_host_job* job = (const conv_host_job*)ctx;
+    const conv_filter* filter = job->filter;
+    int width = job->width;
+    int height = job->height;
+    int channels = job->channels;
+    int radius = filter->radius;
+    int y_end = (item + 1) * CONV_HOST_BAND_ROWS;
+    (void)thread_index;
+
+    for (int y = item * CONV_HOST_BAND_ROWS; y < y_end && y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            // Away from the edges every tap is a fixed offset from the pixel; only the border clamps
+            int interior = x >= radius && x < width - radius && y >= radius && y < height - radius;
+            const unsigned char* center = job->input + (((size_t)y * width) + x) * channels;
+            for (int c = 0; c < channels; c++)
+            {
+                float sum = 0.0f;
+                for (int t = 0; t < job->num_taps; t++)
+                {
+                    float pixel;
+                    if (interior)
+                    {
+                        pixel = center[job->tap_offsets[t] + c];
+                    }
+                    else
+                    {
+                        int ix = x + job->tap_dx[t];
+                        int iy = y + job->tap_dy[t];
+                        ix = (ix < 0) ? 0 : (ix >= width) ? width - 1 : ix;
+                        iy = (iy < 0) ? 0 : (iy >= height) ? height - 1 : iy;
+                        pixel = job->input[(((size_t)iy * width) + ix) * channels + c];
+                    }
+                    sum += pixel * job->tap_weights[t];
+                }
+                if (filter->bias != 0.0f)
+                    sum += filter->bias;
+                if (filter->output == CONV_OUTPUT_ABS)
+                    sum = fabsf(sum);
+                sum = (sum < 0.0f) ? 0.0f : (sum > 255.0f) ? 255.0f : sum;
+                job->output[(((size_t)y * width) + x) * channels + c] = (unsigned char)sum;
+            }
+        }
+    }
+}
+
+void conv_filter_apply_host(cpu_thread_pool* pool, const conv_filter* filter, const unsigned char* input, unsigned char* output,
+                            int width, int height, int channels)
+{
+    conv_host_job job;
+    int size = filter->size;
+    job.filter = filter;
+    job.input = input;
+    job.output = output;
+    job.width = width;
+    job.height = height;
+    job.channels = channels;
+    job.tap_dx = (int*)malloc(size * size * sizeof(int));
+    job.tap_dy = (int*)malloc(size * size * sizeof(int));
+    job.tap_offsets = (ptrdiff_t*)malloc(size * size * sizeof(ptrdiff_t));
+    job.tap_weights = (float*)malloc(size * size * sizeof(float));
+
+    // Non-zero taps in row-major order, the order the generated kernels add them in
+    job.num_taps = 0;
+    for (int ky = 0; ky < size; ky++)
+    {
+        for (int kx = 0; kx < size; kx++)
+        {
+            float weight = filter->mask[(ky * size) + kx];
+            if (weight == 0.0f)
+                continue;
+            job.tap_dx[job.num_taps] = kx - filter->radius;
+            job.tap_dy[job.num_taps] = ky - filter->radius;
+            job.tap_offsets[job.num_taps] = (((ptrdiff_t)job.tap_dy[job.num_taps] * width) + job.tap_dx[job.num_taps]) * channels;
+            job.tap_weights[job.num_taps] = weight;
+            job.num_taps++;
+        }
+    }
+
+    int num_bands = (height + CONV_HOST_BAND_ROWS - 1) / CONV_HOST_BAND_ROWS;
+    if (pool)
+    {
+        cpu_thread_pool_run(pool, conv_band_task, &job, num_bands);
+    }
+    else
+    {
+        for (int i = 0; i < num_bands; i++)
+            conv_band_task(&job, i, 0);
+    }
+    free(job.tap_dx);
+    free(job.tap_dy);
+    free(job.tap_offsets);
+    free(job.tap_weights);
+}
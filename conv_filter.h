@@ -0,0 +1,69 @@
+#ifndef CONV_FILTER_H
+#define CONV_FILTER_H
+
+#include "cpu_blur.h"
+
+// Runtime-specified convolution filters: a square (2 * radius + 1)^2 mask, row-major, plus a bias and
+// an output mode. Filters whose mask is the outer product of two vectors also carry the row and
+// column weights, so the device engine can run them as two 1D passes.
+// Results are sum + bias (absolute value for edge filters), clamped to [0, 255] and truncated,
+// so a normalized Gaussian filter reproduces gaussian_blur_host exactly.
+
+#define CONV_FILTER_NAME_LEN 32
+#define CONV_FILTER_MAX_RADIUS 32
+
+typedef enum
+{
+    CONV_OUTPUT_CLAMP,   // clamp(sum + bias)
+    CONV_OUTPUT_ABS      // clamp(|sum + bias|), for signed responses such as Sobel
+} conv_output;
+
+typedef struct
+{
+    char name[CONV_FILTER_NAME_LEN];
+    int radius;
+    int size;             // 2 * radius + 1
+    float* mask;
+    float bias;
+    conv_output output;
+    int separable;        // mask = col_weights * row_weights^T
+    float* row_weights;
+    float* col_weights;
+} conv_filter;
+
+// Copies a mask of (2 * radius + 1)^2 weights and detects separability. Returns 0, or -1 on a bad radius.
+int conv_filter_init(conv_filter* filter, const char* name, const float* mask, int radius, float bias, conv_output output);
+void conv_filter_release(conv_filter* filter);
+
+// Normalized box (mean) filter
+int conv_filter_box(conv_filter* filter, int radius);
+
+// Normalized Gaussian, same weights as the blur engine (radius <= 0 picks ceil(3 * sigma))
+int conv_filter_gaussian(conv_filter* filter, float sigma, int radius);
+
+// 3x3 unsharp mask: the pixel plus amount times its difference to the 4 neighbours (amount 1 is the classic sharpen)
+int conv_filter_sharpen(conv_filter* filter, float amount);
+
+// 3x3 Sobel gradient magnitude along x (vertical == 0) or y, as an absolute value
+int conv_filter_sobel(conv_filter* filter, int vertical);
+
+// 3x3 Laplacian (4-neighbour), as an absolute value
+int conv_filter_laplacian(conv_filter* filter);
+
+// Parses a filter spec:
+//   box[:R]  gaussian[:SIGMA[:R]]  sharpen[:AMOUNT]  sobel-x  sobel-y  laplacian
+//   mask:R:w0,w1,...[/DIVISOR]   user mask of (2R + 1)^2 weights, row-major, optionally divided by DIVISOR
+// Prints an error and returns -1 on a malformed spec.
+int conv_filter_parse(conv_filter* filter, const char* spec);
+
+// Taps with a non-zero weight on the 2D path, and on the two separable passes together
+int conv_filter_taps(const conv_filter* filter);
+int conv_filter_separable_taps(const conv_filter* filter);
+
+// CPU reference: the 2D convolution with the edge pixels clamped, taps summed in row-major order
+// (zero weights skipped) like the generated device kernels. Interleaved channels are filtered
+// independently. Row bands are spread over pool when it is not NULL.
+void conv_filter_apply_host(cpu_thread_pool* pool, const conv_filter* filter, const unsigned char* input, unsigned char* output,
+                            int width, int height, int channels);
+
+#endif
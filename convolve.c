@@ -0,0 +1,286 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+// OpenCL Include
+#include <CL/cl.h>
+
+#include "commons.h"
+#include "cpu_blur.h"
+#include "ocl_runtime.h"
+#include "conv_filter.h"
+#include "conv_engine.h"
+#include "image_io.h"
+#include "verify.h"
+
+
+
+// Function to return a monotonic wall-clock time in seconds
+static double wall_time_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+static int parse_strategy(const char* name, conv_strategy* strategy)
+{
+    if (strcmp(name, "auto") == 0)
+        *strategy = CONV_STRATEGY_AUTO;
+    else if (strcmp(name, "2d") == 0)
+        *strategy = CONV_STRATEGY_2D;
+    else if (strcmp(name, "separable") == 0)
+        *strategy = CONV_STRATEGY_SEPARABLE;
+    else if (strcmp(name, "measure") == 0)
+        *strategy = CONV_STRATEGY_MEASURE;
+    else
+        return -1;
+    return 0;
+}
+
+// Main Code
+int main(int argc, char** argv)
+{
+    // --filter spec      box[:R], gaussian[:SIGMA[:R]], sharpen[:AMOUNT], sobel-x, sobel-y, laplacian or mask:R:w0,w1,...[/DIV]
+    // --strategy auto|2d|separable|measure   device path (measure times both on this image)
+    // --size WxH, --channels 1|3|4, --input file, --output file   as in run
+    // --device spec      device override, as in run (or OCL_DEVICE)
+    // --cpu              host filter only; --threads N sets its thread count
+    // --repeat N         device requests to time (default 1)
+    // --tolerance N, --max-mismatches N   comparison settings, as in run
+    // --print-source     prints the generated OpenCL source
+    const char* filter_spec = "gaussian:1.0";
+    conv_strategy strategy = CONV_STRATEGY_AUTO;
+    const char* device_spec = NULL;
+    const char* input_path = NULL;
+    const char* output_path = NULL;
+    int image_width = 1024;
+    int image_height = 1024;
+    int image_channels = 1;
+    int cpu_only = 0;
+    int num_threads = 0;
+    int repeat = 1;
+    int tolerance = -1;
+    int print_source = 0;
+    verify_options verify;
+    verify_default_options(&verify);
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+        {
+            filter_spec = argv[++i];
+        }
+        else if (strcmp(argv[i], "--strategy") == 0 && i + 1 < argc)
+        {
+            if (parse_strategy(argv[++i], &strategy) != 0)
+            {
+                fprintf(stderr, "Error: Unknown strategy %s (auto, 2d, separable or measure)\n", argv[i]);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%dx%d", &image_width, &image_height) != 2 || image_width <= 0 || image_height <= 0)
+            {
+                fprintf(stderr, "Error: --size takes WxH\n");
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--channels") == 0 && i + 1 < argc)
+        {
+            image_channels = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc)
+        {
+            input_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            output_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc)
+        {
+            device_spec = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cpu") == 0)
+        {
+            cpu_only = 1;
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            num_threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+        {
+            repeat = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+        {
+            tolerance = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-mismatches") == 0 && i + 1 < argc)
+        {
+            verify.max_mismatches = (size_t)strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--print-source") == 0)
+        {
+            print_source = 1;
+        }
+    }
+    if (image_channels != 1 && image_channels != 3 && image_channels != 4)
+    {
+        fprintf(stderr, "Error: --channels must be 1, 3 or 4\n");
+        return -1;
+    }
+    if (repeat < 1)
+    {
+        repeat = 1;
+    }
+
+    conv_filter filter;
+    if (conv_filter_parse(&filter, filter_spec) != 0)
+        return -1;
+    printf("Filter                                              : %s, radius %d, %d taps", filter.name, filter.radius, conv_filter_taps(&filter));
+    if (filter.separable)
+        printf(" (separable: %d)", conv_filter_separable_taps(&filter));
+    printf("\n");
+
+    //------------------------------------------------------
+    // Image: a file or noise
+    //------------------------------------------------------
+    mapped_image input_file, output_file;
+    if (input_path)
+    {
+        if (image_file_open(input_path, image_width, image_height, image_channels, &input_file) != 0)
+        {
+            conv_filter_release(&filter);
+            return -1;
+        }
+        image_width = input_file.width;
+        image_height = input_file.height;
+        image_channels = input_file.channels;
+        printf("Input image                                         : %s (%dx%d, %d channel(s))\n", input_path, image_width, image_height, image_channels);
+    }
+    if (output_path && image_file_create(output_path, image_file_format_from_path(output_path), image_width, image_height, image_channels, &output_file) != 0)
+    {
+        if (input_path)
+            image_file_close(&input_file);
+        conv_filter_release(&filter);
+        return -1;
+    }
+    size_t image_bytes = (size_t)image_width * image_height * image_channels;
+    unsigned char* image = input_path ? input_file.pixels : (unsigned char*)malloc(image_bytes);
+    unsigned char* filtered_host = (unsigned char*)malloc(image_bytes);
+    unsigned char* filtered_device = NULL;
+    if (!input_path)
+    {
+        generate_noisy_image(image, image_width, image_height, image_channels);
+    }
+
+    //------------------------------------------------------
+    // Device filter
+    //------------------------------------------------------
+    ocl_runtime rt;
+    conv_engine engine;
+    int device_ready = 0;
+    if (!cpu_only && ocl_runtime_init(&rt, device_spec, CL_QUEUE_PROFILING_ENABLE) != CL_SUCCESS)
+    {
+        printf("No usable OpenCL device, running the host filter only\n");
+        cpu_only = 1;
+    }
+    if (!cpu_only)
+    {
+        device_ready = 1;
+        cl_int err = conv_engine_init(&engine, &rt, &filter, image_channels, strategy);
+        if (err == CL_SUCCESS && strategy == CONV_STRATEGY_MEASURE)
+        {
+            printf("\n######### Strategy Measurement ################\n");
+            err = conv_engine_measure(&engine, image_width, image_height, 1);
+        }
+        if (err != CL_SUCCESS)
+        {
+            fprintf(stderr, "Error: Could not set up the device filter\n");
+            conv_engine_release(&engine);
+            ocl_runtime_release(&rt);
+            cpu_only = 1;
+            device_ready = 0;
+        }
+    }
+    if (device_ready)
+    {
+        if (print_source)
+            printf("\n%s\n", engine.source);
+        filtered_device = output_path ? output_file.pixels : (unsigned char*)malloc(image_bytes);
+
+        printf("\n######### Device Profiling ################\n");
+        printf("Device                                              : %s\n", rt.selected.device_name);
+        printf("Path                                                : %s, %s, work-group %zux%zu\n", engine.separable ? "separable" : "2d",
+               engine.use_local_tile ? "local tiles" : "global reads", engine.local_work_size[0], engine.local_work_size[1]);
+        double kernel_time_sec = 0.0;
+        double start = wall_time_sec();
+        for (int r = 0; r < repeat; r++)
+        {
+            blur_events events;
+            if (conv_engine_run(&engine, image, filtered_device, image_width, image_height, &events) != CL_SUCCESS)
+            {
+                fprintf(stderr, "Error: Device filter failed\n");
+                break;
+            }
+            kernel_time_sec += blur_events_kernel_time(&events);
+            blur_events_release(&events);
+        }
+        double wall_time_sec_device = (wall_time_sec() - start) / repeat;
+        printf("Kernel Execution Time                               : %f seconds\n", kernel_time_sec / repeat);
+        printf("Time taken for the filter on device                 : %f seconds\n", wall_time_sec_device);
+    }
+
+    //------------------------------------------------------
+    // Host filter and comparison
+    //------------------------------------------------------
+    printf("\n######### Host Profiling ################\n");
+    cpu_thread_pool* pool = cpu_thread_pool_create(num_threads);
+    double start = wall_time_sec();
+    conv_filter_apply_host(pool, &filter, image, filtered_host, image_width, image_height, image_channels);
+    printf("Time taken for the filter on host                   : %f seconds (%d threads)\n", wall_time_sec() - start,
+           cpu_thread_pool_size(pool));
+
+    int passed = 1;
+    if (device_ready)
+    {
+        // The separable path sums in a different order than the 2D reference, so truncation can differ by one
+        verify_result comparison;
+        verify.tolerance = (tolerance >= 0) ? tolerance : (engine.separable ? 1 : 0);
+        printf("\n######### Comparison: Device vs Host ################\n");
+        passed = verify_images(pool, filtered_host, filtered_device, image_bytes, &verify, &comparison);
+        verify_print(&comparison, &verify, filtered_host, filtered_device, image_bytes, image_width, image_channels);
+    }
+    else if (output_path)
+    {
+        memcpy(output_file.pixels, filtered_host, image_bytes);
+    }
+
+    // Clean up
+    if (device_ready)
+    {
+        conv_engine_release(&engine);
+        ocl_runtime_release(&rt);
+        if (!output_path)
+            free(filtered_device);
+    }
+    if (output_path)
+    {
+        image_file_close(&output_file);
+        printf("Result written to %s\n", output_path);
+    }
+    if (input_path)
+        image_file_close(&input_file);
+    else
+        free(image);
+    cpu_thread_pool_destroy(pool);
+    free(filtered_host);
+    conv_filter_release(&filter);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,989 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPU_BLUR_X86 1
+#endif
+
+#include "cpu_blur.h"
+#include "gaussian_mask.h"
+
+// Rows per work item for the 2D path, and block shape for the separable path.
+// A 32 x 512 block keeps its float intermediate (plus halo rows) within a typical L2 cache.
+#define EXACT_BAND_ROWS 16
+#define SEPARABLE_BAND_ROWS 32
+#define SEPARABLE_BLOCK_COLS 512
+
+
+
+//------------------------------------------------------
+// Thread pool
+//------------------------------------------------------
+struct cpu_thread_pool
+{
+    int num_threads;            // Including the calling thread
+    pthread_t* threads;
+    pthread_mutex_t mutex;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    unsigned long generation;   // Bumped for every cpu_thread_pool_run call
+    int active_workers;
+    int shutdown;
+
+    cpu_task_fn task;
+    void* ctx;
+    int num_items;
+    int next_item;
+};
+
+typedef struct
+{
+    cpu_thread_pool* pool;
+    int thread_index;
+} cpu_worker_args;
+
+static void run_items(cpu_thread_pool* pool, int thread_index)
+{
+    for (;;)
+    {
+        int item = __atomic_fetch_add(&pool->next_item, 1, __ATOMIC_RELAXED);
+        if (item >= pool->num_items)
+            break;
+        pool->task(pool->ctx, item, thread_index);
+    }
+}
+
+static void* worker_main(void* arg)
+{
+    cpu_worker_args args = *(cpu_worker_args*)arg;
+    cpu_thread_pool* pool = args.pool;
+    free(arg);
+
+    unsigned long seen_generation = 0;
+    pthread_mutex_lock(&pool->mutex);
+    for (;;)
+    {
+        while (!pool->shutdown && pool->generation == seen_generation)
+            pthread_cond_wait(&pool->work_ready, &pool->mutex);
+        if (pool->shutdown)
+            break;
+        seen_generation = pool->generation;
+        pthread_mutex_unlock(&pool->mutex);
+
+        run_items(pool, args.thread_index);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->active_workers == 0)
+            pthread_cond_signal(&pool->work_done);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+cpu_thread_pool* cpu_thread_pool_create(int num_threads)
+{
+    if (num_threads <= 0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = (online > 0) ? (int)online : 1;
+    }
+
+    cpu_thread_pool* pool = (cpu_thread_pool*)calloc(1, sizeof(cpu_thread_pool));
+    if (!pool)
+        return NULL;
+    // Without room for the thread handles the pool runs everything on the calling thread
+    pool->threads = (pthread_t*)calloc(num_threads, sizeof(pthread_t));
+    pool->num_threads = pool->threads ? num_threads : 1;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+
+    // Thread 0 is the caller of cpu_thread_pool_run, so only num_threads - 1 workers are spawned
+    for (int i = 1; i < pool->num_threads; i++)
+    {
+        cpu_worker_args* args = (cpu_worker_args*)malloc(sizeof(cpu_worker_args));
+        if (!args)
+        {
+            fprintf(stderr, "Error: Could not allocate CPU worker thread %d\n", i);
+            pool->num_threads = i;
+            break;
+        }
+        args->pool = pool;
+        args->thread_index = i;
+        if (pthread_create(&pool->threads[i], NULL, worker_main, args) != 0)
+        {
+            fprintf(stderr, "Error: Could not create CPU worker thread %d\n", i);
+            free(args);
+            pool->num_threads = i;
+            break;
+        }
+    }
+    return pool;
+}
+
+void cpu_thread_pool_destroy(cpu_thread_pool* pool)
+{
+    if (!pool)
+        return;
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->mutex);
+    for (int i = 1; i < pool->num_threads; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->work_done);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->threads);
+    free(pool);
+}
+
+int cpu_thread_pool_size(const cpu_thread_pool* pool)
+{
+    return pool->num_threads;
+}
+
+void cpu_thread_pool_run(cpu_thread_pool* pool, cpu_task_fn task, void* ctx, int num_items)
+{
+    if (pool->num_threads == 1 || num_items <= 1)
+    {
+        for (int item = 0; item < num_items; item++)
+            task(ctx, item, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->task = task;
+    pool->ctx = ctx;
+    pool->num_items = num_items;
+    pool->next_item = 0;
+    pool->active_workers = pool->num_threads - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->mutex);
+
+    run_items(pool, 0);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->active_workers > 0)
+        pthread_cond_wait(&pool->work_done, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+// Per-thread scratch buffers of bytes each. Returns how many threads got one (0 when not even the
+// calling thread did); the rest are NULL.
+static int alloc_scratch(void*** scratch, int num_threads, size_t bytes)
+{
+    *scratch = (void**)calloc(num_threads, sizeof(void*));
+    if (!*scratch)
+        return 0;
+    int allocated = 0;
+    while (allocated < num_threads && ((*scratch)[allocated] = malloc(bytes)) != NULL)
+        allocated++;
+    return allocated;
+}
+
+static void free_scratch(void** scratch, int num_threads)
+{
+    for (int i = 0; scratch && i < num_threads; i++)
+        free(scratch[i]);
+    free(scratch);
+}
+
+// Runs the items on the pool when every thread has its scratch, else on the calling thread alone
+// (thread 0). Returns 0, or -1 when there is no scratch at all.
+static int run_with_scratch(cpu_thread_pool* pool, cpu_task_fn task, void* ctx, int num_items, int scratch_threads)
+{
+    if (scratch_threads == 0)
+    {
+        fprintf(stderr, "Error: Could not allocate the CPU blur scratch memory\n");
+        return -1;
+    }
+    if (scratch_threads < cpu_thread_pool_size(pool))
+    {
+        for (int item = 0; item < num_items; item++)
+            task(ctx, item, 0);
+        return 0;
+    }
+    cpu_thread_pool_run(pool, task, ctx, num_items);
+    return 0;
+}
+
+
+
+//------------------------------------------------------
+// Inner loops
+//------------------------------------------------------
+// Rows are processed as interleaved samples (width * channels per row), so horizontal taps step
+// channels samples apart and every lane of a vector is one channel of one pixel.
+// Each variant processes samples [x, x_end) that need no column clamping and returns
+// the first sample it did not process; the scalar code finishes the remainder.
+
+// 2D taps for one output row. rows[ky] points at the (already clamped) source row for tap row ky.
+typedef int (*exact_row_fn)(const unsigned char** rows, unsigned char* out, int x, int x_end, const float* mkernel, int kernel_radius, int channels);
+// Horizontal 1D taps: src points at the source row, out at the float intermediate for sample 0.
+typedef int (*horizontal_row_fn)(const unsigned char* src, float* out, int x, int x_end, const float* weights, int kernel_radius, int channels);
+// Vertical 1D taps over intermediate rows spaced stride floats apart.
+typedef int (*vertical_row_fn)(const float* src, int stride, unsigned char* out, int x, int x_end, const float* weights, int kernel_radius);
+// Fixed-point versions: Q14 weights, int sums, a Q7 short intermediate (see gaussian_mask.h)
+typedef int (*exact_row_fixed_fn)(const unsigned char** rows, unsigned char* out, int x, int x_end, const short* mask, int kernel_radius, int channels);
+typedef int (*horizontal_row_fixed_fn)(const unsigned char* src, short* out, int x, int x_end, const short* weights, int kernel_radius, int channels);
+typedef int (*vertical_row_fixed_fn)(const short* src, int stride, unsigned char* out, int x, int x_end, const short* weights, int kernel_radius);
+
+static int exact_row_scalar(const unsigned char** rows, unsigned char* out, int x, int x_end, const float* mkernel, int kernel_radius, int channels)
+{
+    (void)rows; (void)out; (void)x_end; (void)mkernel; (void)kernel_radius; (void)channels;
+    return x;
+}
+
+static int horizontal_row_scalar(const unsigned char* src, float* out, int x, int x_end, const float* weights, int kernel_radius, int channels)
+{
+    (void)src; (void)out; (void)x_end; (void)weights; (void)kernel_radius; (void)channels;
+    return x;
+}
+
+static int vertical_row_scalar(const float* src, int stride, unsigned char* out, int x, int x_end, const float* weights, int kernel_radius)
+{
+    (void)src; (void)stride; (void)out; (void)x_end; (void)weights; (void)kernel_radius;
+    return x;
+}
+
+static int exact_row_fixed_scalar(const unsigned char** rows, unsigned char* out, int x, int x_end, const short* mask, int kernel_radius, int channels)
+{
+    (void)rows; (void)out; (void)x_end; (void)mask; (void)kernel_radius; (void)channels;
+    return x;
+}
+
+static int horizontal_row_fixed_scalar(const unsigned char* src, short* out, int x, int x_end, const short* weights, int kernel_radius, int channels)
+{
+    (void)src; (void)out; (void)x_end; (void)weights; (void)kernel_radius; (void)channels;
+    return x;
+}
+
+static int vertical_row_fixed_scalar(const short* src, int stride, unsigned char* out, int x, int x_end, const short* weights, int kernel_radius)
+{
+    (void)src; (void)stride; (void)out; (void)x_end; (void)weights; (void)kernel_radius;
+    return x;
+}
+
+#ifdef CPU_BLUR_X86
+// Truncate like a (unsigned char) cast on x86: float -> int32 toward zero, keep the low byte.
+__attribute__((target("sse4.1")))
+static inline void store_u8x4_sse(unsigned char* out, __m128 sum)
+{
+    __m128i value = _mm_and_si128(_mm_cvttps_epi32(sum), _mm_set1_epi32(0xFF));
+    value = _mm_packus_epi16(_mm_packus_epi32(value, value), value);
+    int packed = _mm_cvtsi128_si32(value);
+    memcpy(out, &packed, sizeof(packed));
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128 load_u8x4_sse(const unsigned char* src)
+{
+    int packed;
+    memcpy(&packed, src, sizeof(packed));
+    return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)));
+}
+
+__attribute__((target("sse4.1")))
+static int exact_row_sse(const unsigned char** rows, unsigned char* out, int x, int x_end, const float* mkernel, int kernel_radius, int channels)
+{
+    int size = (2 * kernel_radius) + 1;
+    for (; x + 4 <= x_end; x += 4)
+    {
+        __m128 sum = _mm_setzero_ps();
+        for (int ky = 0; ky < size; ky++)
+        {
+            const unsigned char* src = rows[ky] + x - (kernel_radius * channels);
+            const float* weights = mkernel + (ky * size);
+            for (int kx = 0; kx < size; kx++)
+                sum = _mm_add_ps(sum, _mm_mul_ps(load_u8x4_sse(src + (kx * channels)), _mm_set1_ps(weights[kx])));
+        }
+        store_u8x4_sse(out + x, sum);
+    }
+    return x;
+}
+
+__attribute__((target("sse4.1")))
+static int horizontal_row_sse(const unsigned char* src, float* out, int x, int x_end, const float* weights, int kernel_radius, int channels)
+{
+    int size = (2 * kernel_radius) + 1;
+    for (; x + 4 <= x_end; x += 4)
+    {
+        __m128 sum = _mm_setzero_ps();
+        for (int k = 0; k < size; k++)
+            sum = _mm_add_ps(sum, _mm_mul_ps(load_u8x4_sse(src + x + ((k - kernel_radius) * channels)), _mm_set1_ps(weights[k])));
+        _mm_storeu_ps(out + x, sum);
+    }
+    return x;
+}
+
+__attribute__((target("sse4.1")))
+static int vertical_row_sse(const float* src, int stride, unsigned char* out, int x, int x_end, const float* weights, int kernel_radius)
+{
+    int size = (2 * kernel_radius) + 1;
+    for (; x + 4 <= x_end; x += 4)
+    {
+        __m128 sum = _mm_setzero_ps();
+        for (int k = 0; k < size; k++)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src + (k * stride) + x), _mm_set1_ps(weights[k])));
+        store_u8x4_sse(out + x, sum);
+    }
+    return x;
+}
+
+// AVX2 only (no FMA target), so multiply and add stay separate roundings like the scalar reference
+__attribute__((target("avx2")))
+static inline void store_u8x8_avx2(unsigned char* out, __m256 sum)
+{
+    __m256i value = _mm256_and_si256(_mm256_cvttps_epi32(sum), _mm256_set1_epi32(0xFF));
+    __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1));
+    _mm_storel_epi64((__m128i*)out, _mm_packus_epi16(packed, packed));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 load_u8x8_avx2(const unsigned char* src)
+{
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)src)));
+}
+
+__attribute__((target("avx2")))
+static int exact_row_avx2(const unsigned char** rows, unsigned char* out, int x, int x_end, const float* mkernel, int kernel_radius, int channels)
+{
+    int size = (2 * kernel_radius) + 1;
+    for (; x + 8 <= x_end; x += 8)
+    {
+        __m256 sum = _mm256_setzero_ps();
+        for (int ky = 0; ky < size; ky++)
+        {
+            const unsigned char* src = rows[ky] + x - (kernel_radius * channels);
+            const float* weights = mkernel + (ky * size);
+            for (int kx = 0; kx < size; kx++)
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(load_u8x8_avx2(src + (kx * channels)), _mm256_set1_ps(weights[kx])));
+        }
+        store_u8x8_avx2(out + x, sum);
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static int horizontal_row_avx2(const unsigned char* src, float* out, int x, int x_end, const float* weights, int kernel_radius, int channels)
+{
+    int size = (2 * kernel_radius) + 1;
+    for (; x + 8 <= x_end; x += 8)
+    {
+        __m256 sum = _mm256_setzero_ps();
+        for (int k = 0; k < size; k++)
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(load_u8x8_avx2(src + x + ((k - kernel_radius) * channels)), _mm256_set1_ps(weights[k])));
+        _mm256_storeu_ps(out + x, sum);
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static int vertical_row_avx2(const float* src, int stride, unsigned char* out, int x, int x_end, const float* weights, int kernel_radius)
+{
+    int size = (2 * kernel_radius) + 1;
+    for (; x + 8 <= x_end; x += 8)
+    {
+        __m256 sum = _mm256_setzero_ps();
+        for (int k = 0; k < size; k++)
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(src + (k * stride) + x), _mm256_set1_ps(weights[k])));
+        store_u8x8_avx2(out + x, sum);
+    }
+    return x;
+}
+
+// Fixed point: taps are taken in pairs, the 16-bit samples of tap k and k + 1 interleaved so one
+// pmaddwd (_mm_madd_epi16) multiplies both by their weights and adds them into 32-bit sums.
+// An odd last tap pairs with a zero weight. Products stay below 2 * 32640 * 16384 < 2^31.
+static inline int weight_pair(short w0, short w1)
+{
+    return (int)(((unsigned int)(unsigned short)w1 << 16) | (unsigned short)w0);
+}
+
+__attribute__((target("sse4.1")))
+static int exact_row_fixed_sse(const unsigned char** rows, unsigned char* out, int x, int x_end, const short* mask, int kernel_radius, int channels)
+{
+    int size = (2 * kernel_radius) + 1;
+    for (; x + 8 <= x_end; x += 8)
+    {
+        __m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+        for (int ky = 0; ky < size; ky++)
+        {
+            const unsigned char* src = rows[ky] + x - (kernel_radius * channels);
+            const short* weights = mask + (ky * size);
+            for (int kx = 0; kx < size; kx += 2)
+            {
+                int next = (kx + 1 < size) ? kx + 1 : kx;
+                __m128i a = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(src + (kx * channels))));
+                __m128i b = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(src + (next * channels))));
+                __m128i w = _mm_set1_epi32(weight_pair(weights[kx], (kx + 1 < size) ? weights[kx + 1] : 0));
+                lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+                hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+            }
+        }
+        __m128i packed = _mm_packs_epi32(_mm_srai_epi32(lo, GAUSSIAN_FIXED_BITS), _mm_srai_epi32(hi, GAUSSIAN_FIXED_BITS));
+        _mm_storel_epi64((__m128i*)(out + x), _mm_packus_epi16(packed, packed));
+    }
+    return x;
+}
+
+__attribute__((target("sse4.1")))
+static int horizontal_row_fixed_sse(const unsigned char* src, short* out, int x, int x_end, const short* weights, int kernel_radius, int channels)
+{
+    int size = (2 * kernel_radius) + 1;
+    for (; x + 8 <= x_end; x += 8)
+    {
+        const unsigned char* base = src + x - (kernel_radius * channels);
+        __m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+        for (int k = 0; k < size; k += 2)
+        {
+            int next = (k + 1 < size) ? k + 1 : k;
+            __m128i a = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(base + (k * channels))));
+            __m128i b = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(base + (next * channels))));
+            __m128i w = _mm_set1_epi32(weight_pair(weights[k], (k + 1 < size) ? weights[k + 1] : 0));
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+        }
+        _mm_storeu_si128((__m128i*)(out + x), _mm_packs_epi32(_mm_srai_epi32(lo, GAUSSIAN_FIXED_TEMP_BITS), _mm_srai_epi32(hi, GAUSSIAN_FIXED_TEMP_BITS)));
+    }
+    return x;
+}
+
+__attribute__((target("sse4.1")))
+static int vertical_row_fixed_sse(const short* src, int stride, unsigned char* out, int x, int x_end, const short* weights, int kernel_radius)
+{
+    int size = (2 * kernel_radius) + 1;
+    for (; x + 8 <= x_end; x += 8)
+    {
+        __m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+        for (int k = 0; k < size; k += 2)
+        {
+            int next = (k + 1 < size) ? k + 1 : k;
+            __m128i a = _mm_loadu_si128((const __m128i*)(src + (k * stride) + x));
+            __m128i b = _mm_loadu_si128((const __m128i*)(src + (next * stride) + x));
+            __m128i w = _mm_set1_epi32(weight_pair(weights[k], (k + 1 < size) ? weights[k + 1] : 0));
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+        }
+        int shift = GAUSSIAN_FIXED_BITS + GAUSSIAN_FIXED_TEMP_BITS;
+        __m128i packed = _mm_packs_epi32(_mm_srai_epi32(lo, shift), _mm_srai_epi32(hi, shift));
+        _mm_storel_epi64((__m128i*)(out + x), _mm_packus_epi16(packed, packed));
+    }
+    return x;
+}
+
+// AVX2 unpacks within 128-bit lanes, so lo holds samples 0-3 and 8-11, hi 4-7 and 12-15; the lane-wise
+// pack of lo and hi puts them back in order
+__attribute__((target("avx2")))
+static inline void store_u8x16_fixed_avx2(unsigned char* out, __m256i lo, __m256i hi, int shift)
+{
+    __m256i packed = _mm256_packs_epi32(_mm256_srai_epi32(lo, shift), _mm256_srai_epi32(hi, shift));
+    _mm_storeu_si128((__m128i*)out, _mm_packus_epi16(_mm256_castsi256_si128(packed), _mm256_extracti128_si256(packed, 1)));
+}
+
+__attribute__((target("avx2")))
+static int exact_row_fixed_avx2(const unsigned char** rows, unsigned char* out, int x, int x_end, const short* mask, int kernel_radius, int channels)
+{
+    int size = (2 * kernel_radius) + 1;
+    for (; x + 16 <= x_end; x += 16)
+    {
+        __m256i lo = _mm256_setzero_si256(), hi = _mm256_setzero_si256();
+        for (int ky = 0; ky < size; ky++)
+        {
+            const unsigned char* src = rows[ky] + x - (kernel_radius * channels);
+            const short* weights = mask + (ky * size);
+            for (int kx = 0; kx < size; kx += 2)
+            {
+                int next = (kx + 1 < size) ? kx + 1 : kx;
+                __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + (kx * channels))));
+                __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(src + (next * channels))));
+                __m256i w = _mm256_set1_epi32(weight_pair(weights[kx], (kx + 1 < size) ? weights[kx + 1] : 0));
+                lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+                hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
+            }
+        }
+        store_u8x16_fixed_avx2(out + x, lo, hi, GAUSSIAN_FIXED_BITS);
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static int horizontal_row_fixed_avx2(const unsigned char* src, short* out, int x, int x_end, const short* weights, int kernel_radius, int channels)
+{
+    int size = (2 * kernel_radius) + 1;
+    for (; x + 16 <= x_end; x += 16)
+    {
+        const unsigned char* base = src + x - (kernel_radius * channels);
+        __m256i lo = _mm256_setzero_si256(), hi = _mm256_setzero_si256();
+        for (int k = 0; k < size; k += 2)
+        {
+            int next = (k + 1 < size) ? k + 1 : k;
+            __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(base + (k * channels))));
+            __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(base + (next * channels))));
+            __m256i w = _mm256_set1_epi32(weight_pair(weights[k], (k + 1 < size) ? weights[k + 1] : 0));
+            lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+            hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
+        }
+        __m256i packed = _mm256_packs_epi32(_mm256_srai_epi32(lo, GAUSSIAN_FIXED_TEMP_BITS), _mm256_srai_epi32(hi, GAUSSIAN_FIXED_TEMP_BITS));
+        _mm256_storeu_si256((__m256i*)(out + x), packed);
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static int vertical_row_fixed_avx2(const short* src, int stride, unsigned char* out, int x, int x_end, const short* weights, int kernel_radius)
+{
+    int size = (2 * kernel_radius) + 1;
+    for (; x + 16 <= x_end; x += 16)
+    {
+        __m256i lo = _mm256_setzero_si256(), hi = _mm256_setzero_si256();
+        for (int k = 0; k < size; k += 2)
+        {
+            int next = (k + 1 < size) ? k + 1 : k;
+            __m256i a = _mm256_loadu_si256((const __m256i*)(src + (k * stride) + x));
+            __m256i b = _mm256_loadu_si256((const __m256i*)(src + (next * stride) + x));
+            __m256i w = _mm256_set1_epi32(weight_pair(weights[k], (k + 1 < size) ? weights[k + 1] : 0));
+            lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), w));
+            hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), w));
+        }
+        store_u8x16_fixed_avx2(out + x, lo, hi, GAUSSIAN_FIXED_BITS + GAUSSIAN_FIXED_TEMP_BITS);
+    }
+    return x;
+}
+#endif
+
+typedef struct
+{
+    const char* name;
+    exact_row_fn exact_row;
+    horizontal_row_fn horizontal_row;
+    vertical_row_fn vertical_row;
+    exact_row_fixed_fn exact_row_fixed;
+    horizontal_row_fixed_fn horizontal_row_fixed;
+    vertical_row_fixed_fn vertical_row_fixed;
+} simd_dispatch;
+
+static const simd_dispatch* select_simd(void)
+{
+    static const simd_dispatch scalar = { "scalar", exact_row_scalar, horizontal_row_scalar, vertical_row_scalar,
+                                          exact_row_fixed_scalar, horizontal_row_fixed_scalar, vertical_row_fixed_scalar };
+#ifdef CPU_BLUR_X86
+    static const simd_dispatch sse = { "sse4.1", exact_row_sse, horizontal_row_sse, vertical_row_sse,
+                                       exact_row_fixed_sse, horizontal_row_fixed_sse, vertical_row_fixed_sse };
+    static const simd_dispatch avx2 = { "avx2", exact_row_avx2, horizontal_row_avx2, vertical_row_avx2,
+                                        exact_row_fixed_avx2, horizontal_row_fixed_avx2, vertical_row_fixed_avx2 };
+
+    const char* forced = getenv("CPU_BLUR_SIMD");
+    int allow_avx2 = !forced || strcmp(forced, "avx2") == 0;
+    int allow_sse = allow_avx2 || strcmp(forced, "sse4.1") == 0 || strcmp(forced, "sse") == 0;
+
+    __builtin_cpu_init();
+    if (allow_avx2 && __builtin_cpu_supports("avx2"))
+        return &avx2;
+    if (allow_sse && __builtin_cpu_supports("sse4.1"))
+        return &sse;
+#endif
+    return &scalar;
+}
+
+static const simd_dispatch* get_simd(void)
+{
+    static const simd_dispatch* simd = NULL;
+    if (!simd)
+        simd = select_simd();
+    return simd;
+}
+
+const char* cpu_blur_simd_name(void)
+{
+    return get_simd()->name;
+}
+
+static inline int clamp_index(int i, int n)
+{
+    return (i < 0) ? 0 : (i >= n) ? n - 1 : i;
+}
+
+
+
+//------------------------------------------------------
+// Full 2D path
+//------------------------------------------------------
+typedef struct
+{
+    const unsigned char* input;
+    unsigned char* output;
+    int width;
+    int height;
+    int channels;
+    const float* mkernel;
+    int kernel_radius;
+    void** row_scratch;     // One array of 2r+1 row pointers per thread
+} exact_job;
+
+// Scalar sample with per-tap column clamping (border columns only)
+static inline unsigned char exact_pixel_clamped(const exact_job* job, const unsigned char** rows, int x)
+{
+    int size = (2 * job->kernel_radius) + 1;
+    int c = job->channels;
+    int pixel_x = x / c;
+    int channel = x % c;
+    float sum = 0.0f;
+    for (int ky = 0; ky < size; ky++)
+    {
+        for (int kx = 0; kx < size; kx++)
+        {
+            float pixel = rows[ky][(clamp_index(pixel_x + kx - job->kernel_radius, job->width) * c) + channel];
+            float weight = job->mkernel[(ky * size) + kx];
+            sum += pixel * weight;
+        }
+    }
+    return (unsigned char)sum;
+}
+
+static inline unsigned char exact_pixel_interior(const exact_job* job, const unsigned char** rows, int x)
+{
+    int size = (2 * job->kernel_radius) + 1;
+    int c = job->channels;
+    float sum = 0.0f;
+    for (int ky = 0; ky < size; ky++)
+    {
+        const unsigned char* src = rows[ky] + x - (job->kernel_radius * c);
+        for (int kx = 0; kx < size; kx++)
+        {
+            float pixel = src[kx * c];
+            float weight = job->mkernel[(ky * size) + kx];
+            sum += pixel * weight;
+        }
+    }
+    return (unsigned char)sum;
+}
+
+static void exact_band_task(void* ctx, int item, int thread_index)
+{
+    const exact_job* job = (const exact_job*)ctx;
+    const simd_dispatch* simd = get_simd();
+    const unsigned char** rows = (const unsigned char**)job->row_scratch[thread_index];
+    int r = job->kernel_radius;
+    int y_begin = item * EXACT_BAND_ROWS;
+    int y_end = (y_begin + EXACT_BAND_ROWS < job->height) ? y_begin + EXACT_BAND_ROWS : job->height;
+    int c = job->channels;
+    int samples = job->width * c;
+
+    // Interior columns are the samples of pixels [r, width - r); the rest clamp per tap
+    int interior_begin = (r < job->width) ? r * c : samples;
+    int interior_end = ((job->width - r) * c > interior_begin) ? (job->width - r) * c : interior_begin;
+
+    for (int y = y_begin; y < y_end; y++)
+    {
+        // Row clamping is resolved once per output row, not per tap
+        for (int ky = 0; ky <= 2 * r; ky++)
+            rows[ky] = job->input + ((size_t)clamp_index(y + ky - r, job->height) * samples);
+
+        unsigned char* out = job->output + ((size_t)y * samples);
+        int x = 0;
+        for (; x < interior_begin; x++)
+            out[x] = exact_pixel_clamped(job, rows, x);
+        x = simd->exact_row(rows, out, x, interior_end, job->mkernel, r, c);
+        for (; x < interior_end; x++)
+            out[x] = exact_pixel_interior(job, rows, x);
+        for (; x < samples; x++)
+            out[x] = exact_pixel_clamped(job, rows, x);
+    }
+}
+
+int cpu_gaussian_blur(cpu_thread_pool* pool, const unsigned char* input, unsigned char* output, int width, int height, int channels,
+                      const float* mkernel, int kernel_radius)
+{
+    int num_threads = cpu_thread_pool_size(pool);
+    exact_job job = { input, output, width, height, (channels > 1) ? channels : 1, mkernel, kernel_radius, NULL };
+    int scratch_threads = alloc_scratch(&job.row_scratch, num_threads, ((2 * kernel_radius) + 1) * sizeof(const unsigned char*));
+
+    int status = run_with_scratch(pool, exact_band_task, &job, (height + EXACT_BAND_ROWS - 1) / EXACT_BAND_ROWS, scratch_threads);
+
+    free_scratch(job.row_scratch, num_threads);
+    return status;
+}
+
+
+
+//------------------------------------------------------
+// Separable path
+//------------------------------------------------------
+typedef struct
+{
+    const unsigned char* input;
+    unsigned char* output;
+    int width;
+    int height;
+    int channels;
+    const float* row_weights;
+    const float* col_weights;
+    int kernel_radius;
+    int num_col_blocks;     // Blocks of SEPARABLE_BLOCK_COLS samples
+    void** block_scratch;   // One (SEPARABLE_BAND_ROWS + 2r) x SEPARABLE_BLOCK_COLS block per thread
+} separable_job;
+
+// Horizontal taps for one sample with per-tap column clamping (border columns only)
+static inline float horizontal_sample_clamped(const separable_job* job, const unsigned char* row, int x)
+{
+    int size = (2 * job->kernel_radius) + 1;
+    int c = job->channels;
+    int pixel_x = x / c;
+    int channel = x % c;
+    float sum = 0.0f;
+    for (int k = 0; k < size; k++)
+        sum += row[(clamp_index(pixel_x - job->kernel_radius + k, job->width) * c) + channel] * job->row_weights[k];
+    return sum;
+}
+
+static void separable_block_task(void* ctx, int item, int thread_index)
+{
+    const separable_job* job = (const separable_job*)ctx;
+    const simd_dispatch* simd = get_simd();
+    int r = job->kernel_radius;
+    int size = (2 * r) + 1;
+    int c = job->channels;
+    int samples = job->width * c;
+    int y_begin = (item / job->num_col_blocks) * SEPARABLE_BAND_ROWS;
+    int y_end = (y_begin + SEPARABLE_BAND_ROWS < job->height) ? y_begin + SEPARABLE_BAND_ROWS : job->height;
+    int x_begin = (item % job->num_col_blocks) * SEPARABLE_BLOCK_COLS;
+    int x_end = (x_begin + SEPARABLE_BLOCK_COLS < samples) ? x_begin + SEPARABLE_BLOCK_COLS : samples;
+    int block_width = x_end - x_begin;
+
+    // Interior columns (horizontal taps stay inside the image), in samples relative to x_begin
+    int interior_begin = ((r * c > x_begin) ? r * c : x_begin) - x_begin;
+    int interior_end = (((job->width - r) * c < x_end) ? (job->width - r) * c : x_end) - x_begin;
+    if (interior_begin > block_width)
+        interior_begin = block_width;
+    if (interior_end < interior_begin)
+        interior_end = interior_begin;
+
+    // Pass 1: horizontal taps for the band rows plus r halo rows above and below (clamped to the image)
+    float* block = (float*)job->block_scratch[thread_index];
+    for (int j = 0; j < (y_end - y_begin) + (2 * r); j++)
+    {
+        const unsigned char* row = job->input + ((size_t)clamp_index(y_begin - r + j, job->height) * samples);
+        const unsigned char* src = row + x_begin;
+        float* tmp = block + ((size_t)j * SEPARABLE_BLOCK_COLS);
+
+        int x = 0;
+        for (; x < interior_begin; x++)
+        {
+            tmp[x] = horizontal_sample_clamped(job, row, x_begin + x);
+        }
+        x = simd->horizontal_row(src, tmp, x, interior_end, job->row_weights, r, c);
+        for (; x < block_width; x++)
+        {
+            tmp[x] = horizontal_sample_clamped(job, row, x_begin + x);
+        }
+    }
+
+    // Pass 2: vertical taps straight out of the cached block
+    for (int y = y_begin; y < y_end; y++)
+    {
+        const float* tmp = block + ((size_t)(y - y_begin) * SEPARABLE_BLOCK_COLS);
+        unsigned char* out = job->output + ((size_t)y * samples) + x_begin;
+        int x = simd->vertical_row(tmp, SEPARABLE_BLOCK_COLS, out, 0, block_width, job->col_weights, r);
+        for (; x < block_width; x++)
+        {
+            float sum = 0.0f;
+            for (int k = 0; k < size; k++)
+                sum += tmp[(k * SEPARABLE_BLOCK_COLS) + x] * job->col_weights[k];
+            out[x] = (unsigned char)sum;
+        }
+    }
+}
+
+int cpu_gaussian_blur_separable(cpu_thread_pool* pool, const unsigned char* input, unsigned char* output, int width, int height, int channels,
+                                const float* row_weights, const float* col_weights, int kernel_radius)
+{
+    int num_threads = cpu_thread_pool_size(pool);
+    separable_job job = { input, output, width, height, (channels > 1) ? channels : 1, row_weights, col_weights, kernel_radius, 0, NULL };
+    job.num_col_blocks = ((width * job.channels) + SEPARABLE_BLOCK_COLS - 1) / SEPARABLE_BLOCK_COLS;
+    int scratch_threads = alloc_scratch(&job.block_scratch, num_threads, (size_t)(SEPARABLE_BAND_ROWS + (2 * kernel_radius)) * SEPARABLE_BLOCK_COLS * sizeof(float));
+
+    int num_bands = (height + SEPARABLE_BAND_ROWS - 1) / SEPARABLE_BAND_ROWS;
+    int status = run_with_scratch(pool, separable_block_task, &job, num_bands * job.num_col_blocks, scratch_threads);
+
+    free_scratch(job.block_scratch, num_threads);
+    return status;
+}
+
+
+
+//------------------------------------------------------
+// Fixed-point paths
+//------------------------------------------------------
+// Same bands and blocks as the float paths, on Q14 weights with int sums. Every sample is an exact
+// integer function of its neighbourhood, so the SIMD loops, the scalar code and the device FIXED_POINT
+// kernels agree bit for bit. The scalar code only handles borders and row tails, so it always clamps.
+typedef struct
+{
+    const unsigned char* input;
+    unsigned char* output;
+    int width;
+    int height;
+    int channels;
+    const short* mask;
+    int kernel_radius;
+    void** row_scratch;     // One array of 2r+1 row pointers per thread
+} fixed_exact_job;
+
+static inline unsigned char fixed_exact_pixel(const fixed_exact_job* job, const unsigned char** rows, int x)
+{
+    int size = (2 * job->kernel_radius) + 1;
+    int c = job->channels;
+    int pixel_x = x / c;
+    int channel = x % c;
+    int sum = 0;
+    for (int ky = 0; ky < size; ky++)
+    {
+        for (int kx = 0; kx < size; kx++)
+            sum += rows[ky][(clamp_index(pixel_x + kx - job->kernel_radius, job->width) * c) + channel] * job->mask[(ky * size) + kx];
+    }
+    return (unsigned char)(sum >> GAUSSIAN_FIXED_BITS);
+}
+
+static void fixed_exact_band_task(void* ctx, int item, int thread_index)
+{
+    const fixed_exact_job* job = (const fixed_exact_job*)ctx;
+    const simd_dispatch* simd = get_simd();
+    const unsigned char** rows = (const unsigned char**)job->row_scratch[thread_index];
+    int r = job->kernel_radius;
+    int y_begin = item * EXACT_BAND_ROWS;
+    int y_end = (y_begin + EXACT_BAND_ROWS < job->height) ? y_begin + EXACT_BAND_ROWS : job->height;
+    int c = job->channels;
+    int samples = job->width * c;
+    int interior_begin = (r < job->width) ? r * c : samples;
+    int interior_end = ((job->width - r) * c > interior_begin) ? (job->width - r) * c : interior_begin;
+
+    for (int y = y_begin; y < y_end; y++)
+    {
+        for (int ky = 0; ky <= 2 * r; ky++)
+            rows[ky] = job->input + ((size_t)clamp_index(y + ky - r, job->height) * samples);
+
+        unsigned char* out = job->output + ((size_t)y * samples);
+        int x = 0;
+        for (; x < interior_begin; x++)
+            out[x] = fixed_exact_pixel(job, rows, x);
+        x = simd->exact_row_fixed(rows, out, x, interior_end, job->mask, r, c);
+        for (; x < samples; x++)
+            out[x] = fixed_exact_pixel(job, rows, x);
+    }
+}
+
+int cpu_gaussian_blur_fixed(cpu_thread_pool* pool, const unsigned char* input, unsigned char* output, int width, int height, int channels,
+                            const short* mask, int kernel_radius)
+{
+    int num_threads = cpu_thread_pool_size(pool);
+    fixed_exact_job job = { input, output, width, height, (channels > 1) ? channels : 1, mask, kernel_radius, NULL };
+    int scratch_threads = alloc_scratch(&job.row_scratch, num_threads, ((2 * kernel_radius) + 1) * sizeof(const unsigned char*));
+
+    int status = run_with_scratch(pool, fixed_exact_band_task, &job, (height + EXACT_BAND_ROWS - 1) / EXACT_BAND_ROWS, scratch_threads);
+
+    free_scratch(job.row_scratch, num_threads);
+    return status;
+}
+
+typedef struct
+{
+    const unsigned char* input;
+    unsigned char* output;
+    int width;
+    int height;
+    int channels;
+    const short* row_weights;
+    const short* col_weights;
+    int kernel_radius;
+    int num_col_blocks;     // Blocks of SEPARABLE_BLOCK_COLS samples
+    void** block_scratch;   // One (SEPARABLE_BAND_ROWS + 2r) x SEPARABLE_BLOCK_COLS block per thread
+} fixed_separable_job;
+
+// Horizontal taps for one sample with column clamping, as the Q7 intermediate
+static inline short fixed_horizontal_sample(const fixed_separable_job* job, const unsigned char* row, int x)
+{
+    int size = (2 * job->kernel_radius) + 1;
+    int c = job->channels;
+    int pixel_x = x / c;
+    int channel = x % c;
+    int sum = 0;
+    for (int k = 0; k < size; k++)
+        sum += row[(clamp_index(pixel_x - job->kernel_radius + k, job->width) * c) + channel] * job->row_weights[k];
+    return (short)(sum >> GAUSSIAN_FIXED_TEMP_BITS);
+}
+
+static void fixed_separable_block_task(void* ctx, int item, int thread_index)
+{
+    const fixed_separable_job* job = (const fixed_separable_job*)ctx;
+    const simd_dispatch* simd = get_simd();
+    int r = job->kernel_radius;
+    int size = (2 * r) + 1;
+    int c = job->channels;
+    int samples = job->width * c;
+    int y_begin = (item / job->num_col_blocks) * SEPARABLE_BAND_ROWS;
+    int y_end = (y_begin + SEPARABLE_BAND_ROWS < job->height) ? y_begin + SEPARABLE_BAND_ROWS : job->height;
+    int x_begin = (item % job->num_col_blocks) * SEPARABLE_BLOCK_COLS;
+    int x_end = (x_begin + SEPARABLE_BLOCK_COLS < samples) ? x_begin + SEPARABLE_BLOCK_COLS : samples;
+    int block_width = x_end - x_begin;
+
+    int interior_begin = ((r * c > x_begin) ? r * c : x_begin) - x_begin;
+    int interior_end = (((job->width - r) * c < x_end) ? (job->width - r) * c : x_end) - x_begin;
+    if (interior_begin > block_width)
+        interior_begin = block_width;
+    if (interior_end < interior_begin)
+        interior_end = interior_begin;
+
+    // Pass 1: horizontal taps into the Q7 block, halo rows included
+    short* block = (short*)job->block_scratch[thread_index];
+    for (int j = 0; j < (y_end - y_begin) + (2 * r); j++)
+    {
+        const unsigned char* row = job->input + ((size_t)clamp_index(y_begin - r + j, job->height) * samples);
+        short* tmp = block + ((size_t)j * SEPARABLE_BLOCK_COLS);
+
+        int x = 0;
+        for (; x < interior_begin; x++)
+            tmp[x] = fixed_horizontal_sample(job, row, x_begin + x);
+        x = simd->horizontal_row_fixed(row + x_begin, tmp, x, interior_end, job->row_weights, r, c);
+        for (; x < block_width; x++)
+            tmp[x] = fixed_horizontal_sample(job, row, x_begin + x);
+    }
+
+    // Pass 2: vertical taps, shifting out the weight and intermediate fractions
+    for (int y = y_begin; y < y_end; y++)
+    {
+        const short* tmp = block + ((size_t)(y - y_begin) * SEPARABLE_BLOCK_COLS);
+        unsigned char* out = job->output + ((size_t)y * samples) + x_begin;
+        int x = simd->vertical_row_fixed(tmp, SEPARABLE_BLOCK_COLS, out, 0, block_width, job->col_weights, r);
+        for (; x < block_width; x++)
+        {
+            int sum = 0;
+            for (int k = 0; k < size; k++)
+                sum += tmp[(k * SEPARABLE_BLOCK_COLS) + x] * job->col_weights[k];
+            out[x] = (unsigned char)(sum >> (GAUSSIAN_FIXED_BITS + GAUSSIAN_FIXED_TEMP_BITS));
+        }
+    }
+}
+
+int cpu_gaussian_blur_separable_fixed(cpu_thread_pool* pool, const unsigned char* input, unsigned char* output, int width, int height, int channels,
+                                      const short* row_weights, const short* col_weights, int kernel_radius)
+{
+    int num_threads = cpu_thread_pool_size(pool);
+    fixed_separable_job job = { input, output, width, height, (channels > 1) ? channels : 1, row_weights, col_weights, kernel_radius, 0, NULL };
+    job.num_col_blocks = ((width * job.channels) + SEPARABLE_BLOCK_COLS - 1) / SEPARABLE_BLOCK_COLS;
+    int scratch_threads = alloc_scratch(&job.block_scratch, num_threads, (size_t)(SEPARABLE_BAND_ROWS + (2 * kernel_radius)) * SEPARABLE_BLOCK_COLS * sizeof(short));
+
+    int num_bands = (height + SEPARABLE_BAND_ROWS - 1) / SEPARABLE_BAND_ROWS;
+    int status = run_with_scratch(pool, fixed_separable_block_task, &job, num_bands * job.num_col_blocks, scratch_threads);
+
+    free_scratch(job.block_scratch, num_threads);
+    return status;
+}
@@ -0,0 +1,51 @@
+#ifndef CPU_BLUR_H
+#define CPU_BLUR_H
+
+// Multithreaded, vectorized CPU blur engine.
+// Rows are split across a persistent thread pool; interior pixels run through SSE4.1/AVX2
+// loops (picked at runtime, scalar fallback) and only the border columns clamp per tap.
+// Images are interleaved with channels bytes per pixel (1, 3 for RGB, 4 for RGBA); every channel
+// is blurred independently with the same mask.
+
+typedef struct cpu_thread_pool cpu_thread_pool;
+
+// Task callback: item is the work item index, thread_index is in [0, cpu_thread_pool_size())
+typedef void (*cpu_task_fn)(void* ctx, int item, int thread_index);
+
+// num_threads <= 0 uses one thread per online CPU. Workers that cannot be allocated or started are
+// dropped, so the pool may end up smaller (down to the calling thread alone); NULL only when out of memory.
+cpu_thread_pool* cpu_thread_pool_create(int num_threads);
+void cpu_thread_pool_destroy(cpu_thread_pool* pool);
+int cpu_thread_pool_size(const cpu_thread_pool* pool);
+
+// Runs task(ctx, item, thread) for every item in [0, num_items) and returns when all are done.
+// The calling thread takes part in the work.
+void cpu_thread_pool_run(cpu_thread_pool* pool, cpu_task_fn task, void* ctx, int num_items);
+
+// Name of the instruction set used by the inner loops ("avx2", "sse4.1" or "scalar").
+// The CPU_BLUR_SIMD environment variable can force a lower level.
+const char* cpu_blur_simd_name(void);
+
+// The blurs return 0, or -1 when not even the calling thread's scratch memory could be allocated.
+// With scratch for only some of the threads they run on the calling thread alone.
+
+// Full 2D convolution, bit-identical to gaussian_blur_host: every lane accumulates the taps in the
+// same row-major order with separate multiply and add, then truncates to unsigned char.
+int cpu_gaussian_blur(cpu_thread_pool* pool, const unsigned char* input, unsigned char* output, int width, int height, int channels,
+                      const float* mkernel, int kernel_radius);
+
+// Separable two-pass convolution (mask = col_weights * row_weights^T), processed in row bands and
+// column blocks so the float intermediate of each block stays in cache. O(r) work per pixel; the
+// result can differ from the 2D reference by one because of the different summation order.
+int cpu_gaussian_blur_separable(cpu_thread_pool* pool, const unsigned char* input, unsigned char* output, int width, int height, int channels,
+                                const float* row_weights, const float* col_weights, int kernel_radius);
+
+// Fixed-point versions on Q14 weights from quantize_weights (gaussian_mask.h): integer sums, pairs of taps
+// per pmaddwd in the SSE4.1/AVX2 loops, and a Q7 short intermediate on the separable path. Bit-identical
+// to the device's fixed-point kernels; within a step or two of the float blur (the exact bound depends on the mask).
+int cpu_gaussian_blur_fixed(cpu_thread_pool* pool, const unsigned char* input, unsigned char* output, int width, int height, int channels,
+                            const short* mask, int kernel_radius);
+int cpu_gaussian_blur_separable_fixed(cpu_thread_pool* pool, const unsigned char* input, unsigned char* output, int width, int height, int channels,
+                                      const short* row_weights, const short* col_weights, int kernel_radius);
+
+#endif
@@ -1,7 +1,12 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <CL/cl.h>
 
-#define STRING_BUFFER_LEN 1024
+#include "ocl_runtime.h"
+#include "device_profile.h"
+
+#define MAX_CANDIDATES 64
 
 // OpenCL kernel
 const char *kernelSource =
@@ -27,81 +32,96 @@ void print_platform_details(cl_platform_id platform)
     printf("Version : %s\n", platformVersion);
 }
 
-void printDeviceInfo(cl_device_id device) {
-    char buffer[STRING_BUFFER_LEN];
-    cl_ulong globalMemSize;
-    size_t maxWorkGroupSize;
-    cl_uint computeUnits;
-
-    // Get and print device name
-    clGetDeviceInfo(device, CL_DEVICE_NAME, STRING_BUFFER_LEN, buffer, NULL);
-    printf("Device Name: %s\n", buffer);
-
-    // Get and print device vendor
-    clGetDeviceInfo(device, CL_DEVICE_VENDOR, STRING_BUFFER_LEN, buffer, NULL);
-    printf("Device Vendor: %s\n", buffer);
-
-    // Get and print device version
-    clGetDeviceInfo(device, CL_DEVICE_VERSION, STRING_BUFFER_LEN, buffer, NULL);
-    printf("Device Version: %s\n", buffer);
-
-    // Get and print max compute units
-    clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(computeUnits), &computeUnits, NULL);
-    printf("Max Compute Units: %u\n", computeUnits);
-
-    // Get and print global memory size
-    clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(globalMemSize), &globalMemSize, NULL);
-    printf("Global Memory Size: %lu MB\n", globalMemSize / (1024 * 1024));
-
-    // Get and print max work group size
-    clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(maxWorkGroupSize), &maxWorkGroupSize, NULL);
-    printf("Max Work Group Size: %zu\n", maxWorkGroupSize);
+// Writes every profile as one JSON report: {"devices": [...]}
+int write_report(const char* path, const device_profile* profiles, int count) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Error: Could not write %s\n", path);
+        return -1;
+    }
+    fprintf(file, "{\n  \"devices\": [\n");
+    for (int i = 0; i < count; i++) {
+        device_profile_write_json(file, &profiles[i], 4);
+        fprintf(file, (i + 1 < count) ? ",\n" : "\n");
+    }
+    fprintf(file, "  ]\n}\n");
+    return (fclose(file) == 0) ? 0 : -1;
 }
 
-int main() {
-    // Step 1: Get Platform and Device
-    cl_platform_id platform;
-    cl_device_id device;
-    clGetPlatformIDs(1, &platform, NULL);
-    clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, NULL);
+int main(int argc, char** argv) {
+    // --json file.json  writes the capability profiles of every device as one machine-readable report
+    // --refresh         queries and measures again instead of reading the cached profiles
+    const char* json_path = NULL;
+    int refresh = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            json_path = argv[++i];
+        else if (strcmp(argv[i], "--refresh") == 0)
+            refresh = 1;
+    }
 
-    // Print device information
-    print_platform_details(platform);
-    printDeviceInfo(device);
+    // Step 1: Get Platform and Device
+    // Profile every device on every platform (cached after the first run), then run the kernel on the selected one
+    device_candidate candidates[MAX_CANDIDATES];
+    int num_candidates = enumerate_devices(candidates, MAX_CANDIDATES);
+    device_profile* profiles = (device_profile*)calloc(num_candidates > 0 ? num_candidates : 1, sizeof(device_profile));
+    int num_profiles = 0;
+    for (int i = 0; i < num_candidates; i++) {
+        printf("\n--- Platform %u, Device %u ---\n", candidates[i].platform_index, candidates[i].device_index);
+        print_platform_details(candidates[i].platform);
+        if (device_profile_get(candidates[i].device, &profiles[num_profiles], 1, refresh) != CL_SUCCESS)
+            continue;
+        device_profile_print(&profiles[num_profiles], 1);
+        num_profiles++;
+    }
+    if (json_path && write_report(json_path, profiles, num_profiles) == 0)
+        printf("\nDevice report written to %s\n", json_path);
+    free(profiles);
 
     // Step 2: Create OpenCL Context and Command Queue
-    cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, NULL);
-    cl_command_queue queue = clCreateCommandQueue(context, device, 0, NULL);
+    ocl_runtime rt;
+    cl_int err = ocl_runtime_init(&rt, find_device_flag(argc, argv), 0);
+    if (err != CL_SUCCESS) {
+        printf("Failed to set up OpenCL: %s\n", ocl_error_string(err));
+        return -1;
+    }
+    printf("\nRunning on %s / %s\n", rt.selected.platform_name, rt.selected.device_name);
 
     // Step 3: Create Memory Buffer
     char output[14] = {0}; // To store "Hello, World!\n"
-    cl_mem outputBuffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(output), NULL, NULL);
+    cl_mem outputBuffer = ocl_runtime_buffer(&rt, CL_MEM_WRITE_ONLY, sizeof(output), NULL, &err);
+    if (!outputBuffer) {
+        ocl_runtime_release(&rt);
+        return -1;
+    }
 
     // Step 4: Compile Kernel
-    cl_program program = clCreateProgramWithSource(context, 1, &kernelSource, NULL, NULL);
-    clBuildProgram(program, 1, &device, NULL, NULL, NULL);
-    cl_kernel kernel = clCreateKernel(program, "hello_kernel", NULL);
+    cl_program program = ocl_runtime_program(&rt, "hello_kernel", kernelSource, NULL, &err);
+    cl_kernel kernel = program ? ocl_runtime_kernel(&rt, program, "hello_kernel", &err) : NULL;
+    if (!kernel) {
+        clReleaseMemObject(outputBuffer);
+        ocl_runtime_release(&rt);
+        return -1;
+    }
 
     // Step 5: Set Kernel Arguments
-    clSetKernelArg(kernel, 0, sizeof(cl_mem), &outputBuffer);
+    OCL_CHECK_GOTO(clSetKernelArg(kernel, 0, sizeof(cl_mem), &outputBuffer), err, cleanup);
 
     // Step 6: Enqueue Kernel Execution
     size_t globalSize = sizeof(output);
-    clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &globalSize, NULL, 0, NULL, NULL);
+    OCL_CHECK_GOTO(clEnqueueNDRangeKernel(rt.queue, kernel, 1, NULL, &globalSize, NULL, 0, NULL, NULL), err, cleanup);
 
     // Step 7: Ensure all commands finish
-    clFinish(queue); // Wait for all enqueued tasks (kernel execution) to complete
+    OCL_CHECK_GOTO(clFinish(rt.queue), err, cleanup); // Wait for all enqueued tasks (kernel execution) to complete
 
     // Step 8: Read and Print Output
-    clEnqueueReadBuffer(queue, outputBuffer, CL_TRUE, 0, sizeof(output), output, 0, NULL, NULL);
-    printf("%s", output);
+    OCL_CHECK_GOTO(clEnqueueReadBuffer(rt.queue, outputBuffer, CL_TRUE, 0, sizeof(output), output, 0, NULL, NULL), err, cleanup);
+    printf("%.*s", (int)sizeof(output), output);
 
-    // Step 9: Cleanup
-    clReleaseKernel(kernel);
-    clReleaseProgram(program);
+    // Step 9: Cleanup (the runtime releases the program and kernel)
+cleanup:
     clReleaseMemObject(outputBuffer);
-    clReleaseCommandQueue(queue);
-    clReleaseContext(context);
+    ocl_runtime_release(&rt);
 
-    return 0;
+    return (err == CL_SUCCESS) ? 0 : -1;
 }
@@ -0,0 +1,547 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "device_profile.h"
+#include "ocl_runtime.h"
+#include "program_cache.h"
+
+#define PROFILE_PATH_LEN 1024
+#define PROFILE_FILE_MAX (64 * 1024)        // Largest profile file read back
+#define BANDWIDTH_BYTES (32 * 1024 * 1024)  // Transfer and copy size, capped at half the largest allocation
+#define BANDWIDTH_TRIALS 5                  // Timed runs per bandwidth figure, the fastest counts
+#define LATENCY_RUNS 31                     // Timed empty launches, the median counts
+
+// Microbenchmark kernels: an empty kernel for the launch latency, and the calibration kernel the device
+// selection ranks devices by (a short dependent multiply-add chain per element, enough to load every
+// compute unit and touch 4 MB of global memory)
+static const char* profile_source =
+"__kernel void empty(void)                                  \n"
+"{                                                          \n"
+"}                                                          \n"
+"                                                           \n"
+"__kernel void calibrate(__global float* data)              \n"
+"{                                                          \n"
+"    int i = get_global_id(0);                              \n"
+"    float v = data[i];                                     \n"
+"    for (int k = 0; k < 64; k++)                           \n"
+"        v = (v * 0.999f) + 0.5f;                           \n"
+"    data[i] = v;                                           \n"
+"}                                                          \n";
+
+
+
+static double wall_clock_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+//------------------------------------------------------
+// Queries
+//------------------------------------------------------
+
+// Reads a string property, truncated to out_size
+static cl_int query_string(cl_device_id device, cl_device_info param, char* out, size_t out_size)
+{
+    size_t size = 0;
+    out[0] = '\0';
+    cl_int err = clGetDeviceInfo(device, param, 0, NULL, &size);
+    if (err != CL_SUCCESS || size <= out_size)
+        return (err != CL_SUCCESS) ? err : clGetDeviceInfo(device, param, out_size, out, NULL);
+
+    char* full = (char*)malloc(size);
+    err = clGetDeviceInfo(device, param, size, full, NULL);
+    if (err == CL_SUCCESS)
+        snprintf(out, out_size, "%s", full);
+    free(full);
+    return err;
+}
+
+// Reads the extension list; the fp16/fp64 flags come from the full list, even when the stored copy is truncated
+static cl_int query_extensions(cl_device_id device, device_profile* profile)
+{
+    size_t size = 0;
+    cl_int err = clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, 0, NULL, &size);
+    if (err != CL_SUCCESS)
+        return err;
+    char* extensions = (char*)calloc(size + 1, 1);
+    err = clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, size, extensions, NULL);
+    if (err == CL_SUCCESS)
+    {
+        profile->fp16 = strstr(extensions, "cl_khr_fp16") != NULL;
+        profile->fp64 = strstr(extensions, "cl_khr_fp64") != NULL;
+        snprintf(profile->extensions, sizeof(profile->extensions), "%s", extensions);
+    }
+    free(extensions);
+    return err;
+}
+
+cl_int device_profile_query(cl_device_id device, device_profile* profile)
+{
+    cl_platform_id platform;
+    memset(profile, 0, sizeof(*profile));
+    OCL_CHECK(clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, NULL));
+    OCL_CHECK(clGetPlatformInfo(platform, CL_PLATFORM_NAME, sizeof(profile->platform_name), profile->platform_name, NULL));
+    OCL_CHECK(query_string(device, CL_DEVICE_NAME, profile->device_name, sizeof(profile->device_name)));
+    OCL_CHECK(query_string(device, CL_DEVICE_VENDOR, profile->vendor, sizeof(profile->vendor)));
+    OCL_CHECK(query_string(device, CL_DEVICE_VERSION, profile->device_version, sizeof(profile->device_version)));
+    OCL_CHECK(query_string(device, CL_DRIVER_VERSION, profile->driver_version, sizeof(profile->driver_version)));
+    OCL_CHECK(clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(profile->type), &profile->type, NULL));
+    OCL_CHECK(clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(profile->compute_units), &profile->compute_units, NULL));
+    OCL_CHECK(clGetDeviceInfo(device, CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(profile->max_clock_mhz), &profile->max_clock_mhz, NULL));
+    OCL_CHECK(clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(profile->global_mem_size), &profile->global_mem_size, NULL));
+    OCL_CHECK(clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(profile->local_mem_size), &profile->local_mem_size, NULL));
+    OCL_CHECK(clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(profile->max_mem_alloc_size), &profile->max_mem_alloc_size, NULL));
+    OCL_CHECK(clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(profile->max_work_group_size), &profile->max_work_group_size, NULL));
+    OCL_CHECK(clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(profile->max_work_item_sizes), profile->max_work_item_sizes, NULL));
+    OCL_CHECK(clGetDeviceInfo(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_CHAR, sizeof(cl_uint), &profile->vector_width_char, NULL));
+    OCL_CHECK(clGetDeviceInfo(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_SHORT, sizeof(cl_uint), &profile->vector_width_short, NULL));
+    OCL_CHECK(clGetDeviceInfo(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_INT, sizeof(cl_uint), &profile->vector_width_int, NULL));
+    OCL_CHECK(clGetDeviceInfo(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT, sizeof(cl_uint), &profile->vector_width_float, NULL));
+    OCL_CHECK(clGetDeviceInfo(device, CL_DEVICE_IMAGE_SUPPORT, sizeof(profile->image_support), &profile->image_support, NULL));
+    OCL_CHECK(query_extensions(device, profile));
+
+    // OpenCL 1.1 properties some 1.0 drivers reject
+    if (clGetDeviceInfo(device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_HALF, sizeof(cl_uint), &profile->vector_width_half, NULL) != CL_SUCCESS)
+        profile->vector_width_half = 0;
+    if (profile->image_support &&
+        (clGetDeviceInfo(device, CL_DEVICE_IMAGE2D_MAX_WIDTH, sizeof(profile->image2d_max_width), &profile->image2d_max_width, NULL) != CL_SUCCESS ||
+         clGetDeviceInfo(device, CL_DEVICE_IMAGE2D_MAX_HEIGHT, sizeof(profile->image2d_max_height), &profile->image2d_max_height, NULL) != CL_SUCCESS))
+        profile->image_support = CL_FALSE;
+    // Deprecated in OpenCL 2.0 but still answered; CPU devices always share host memory
+    if (clGetDeviceInfo(device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(profile->host_unified_memory), &profile->host_unified_memory, NULL) != CL_SUCCESS)
+        profile->host_unified_memory = CL_FALSE;
+    if (profile->type & CL_DEVICE_TYPE_CPU)
+        profile->host_unified_memory = CL_TRUE;
+    return CL_SUCCESS;
+}
+
+//------------------------------------------------------
+// Microbenchmarks
+//------------------------------------------------------
+
+// Kernel or transfer time of a completed command, from its profiling events. Releases the event.
+static double command_time_sec(cl_event event)
+{
+    cl_ulong start = 0, end = 0;
+    clWaitForEvents(1, &event);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+    clReleaseEvent(event);
+    return (end > start) ? (end - start) * 1e-9 : 0.0;
+}
+
+static int compare_double(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Fastest of a warm-up plus BANDWIDTH_TRIALS runs of a write (0), read (1) or device copy (2), in GB/s
+static cl_int time_transfer(cl_command_queue queue, int kind, cl_mem a, cl_mem b, void* host, size_t bytes, double* gbs)
+{
+    double best = 0.0;
+    for (int i = 0; i <= BANDWIDTH_TRIALS; i++)
+    {
+        cl_event event;
+        if (kind == 0)
+            OCL_CHECK(clEnqueueWriteBuffer(queue, a, CL_FALSE, 0, bytes, host, 0, NULL, &event));
+        else if (kind == 1)
+            OCL_CHECK(clEnqueueReadBuffer(queue, a, CL_FALSE, 0, bytes, host, 0, NULL, &event));
+        else
+            OCL_CHECK(clEnqueueCopyBuffer(queue, a, b, 0, 0, bytes, 0, NULL, &event));
+        double time_sec = command_time_sec(event);
+        if (i > 0 && time_sec > 0.0 && (best == 0.0 || time_sec < best))
+            best = time_sec;
+    }
+    // A copy reads and writes every byte
+    *gbs = (best > 0.0) ? ((kind == 2 ? 2.0 : 1.0) * bytes) / best * 1e-9 : 0.0;
+    return CL_SUCCESS;
+}
+
+cl_int device_profile_measure(cl_device_id device, device_profile* profile)
+{
+    cl_int err;
+    profile->measured = 0;
+    if (profile->max_mem_alloc_size == 0)
+        OCL_CHECK(device_profile_query(device, profile));
+
+    cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
+    if (!context)
+    {
+        ocl_report_error("clCreateContext", err, __FILE__, __LINE__);
+        return err;
+    }
+    size_t bytes = BANDWIDTH_BYTES;
+    if (bytes > profile->max_mem_alloc_size / 2)
+        bytes = (size_t)(profile->max_mem_alloc_size / 2);
+    size_t calibration_bytes = DEVICE_PROFILE_CALIBRATION_ITEMS * sizeof(cl_float);
+    cl_command_queue queue = NULL;
+    cl_program program = NULL;
+    cl_kernel empty = NULL;
+    cl_kernel calibrate = NULL;
+    cl_mem a = NULL;
+    cl_mem b = NULL;
+    cl_mem calibration = NULL;
+    void* host = malloc(bytes);
+
+    queue = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err);
+    if (!queue)
+    {
+        ocl_report_error("clCreateCommandQueue", err, __FILE__, __LINE__);
+        goto cleanup;
+    }
+    if (!(program = build_program_cached(context, device, profile_source, NULL, NULL, &err)))
+        goto cleanup;
+    if (!(empty = clCreateKernel(program, "empty", &err)) || !(calibrate = clCreateKernel(program, "calibrate", &err)))
+    {
+        ocl_report_error("clCreateKernel", err, __FILE__, __LINE__);
+        goto cleanup;
+    }
+    if (!(a = clCreateBuffer(context, CL_MEM_READ_WRITE, bytes, NULL, &err)) ||
+        !(b = clCreateBuffer(context, CL_MEM_READ_WRITE, bytes, NULL, &err)) ||
+        !(calibration = clCreateBuffer(context, CL_MEM_READ_WRITE, calibration_bytes, NULL, &err)))
+    {
+        ocl_report_error("clCreateBuffer", err, __FILE__, __LINE__);
+        goto cleanup;
+    }
+
+    // Bandwidth: host to device, device to host, device copy
+    memset(host, 1, bytes);
+    if ((err = time_transfer(queue, 0, a, NULL, host, bytes, &profile->write_gbs)) != CL_SUCCESS ||
+        (err = time_transfer(queue, 1, a, NULL, host, bytes, &profile->read_gbs)) != CL_SUCCESS ||
+        (err = time_transfer(queue, 2, a, b, host, bytes, &profile->copy_gbs)) != CL_SUCCESS)
+        goto cleanup;
+
+    // Launch latency: the wall clock of an empty one-item launch, enqueue to completion
+    size_t one = 1;
+    double latencies[LATENCY_RUNS];
+    for (int i = -3; i < LATENCY_RUNS; i++)
+    {
+        double start = wall_clock_sec();
+        OCL_CHECK_GOTO(clEnqueueNDRangeKernel(queue, empty, 1, NULL, &one, NULL, 0, NULL, NULL), err, cleanup);
+        OCL_CHECK_GOTO(clFinish(queue), err, cleanup);
+        if (i >= 0)
+            latencies[i] = wall_clock_sec() - start;
+    }
+    qsort(latencies, LATENCY_RUNS, sizeof(double), compare_double);
+    profile->launch_latency_us = latencies[LATENCY_RUNS / 2] * 1e6;
+
+    // Calibration: the first launch warms up the driver, the second one is timed
+    float zero = 0.0f;
+    size_t calibration_items = DEVICE_PROFILE_CALIBRATION_ITEMS;
+    cl_event event;
+    OCL_CHECK_GOTO(clSetKernelArg(calibrate, 0, sizeof(cl_mem), &calibration), err, cleanup);
+    OCL_CHECK_GOTO(clEnqueueFillBuffer(queue, calibration, &zero, sizeof(zero), 0, calibration_bytes, 0, NULL, NULL), err, cleanup);
+    OCL_CHECK_GOTO(clEnqueueNDRangeKernel(queue, calibrate, 1, NULL, &calibration_items, NULL, 0, NULL, NULL), err, cleanup);
+    OCL_CHECK_GOTO(clEnqueueNDRangeKernel(queue, calibrate, 1, NULL, &calibration_items, NULL, 0, NULL, &event), err, cleanup);
+    profile->calibration_sec = command_time_sec(event);
+    profile->measured = 1;
+
+cleanup:
+    if (queue)
+        clFinish(queue);
+    if (calibration)
+        clReleaseMemObject(calibration);
+    if (b)
+        clReleaseMemObject(b);
+    if (a)
+        clReleaseMemObject(a);
+    if (calibrate)
+        clReleaseKernel(calibrate);
+    if (empty)
+        clReleaseKernel(empty);
+    if (program)
+        clReleaseProgram(program);
+    if (queue)
+        clReleaseCommandQueue(queue);
+    clReleaseContext(context);
+    free(host);
+    return err;
+}
+
+//------------------------------------------------------
+// JSON cache
+//------------------------------------------------------
+
+static const char* type_name(cl_device_type type)
+{
+    if (type & CL_DEVICE_TYPE_GPU)
+        return "gpu";
+    if (type & CL_DEVICE_TYPE_ACCELERATOR)
+        return "accelerator";
+    if (type & CL_DEVICE_TYPE_CPU)
+        return "cpu";
+    return "other";
+}
+
+static void write_json_string(FILE* file, const char* key, const char* text, int indent)
+{
+    fprintf(file, "%*s  \"%s\": \"", indent, "", key);
+    for (const char* p = text; *p; p++)
+    {
+        if (*p == '"' || *p == '\\')
+            fprintf(file, "\\%c", *p);
+        else if ((unsigned char)*p < 0x20)
+            fprintf(file, "\\u%04x", (unsigned char)*p);
+        else
+            fputc(*p, file);
+    }
+    fprintf(file, "\",\n");
+}
+
+void device_profile_write_json(FILE* file, const device_profile* profile, int indent)
+{
+    const device_profile* p = profile;
+    fprintf(file, "%*s{\n", indent, "");
+    fprintf(file, "%*s  \"version\": %d,\n", indent, "", DEVICE_PROFILE_VERSION);
+    write_json_string(file, "platform", p->platform_name, indent);
+    write_json_string(file, "device", p->device_name, indent);
+    write_json_string(file, "vendor", p->vendor, indent);
+    write_json_string(file, "device_version", p->device_version, indent);
+    write_json_string(file, "driver_version", p->driver_version, indent);
+    write_json_string(file, "type", type_name(p->type), indent);
+    fprintf(file, "%*s  \"compute_units\": %u,\n", indent, "", p->compute_units);
+    fprintf(file, "%*s  \"max_clock_mhz\": %u,\n", indent, "", p->max_clock_mhz);
+    fprintf(file, "%*s  \"global_mem_size\": %llu,\n", indent, "", (unsigned long long)p->global_mem_size);
+    fprintf(file, "%*s  \"local_mem_size\": %llu,\n", indent, "", (unsigned long long)p->local_mem_size);
+    fprintf(file, "%*s  \"max_mem_alloc_size\": %llu,\n", indent, "", (unsigned long long)p->max_mem_alloc_size);
+    fprintf(file, "%*s  \"max_work_group_size\": %zu,\n", indent, "", p->max_work_group_size);
+    fprintf(file, "%*s  \"max_work_item_sizes\": [%zu, %zu, %zu],\n", indent, "", p->max_work_item_sizes[0], p->max_work_item_sizes[1],
+            p->max_work_item_sizes[2]);
+    fprintf(file, "%*s  \"vector_width_char\": %u,\n", indent, "", p->vector_width_char);
+    fprintf(file, "%*s  \"vector_width_short\": %u,\n", indent, "", p->vector_width_short);
+    fprintf(file, "%*s  \"vector_width_int\": %u,\n", indent, "", p->vector_width_int);
+    fprintf(file, "%*s  \"vector_width_float\": %u,\n", indent, "", p->vector_width_float);
+    fprintf(file, "%*s  \"vector_width_half\": %u,\n", indent, "", p->vector_width_half);
+    fprintf(file, "%*s  \"image_support\": %s,\n", indent, "", p->image_support ? "true" : "false");
+    fprintf(file, "%*s  \"image2d_max_width\": %zu,\n", indent, "", p->image2d_max_width);
+    fprintf(file, "%*s  \"image2d_max_height\": %zu,\n", indent, "", p->image2d_max_height);
+    fprintf(file, "%*s  \"host_unified_memory\": %s,\n", indent, "", p->host_unified_memory ? "true" : "false");
+    fprintf(file, "%*s  \"fp16\": %s,\n", indent, "", p->fp16 ? "true" : "false");
+    fprintf(file, "%*s  \"fp64\": %s,\n", indent, "", p->fp64 ? "true" : "false");
+    write_json_string(file, "extensions", p->extensions, indent);
+    fprintf(file, "%*s  \"measured\": %s,\n", indent, "", p->measured ? "true" : "false");
+    fprintf(file, "%*s  \"write_gbs\": %.4f,\n", indent, "", p->write_gbs);
+    fprintf(file, "%*s  \"read_gbs\": %.4f,\n", indent, "", p->read_gbs);
+    fprintf(file, "%*s  \"copy_gbs\": %.4f,\n", indent, "", p->copy_gbs);
+    fprintf(file, "%*s  \"launch_latency_us\": %.3f,\n", indent, "", p->launch_latency_us);
+    fprintf(file, "%*s  \"calibration_sec\": %.9f\n", indent, "", p->calibration_sec);
+    fprintf(file, "%*s}", indent, "");
+}
+
+// The files are the flat objects written above, so a lookup of "key": is all the parsing needed.
+// Returns the start of the value, or NULL when the key is missing.
+static const char* json_value(const char* text, const char* key)
+{
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char* found = strstr(text, pattern);
+    if (!found)
+        return NULL;
+    found += strlen(pattern);
+    while (*found == ' ')
+        found++;
+    return found;
+}
+
+static int json_string(const char* text, const char* key, char* out, size_t out_size)
+{
+    const char* value = json_value(text, key);
+    if (!value || *value != '"')
+        return 0;
+    size_t length = 0;
+    for (value++; *value && *value != '"'; value++)
+    {
+        char c = *value;
+        if (c == '\\' && value[1] == 'u' && value[2] && value[3] && value[4] && value[5])
+        {
+            char hex[5] = { value[2], value[3], value[4], value[5], '\0' };
+            c = (char)strtol(hex, NULL, 16);
+            value += 5;
+        }
+        else if (c == '\\' && value[1])
+        {
+            c = *++value;
+        }
+        if (length + 1 < out_size)
+            out[length++] = c;
+    }
+    out[length] = '\0';
+    return *value == '"';
+}
+
+static unsigned long long json_number(const char* text, const char* key, int* ok)
+{
+    const char* value = json_value(text, key);
+    if (!value)
+        *ok = 0;
+    return value ? strtoull(value, NULL, 10) : 0;
+}
+
+static double json_double(const char* text, const char* key, int* ok)
+{
+    const char* value = json_value(text, key);
+    if (!value)
+        *ok = 0;
+    return value ? strtod(value, NULL) : 0.0;
+}
+
+static int json_bool(const char* text, const char* key, int* ok)
+{
+    const char* value = json_value(text, key);
+    if (!value)
+        *ok = 0;
+    return value && strncmp(value, "true", 4) == 0;
+}
+
+static int profile_file(cl_device_id device, char* dir, size_t dir_size, char* path, size_t path_size)
+{
+    program_cache_dir(dir, dir_size);
+    if (dir[0] == '\0')
+        return 0;
+    snprintf(path, path_size, "%s/profile_%016llx.json", dir, device_cache_key(device));
+    return 1;
+}
+
+int device_profile_load(cl_device_id device, device_profile* profile)
+{
+    char dir[PROFILE_PATH_LEN], path[PROFILE_PATH_LEN + 64], type[32] = "";
+    if (!profile_file(device, dir, sizeof(dir), path, sizeof(path)))
+        return 0;
+    FILE* file = fopen(path, "r");
+    if (!file)
+        return 0;
+    char* text = (char*)malloc(PROFILE_FILE_MAX + 1);
+    if (!text)
+    {
+        fclose(file);
+        return 0;
+    }
+    size_t size = fread(text, 1, PROFILE_FILE_MAX, file);
+    fclose(file);
+    text[size] = '\0';
+
+    device_profile* p = profile;
+    int ok = 1;
+    memset(p, 0, sizeof(*p));
+    ok = (json_number(text, "version", &ok) == DEVICE_PROFILE_VERSION) && ok && json_string(text, "platform", p->platform_name, sizeof(p->platform_name)) &&
+         json_string(text, "device", p->device_name, sizeof(p->device_name)) &&
+         json_string(text, "vendor", p->vendor, sizeof(p->vendor)) &&
+         json_string(text, "device_version", p->device_version, sizeof(p->device_version)) &&
+         json_string(text, "driver_version", p->driver_version, sizeof(p->driver_version)) &&
+         json_string(text, "type", type, sizeof(type)) &&
+         json_string(text, "extensions", p->extensions, sizeof(p->extensions));
+    p->type = (strcmp(type, "gpu") == 0) ? CL_DEVICE_TYPE_GPU : (strcmp(type, "accelerator") == 0) ? CL_DEVICE_TYPE_ACCELERATOR
+            : (strcmp(type, "cpu") == 0) ? CL_DEVICE_TYPE_CPU : CL_DEVICE_TYPE_DEFAULT;
+    p->compute_units = (cl_uint)json_number(text, "compute_units", &ok);
+    p->max_clock_mhz = (cl_uint)json_number(text, "max_clock_mhz", &ok);
+    p->global_mem_size = json_number(text, "global_mem_size", &ok);
+    p->local_mem_size = json_number(text, "local_mem_size", &ok);
+    p->max_mem_alloc_size = json_number(text, "max_mem_alloc_size", &ok);
+    p->max_work_group_size = (size_t)json_number(text, "max_work_group_size", &ok);
+    const char* sizes = json_value(text, "max_work_item_sizes");
+    ok = ok && sizes && sscanf(sizes, "[%zu, %zu, %zu]", &p->max_work_item_sizes[0], &p->max_work_item_sizes[1], &p->max_work_item_sizes[2]) == 3;
+    p->vector_width_char = (cl_uint)json_number(text, "vector_width_char", &ok);
+    p->vector_width_short = (cl_uint)json_number(text, "vector_width_short", &ok);
+    p->vector_width_int = (cl_uint)json_number(text, "vector_width_int", &ok);
+    p->vector_width_float = (cl_uint)json_number(text, "vector_width_float", &ok);
+    p->vector_width_half = (cl_uint)json_number(text, "vector_width_half", &ok);
+    p->image_support = json_bool(text, "image_support", &ok) ? CL_TRUE : CL_FALSE;
+    p->image2d_max_width = (size_t)json_number(text, "image2d_max_width", &ok);
+    p->image2d_max_height = (size_t)json_number(text, "image2d_max_height", &ok);
+    p->host_unified_memory = json_bool(text, "host_unified_memory", &ok) ? CL_TRUE : CL_FALSE;
+    p->fp16 = json_bool(text, "fp16", &ok);
+    p->fp64 = json_bool(text, "fp64", &ok);
+    p->measured = json_bool(text, "measured", &ok);
+    p->write_gbs = json_double(text, "write_gbs", &ok);
+    p->read_gbs = json_double(text, "read_gbs", &ok);
+    p->copy_gbs = json_double(text, "copy_gbs", &ok);
+    p->launch_latency_us = json_double(text, "launch_latency_us", &ok);
+    p->calibration_sec = json_double(text, "calibration_sec", &ok);
+    free(text);
+
+    // A damaged or partial file is ignored, and replaced on the next store
+    ok = ok && p->max_work_group_size > 0 && p->max_mem_alloc_size > 0;
+    if (!ok)
+        memset(p, 0, sizeof(*p));
+    return ok;
+}
+
+void device_profile_store(cl_device_id device, const device_profile* profile)
+{
+    char dir[PROFILE_PATH_LEN], path[PROFILE_PATH_LEN + 64], temp_path[PROFILE_PATH_LEN + 96];
+    if (!profile_file(device, dir, sizeof(dir), path, sizeof(path)) || program_cache_make_dirs(dir) != 0)
+        return;
+
+    // Write a temporary file and swap it in atomically, so concurrent runs never read half a profile
+    snprintf(temp_path, sizeof(temp_path), "%s.%ld.tmp", path, (long)getpid());
+    FILE* out = fopen(temp_path, "w");
+    if (!out)
+        return;
+    device_profile_write_json(out, profile, 0);
+    fputc('\n', out);
+    if (fclose(out) != 0 || rename(temp_path, path) != 0)
+        remove(temp_path);
+}
+
+cl_int device_profile_get(cl_device_id device, device_profile* profile, int measure, int refresh)
+{
+    if (!refresh && device_profile_load(device, profile) && (profile->measured || !measure))
+        return CL_SUCCESS;
+
+    cl_int err = device_profile_query(device, profile);
+    if (err != CL_SUCCESS)
+        return err;
+    if (measure && device_profile_measure(device, profile) != CL_SUCCESS)
+        fprintf(stderr, "Error: Microbenchmarks failed on %s, profile keeps the queried properties only\n", profile->device_name);
+    device_profile_store(device, profile);
+    return CL_SUCCESS;
+}
+
+//------------------------------------------------------
+// Report
+//------------------------------------------------------
+
+void device_profile_print(const device_profile* profile, int verbose)
+{
+    const device_profile* p = profile;
+    printf("Device Name                                         : %s\n", p->device_name);
+    printf("Device Vendor                                       : %s\n", p->vendor);
+    printf("Platform                                            : %s\n", p->platform_name);
+    printf("Device Version                                      : %s\n", p->device_version);
+    printf("Driver Version                                      : %s\n", p->driver_version);
+    printf("Device Type                                         : %s\n", type_name(p->type));
+    printf("Max Compute Units                                   : %u (%u MHz)\n", p->compute_units, p->max_clock_mhz);
+    printf("Global Memory Size                                  : %llu MB\n", (unsigned long long)(p->global_mem_size / (1024 * 1024)));
+    printf("Local Memory Size                                   : %llu KB\n", (unsigned long long)(p->local_mem_size / 1024));
+    printf("Max Allocation                                      : %llu MB\n", (unsigned long long)(p->max_mem_alloc_size / (1024 * 1024)));
+    printf("Max Work Group Size                                 : %zu (items %zu x %zu x %zu)\n", p->max_work_group_size,
+           p->max_work_item_sizes[0], p->max_work_item_sizes[1], p->max_work_item_sizes[2]);
+    printf("Preferred Vector Widths                             : char %u, short %u, int %u, float %u, half %u\n",
+           p->vector_width_char, p->vector_width_short, p->vector_width_int, p->vector_width_float, p->vector_width_half);
+    if (p->image_support)
+        printf("Image Support                                       : yes (2D up to %zux%zu)\n", p->image2d_max_width, p->image2d_max_height);
+    else
+        printf("Image Support                                       : no\n");
+    printf("Unified Host Memory                                 : %s\n", p->host_unified_memory ? "yes" : "no");
+    printf("Half / Double Precision                             : %s / %s\n", p->fp16 ? "yes" : "no", p->fp64 ? "yes" : "no");
+    if (verbose)
+        printf("Extensions                                          : %s\n", p->extensions);
+    if (!p->measured)
+    {
+        printf("Microbenchmarks                                     : not measured\n");
+        return;
+    }
+    printf("Host to Device Bandwidth                            : %.2f GB/s\n", p->write_gbs);
+    printf("Device to Host Bandwidth                            : %.2f GB/s\n", p->read_gbs);
+    printf("Device Copy Bandwidth                               : %.2f GB/s\n", p->copy_gbs);
+    printf("Kernel Launch Latency                               : %.1f us\n", p->launch_latency_us);
+    printf("Calibration Kernel                                  : %f seconds\n", p->calibration_sec);
+}
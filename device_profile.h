@@ -0,0 +1,80 @@
+#ifndef DEVICE_PROFILE_H
+#define DEVICE_PROFILE_H
+
+#include <stdio.h>
+#include <CL/cl.h>
+
+// Per-device capability profile: the properties kernels are chosen and sized by, and microbenchmarks
+// (transfer and copy bandwidth, launch latency, the device selection's calibration kernel).
+// Profiles are cached as JSON next to the program binaries in <cache dir>/profile_<device key>.json,
+// so startup reads one file instead of querying and measuring every device again. The device key
+// hashes the name and driver/device/platform versions, so a driver update measures afresh.
+// OCL_CACHE_DISABLE=1 (see program_cache.h) queries and measures on every run.
+
+#define DEVICE_PROFILE_VERSION 1                // Bump when fields change; older files are ignored
+#define DEVICE_PROFILE_NAME_LEN 256
+#define DEVICE_PROFILE_EXTENSIONS_LEN 8192
+#define DEVICE_PROFILE_CALIBRATION_ITEMS (1 << 20)
+
+typedef struct
+{
+    // Queried with clGetDeviceInfo
+    char platform_name[DEVICE_PROFILE_NAME_LEN];
+    char device_name[DEVICE_PROFILE_NAME_LEN];
+    char vendor[DEVICE_PROFILE_NAME_LEN];
+    char device_version[DEVICE_PROFILE_NAME_LEN];
+    char driver_version[DEVICE_PROFILE_NAME_LEN];
+    cl_device_type type;
+    cl_uint compute_units;
+    cl_uint max_clock_mhz;
+    cl_ulong global_mem_size;
+    cl_ulong local_mem_size;
+    cl_ulong max_mem_alloc_size;
+    size_t max_work_group_size;
+    size_t max_work_item_sizes[3];
+    cl_uint vector_width_char;     // CL_DEVICE_PREFERRED_VECTOR_WIDTH_*
+    cl_uint vector_width_short;
+    cl_uint vector_width_int;
+    cl_uint vector_width_float;
+    cl_uint vector_width_half;     // 0 without cl_khr_fp16
+    cl_bool image_support;
+    size_t image2d_max_width;
+    size_t image2d_max_height;
+    cl_bool host_unified_memory;   // Device shares physical memory with the host (integrated GPU, CPU device)
+    int fp16;                      // cl_khr_fp16
+    int fp64;                      // cl_khr_fp64
+    char extensions[DEVICE_PROFILE_EXTENSIONS_LEN];
+
+    // Measured by device_profile_measure (all 0 until then)
+    int measured;
+    double write_gbs;              // Host to device, clEnqueueWriteBuffer from pageable memory
+    double read_gbs;               // Device to host
+    double copy_gbs;               // clEnqueueCopyBuffer, bytes read plus bytes written
+    double launch_latency_us;      // Empty kernel, enqueue to clFinish returning (median)
+    double calibration_sec;        // Kernel time of the device selection's calibration kernel
+} device_profile;
+
+// Fills the queried fields. Returns CL_SUCCESS or the first failing query's error.
+cl_int device_profile_query(cl_device_id device, device_profile* profile);
+
+// Runs the microbenchmarks on a context of its own and sets measured. Returns CL_SUCCESS or an OpenCL error.
+cl_int device_profile_measure(cl_device_id device, device_profile* profile);
+
+// Returns the device's profile: from the cache unless refresh is set, else queried (and measured when
+// measure is set) and stored. A cached profile without measurements is measured when measure asks for it.
+// Returns CL_SUCCESS or an OpenCL error; a failed measurement leaves measured at 0 and is not an error.
+cl_int device_profile_get(cl_device_id device, device_profile* profile, int measure, int refresh);
+
+// Looks up the cached profile. Returns 1 when found.
+int device_profile_load(cl_device_id device, device_profile* profile);
+
+// Stores the profile. Silently does nothing when the cache is disabled.
+void device_profile_store(cl_device_id device, const device_profile* profile);
+
+// Writes the profile as a JSON object, every line prefixed with indent spaces (the cache file format)
+void device_profile_write_json(FILE* file, const device_profile* profile, int indent);
+
+// Prints the profile in the "Name : value" layout of the other reports; the extension list only when verbose
+void device_profile_print(const device_profile* profile, int verbose);
+
+#endif
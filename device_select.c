@@ -0,0 +1,216 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "device_select.h"
+#include "device_profile.h"
+
+#define MAX_PLATFORMS 16
+#define MAX_DEVICES 64
+
+
+
+int enumerate_devices(device_candidate* candidates, int max_candidates)
+{
+    cl_platform_id platforms[MAX_PLATFORMS];
+    cl_uint num_platforms = 0;
+    if (clGetPlatformIDs(MAX_PLATFORMS, platforms, &num_platforms) != CL_SUCCESS)
+        return 0;
+    if (num_platforms > MAX_PLATFORMS)
+        num_platforms = MAX_PLATFORMS;
+
+    int count = 0;
+    for (cl_uint p = 0; p < num_platforms; p++)
+    {
+        cl_device_id devices[MAX_DEVICES];
+        cl_uint num_devices = 0;
+        if (clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, MAX_DEVICES, devices, &num_devices) != CL_SUCCESS)
+            continue;
+        if (num_devices > MAX_DEVICES)
+            num_devices = MAX_DEVICES;
+
+        for (cl_uint d = 0; d < num_devices && count < max_candidates; d++)
+        {
+            cl_bool available = CL_FALSE;
+            clGetDeviceInfo(devices[d], CL_DEVICE_AVAILABLE, sizeof(available), &available, NULL);
+            if (!available)
+                continue;
+
+            device_candidate* c = &candidates[count++];
+            memset(c, 0, sizeof(*c));
+            c->platform = platforms[p];
+            c->device = devices[d];
+            c->platform_index = p;
+            c->device_index = d;
+            clGetPlatformInfo(platforms[p], CL_PLATFORM_NAME, sizeof(c->platform_name), c->platform_name, NULL);
+            clGetDeviceInfo(devices[d], CL_DEVICE_NAME, sizeof(c->device_name), c->device_name, NULL);
+            clGetDeviceInfo(devices[d], CL_DEVICE_TYPE, sizeof(c->type), &c->type, NULL);
+            clGetDeviceInfo(devices[d], CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(c->compute_units), &c->compute_units, NULL);
+            clGetDeviceInfo(devices[d], CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(c->max_clock_mhz), &c->max_clock_mhz, NULL);
+            clGetDeviceInfo(devices[d], CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(c->global_mem_size), &c->global_mem_size, NULL);
+        }
+    }
+    return count;
+}
+
+// Static score: device type first (GPU > accelerator > CPU), then compute units x clock,
+// with a small bonus for global memory
+// GPUs over accelerators over CPU devices, in the static estimate and the calibrated throughput alike
+static double type_weight(const device_candidate* c)
+{
+    return (c->type & CL_DEVICE_TYPE_GPU) ? 4.0 : (c->type & CL_DEVICE_TYPE_ACCELERATOR) ? 2.0 : 1.0;
+}
+
+static double static_score(const device_candidate* c)
+{
+    double clock_mhz = (c->max_clock_mhz > 0) ? c->max_clock_mhz : 1000.0;
+    double mem_gb = (double)c->global_mem_size / (1024.0 * 1024.0 * 1024.0);
+    return type_weight(c) * c->compute_units * clock_mhz * (1.0 + (0.1 * log2(1.0 + mem_gb)));
+}
+
+static int contains_ignore_case(const char* haystack, const char* needle)
+{
+    size_t needle_length = strlen(needle);
+    for (; *haystack; haystack++)
+    {
+        size_t i = 0;
+        while (i < needle_length && haystack[i] && tolower((unsigned char)haystack[i]) == tolower((unsigned char)needle[i]))
+            i++;
+        if (i == needle_length)
+            return 1;
+    }
+    return needle_length == 0;
+}
+
+// Returns 1 if the candidate matches the spec (see select_device)
+static int matches_spec(const device_candidate* c, const char* spec)
+{
+    unsigned int platform_index, device_index;
+    char tail;
+    if (strcmp(spec, "gpu") == 0)
+        return (c->type & CL_DEVICE_TYPE_GPU) != 0;
+    if (strcmp(spec, "cpu") == 0)
+        return (c->type & CL_DEVICE_TYPE_CPU) != 0;
+    if (strcmp(spec, "accelerator") == 0)
+        return (c->type & CL_DEVICE_TYPE_ACCELERATOR) != 0;
+    if (sscanf(spec, "%u:%u%c", &platform_index, &device_index, &tail) == 2)
+        return c->platform_index == platform_index && c->device_index == device_index;
+    return contains_ignore_case(c->device_name, spec) || contains_ignore_case(c->platform_name, spec);
+}
+
+static const char* device_type_name(cl_device_type type)
+{
+    if (type & CL_DEVICE_TYPE_GPU)
+        return "GPU";
+    if (type & CL_DEVICE_TYPE_ACCELERATOR)
+        return "Accelerator";
+    if (type & CL_DEVICE_TYPE_CPU)
+        return "CPU";
+    return "Other";
+}
+
+// Ranks the candidates in place (best first), calibrating them when there is a choice to make.
+// Calibration times come from the device profiles, so each device is only measured on its first run.
+static void rank_candidates(device_candidate* candidates, int count)
+{
+    const char* calibrate_env = getenv("OCL_DEVICE_CALIBRATE");
+    int calibrate = (count > 1) && !(calibrate_env && strcmp(calibrate_env, "0") == 0);
+
+    for (int i = 0; i < count; i++)
+    {
+        device_profile profile;
+        candidates[i].score = static_score(&candidates[i]);
+        if (calibrate && device_profile_get(candidates[i].device, &profile, 1, 0) == CL_SUCCESS)
+            candidates[i].calibration_sec = profile.calibration_sec;
+    }
+
+    // Measured throughput outranks the static estimate: every calibrated device scores by its items
+    // per second times its type weight, uncalibrated ones fall back behind them. A CPU device thus
+    // only beats a GPU when it calibrates more than four times faster.
+    for (int i = 0; i < count; i++)
+    {
+        if (candidates[i].calibration_sec > 0.0)
+            candidates[i].score = 1e12 + (type_weight(&candidates[i]) * DEVICE_PROFILE_CALIBRATION_ITEMS / candidates[i].calibration_sec);
+    }
+
+    // Insertion sort, the list is tiny
+    for (int i = 1; i < count; i++)
+    {
+        device_candidate c = candidates[i];
+        int j = i - 1;
+        while (j >= 0 && candidates[j].score < c.score)
+        {
+            candidates[j + 1] = candidates[j];
+            j--;
+        }
+        candidates[j + 1] = c;
+    }
+}
+
+int select_device(const char* spec, device_candidate* selected)
+{
+    device_candidate candidates[MAX_DEVICES];
+    int count = enumerate_devices(candidates, MAX_DEVICES);
+    if (count == 0)
+    {
+        fprintf(stderr, "Error: No OpenCL device found on any platform\n");
+        return -1;
+    }
+
+    if (!spec || !spec[0])
+        spec = getenv("OCL_DEVICE");
+
+    // Keep only the devices matching the override, if any
+    if (spec && spec[0])
+    {
+        int kept = 0;
+        for (int i = 0; i < count; i++)
+        {
+            if (matches_spec(&candidates[i], spec))
+                candidates[kept++] = candidates[i];
+        }
+        if (kept == 0)
+        {
+            fprintf(stderr, "Error: No OpenCL device matches \"%s\"\n", spec);
+            return -1;
+        }
+        count = kept;
+    }
+
+    rank_candidates(candidates, count);
+    *selected = candidates[0];
+    return 0;
+}
+
+const char* find_device_flag(int argc, char** argv)
+{
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--device") == 0)
+            return argv[i + 1];
+    }
+    return NULL;
+}
+
+void print_device_candidates(const device_candidate* selected)
+{
+    device_candidate candidates[MAX_DEVICES];
+    int count = enumerate_devices(candidates, MAX_DEVICES);
+
+    printf("\n######### Available Devices ################\n");
+    for (int i = 0; i < count; i++)
+    {
+        int is_selected = selected && candidates[i].device == selected->device;
+        printf("%s %u:%u  %-11s  %s / %s  (%u CUs, %u MHz, %lu MB)\n", is_selected ? "*" : " ",
+               candidates[i].platform_index, candidates[i].device_index, device_type_name(candidates[i].type),
+               candidates[i].platform_name, candidates[i].device_name, candidates[i].compute_units,
+               candidates[i].max_clock_mhz, (unsigned long)(candidates[i].global_mem_size / (1024 * 1024)));
+    }
+    if (selected && selected->calibration_sec > 0.0)
+    {
+        printf("Calibration kernel on selected device               : %f seconds\n", selected->calibration_sec);
+    }
+}
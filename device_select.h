@@ -0,0 +1,45 @@
+#ifndef DEVICE_SELECT_H
+#define DEVICE_SELECT_H
+
+#include <CL/cl.h>
+
+#define DEVICE_SELECT_NAME_LEN 256
+
+// One enumerated OpenCL device together with the numbers used to rank it
+typedef struct
+{
+    cl_platform_id platform;
+    cl_device_id device;
+    cl_device_type type;
+    cl_uint platform_index;
+    cl_uint device_index;
+    char platform_name[DEVICE_SELECT_NAME_LEN];
+    char device_name[DEVICE_SELECT_NAME_LEN];
+    cl_uint compute_units;
+    cl_uint max_clock_mhz;
+    cl_ulong global_mem_size;
+    double calibration_sec;  // Kernel time of the calibration run, 0 when not measured
+    double score;            // Higher is better
+} device_candidate;
+
+// Enumerates every device on every platform. Returns the number of devices written to
+// candidates (at most max_candidates), 0 when no OpenCL device is available.
+int enumerate_devices(device_candidate* candidates, int max_candidates);
+
+// Picks a device. spec comes from a --device flag; when NULL the OCL_DEVICE environment variable is used.
+// A spec can be a device type (gpu, cpu, accelerator), "platform:device" indices, or a case-insensitive
+// substring of the platform or device name. Without a spec, devices are ranked by compute units, clock and
+// memory, refined by a short calibration kernel when there is more than one candidate
+// (OCL_DEVICE_CALIBRATE=0 disables it; the time is kept in the device profile, see device_profile.h).
+// Both scores weigh GPUs 4x and accelerators 2x over CPU devices such as POCL, so a CPU device only
+// ranks first when it is that much faster.
+// Returns 0 on success, -1 when no device matches.
+int select_device(const char* spec, device_candidate* selected);
+
+// Returns the value of --device in argv, or NULL
+const char* find_device_flag(int argc, char** argv);
+
+// Prints every enumerated device with its score, marking the selected one
+void print_device_candidates(const device_candidate* selected);
+
+#endif
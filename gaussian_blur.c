@@ -1,216 +1,900 @@
 // Standard includes
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <time.h>
 
 // OpenCL Include
 #include <CL/cl.h>
 
 #include "commons.h"
+#include "gaussian_mask.h"
+#include "cpu_blur.h"
+#include "ocl_runtime.h"
+#include "blur_engine.h"
+#include "blur_stream.h"
+#include "ocl_async.h"
+#include "host_buffer.h"
+#include "image_io.h"
+#include "ocl_profiler.h"
+#include "verify.h"
+#include "iir_blur.h"
+
+
+
+// Host blur implementations
+typedef enum
+{
+    HOST_BLUR_EXACT,       // CPU engine, full 2D, bit-identical to gaussian_blur_host
+    HOST_BLUR_SEPARABLE,   // CPU engine, two 1D passes
+    HOST_BLUR_REFERENCE    // Scalar single-threaded gaussian_blur_host
+} host_blur_mode;
+
+// Difference from the exact blur counted as a large error in the recursive blur report
+#define IIR_REPORT_TOLERANCE 2
 
+// Difference from the float blur counted as a large error in the reduced precision report
+#define REDUCED_PRECISION_REPORT_TOLERANCE 1
 
+// Function to return a monotonic wall-clock time in seconds
+double wall_time_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
 
-// Function to read kernel source from file
-char* read_kernel_source(const char* filename) 
+// Function to run the selected host blur and return its wall-clock time in seconds
+double run_host_blur(host_blur_mode mode, cpu_thread_pool* pool, unsigned char* input, unsigned char* output, int width, int height, int channels,
+                     const float* mkernel, const float* row_weights, const float* col_weights, int kernel_radius)
 {
-    FILE* file = fopen(filename, "r");
-    if (!file) 
+    double start_time = wall_time_sec();
+    switch (mode)
     {
-        fprintf(stderr, "Error: Could not open kernel file %s\n", filename);
-        return NULL;
+    case HOST_BLUR_EXACT:
+        cpu_gaussian_blur(pool, input, output, width, height, channels, mkernel, kernel_radius);
+        break;
+    case HOST_BLUR_SEPARABLE:
+        cpu_gaussian_blur_separable(pool, input, output, width, height, channels, row_weights, col_weights, kernel_radius);
+        break;
+    case HOST_BLUR_REFERENCE:
+        gaussian_blur_host(input, output, width, height, channels, mkernel, kernel_radius);
+        break;
     }
+    return wall_time_sec() - start_time;
+}
 
-    fseek(file, 0, SEEK_END);
-    long length = ftell(file);
-    fseek(file, 0, SEEK_SET);
+// Function to run the fixed-point host blur on Q14 weights (the separable or the 2D path, as the device does)
+// and return its wall-clock time in seconds
+double run_host_blur_fixed(int separable, cpu_thread_pool* pool, unsigned char* input, unsigned char* output, int width, int height, int channels,
+                           const short* fixed_mask, const short* fixed_row_weights, const short* fixed_col_weights, int kernel_radius)
+{
+    double start_time = wall_time_sec();
+    if (separable)
+        cpu_gaussian_blur_separable_fixed(pool, input, output, width, height, channels, fixed_row_weights, fixed_col_weights, kernel_radius);
+    else
+        cpu_gaussian_blur_fixed(pool, input, output, width, height, channels, fixed_mask, kernel_radius);
+    return wall_time_sec() - start_time;
+}
+
+// Function to report how far a reduced precision result is from the float blur (exact 2D on the host)
+void report_precision_error(cpu_thread_pool* pool, blur_precision precision, const unsigned char* input, const unsigned char* result,
+                            int width, int height, int channels, const float* mkernel, int kernel_radius)
+{
+    size_t image_bytes = (size_t)width * height * channels * sizeof(unsigned char);
+    unsigned char* float_host = (unsigned char*)malloc(image_bytes);
+    cpu_gaussian_blur(pool, input, float_host, width, height, channels, mkernel, kernel_radius);
+
+    // Reported, not judged: every sample is compared
+    verify_options report;
+    verify_default_options(&report);
+    report.tolerance = REDUCED_PRECISION_REPORT_TOLERANCE;
+    report.max_mismatches = 0;
+    verify_result comparison;
+    verify_images(pool, float_host, result, image_bytes, &report, &comparison);
+    printf("\n######### Reduced Precision Error: %s vs Float ################\n", blur_precision_name(precision));
+    printf("Max error                                           : %d\n", comparison.max_error);
+    printf("Mean abs error                                      : %.4f\n", comparison.mean_abs_error);
+    printf("PSNR                                                : %.2f dB\n", comparison.psnr_db);
+    printf("Samples off by more than %d                          : %zu (%.3f%%)\n", REDUCED_PRECISION_REPORT_TOLERANCE, comparison.mismatches,
+           (100.0 * comparison.mismatches) / comparison.samples);
+    free(float_host);
+}
+
+// Function to count frames completed through the asynchronous submitter (runs on the driver's callback thread)
+static void count_async_frame(void* user, cl_int status)
+{
+    if (status == CL_SUCCESS)
+        __atomic_add_fetch((int*)user, 1, __ATOMIC_RELAXED);
+}
 
-    char* source = (char*)malloc(length + 1);
-    if (!source) 
+// Function to blur num_frames images back to back, then through the pipelined stream and the asynchronous
+// submitter, and report all three
+int run_frame_stream(blur_engine* engine, int width, int height, int num_frames, int num_slots, ocl_profiler* profiler)
+{
+    size_t image_bytes = (size_t)width * height * engine->channels * sizeof(unsigned char);
+    unsigned char** inputs = (unsigned char**)calloc(num_frames, sizeof(unsigned char*));
+    unsigned char** outputs = (unsigned char**)calloc(num_frames, sizeof(unsigned char*));
+    unsigned char* sequential_output = (unsigned char*)malloc(image_bytes);
+    int status = -1;
+    for (int i = 0; i < num_frames; i++)
     {
-        fprintf(stderr, "Error: Could not allocate memory for kernel source\n");
-        fclose(file);
-        return NULL;
+        inputs[i] = (unsigned char*)malloc(image_bytes);
+        outputs[i] = (unsigned char*)malloc(image_bytes);
+        generate_noisy_image(inputs[i], width, height, engine->channels);
     }
 
-    fread(source, 1, length, file);
-    source[length] = '\0'; // Null-terminate the string
+    printf("\n######### Frame Stream (%d frames, %d slots) ################\n", num_frames, num_slots);
 
-    fclose(file);
-    return source;
-}
+    // Baseline: one blocking request per frame on the runtime queue
+    double sequential_start = wall_time_sec();
+    for (int i = 0; i < num_frames; i++)
+    {
+        if (blur_engine_run(engine, inputs[i], (i == num_frames - 1) ? sequential_output : outputs[i], width, height, NULL) != CL_SUCCESS)
+            goto cleanup;
+    }
+    double sequential_time_sec = wall_time_sec() - sequential_start;
+
+    blur_stream stream;
+    blur_stream_stats stats;
+    cl_int err = blur_stream_init(&stream, engine, width, height, num_slots);
+    stream.profiler = profiler;
+    if (err != CL_SUCCESS ||
+        blur_stream_process(&stream, (const unsigned char* const*)inputs, outputs, num_frames, &stats) != CL_SUCCESS)
+    {
+        fprintf(stderr, "Error: Frame stream failed\n");
+        blur_stream_release(&stream);
+        goto cleanup;
+    }
+    blur_stream_release(&stream);
+
+    printf("Upload Time (all frames)                            : %f seconds\n", stats.upload_time_sec);
+    printf("Kernel Execution Time (all frames)                  : %f seconds\n", stats.kernel_time_sec);
+    printf("Download Time (all frames)                          : %f seconds\n", stats.download_time_sec);
+    printf("Sequential wall time per frame                      : %f seconds\n", sequential_time_sec / num_frames);
+    printf("Streamed wall time per frame                        : %f seconds\n", stats.wall_time_sec / num_frames);
+    printf("Streamed throughput                                 : %f frames/s (%.2fx sequential)\n",
+           num_frames / stats.wall_time_sec, sequential_time_sec / stats.wall_time_sec);
+
+    // Same kernels on the same data, so the streamed frame must match the sequential one exactly
+    status = memcmp(sequential_output, outputs[num_frames - 1], image_bytes) == 0 ? 0 : -1;
+    printf("Streamed output %s the sequential output\n", status == 0 ? "matches" : "DOES NOT match");
+    if (status != 0)
+        goto cleanup;
+
+    // Same frames again through the asynchronous submitter: this thread only enqueues, the driver reports
+    // each finished frame through a callback, and submits wait once num_slots frames are in flight
+    ocl_async async;
+    ocl_async_stats async_stats;
+    int frames_done = 0;
+    memset(outputs[num_frames - 1], 0, image_bytes);
+    double async_start = wall_time_sec();
+    err = ocl_async_init(&async, engine->rt, num_slots, 2);
+    for (int i = 0; err == CL_SUCCESS && i < num_frames; i++)
+        err = blur_engine_submit(engine, &async, inputs[i], outputs[i], width, height, count_async_frame, &frames_done, NULL);
+    cl_int drain_err = ocl_async_drain(&async);
+    double async_time_sec = wall_time_sec() - async_start;
+    ocl_async_get_stats(&async, &async_stats);
+    ocl_async_release(&async);
+    if (err != CL_SUCCESS || drain_err != CL_SUCCESS)
+    {
+        fprintf(stderr, "Error: Asynchronous submission failed\n");
+        status = -1;
+        goto cleanup;
+    }
 
+    printf("Async wall time per frame                           : %f seconds\n", async_time_sec / num_frames);
+    printf("Async throughput                                    : %f frames/s (%.2fx sequential)\n",
+           num_frames / async_time_sec, sequential_time_sec / async_time_sec);
+    printf("Async frames reported by callback                   : %d of %d\n", __atomic_load_n(&frames_done, __ATOMIC_RELAXED), num_frames);
+    printf("Async submits held back (backpressure)              : %llu, %f seconds waiting\n", async_stats.stalls, async_stats.stall_sec);
+    status = memcmp(sequential_output, outputs[num_frames - 1], image_bytes) == 0 ? 0 : -1;
+    printf("Async output %s the sequential output\n", status == 0 ? "matches" : "DOES NOT match");
 
+cleanup:
+    for (int i = 0; i < num_frames; i++)
+    {
+        free(inputs[i]);
+        free(outputs[i]);
+    }
+    free(inputs);
+    free(outputs);
+    free(sequential_output);
+    return status;
+}
 
-// Main Code
-int main()
-{
-    //------------------------------------------------------
-    // 2. Initialize data on the HOST
-    //------------------------------------------------------
-    // Image dimensions
-    int image_width = 1024;
-    int image_height = 1024;
-    int image_channels = 1; // Grayscale image
 
-    // Allocate memory for the noisy image
-    unsigned char* noisy_image = (unsigned char*)malloc(image_width * image_height * image_channels * sizeof(unsigned char));
-    unsigned char* blurred_image_host = (unsigned char*)malloc(image_width * image_height * image_channels * sizeof(unsigned char));
-    unsigned char* blurred_image_device = (unsigned char*)malloc(image_width * image_height * image_channels * sizeof(unsigned char));
-    
-    // Generate the input image
-    generate_noisy_image(noisy_image, image_width, image_height, image_channels);
 
+// Function to blur an image in strips that fit the device memory budget and report it.
+// Returns the wall-clock time in seconds, or -1 on failure.
+double run_tiled_blur(blur_engine* engine, const unsigned char* input, unsigned char* output, int width, int height,
+                      size_t mem_budget, int strip_rows)
+{
+    int num_strips = 0;
+    printf("\n######### Device Profiling (strips) ################\n");
+    printf("Strip height (with %d-row halos)                     : %d rows\n", engine->kernel_radius, strip_rows);
+    double start = wall_time_sec();
+    if (blur_engine_run_tiled(engine, input, output, width, height, mem_budget, &num_strips) != CL_SUCCESS)
+        return -1.0;
+    double time_sec = wall_time_sec() - start;
+    printf("Strips                                              : %d\n", num_strips);
+    printf("Time taken for Gaussian blur on device              : %f seconds\n", time_sec);
+    return time_sec;
+}
 
 
-    //------------------------------------------------------
-    // 3. Platform and device setup
-    //------------------------------------------------------
-    cl_platform_id platform;
-    clGetPlatformIDs(1, &platform, NULL);
 
-    cl_device_id device;
-    clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, NULL);
+// Function to run the recursive (IIR) approximation on the device (rt may be NULL) and the host, check that
+// both agree and report the approximation error against the exact host blur. Returns the exit status.
+int run_iir_blur(ocl_runtime* rt, cpu_thread_pool* pool, host_blur_mode exact_mode, float sigma, const unsigned char* input, unsigned char* output,
+                 int width, int height, int channels, int repeat, const float* mkernel, const float* row_weights, const float* col_weights,
+                 int kernel_radius, verify_options* verify, int tolerance)
+{
+    iir_coefficients coeffs;
+    if (iir_gaussian_coefficients(sigma, &coeffs) != 0)
+        return -1;
+    size_t image_bytes = (size_t)width * height * channels * sizeof(unsigned char);
+    unsigned char* iir_host = (unsigned char*)malloc(image_bytes);
+    unsigned char* exact_host = (unsigned char*)malloc(image_bytes);
+    unsigned char* iir_device = NULL;
+    int status = 0;
+
+    printf("\n######### Recursive Blur (Young-van Vliet, sigma %.2f) ################\n", sigma);
+    printf("Recursion coefficients                              : b %f, a1 %f, a2 %f, a3 %f\n", coeffs.b, coeffs.a1, coeffs.a2, coeffs.a3);
+    iir_engine engine;
+    if (rt && iir_engine_init(&engine, rt, sigma, channels) == CL_SUCCESS)
+    {
+        iir_device = (unsigned char*)malloc(image_bytes);
+        double kernel_time_sec = 0.0;
+        double start = wall_time_sec();
+        for (int i = 0; i < repeat; i++)
+        {
+            blur_events events;
+            if (iir_engine_run(&engine, input, iir_device, width, height, &events) != CL_SUCCESS)
+            {
+                fprintf(stderr, "Error: Recursive device blur failed\n");
+                free(iir_device);
+                iir_device = NULL;
+                break;
+            }
+            kernel_time_sec += blur_events_kernel_time(&events);
+            blur_events_release(&events);
+        }
+        if (iir_device)
+        {
+            printf("Work-group                                          : %zu columns\n", engine.group_size);
+            printf("Kernel Execution Time                               : %f seconds\n", kernel_time_sec / repeat);
+            printf("Time taken for recursive blur on device             : %f seconds\n", (wall_time_sec() - start) / repeat);
+        }
+    }
+    else if (rt)
+    {
+        fprintf(stderr, "Error: Could not set up the recursive device blur\n");
+    }
+    if (rt)
+        iir_engine_release(&engine);
+
+    double start = wall_time_sec();
+    iir_blur_host(pool, input, iir_host, width, height, channels, &coeffs);
+    printf("Time taken for recursive blur on host               : %f seconds\n", wall_time_sec() - start);
+    double exact_time_sec = run_host_blur(exact_mode, pool, (unsigned char*)input, exact_host, width, height, channels,
+                                          mkernel, row_weights, col_weights, kernel_radius);
+    printf("Time taken for exact blur on host (radius %3d)      : %f seconds\n", kernel_radius, exact_time_sec);
+
+    // Device and host run the same recursion, so only rounding at the truncation can differ
+    verify_result comparison;
+    if (iir_device)
+    {
+        printf("\n######### Comparison: Device vs Host ################\n");
+        verify->tolerance = (tolerance >= 0) ? tolerance : 1;
+        verify_images(pool, iir_host, iir_device, image_bytes, verify, &comparison);
+        verify_print(&comparison, verify, iir_host, iir_device, image_bytes, width, channels);
+        status = comparison.passed ? 0 : 1;
+    }
 
+    // The approximation error is reported, not judged: every sample is compared
+    verify_options approximation;
+    verify_default_options(&approximation);
+    approximation.tolerance = IIR_REPORT_TOLERANCE;
+    approximation.max_mismatches = 0;
+    verify_images(pool, exact_host, iir_device ? iir_device : iir_host, image_bytes, &approximation, &comparison);
+    printf("\n######### Approximation Error: Recursive vs Exact ################\n");
+    printf("Max error                                           : %d\n", comparison.max_error);
+    printf("Mean abs error                                      : %.4f\n", comparison.mean_abs_error);
+    printf("PSNR                                                : %.2f dB\n", comparison.psnr_db);
+    printf("Samples off by more than %d                          : %zu (%.3f%%)\n", IIR_REPORT_TOLERANCE, comparison.mismatches,
+           (100.0 * comparison.mismatches) / comparison.samples);
+
+    if (output)
+        memcpy(output, iir_device ? iir_device : iir_host, image_bytes);
+    free(iir_host);
+    free(exact_host);
+    free(iir_device);
+    return status;
+}
 
-    // Max Work GroupSize of the device
-    size_t max_work_group_size;
-    clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(max_work_group_size), &max_work_group_size, NULL);
 
-    print_platform_details(platform);
-    printDeviceInfo(device);
 
+// Main Code
+int main(int argc, char** argv)
+{
+    // --reference forces the full 2D kernel even when the mask is separable
+    // --sigma / --radius set the Gaussian (radius defaults to ceil(3 * sigma))
+    // --jit bakes the radius and weights into the program as compile-time constants
+    // --host exact|separable|reference picks the host implementation, --threads its thread count
+    // --cpu runs only the host blur (for nodes without an OpenCL device)
+    // --iir approximates the Gaussian with the recursive filter (constant time per pixel, for large sigma) on the
+    //       device and the host, and reports its error against the exact host blur (--host picks that one)
+    // --device gpu|cpu|accelerator|<platform>:<device>|<name> overrides the device ranking (or OCL_DEVICE)
+    // --repeat N runs N device requests on the same runtime and reports the wall time per request
+    // --storage auto|buffer|image keeps frames in buffers or image2d_t objects (auto: images when the device supports them)
+    // --precision float|fixed|half runs the kernels on Q14 integer weights (the host runs the same fixed-point blur)
+    //             or in half precision (device only, needs cl_khr_fp16), and reports the error against the float blur
+    // --channels 1|3|4 blurs a grayscale, interleaved RGB or RGBA image
+    // --frames N blurs a batch of N frames through the pipelined stream (--slots buffer sets, default 3)
+    //            and the asynchronous submitter (--slots frames in flight)
+    // --autotune times the work-group shapes on this image and stores the fastest for the device
+    // --size WxH sets the image size (default 1024x1024, any size works)
+    // --mem-budget MB blurs in horizontal strips that fit the device memory budget (also used when the image exceeds one allocation)
+    // --input file.pgm|.ppm|.raw blurs a real image instead of noise (raw files take --size and --channels)
+    // --output file.pgm|.ppm|.raw writes the device result (the host result with --cpu)
+    // --trace file.json|file.csv records every device command (all four timestamps) as a Chrome trace or CSV
+    // --tolerance N accepts device/host differences up to N per sample (default 1 for separable paths, 0 otherwise;
+    //             0 in fixed point, 2 in half precision)
+    // --max-mismatches N stops the comparison after N mismatched samples (0 compares everything)
+    int use_reference_kernel = 0;
+    const char* device_spec = NULL;
+    int use_jit = 0;
+    int autotune = 0;
+    int cpu_only = 0;
+    int use_iir = 0;
+    int num_threads = 0;
+    int repeat = 1;
+    int num_frames = 0;
+    int num_slots = 3;
+    int image_channels = 1; // Grayscale image unless --channels says otherwise
+    blur_storage storage = BLUR_STORAGE_AUTO;
+    blur_precision precision = BLUR_PRECISION_FLOAT;
+    host_blur_mode host_mode = HOST_BLUR_EXACT;
+    float sigma = 1.0f;
+    int kernel_radius = 0;
+    int image_width = 1024;
+    int image_height = 1024;
+    size_t mem_budget = 0;
+    const char* input_path = NULL;
+    const char* output_path = NULL;
+    const char* trace_path = NULL;
+    int tolerance = -1;
+    verify_options verify;
+    verify_default_options(&verify);
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--reference") == 0)
+        {
+            use_reference_kernel = 1;
+        }
+        else if (strcmp(argv[i], "--iir") == 0)
+        {
+            use_iir = 1;
+        }
+        else if (strcmp(argv[i], "--jit") == 0)
+        {
+            use_jit = 1;
+        }
+        else if (strcmp(argv[i], "--autotune") == 0)
+        {
+            autotune = 1;
+        }
+        else if (strcmp(argv[i], "--sigma") == 0 && i + 1 < argc)
+        {
+            sigma = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--radius") == 0 && i + 1 < argc)
+        {
+            kernel_radius = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--cpu") == 0)
+        {
+            cpu_only = 1;
+        }
+        else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc)
+        {
+            device_spec = argv[++i];
+        }
+        else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+        {
+            repeat = atoi(argv[++i]);
+            repeat = (repeat < 1) ? 1 : repeat;
+        }
+        else if (strcmp(argv[i], "--storage") == 0 && i + 1 < argc)
+        {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "auto") == 0)
+                storage = BLUR_STORAGE_AUTO;
+            else if (strcmp(mode, "buffer") == 0)
+                storage = BLUR_STORAGE_BUFFER;
+            else if (strcmp(mode, "image") == 0)
+                storage = BLUR_STORAGE_IMAGE;
+            else
+            {
+                fprintf(stderr, "Error: Unknown storage %s\n", mode);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc)
+        {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "float") == 0)
+                precision = BLUR_PRECISION_FLOAT;
+            else if (strcmp(mode, "fixed") == 0)
+                precision = BLUR_PRECISION_FIXED;
+            else if (strcmp(mode, "half") == 0)
+                precision = BLUR_PRECISION_HALF;
+            else
+            {
+                fprintf(stderr, "Error: Unknown precision %s\n", mode);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--channels") == 0 && i + 1 < argc)
+        {
+            image_channels = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            num_frames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--slots") == 0 && i + 1 < argc)
+        {
+            num_slots = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%dx%d", &image_width, &image_height) != 2 || image_width <= 0 || image_height <= 0)
+            {
+                fprintf(stderr, "Error: --size expects WIDTHxHEIGHT\n");
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--mem-budget") == 0 && i + 1 < argc)
+        {
+            mem_budget = (size_t)(atof(argv[++i]) * 1024.0 * 1024.0);
+        }
+        else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc)
+        {
+            input_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            output_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            trace_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+        {
+            tolerance = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-mismatches") == 0 && i + 1 < argc)
+        {
+            verify.max_mismatches = (size_t)strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            num_threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--host") == 0 && i + 1 < argc)
+        {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "exact") == 0)
+                host_mode = HOST_BLUR_EXACT;
+            else if (strcmp(mode, "separable") == 0)
+                host_mode = HOST_BLUR_SEPARABLE;
+            else if (strcmp(mode, "reference") == 0)
+                host_mode = HOST_BLUR_REFERENCE;
+            else
+            {
+                fprintf(stderr, "Error: Unknown host blur mode %s\n", mode);
+                return -1;
+            }
+        }
+    }
+    if (sigma <= 0.0f)
+    {
+        fprintf(stderr, "Error: sigma must be positive\n");
+        return -1;
+    }
+    if (image_channels != 1 && image_channels != 3 && image_channels != 4)
+    {
+        fprintf(stderr, "Error: --channels must be 1, 3 or 4\n");
+        return -1;
+    }
+    if (kernel_radius <= 0)
+    {
+        kernel_radius = gaussian_kernel_radius(sigma);
+    }
 
     //------------------------------------------------------
-    // 4. Create a context and command queue
+    // 2. Initialize data on the HOST
     //------------------------------------------------------
-    // Create context and command queue with profiling enabled
-    cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, NULL);
-    cl_command_queue queue = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, NULL);
+    // Image dimensions come from --size, or from the input file. Input and output files are memory-mapped
+    // and their pages go straight to the device transfers.
+    mapped_image input_file, output_file;
+    if (input_path)
+    {
+        if (image_file_open(input_path, image_width, image_height, image_channels, &input_file) != 0)
+            return -1;
+        image_width = input_file.width;
+        image_height = input_file.height;
+        image_channels = input_file.channels;
+        printf("Input image                                         : %s (%dx%d, %d channel(s))\n", input_path, image_width, image_height, image_channels);
+    }
+    if (output_path && image_file_create(output_path, image_file_format_from_path(output_path), image_width, image_height, image_channels, &output_file) != 0)
+    {
+        if (input_path)
+            image_file_close(&input_file);
+        return -1;
+    }
+    size_t image_bytes = (size_t)image_width * image_height * image_channels * sizeof(unsigned char);
+
+    // The noisy input and the device result live in host buffers the device can use (step 6), or in
+    // the mapped files; the host-only run allocates the input here
+    unsigned char* noisy_image = NULL;
+    unsigned char* blurred_image_host = (unsigned char*)malloc(image_bytes);
+
+    // Generate the Gaussian mask, then split it into 1D row/column weights when it is separable
+    int kernel_size = (2 * kernel_radius) + 1;
+    float* gaussian_kernel = (float*)malloc(kernel_size * kernel_size * sizeof(float));
+    float* row_weights = (float*)malloc(kernel_size * sizeof(float));
+    float* col_weights = (float*)malloc(kernel_size * sizeof(float));
+    generate_gaussian_kernel(gaussian_kernel, sigma, kernel_radius);
+    int mask_separable = extract_separable_kernel(gaussian_kernel, kernel_radius, row_weights, col_weights);
+    if (host_mode == HOST_BLUR_SEPARABLE && !mask_separable)
+    {
+        host_mode = HOST_BLUR_EXACT;
+    }
+    // Q14 weights for the fixed-point blur, the same the device engine quantizes
+    short* fixed_mask = (short*)malloc(kernel_size * kernel_size * sizeof(short));
+    short* fixed_row_weights = (short*)malloc(kernel_size * sizeof(short));
+    short* fixed_col_weights = (short*)malloc(kernel_size * sizeof(short));
+    quantize_weights(gaussian_kernel, kernel_size * kernel_size, fixed_mask);
+    quantize_weights(row_weights, kernel_size, fixed_row_weights);
+    quantize_weights(col_weights, kernel_size, fixed_col_weights);
 
     //------------------------------------------------------
-    // 5. Create memory buffers on the DEVICE
+    // 3. Platform and device setup
+    // 4. Create a context and command queue
     //------------------------------------------------------
-    // Create buffers for input and output
-    cl_mem input_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, image_width * image_height * image_channels * sizeof(cl_uchar), NULL, NULL);
-    cl_mem output_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, image_width * image_height * image_channels * sizeof(cl_uchar), NULL, NULL);
-    cl_mem kernel_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(gaussian_kernel), (void*)gaussian_kernel, NULL);
+    // Rank every device on every platform; without any, the CPU engine does the work.
+    // The runtime keeps the context and the profiling-enabled queue for every request.
+    ocl_runtime rt;
+    if (!cpu_only && ocl_runtime_init(&rt, device_spec, CL_QUEUE_PROFILING_ENABLE) != CL_SUCCESS)
+    {
+        printf("No usable OpenCL device, running the CPU engine only\n");
+        cpu_only = 1;
+    }
 
-    //------------------------------------------------------
-    // 6. Write data from HOST to DEVICE
-    //------------------------------------------------------
-    cl_event write_event;
-    clEnqueueWriteBuffer(queue, input_buffer, CL_FALSE, 0, image_width * image_height * image_channels * sizeof(cl_uchar), noisy_image, 0, NULL, &write_event);
+    // CPU blur engine (thread pool + SIMD inner loops)
+    cpu_thread_pool* cpu_pool = cpu_thread_pool_create(num_threads);
 
-    //------------------------------------------------------
-    // 7. Build the program and create the kernel
-    //------------------------------------------------------
-    // Read kernel source from file
-    const char* kernel_filename = "../gaussian_blur.cl";
-    char* kernel_source = read_kernel_source(kernel_filename);
-    if (!kernel_source) 
+    // Recursive approximation: its own device engine, then the report against the exact host blur
+    if (use_iir)
     {
-        fprintf(stderr, "Error: Could not read kernel source from file %s\n", kernel_filename);
-        return -1;
+        if (!cpu_only)
+        {
+            print_platform_details(rt.platform);
+            printDeviceInfo(rt.device);
+            print_device_candidates(&rt.selected);
+        }
+        if (input_path)
+        {
+            noisy_image = input_file.pixels;
+        }
+        else
+        {
+            noisy_image = (unsigned char*)malloc(image_bytes);
+            generate_noisy_image(noisy_image, image_width, image_height, image_channels);
+        }
+        int status = run_iir_blur(cpu_only ? NULL : &rt, cpu_pool, host_mode, sigma, noisy_image, output_path ? output_file.pixels : NULL,
+                                  image_width, image_height, image_channels, repeat, gaussian_kernel, row_weights, col_weights, kernel_radius,
+                                  &verify, tolerance);
+
+        if (!cpu_only)
+            ocl_runtime_release(&rt);
+        cpu_thread_pool_destroy(cpu_pool);
+        if (input_path)
+            image_file_close(&input_file);
+        else
+            free(noisy_image);
+        if (output_path)
+            image_file_close(&output_file);
+        free(blurred_image_host);
+        free(gaussian_kernel);
+        free(row_weights);
+        free(col_weights);
+        free(fixed_mask);
+        free(fixed_row_weights);
+        free(fixed_col_weights);
+        return status;
     }
-
-    // Compile the OpenCL program
-    cl_program program = clCreateProgramWithSource(context, 1, (const char**)&kernel_source, NULL, NULL);
-    clBuildProgram(program, 1, &device, NULL, NULL, NULL);
-    // Check for build errors
-    cl_build_status status;
-    clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_STATUS, sizeof(status), &status, NULL);
-    if (status != CL_BUILD_SUCCESS) 
+    if (cpu_only)
     {
-        char log[4096];
-        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, sizeof(log), log, NULL);
-        fprintf(stderr, "Error: Kernel build failed:\n%s\n", log);
-        return -1;
+        printf("\n######### Host Profiling ################\n");
+        printf("CPU engine                                          : %d threads, %s\n", cpu_thread_pool_size(cpu_pool), cpu_blur_simd_name());
+        if (input_path)
+        {
+            noisy_image = input_file.pixels;
+        }
+        else
+        {
+            noisy_image = (unsigned char*)malloc(image_bytes);
+            generate_noisy_image(noisy_image, image_width, image_height, image_channels);
+        }
+        // Half precision only exists in the device kernels
+        if (precision == BLUR_PRECISION_HALF)
+        {
+            printf("Half precision is device-only, using float\n");
+            precision = BLUR_PRECISION_FLOAT;
+        }
+        unsigned char* host_result = output_path ? output_file.pixels : blurred_image_host;
+        double total_time_sec_host = (precision == BLUR_PRECISION_FIXED)
+            ? run_host_blur_fixed(mask_separable && !use_reference_kernel, cpu_pool, noisy_image, host_result, image_width, image_height, image_channels,
+                                  fixed_mask, fixed_row_weights, fixed_col_weights, kernel_radius)
+            : run_host_blur(host_mode, cpu_pool, noisy_image, host_result, image_width, image_height, image_channels,
+                            gaussian_kernel, row_weights, col_weights, kernel_radius);
+        printf("Time taken for Gaussian blur on host                : %f seconds\n", total_time_sec_host);
+        if (precision != BLUR_PRECISION_FLOAT)
+        {
+            report_precision_error(cpu_pool, precision, noisy_image, host_result, image_width, image_height, image_channels,
+                                   gaussian_kernel, kernel_radius);
+        }
+
+        cpu_thread_pool_destroy(cpu_pool);
+        if (input_path)
+            image_file_close(&input_file);
+        else
+            free(noisy_image);
+        if (output_path)
+            image_file_close(&output_file);
+        free(blurred_image_host);
+        free(gaussian_kernel);
+        free(row_weights);
+        free(col_weights);
+        free(fixed_mask);
+        free(fixed_row_weights);
+        free(fixed_col_weights);
+        return 0;
     }
+
+    print_platform_details(rt.platform);
+    printDeviceInfo(rt.device);
+    print_device_candidates(&rt.selected);
+
     //------------------------------------------------------
-    // 8. Set kernel arguments
+    // 5. Build the program and create the kernels
     //------------------------------------------------------
-    cl_kernel kernel = clCreateKernel(program, "gaussian_blur", NULL);
-    int kernel_radius = 2;
-    clSetKernelArg(kernel, 0, sizeof(cl_mem), &input_buffer);
-    clSetKernelArg(kernel, 1, sizeof(cl_mem), &output_buffer);
-    clSetKernelArg(kernel, 2, sizeof(int), &image_width);
-    clSetKernelArg(kernel, 3, sizeof(int), &image_height);
-    clSetKernelArg(kernel, 4, sizeof(cl_mem), &kernel_buffer);
-    clSetKernelArg(kernel, 5, sizeof(int), &kernel_radius); // Kernel radius (5x5 kernel has radius 2)
+    // The blur engine owns the weight buffers; the program comes from the binary cache when possible.
+    // From here on every failure goes through the cleanup at the end, so everything the device run
+    // owns is declared up front.
+    int status = -1;
+    int plain_memory = 0;
+    unsigned char* blurred_image_device = NULL;
+    ocl_host_buffer input_host, output_host;
+    memset(&input_host, 0, sizeof(input_host));
+    memset(&output_host, 0, sizeof(output_host));
+    ocl_profiler profiler;
+    ocl_profiler_init(&profiler);
+    blur_params params = { sigma, kernel_radius, use_reference_kernel, use_jit, image_channels, storage, precision };
+    blur_engine engine;
+    double setup_start = wall_time_sec();
+    if (blur_engine_init(&engine, &rt, &params) != CL_SUCCESS)
+    {
+        fprintf(stderr, "Error: Could not set up the device blur\n");
+        goto cleanup;
+    }
+    int separable = engine.separable;
+    printf("\nBlur path: %s%s (sigma %.2f, radius %d, %d channel%s)\n", separable ? "separable (horizontal + vertical, local memory tiles)" : "reference (full 2D)",
+           use_jit ? ", JIT weights" : "", sigma, kernel_radius, image_channels, (image_channels > 1) ? "s" : "");
+    printf("Frame storage                                       : %s\n", engine.use_images ? "image2d_t (clamp-to-edge sampler)" : "buffers");
+    printf("Precision                                           : %s\n", blur_precision_name(engine.precision));
+    printf("Engine setup (program build or cache load)          : %f seconds\n", wall_time_sec() - setup_start);
+    if (autotune)
+    {
+        printf("\nAutotuning work-group shapes on %dx%d:\n", image_width, image_height);
+        if (blur_engine_autotune(&engine, image_width, image_height, 1) != CL_SUCCESS)
+            printf("Autotuning failed, keeping the default shape\n");
+    }
+    printf("Work-group                                          : %zux%zu, %d pixel(s) per work-item (%s)\n",
+           engine.local_work_size[0], engine.local_work_size[1], engine.pixels_per_item, engine.tuned ? "tuned" : "default");
 
     //------------------------------------------------------
-    // 9. Execute the kernel
+    // 6. Write, execute and read back
     //------------------------------------------------------
-    size_t global_work_size[2] = {image_width, image_height};
-    size_t local_work_size[2] = {16, 16};      // Number of work-items per workgroup
-    cl_event kernel_event;
-    clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_work_size, local_work_size, 1, &write_event, &kernel_event);
-    
-    
+    // Mapped files, and images over --mem-budget or the largest device allocation, are transferred from plain
+    // host memory (in strips when needed). Otherwise the input is generated in place in a zero-copy (unified
+    // memory) or pinned staging host buffer, and the result is read where the device left it
+    int strip_rows = blur_engine_strip_rows(&engine, image_width, mem_budget);
+    int tiled = strip_rows < image_height;
+    plain_memory = tiled || input_path || output_path;
+    double total_time_sec_device = 0.0;
+    double wall_time_sec_device = 0.0; // End-to-end wall clock per request, comparable with the host time
+    // Every command of every request and streamed frame goes into the timeline
+    ocl_profiler_name_queue(&profiler, rt.queue, "runtime queue");
+    if (plain_memory)
+    {
+        if (input_path)
+        {
+            noisy_image = input_file.pixels;
+        }
+        else
+        {
+            noisy_image = (unsigned char*)malloc(image_bytes);
+            generate_noisy_image(noisy_image, image_width, image_height, image_channels);
+        }
+        blurred_image_device = output_path ? output_file.pixels : (unsigned char*)malloc(image_bytes);
+        total_time_sec_device = run_tiled_blur(&engine, noisy_image, blurred_image_device, image_width, image_height, mem_budget, strip_rows);
+        if (total_time_sec_device < 0.0)
+        {
+            fprintf(stderr, "Error: Tiled device blur failed\n");
+            goto cleanup;
+        }
+        wall_time_sec_device = total_time_sec_device;
+    }
+    else
+    {
+        if (ocl_host_buffer_create(&rt, image_bytes, &input_host) != CL_SUCCESS ||
+            ocl_host_buffer_create(&rt, image_bytes, &output_host) != CL_SUCCESS)
+        {
+            fprintf(stderr, "Error: Could not allocate the host buffers\n");
+            goto cleanup;
+        }
+        generate_noisy_image((unsigned char*)input_host.host_ptr, image_width, image_height, image_channels);
+        printf("Host buffers                                        : %s\n",
+               input_host.zero_copy ? "zero-copy (CL_MEM_USE_HOST_PTR)" : "pinned staging (CL_MEM_ALLOC_HOST_PTR)");
+
+        // Extra --repeat requests reuse the same context, program, kernels and buffers
+        blur_events events;
+        double repeat_start = wall_time_sec();
+        for (int i = 0; i < repeat; i++)
+        {
+            if (blur_engine_run_host(&engine, &input_host, &output_host, image_width, image_height, &events) != CL_SUCCESS)
+            {
+                fprintf(stderr, "Error: Device blur failed\n");
+                goto cleanup;
+            }
+            // The read has completed, so every event of the request is final; the last request is reported below
+            blur_events_record(&events, &profiler, i);
+            if (i < repeat - 1)
+                blur_events_release(&events);
+        }
+        double repeat_time_sec = wall_time_sec() - repeat_start;
+        wall_time_sec_device = repeat_time_sec / repeat;
+
+        // Take the input back from the device for the host blur
+        if (ocl_host_buffer_map(&rt, &input_host, CL_MAP_READ, 0, NULL, NULL) != CL_SUCCESS)
+        {
+            fprintf(stderr, "Error: Could not map the input image\n");
+            blur_events_release(&events);
+            goto cleanup;
+        }
+        noisy_image = (unsigned char*)input_host.host_ptr;
+        blurred_image_device = (unsigned char*)output_host.host_ptr;
+
+        //------------------------------------------------------
+        // 7. Profiling the Device
+        //------------------------------------------------------
+        // Profiling: Calculate execution times of the last request
+        printf("\n######### Device Profiling ################\n");
+        double write_time_sec = event_time_sec(events.write_event);
+        double kernel_time_sec = blur_events_kernel_time(&events);
+        double read_time_sec = event_time_sec(events.read_event);
+
+        // Total Time (Sum of all phases)
+        total_time_sec_device = write_time_sec + kernel_time_sec + read_time_sec;
+        printf("Data Write Time                                     : %f seconds\n", write_time_sec);
+        printf("Kernel Execution Time                               : %f seconds\n", kernel_time_sec);
+        printf("Data Read Time                                      : %f seconds\n", read_time_sec);
+        printf("Time taken for Gaussian blur on device              : %f seconds\n", total_time_sec_device);
+        if (repeat > 1)
+        {
+            printf("Wall time per request (%4d requests)                : %f seconds\n", repeat, repeat_time_sec / repeat);
+        }
+        blur_events_release(&events);
+    }
+
     //------------------------------------------------------
-    // 10. Read the result from DEVICE to HOST
+    // 8. Stream a batch of frames
     //------------------------------------------------------
-    cl_event read_event;
-    clEnqueueReadBuffer(queue, output_buffer, CL_FALSE, 0, image_width * image_height * image_channels * sizeof(cl_uchar), blurred_image_device, 1, &kernel_event, &read_event);
-    // Wait for read operation to complete
-    clWaitForEvents(1, &read_event);
+    // Upload of frame N+1, kernels of frame N and download of frame N-1 overlap on separate queues,
+    // then the same frames go through non-blocking submits with completion callbacks
+    // (frames too large for the device are only blurred in strips)
+    if (num_frames > 0 && !tiled && run_frame_stream(&engine, image_width, image_height, num_frames, num_slots, &profiler) != 0)
+    {
+        fprintf(stderr, "Error: Frame stream or asynchronous submission did not reproduce the sequential result\n");
+    }
 
+    // Percentiles per stage over all requests and frames, and the idle time of each queue
+    if (repeat > 1 || num_frames > 0)
+    {
+        printf("\n######### Command Timeline (%d commands) ################\n", profiler.num_records);
+        ocl_profiler_print_summary(&profiler);
 
-    //------------------------------------------------------
-    // 11. Profiling the Device
-    //------------------------------------------------------
-    // Profiling: Calculate execution times
-    printf("\n######### Device Profiling ################\n");
-    cl_ulong start, end;
-    double write_time_sec, kernel_time_sec, read_time_sec, total_time_sec_device;
-    clGetEventProfilingInfo(write_event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
-    clGetEventProfilingInfo(write_event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
-    write_time_sec = (end - start) * 1e-9; // Convert from nanoseconds to seconds
-
-
-    clGetEventProfilingInfo(kernel_event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
-    clGetEventProfilingInfo(kernel_event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
-    kernel_time_sec = (end - start) * 1e-9; // Convert from nanoseconds to seconds
-    
-
-    clGetEventProfilingInfo(read_event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
-    clGetEventProfilingInfo(read_event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
-    read_time_sec = (end - start) * 1e-9; // Convert from nanoseconds to seconds
-    
-    // Total Time (Sum of all phases)
-    total_time_sec_device = write_time_sec + kernel_time_sec + read_time_sec;
-    printf("Data Write Time                                     : %f seconds\n", write_time_sec);
-    printf("Kernel Execution Time                               : %f seconds\n", kernel_time_sec);
-    printf("Data Read Time                                      : %f seconds\n", read_time_sec); 
-    printf("Time taken for Gaussian blur on device              : %f seconds\n", total_time_sec_device);
+        // Buffers recycled from request to request instead of created each time
+        printf("\n######### Buffer Pool ################\n");
+        buffer_pool_print_stats(&rt.buffers);
+    }
+    if (trace_path && ocl_profiler_write(&profiler, trace_path) == 0)
+    {
+        printf("Command timeline written to %s\n", trace_path);
+    }
 
     // Start time measurement
     printf("\n######### Host Profiling ################\n");
-    clock_t start_time = clock();
-    // Apply Gaussian blur on host
-    gaussian_blur_host(noisy_image, blurred_image_host, image_width, image_height, gaussian_kernel, kernel_radius);
-    // End time measurement
-    clock_t end_time = clock();
-    // Calculate the time taken
-    double total_time_sec_host = (double)(end_time - start_time) / CLOCKS_PER_SEC;
+    if (host_mode != HOST_BLUR_REFERENCE)
+    {
+        printf("CPU engine                                          : %d threads, %s\n", cpu_thread_pool_size(cpu_pool), cpu_blur_simd_name());
+    }
+    // Apply Gaussian blur on host (wall-clock time, since the engine is multithreaded). In fixed point the
+    // host runs the same integer blur on the device's path; half precision is checked against the float blur.
+    double total_time_sec_host = (engine.precision == BLUR_PRECISION_FIXED)
+        ? run_host_blur_fixed(separable, cpu_pool, noisy_image, blurred_image_host, image_width, image_height, image_channels,
+                              fixed_mask, fixed_row_weights, fixed_col_weights, kernel_radius)
+        : run_host_blur(host_mode, cpu_pool, noisy_image, blurred_image_host, image_width, image_height, image_channels,
+                        gaussian_kernel, row_weights, col_weights, kernel_radius);
     printf("Time taken for Gaussian blur on host                : %f seconds\n", total_time_sec_host);    
 
     printf("\n######### Comparison: Device vs Host ################\n");
-    are_arrays_equal(blurred_image_host, blurred_image_device, image_width * image_height * image_channels);     
-    printf("Device is %f times faster than Host \n\n\n\n", (total_time_sec_host/total_time_sec_device));    
+    // The separable paths sum in a different order than the 2D reference, so truncation can differ by one.
+    // Fixed point is the same integer arithmetic on both sides; half precision rounds every product and sum.
+    if (tolerance >= 0)
+        verify.tolerance = tolerance;
+    else if (engine.precision == BLUR_PRECISION_FIXED)
+        verify.tolerance = 0;
+    else if (engine.precision == BLUR_PRECISION_HALF)
+        verify.tolerance = 2;
+    else
+        verify.tolerance = (separable || host_mode == HOST_BLUR_SEPARABLE) ? 1 : 0;
+    verify_result comparison;
+    double verify_start = wall_time_sec();
+    verify_images(cpu_pool, blurred_image_host, blurred_image_device, image_bytes, &verify, &comparison);
+    double verify_time_sec = wall_time_sec() - verify_start;
+    verify_print(&comparison, &verify, blurred_image_host, blurred_image_device, image_bytes, image_width, image_channels);
+    printf("Time taken for comparison                           : %f seconds\n", verify_time_sec);
+    if (engine.precision != BLUR_PRECISION_FLOAT)
+    {
+        report_precision_error(cpu_pool, engine.precision, noisy_image, blurred_image_device, image_width, image_height, image_channels,
+                               gaussian_kernel, kernel_radius);
+    }
+    // Both sides are wall-clock time of a whole request; these are single samples, bench gives the statistics
+    printf("Device is %f times faster than Host (wall clock per request; see bench for repeated trials)\n\n\n\n",
+           total_time_sec_host / wall_time_sec_device);    
+    status = comparison.passed ? 0 : 1;
 
     // Clean up
-    clReleaseMemObject(input_buffer);
-    clReleaseMemObject(output_buffer);
-    clReleaseMemObject(kernel_buffer);
-    clReleaseProgram(program);
-    clReleaseKernel(kernel);
-    clReleaseCommandQueue(queue);
-    clReleaseContext(context);
-    free(noisy_image);
-    free(blurred_image_device);
+cleanup:
+    ocl_profiler_release(&profiler);
+    ocl_host_buffer_release(&rt, &input_host);
+    ocl_host_buffer_release(&rt, &output_host);
+    if (input_path)
+        image_file_close(&input_file);
+    else if (plain_memory)
+        free(noisy_image);
+    if (output_path)
+        image_file_close(&output_file);
+    else if (plain_memory)
+        free(blurred_image_device);
+    blur_engine_release(&engine);
+    ocl_runtime_release(&rt);
+    cpu_thread_pool_destroy(cpu_pool);
     free(blurred_image_host);
-    free(kernel_source);
-
-    return 0;
+    free(gaussian_kernel);
+    free(row_weights);
+    free(col_weights);
+    free(fixed_mask);
+    free(fixed_row_weights);
+    free(fixed_col_weights);
+
+    return status;
 }
@@ -1,29 +1,278 @@
-__kernel void gaussian_blur(__global const uchar* input, __global uchar* output, int width, int height, __constant float* mkernel, int kernel_radius) 
+// Precision of the buffer kernels: float by default, or
+// -D FIXED_POINT: Q FIXED_BITS short weights summing to exactly 1 << FIXED_BITS and int accumulators.
+//     The 2D kernel shifts its sum right by FIXED_BITS; the horizontal pass keeps FIXED_TEMP_BITS
+//     fractional bits in a short intermediate, which the vertical pass shifts out with the weights.
+//     Shifts floor like the float path's truncation, and the host fixed-point blur computes the same integers.
+// -D HALF_PRECISION: float weights, half (cl_khr_fp16) products, sums and intermediate.
+#if defined(FIXED_POINT)
+typedef short weight_t;
+#define ACC_T int
+#define TEMP_T short
+#define FINISH_2D(v) ((v) >> FIXED_BITS)
+#define FINISH_HORIZONTAL(v) ((v) >> FIXED_TEMP_BITS)
+#define FINISH_VERTICAL(v) ((v) >> (FIXED_BITS + FIXED_TEMP_BITS))
+#elif defined(HALF_PRECISION)
+#pragma OPENCL EXTENSION cl_khr_fp16 : enable
+typedef float weight_t;
+#define ACC_T half
+#define TEMP_T half
+#else
+typedef float weight_t;
+#define ACC_T float
+#define TEMP_T float
+#endif
+#ifndef FINISH_2D
+#define FINISH_2D(v) (v)
+#define FINISH_HORIZONTAL(v) (v)
+#define FINISH_VERTICAL(v) (v)
+#endif
+#define WEIGHT(w) ((ACC_T)(w))
+
+// JIT path: the host bakes the radius and weights in with -D KERNEL_RADIUS=... and
+// MASK_WEIGHTS / ROW_WEIGHTS / COL_WEIGHTS, so tap loops have constant bounds and unroll.
+// Without those defines the kernels use their runtime kernel_radius and weight arguments.
+#ifdef KERNEL_RADIUS
+#define RADIUS KERNEL_RADIUS
+#else
+#define RADIUS kernel_radius
+#endif
+
+#ifdef MASK_WEIGHTS
+__constant weight_t jit_mask_weights[] = { MASK_WEIGHTS };
+#define MASK_WEIGHT(i) jit_mask_weights[i]
+#else
+#define MASK_WEIGHT(i) mkernel[i]
+#endif
+
+#ifdef ROW_WEIGHTS
+__constant weight_t jit_row_weights[] = { ROW_WEIGHTS };
+#define ROW_WEIGHT(i) jit_row_weights[i]
+#else
+#define ROW_WEIGHT(i) row_weights[i]
+#endif
+
+#ifdef COL_WEIGHTS
+__constant weight_t jit_col_weights[] = { COL_WEIGHTS };
+#define COL_WEIGHT(i) jit_col_weights[i]
+#else
+#define COL_WEIGHT(i) col_weights[i]
+#endif
+
+// Interleaved RGB/RGBA: with -D CHANNELS=3 or 4 a pixel is loaded with vload3/vload4 into a vector
+// of the accumulator type, so one work-item blurs every channel of its pixel. Single-channel images use plain scalars.
+#ifndef CHANNELS
+#define CHANNELS 1
+#endif
+
+#define CAT_(a, b) a##b
+#define CAT(a, b) CAT_(a, b)
+
+#if CHANNELS == 4
+typedef CAT(ACC_T, 4) pixel_t;
+#define LOAD_PIXEL(p, i) CAT(convert_, CAT(ACC_T, 4))(vload4((i), (p)))
+#define STORE_PIXEL(v, p, i) vstore4(convert_uchar4_sat(v), (i), (p))
+#define LOAD_SUM(p, i) CAT(convert_, CAT(ACC_T, 4))(vload4((i), (p)))
+#define STORE_SUM(v, p, i) vstore4(CAT(convert_, CAT(TEMP_T, 4))(v), (i), (p))
+#elif CHANNELS == 3
+typedef CAT(ACC_T, 3) pixel_t;
+#define LOAD_PIXEL(p, i) CAT(convert_, CAT(ACC_T, 3))(vload3((i), (p)))
+#define STORE_PIXEL(v, p, i) vstore3(convert_uchar3_sat(v), (i), (p))
+#define LOAD_SUM(p, i) CAT(convert_, CAT(ACC_T, 3))(vload3((i), (p)))
+#define STORE_SUM(v, p, i) vstore3(CAT(convert_, CAT(TEMP_T, 3))(v), (i), (p))
+#else
+typedef ACC_T pixel_t;
+#define LOAD_PIXEL(p, i) ((ACC_T)(p)[i])
+#define STORE_PIXEL(v, p, i) ((p)[i] = (uchar)(v))
+#define LOAD_SUM(p, i) ((ACC_T)(p)[i])
+#define STORE_SUM(v, p, i) ((p)[i] = (TEMP_T)(v))
+#endif
+
+// The 2D kernels can compute PIXELS_PER_ITEM vertically adjacent pixels per work-item (set by the
+// autotuner); the host then launches ceil(height / PIXELS_PER_ITEM) rows of work-items.
+#ifndef PIXELS_PER_ITEM
+#define PIXELS_PER_ITEM 1
+#endif
+
+
+
+__kernel void gaussian_blur(__global const uchar* input, __global uchar* output, int width, int height, __constant weight_t* mkernel, int kernel_radius) 
+{
+    int x = get_global_id(0);
+    int y_first = get_global_id(1) * PIXELS_PER_ITEM;
+
+    for (int p = 0; p < PIXELS_PER_ITEM; p++)
+    {
+        int y = y_first + p;
+        if (x >= width || y >= height) 
+            return;
+
+        pixel_t sum = 0;
+        #pragma unroll
+        for (int ky = -RADIUS; ky <= RADIUS; ky++) 
+        {
+            #pragma unroll
+            for (int kx = -RADIUS; kx <= RADIUS; kx++) 
+            {
+                int ix = x + kx;
+                int iy = y + ky;
+
+                // Handle boundary conditions
+                if (ix < 0) ix = 0;
+                if (iy < 0) iy = 0;
+                if (ix >= width) ix = width - 1;
+                if (iy >= height) iy = height - 1;
+
+                pixel_t pixel = LOAD_PIXEL(input, (iy * width) + ix);
+                ACC_T weight = WEIGHT(MASK_WEIGHT((ky + RADIUS) * ((2 * RADIUS) + 1) + (kx + RADIUS)));
+                sum += pixel * weight;
+            }
+        }
+        STORE_PIXEL(FINISH_2D(sum), output, (y * width) + x);
+    }
+}
+
+
+// Separable pass 1: horizontal 1D convolution (uchar -> float, short or half intermediate).
+// Each work-group stages its rows, plus kernel_radius halo pixels on the left
+// and right, into local memory so every input pixel is read from global memory once.
+__kernel void gaussian_blur_horizontal(__global const uchar* input, __global TEMP_T* output, int width, int height, __constant weight_t* row_weights, int kernel_radius, __local pixel_t* tile)
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    int lx = get_local_id(0);
+    int ly = get_local_id(1);
+    int group_width = get_local_size(0);
+    int tile_width = group_width + (2 * kernel_radius);
+    int tile_x = (get_group_id(0) * group_width) - kernel_radius;
+
+    // Work-items outside the image still help to fill the tile, so clamp the row
+    int iy = min(y, height - 1);
+    for (int i = lx; i < tile_width; i += group_width)
+    {
+        int ix = clamp(tile_x + i, 0, width - 1);
+        tile[(ly * tile_width) + i] = LOAD_PIXEL(input, (iy * width) + ix);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (x >= width || y >= height)
+        return;
+
+    pixel_t sum = 0;
+    #pragma unroll
+    for (int k = 0; k <= 2 * RADIUS; k++)
+    {
+        sum += tile[(ly * tile_width) + lx + k] * WEIGHT(ROW_WEIGHT(k));
+    }
+    STORE_SUM(FINISH_HORIZONTAL(sum), output, (y * width) + x);
+}
+
+
+
+// Separable pass 2: vertical 1D convolution (intermediate -> uchar).
+// Same tiling as the horizontal pass, with the halo above and below the work-group.
+__kernel void gaussian_blur_vertical(__global const TEMP_T* input, __global uchar* output, int width, int height, __constant weight_t* col_weights, int kernel_radius, __local pixel_t* tile)
 {
     int x = get_global_id(0);
     int y = get_global_id(1);
+    int lx = get_local_id(0);
+    int ly = get_local_id(1);
+    int group_width = get_local_size(0);
+    int group_height = get_local_size(1);
+    int tile_height = group_height + (2 * kernel_radius);
+    int tile_y = (get_group_id(1) * group_height) - kernel_radius;
+
+    int ix = min(x, width - 1);
+    for (int i = ly; i < tile_height; i += group_height)
+    {
+        int iy = clamp(tile_y + i, 0, height - 1);
+        tile[(i * group_width) + lx] = LOAD_SUM(input, (iy * width) + ix);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (x >= width || y >= height)
+        return;
+
+    pixel_t sum = 0;
+    #pragma unroll
+    for (int k = 0; k <= 2 * RADIUS; k++)
+    {
+        sum += tile[((ly + k) * group_width) + lx] * WEIGHT(COL_WEIGHT(k));
+    }
+    STORE_PIXEL(FINISH_VERTICAL(sum), output, (y * width) + x);
+}
+
+
 
-    if (x >= width || y >= height) 
-		return;
-
-    float sum = 0.0f;
-    for (int ky = -kernel_radius; ky <= kernel_radius; ky++) 
-	{
-        for (int kx = -kernel_radius; kx <= kernel_radius; kx++) 
-		{
-            int ix = x + kx;
-            int iy = y + ky;
-
-            // Handle boundary conditions
-            if (ix < 0) ix = 0;
-            if (iy < 0) iy = 0;
-            if (ix >= width) ix = width - 1;
-            if (iy >= height) iy = height - 1;
-
-            float pixel = input[(iy * width) + ix];
-            float weight = mkernel[(ky + kernel_radius) * ((2 * kernel_radius) + 1) + (kx + kernel_radius)];
-            sum += pixel * weight;
+// Image path (-D USE_IMAGES, float precision only): frames are image2d_t objects (CL_R or CL_RGBA,
+// CL_UNSIGNED_INT8) and the sampler clamps coordinates to the edge, so the taps need no bounds checks and
+// reads go through the texture cache. Same arguments as the buffer kernels, minus the local-memory tile.
+#ifdef USE_IMAGES
+__constant sampler_t clamp_sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+
+__kernel void gaussian_blur_image(__read_only image2d_t input, __write_only image2d_t output, int width, int height, __constant float* mkernel, int kernel_radius)
+{
+    int x = get_global_id(0);
+    int y_first = get_global_id(1) * PIXELS_PER_ITEM;
+
+    for (int p = 0; p < PIXELS_PER_ITEM; p++)
+    {
+        int y = y_first + p;
+        if (x >= width || y >= height)
+            return;
+
+        float4 sum = 0.0f;
+        #pragma unroll
+        for (int ky = -RADIUS; ky <= RADIUS; ky++)
+        {
+            #pragma unroll
+            for (int kx = -RADIUS; kx <= RADIUS; kx++)
+            {
+                float4 pixel = convert_float4(read_imageui(input, clamp_sampler, (int2)(x + kx, y + ky)));
+                float weight = MASK_WEIGHT((ky + RADIUS) * ((2 * RADIUS) + 1) + (kx + RADIUS));
+                sum += pixel * weight;
+            }
         }
+        write_imageui(output, (int2)(x, y), convert_uint4_sat(sum));
+    }
+}
+
+
+
+// Separable pass 1 on images: uchar image -> float image (CL_FLOAT)
+__kernel void gaussian_blur_image_horizontal(__read_only image2d_t input, __write_only image2d_t output, int width, int height, __constant float* row_weights, int kernel_radius)
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+
+    if (x >= width || y >= height)
+        return;
+
+    float4 sum = 0.0f;
+    #pragma unroll
+    for (int k = 0; k <= 2 * RADIUS; k++)
+    {
+        sum += convert_float4(read_imageui(input, clamp_sampler, (int2)(x + k - RADIUS, y))) * ROW_WEIGHT(k);
+    }
+    write_imagef(output, (int2)(x, y), sum);
+}
+
+
+
+// Separable pass 2 on images: float image -> uchar image
+__kernel void gaussian_blur_image_vertical(__read_only image2d_t input, __write_only image2d_t output, int width, int height, __constant float* col_weights, int kernel_radius)
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+
+    if (x >= width || y >= height)
+        return;
+
+    float4 sum = 0.0f;
+    #pragma unroll
+    for (int k = 0; k <= 2 * RADIUS; k++)
+    {
+        sum += read_imagef(input, clamp_sampler, (int2)(x, y + k - RADIUS)) * COL_WEIGHT(k);
     }
-    output[(y * width) + x] = (uchar)sum;
-}
\ No newline at end of file
+    write_imageui(output, (int2)(x, y), convert_uint4_sat(sum));
+}
+#endif
@@ -0,0 +1,128 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "gaussian_mask.h"
+
+
+
+// Function to pick a Gaussian radius that covers +/- 3 sigma
+int gaussian_kernel_radius(float sigma)
+{
+    int kernel_radius = (int)ceilf(3.0f * sigma);
+    return (kernel_radius < 1) ? 1 : kernel_radius;
+}
+
+// Function to generate a normalized 1D Gaussian with 2 * kernel_radius + 1 taps (weights sum to 1)
+void generate_gaussian_weights(float* weights, float sigma, int kernel_radius)
+{
+    float sum = 0.0f;
+    for (int k = -kernel_radius; k <= kernel_radius; k++)
+    {
+        weights[k + kernel_radius] = expf(-(float)(k * k) / (2.0f * sigma * sigma));
+        sum += weights[k + kernel_radius];
+    }
+    for (int k = 0; k <= 2 * kernel_radius; k++)
+    {
+        weights[k] /= sum;
+    }
+}
+
+// Function to generate a normalized 2D Gaussian mask ((2 * kernel_radius + 1)^2 weights, row-major)
+// as the outer product of the 1D weights, so it stays exactly separable
+void generate_gaussian_kernel(float* mkernel, float sigma, int kernel_radius)
+{
+    int size = (2 * kernel_radius) + 1;
+    float* weights = (float*)malloc(size * sizeof(float));
+    generate_gaussian_weights(weights, sigma, kernel_radius);
+    for (int ky = 0; ky < size; ky++)
+    {
+        for (int kx = 0; kx < size; kx++)
+        {
+            mkernel[(ky * size) + kx] = weights[ky] * weights[kx];
+        }
+    }
+    free(weights);
+}
+
+// Function to append "-D name=w0,w1,..." to an OpenCL build options string.
+// Weights are printed with full float precision so the JIT kernel matches the runtime one.
+void append_weights_define(char* options, size_t options_size, const char* name, const float* weights, int count)
+{
+    size_t length = strlen(options);
+    length += snprintf(options + length, options_size - length, " -D %s=", name);
+    for (int i = 0; i < count && length < options_size; i++)
+    {
+        length += snprintf(options + length, options_size - length, "%s%.9ef", (i > 0) ? "," : "", weights[i]);
+    }
+}
+
+// Function to append "-D name=w0,w1,..." with Q14 integer weights
+void append_fixed_weights_define(char* options, size_t options_size, const char* name, const short* weights, int count)
+{
+    size_t length = strlen(options);
+    length += snprintf(options + length, options_size - length, " -D %s=", name);
+    for (int i = 0; i < count && length < options_size; i++)
+    {
+        length += snprintf(options + length, options_size - length, "%s%d", (i > 0) ? "," : "", weights[i]);
+    }
+}
+
+// Function to quantize weights to Q14 shorts summing to exactly 1 << GAUSSIAN_FIXED_BITS
+void quantize_weights(const float* weights, int count, short* fixed_weights)
+{
+    double sum = 0.0;
+    for (int i = 0; i < count; i++)
+    {
+        sum += weights[i];
+    }
+    int one = 1 << GAUSSIAN_FIXED_BITS;
+    int total = 0;
+    int largest = 0;
+    for (int i = 0; i < count; i++)
+    {
+        fixed_weights[i] = (short)lround((weights[i] / sum) * one);
+        total += fixed_weights[i];
+        if (fixed_weights[i] > fixed_weights[largest])
+            largest = i;
+    }
+    fixed_weights[largest] = (short)(fixed_weights[largest] + (one - total));
+}
+
+// Function to split a 2D mask into a column vector and a row vector (mask = col * row^T).
+// Returns 1 when the mask is separable within tolerance, 0 otherwise.
+int extract_separable_kernel(const float* mkernel, int kernel_radius, float* row_weights, float* col_weights)
+{
+    int size = (2 * kernel_radius) + 1;
+
+    // Pivot on the largest weight to keep the division well conditioned
+    int pivot_row = 0, pivot_col = 0;
+    for (int i = 0; i < size * size; i++) {
+        if (fabsf(mkernel[i]) > fabsf(mkernel[(pivot_row * size) + pivot_col])) {
+            pivot_row = i / size;
+            pivot_col = i % size;
+        }
+    }
+    float pivot = mkernel[(pivot_row * size) + pivot_col];
+    if (pivot == 0.0f) {
+        return 0;
+    }
+
+    for (int i = 0; i < size; i++) {
+        col_weights[i] = mkernel[(i * size) + pivot_col];
+        row_weights[i] = mkernel[(pivot_row * size) + i] / pivot;
+    }
+
+    // The mask is separable if the outer product reproduces every weight
+    for (int ky = 0; ky < size; ky++) {
+        for (int kx = 0; kx < size; kx++) {
+            float error = fabsf((col_weights[ky] * row_weights[kx]) - mkernel[(ky * size) + kx]);
+            if (error > 1e-5f * fabsf(pivot)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,36 @@
+#ifndef GAUSSIAN_MASK_H
+#define GAUSSIAN_MASK_H
+
+#include <stddef.h>
+
+// Gaussian mask generation and separability helpers shared by the host and device blur paths.
+// 2D masks are (2 * kernel_radius + 1)^2 floats, row-major.
+
+// Fixed-point blur: weights in Q14 shorts that sum to exactly 1 << GAUSSIAN_FIXED_BITS, integer
+// accumulation, and a separable intermediate with GAUSSIAN_FIXED_TEMP_BITS fractional bits
+// (255 << 7 still fits a short, and the vertical sums fit an int)
+#define GAUSSIAN_FIXED_BITS 14
+#define GAUSSIAN_FIXED_TEMP_BITS 7
+
+// Radius that covers +/- 3 sigma (at least 1)
+int gaussian_kernel_radius(float sigma);
+
+// Normalized 1D Gaussian with 2 * kernel_radius + 1 taps (weights sum to 1)
+void generate_gaussian_weights(float* weights, float sigma, int kernel_radius);
+
+// Normalized 2D Gaussian, the outer product of the 1D weights
+void generate_gaussian_kernel(float* mkernel, float sigma, int kernel_radius);
+
+// Appends " -D name=w0,w1,..." to an OpenCL build options string
+void append_weights_define(char* options, size_t options_size, const char* name, const float* weights, int count);
+void append_fixed_weights_define(char* options, size_t options_size, const char* name, const short* weights, int count);
+
+// Scales weights to sum to 1 << GAUSSIAN_FIXED_BITS and rounds them; the rounding residual goes to the
+// largest weight, so a flat image stays flat
+void quantize_weights(const float* weights, int count, short* fixed_weights);
+
+// Splits a 2D mask into column and row vectors (mask = col * row^T).
+// Returns 1 when the mask is separable within tolerance, 0 otherwise.
+int extract_separable_kernel(const float* mkernel, int kernel_radius, float* row_weights, float* col_weights);
+
+#endif
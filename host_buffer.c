@@ -0,0 +1,139 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_buffer.h"
+
+#define HOST_BUFFER_ALIGNMENT 4096   // Page alignment, which also satisfies CL_DEVICE_MEM_BASE_ADDR_ALIGN
+#define HOST_BUFFER_SIZE_MULTIPLE 64 // Some zero-copy implementations want the size in cache lines
+
+
+
+static int use_zero_copy(const ocl_runtime* rt)
+{
+    const char* env = getenv("OCL_ZERO_COPY");
+    if (env && env[0] != '\0')
+        return atoi(env) != 0;
+    return rt->host_unified_memory == CL_TRUE;
+}
+
+cl_int ocl_host_buffer_create(ocl_runtime* rt, size_t size, ocl_host_buffer* hb)
+{
+    cl_int err;
+    size_t buffer_size = (size + HOST_BUFFER_SIZE_MULTIPLE - 1) / HOST_BUFFER_SIZE_MULTIPLE * HOST_BUFFER_SIZE_MULTIPLE;
+    memset(hb, 0, sizeof(*hb));
+    hb->size = size;
+    hb->zero_copy = use_zero_copy(rt);
+
+    if (hb->zero_copy)
+    {
+        size_t allocation_size = (buffer_size + HOST_BUFFER_ALIGNMENT - 1) / HOST_BUFFER_ALIGNMENT * HOST_BUFFER_ALIGNMENT;
+        if (posix_memalign(&hb->allocation, HOST_BUFFER_ALIGNMENT, allocation_size) != 0)
+        {
+            fprintf(stderr, "Error: Could not allocate %zu bytes of aligned host memory\n", allocation_size);
+            hb->allocation = NULL;
+            return CL_OUT_OF_HOST_MEMORY;
+        }
+        hb->buffer = ocl_runtime_buffer(rt, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, buffer_size, hb->allocation, &err);
+    }
+    else
+    {
+        // Pinning is the slow part of creating these, so they come from the runtime's pool
+        hb->buffer = ocl_runtime_acquire(rt, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, buffer_size, &err);
+    }
+    if (!hb->buffer)
+    {
+        free(hb->allocation);
+        hb->allocation = NULL;
+        return err;
+    }
+
+    hb->host_ptr = clEnqueueMapBuffer(rt->queue, hb->buffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, size, 0, NULL, NULL, &err);
+    if (!hb->host_ptr)
+    {
+        ocl_report_error("clEnqueueMapBuffer", err, __FILE__, __LINE__);
+        ocl_host_buffer_release(rt, hb);
+        return err;
+    }
+    hb->mapped = 1;
+    return CL_SUCCESS;
+}
+
+void ocl_host_buffer_release(ocl_runtime* rt, ocl_host_buffer* hb)
+{
+    if (hb->buffer)
+    {
+        if (hb->mapped)
+            clEnqueueUnmapMemObject(rt->queue, hb->buffer, hb->host_ptr, 0, NULL, NULL);
+        // The allocation must outlive every command that still uses the buffer
+        clFinish(rt->queue);
+        ocl_runtime_recycle(rt, hb->buffer);
+    }
+    free(hb->allocation);
+    memset(hb, 0, sizeof(*hb));
+}
+
+cl_int ocl_host_buffer_map(ocl_runtime* rt, ocl_host_buffer* hb, cl_map_flags flags,
+                           cl_uint num_wait_events, const cl_event* wait_events, cl_event* event)
+{
+    cl_int err;
+    cl_event map_event;
+    if (event)
+        *event = NULL;
+    if (hb->mapped)
+        return CL_SUCCESS;
+
+    hb->host_ptr = clEnqueueMapBuffer(rt->queue, hb->buffer, CL_FALSE, flags, 0, hb->size,
+                                      num_wait_events, wait_events, &map_event, &err);
+    if (!hb->host_ptr)
+    {
+        ocl_report_error("clEnqueueMapBuffer", err, __FILE__, __LINE__);
+        return err;
+    }
+    err = clWaitForEvents(1, &map_event);
+    if (event)
+        *event = map_event;
+    else
+        clReleaseEvent(map_event);
+    if (err != CL_SUCCESS)
+    {
+        ocl_report_error("clWaitForEvents", err, __FILE__, __LINE__);
+        return err;
+    }
+    hb->mapped = 1;
+    return CL_SUCCESS;
+}
+
+cl_int ocl_host_buffer_unmap(ocl_runtime* rt, ocl_host_buffer* hb, cl_event* event)
+{
+    if (event)
+        *event = NULL;
+    if (!hb->zero_copy || !hb->mapped)
+        return CL_SUCCESS;
+    OCL_CHECK(clEnqueueUnmapMemObject(rt->queue, hb->buffer, hb->host_ptr, 0, NULL, event));
+    hb->mapped = 0;
+    return CL_SUCCESS;
+}
+
+cl_mem ocl_host_buffer_device_mem(const ocl_host_buffer* hb, cl_mem device_buffer)
+{
+    return hb->zero_copy ? hb->buffer : device_buffer;
+}
+
+cl_int ocl_host_buffer_upload(ocl_runtime* rt, ocl_host_buffer* hb, cl_mem device_buffer, size_t size, cl_event* event)
+{
+    if (hb->zero_copy)
+        return ocl_host_buffer_unmap(rt, hb, event);
+    OCL_CHECK(clEnqueueWriteBuffer(rt->queue, device_buffer, CL_FALSE, 0, size, hb->host_ptr, 0, NULL, event));
+    return CL_SUCCESS;
+}
+
+cl_int ocl_host_buffer_download(ocl_runtime* rt, ocl_host_buffer* hb, cl_mem device_buffer, size_t size,
+                                cl_uint num_wait_events, const cl_event* wait_events, cl_event* event)
+{
+    if (hb->zero_copy)
+        return ocl_host_buffer_map(rt, hb, CL_MAP_READ | CL_MAP_WRITE, num_wait_events, wait_events, event);
+    OCL_CHECK(clEnqueueReadBuffer(rt->queue, device_buffer, CL_TRUE, 0, size, hb->host_ptr, num_wait_events, wait_events, event));
+    return CL_SUCCESS;
+}
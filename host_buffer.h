@@ -0,0 +1,51 @@
+#ifndef HOST_BUFFER_H
+#define HOST_BUFFER_H
+
+#include <stddef.h>
+#include <CL/cl.h>
+
+#include "ocl_runtime.h"
+
+// Host memory that reaches the device without an extra copy.
+// On unified-memory devices (integrated GPUs, CPU devices) the buffer wraps page-aligned host memory
+// (CL_MEM_USE_HOST_PTR) and kernels use it in place; the host may only touch host_ptr while it is mapped.
+// On discrete devices it is a pinned CL_MEM_ALLOC_HOST_PTR buffer that stays mapped and serves as the
+// source or destination of full-speed transfers to a device buffer, recycled through the runtime's pool.
+// OCL_ZERO_COPY=0 or 1 forces the staging or the zero-copy mode.
+
+typedef struct
+{
+    cl_mem buffer;
+    void* host_ptr;     // Host view of the data, valid while mapped
+    void* allocation;   // Page-aligned memory behind a zero-copy buffer
+    size_t size;
+    int zero_copy;      // Kernels use buffer directly; otherwise it is a pinned staging buffer
+    int mapped;
+} ocl_host_buffer;
+
+// Creates a host buffer of size bytes, mapped for host reads and writes
+cl_int ocl_host_buffer_create(ocl_runtime* rt, size_t size, ocl_host_buffer* hb);
+
+void ocl_host_buffer_release(ocl_runtime* rt, ocl_host_buffer* hb);
+
+// Maps a zero-copy buffer after the wait list and blocks until host_ptr is usable.
+// Staging buffers are always mapped; event (optional) is then set to NULL.
+cl_int ocl_host_buffer_map(ocl_runtime* rt, ocl_host_buffer* hb, cl_map_flags flags,
+                           cl_uint num_wait_events, const cl_event* wait_events, cl_event* event);
+
+// Hands a zero-copy buffer to the device (no-op for staging buffers, event is then set to NULL)
+cl_int ocl_host_buffer_unmap(ocl_runtime* rt, ocl_host_buffer* hb, cl_event* event);
+
+// Buffer the kernels should use: the host buffer itself when zero-copy, else device_buffer
+cl_mem ocl_host_buffer_device_mem(const ocl_host_buffer* hb, cl_mem device_buffer);
+
+// Makes size bytes of host data visible to the kernels: unmaps a zero-copy buffer, or enqueues a
+// non-blocking write from the pinned memory into device_buffer. event (optional) may come back NULL.
+cl_int ocl_host_buffer_upload(ocl_runtime* rt, ocl_host_buffer* hb, cl_mem device_buffer, size_t size, cl_event* event);
+
+// Brings size bytes of kernel results back to host_ptr after the wait list: maps a zero-copy
+// buffer, or reads device_buffer into the pinned memory. Blocks until the data is on the host.
+cl_int ocl_host_buffer_download(ocl_runtime* rt, ocl_host_buffer* hb, cl_mem device_buffer, size_t size,
+                                cl_uint num_wait_events, const cl_event* wait_events, cl_event* event);
+
+#endif
@@ -0,0 +1,404 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "iir_blur.h"
+
+#define IIR_KERNEL_FILE "iir_blur.cl"
+#define IIR_HOST_BLOCK_COLS 64   // Samples per host column block (the recursion state of a block stays in L1)
+#define IIR_GROUP_SIZE 32        // Columns per work-group on the device
+
+
+
+// Past the last pixel the input stays constant, so the deviations from that constant follow the
+// homogeneous recursions: each column of the boundary map is the anticausal start state for one unit
+// deviation of the causal end state, found by running both recursions far enough for the tail to vanish
+static void compute_boundary(iir_coefficients* coeffs, double a1, double a2, double a3)
+{
+    double b = 1.0 - (a1 + a2 + a3);
+    int length = 64 + (int)(32.0 * coeffs->sigma);   // The impulse response decays by about e^-1 every sigma samples
+    double* w = (double*)malloc((length + 3) * sizeof(double));
+    for (int j = 0; j < 3; j++)
+    {
+        // w[0..2] = w[N-3..N-1] deviations, w[3..] = w[N..]
+        w[0] = (j == 2) ? 1.0 : 0.0;
+        w[1] = (j == 1) ? 1.0 : 0.0;
+        w[2] = (j == 0) ? 1.0 : 0.0;
+        for (int n = 3; n < length + 3; n++)
+            w[n] = (a1 * w[n - 1]) + (a2 * w[n - 2]) + (a3 * w[n - 3]);
+        double v1 = 0.0, v2 = 0.0, v3 = 0.0;
+        for (int n = length + 2; n >= 3; n--)
+        {
+            double v0 = (b * w[n]) + (a1 * v1) + (a2 * v2) + (a3 * v3);
+            v3 = v2;
+            v2 = v1;
+            v1 = v0;
+        }
+        coeffs->boundary[0 + j] = (float)v1;
+        coeffs->boundary[3 + j] = (float)v2;
+        coeffs->boundary[6 + j] = (float)v3;
+    }
+    free(w);
+}
+
+int iir_gaussian_coefficients(float sigma, iir_coefficients* coeffs)
+{
+    if (!(sigma >= IIR_MIN_SIGMA))
+    {
+        fprintf(stderr, "Error: The recursive blur needs sigma >= %.1f (got %g)\n", IIR_MIN_SIGMA, sigma);
+        return -1;
+    }
+    // Young and van Vliet (1995), equations 11b and 8c
+    double s = sigma;
+    double q = (s >= 2.5) ? (0.98711 * s) - 0.96330 : 3.97156 - (4.14554 * sqrt(1.0 - (0.26891 * s)));
+    double b0 = 1.57825 + (2.44413 * q) + (1.4281 * q * q) + (0.422205 * q * q * q);
+    double b1 = (2.44413 * q) + (2.85619 * q * q) + (1.26661 * q * q * q);
+    double b2 = -((1.4281 * q * q) + (1.26661 * q * q * q));
+    double b3 = 0.422205 * q * q * q;
+    coeffs->sigma = sigma;
+    coeffs->a1 = (float)(b1 / b0);
+    coeffs->a2 = (float)(b2 / b0);
+    coeffs->a3 = (float)(b3 / b0);
+    coeffs->b = (float)(1.0 - ((b1 + b2 + b3) / b0));
+    compute_boundary(coeffs, b1 / b0, b2 / b0, b3 / b0);
+    return 0;
+}
+
+//------------------------------------------------------
+// Host passes
+//------------------------------------------------------
+
+typedef struct
+{
+    const unsigned char* input_u8;   // First pass
+    const float* input_f32;          // Second pass
+    float* output_f32;               // First pass, height x width
+    unsigned char* output_u8;        // Second pass, height x width
+    int width;
+    int height;
+    int channels;
+    const iir_coefficients* coeffs;
+    int num_blocks;
+    float** scratch;                 // One height x IIR_HOST_BLOCK_COLS causal pass per thread
+} iir_pass_job;
+
+static void load_block_row(const iir_pass_job* job, int y, int x_begin, int count, float* row)
+{
+    size_t offset = ((size_t)y * job->width * job->channels) + x_begin;
+    if (job->input_u8)
+    {
+        for (int x = 0; x < count; x++)
+            row[x] = job->input_u8[offset + x];
+    }
+    else
+    {
+        memcpy(row, job->input_f32 + offset, count * sizeof(float));
+    }
+}
+
+static void iir_pass_task(void* ctx, int item, int thread_index)
+{
+    const iir_pass_job* job = (const iir_pass_job*)ctx;
+    const iir_coefficients* k = job->coeffs;
+    int channels = job->channels;
+    int height = job->height;
+    int x_begin = item * IIR_HOST_BLOCK_COLS;
+    int samples = job->width * channels;
+    int count = (x_begin + IIR_HOST_BLOCK_COLS < samples) ? IIR_HOST_BLOCK_COLS : samples - x_begin;
+    float* scratch = job->scratch[thread_index];
+    float row[IIR_HOST_BLOCK_COLS];
+    float s1[IIR_HOST_BLOCK_COLS];
+    float s2[IIR_HOST_BLOCK_COLS];
+    float s3[IIR_HOST_BLOCK_COLS];
+    size_t out_offsets[IIR_HOST_BLOCK_COLS];   // Transposed position of each sample in output row 0
+
+    // Causal pass down the block, starting from the steady state of the first row
+    load_block_row(job, 0, x_begin, count, row);
+    for (int x = 0; x < count; x++)
+        s1[x] = s2[x] = s3[x] = row[x];
+    for (int y = 0; y < height; y++)
+    {
+        float* w = scratch + ((size_t)y * IIR_HOST_BLOCK_COLS);
+        load_block_row(job, y, x_begin, count, row);
+        for (int x = 0; x < count; x++)
+        {
+            float w0 = (k->b * row[x]) + (k->a1 * s1[x]) + (k->a2 * s2[x]) + (k->a3 * s3[x]);
+            w[x] = w0;
+            s3[x] = s2[x];
+            s2[x] = s1[x];
+            s1[x] = w0;
+        }
+    }
+
+    // Anticausal pass back up from the state of the replicated last row (row still holds it),
+    // written transposed: sample (y, pixel px, channel c) goes to (px, y, c)
+    const float* m = k->boundary;
+    for (int x = 0; x < count; x++)
+    {
+        int sample = x_begin + x;
+        float d1 = s1[x] - row[x];
+        float d2 = s2[x] - row[x];
+        float d3 = s3[x] - row[x];
+        out_offsets[x] = ((size_t)(sample / channels) * height * channels) + (sample % channels);
+        s1[x] = row[x] + ((m[0] * d1) + (m[1] * d2) + (m[2] * d3));
+        s2[x] = row[x] + ((m[3] * d1) + (m[4] * d2) + (m[5] * d3));
+        s3[x] = row[x] + ((m[6] * d1) + (m[7] * d2) + (m[8] * d3));
+    }
+    for (int y = height - 1; y >= 0; y--)
+    {
+        const float* w = scratch + ((size_t)y * IIR_HOST_BLOCK_COLS);
+        size_t row_offset = (size_t)y * channels;
+        for (int x = 0; x < count; x++)
+        {
+            float v0 = (k->b * w[x]) + (k->a1 * s1[x]) + (k->a2 * s2[x]) + (k->a3 * s3[x]);
+            row[x] = v0;
+            s3[x] = s2[x];
+            s2[x] = s1[x];
+            s1[x] = v0;
+        }
+        if (job->output_f32)
+        {
+            for (int x = 0; x < count; x++)
+                job->output_f32[out_offsets[x] + row_offset] = row[x];
+        }
+        else
+        {
+            for (int x = 0; x < count; x++)
+            {
+                float v = (row[x] < 0.0f) ? 0.0f : (row[x] > 255.0f) ? 255.0f : row[x];
+                job->output_u8[out_offsets[x] + row_offset] = (unsigned char)v;
+            }
+        }
+    }
+}
+
+void iir_blur_host(cpu_thread_pool* pool, const unsigned char* input, unsigned char* output, int width, int height, int channels,
+                   const iir_coefficients* coeffs)
+{
+    int num_threads = cpu_thread_pool_size(pool);
+    channels = (channels > 1) ? channels : 1;
+    size_t pixels = (size_t)width * height;
+    float* temp = (float*)malloc(pixels * channels * sizeof(float));
+    int scratch_rows = (width > height) ? width : height;
+    iir_pass_job job;
+    memset(&job, 0, sizeof(job));
+    job.channels = channels;
+    job.coeffs = coeffs;
+    job.scratch = (float**)malloc(num_threads * sizeof(float*));
+    for (int i = 0; i < num_threads; i++)
+        job.scratch[i] = (float*)malloc((size_t)scratch_rows * IIR_HOST_BLOCK_COLS * sizeof(float));
+
+    // Columns of the image into the transposed temp, then columns of temp (the rows) back into place
+    job.input_u8 = input;
+    job.output_f32 = temp;
+    job.width = width;
+    job.height = height;
+    job.num_blocks = ((width * channels) + IIR_HOST_BLOCK_COLS - 1) / IIR_HOST_BLOCK_COLS;
+    cpu_thread_pool_run(pool, iir_pass_task, &job, job.num_blocks);
+
+    job.input_u8 = NULL;
+    job.input_f32 = temp;
+    job.output_f32 = NULL;
+    job.output_u8 = output;
+    job.width = height;
+    job.height = width;
+    job.num_blocks = ((height * channels) + IIR_HOST_BLOCK_COLS - 1) / IIR_HOST_BLOCK_COLS;
+    cpu_thread_pool_run(pool, iir_pass_task, &job, job.num_blocks);
+
+    for (int i = 0; i < num_threads; i++)
+        free(job.scratch[i]);
+    free(job.scratch);
+    free(temp);
+}
+
+//------------------------------------------------------
+// Device engine
+//------------------------------------------------------
+
+static size_t round_up(size_t value, size_t multiple)
+{
+    return ((value + multiple - 1) / multiple) * multiple;
+}
+
+static cl_kernel pass_kernel(iir_engine* engine, int first, cl_int* err)
+{
+    char options[64];
+    snprintf(options, sizeof(options), "-D CHANNELS=%d%s", engine->channels, first ? " -D IIR_FIRST_PASS" : "");
+    cl_program program = ocl_runtime_program_file(engine->rt, IIR_KERNEL_FILE, options, err);
+    if (!program)
+        return NULL;
+    // The kernel keeps its program alive
+    cl_kernel kernel = ocl_runtime_kernel(engine->rt, program, "iir_columns", err);
+    ocl_runtime_release_program(engine->rt, program);
+    return kernel;
+}
+
+cl_int iir_engine_init(iir_engine* engine, ocl_runtime* rt, float sigma, int channels)
+{
+    cl_int err;
+    memset(engine, 0, sizeof(*engine));
+    engine->rt = rt;
+    engine->channels = (channels > 1) ? channels : 1;
+    if (engine->channels != 1 && engine->channels != 3 && engine->channels != 4)
+    {
+        fprintf(stderr, "Error: Unsupported channel count %d (use 1, 3 or 4)\n", engine->channels);
+        return CL_INVALID_VALUE;
+    }
+    if (iir_gaussian_coefficients(sigma, &engine->coeffs) != 0)
+        return CL_INVALID_VALUE;
+    engine->tile_element_size = (engine->channels > 1) ? sizeof(cl_float4) : sizeof(cl_float);
+
+    engine->kernel_first = pass_kernel(engine, 1, &err);
+    if (!engine->kernel_first)
+        return err;
+    engine->kernel_second = pass_kernel(engine, 0, &err);
+    if (!engine->kernel_second)
+        return err;
+
+    // Widest group the device, both kernels and the local memory take
+    size_t group = IIR_GROUP_SIZE;
+    cl_kernel kernels[2] = {engine->kernel_first, engine->kernel_second};
+    for (int i = 0; i < 2; i++)
+    {
+        size_t limit = 0;
+        if (clGetKernelWorkGroupInfo(kernels[i], rt->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(limit), &limit, NULL) == CL_SUCCESS)
+        {
+            while (group > 1 && group > limit)
+                group /= 2;
+        }
+    }
+    while (group > 1 && (group > rt->max_work_group_size || group * (group + 1) * engine->tile_element_size > rt->local_mem_size))
+        group /= 2;
+    engine->group_size = group;
+    return CL_SUCCESS;
+}
+
+void iir_engine_release(iir_engine* engine)
+{
+    ocl_runtime_release_kernel(engine->rt, engine->kernel_first);
+    ocl_runtime_release_kernel(engine->rt, engine->kernel_second);
+    ocl_runtime_recycle(engine->rt, engine->input_buffer);
+    ocl_runtime_recycle(engine->rt, engine->output_buffer);
+    ocl_runtime_recycle(engine->rt, engine->temp_buffer);
+    ocl_runtime_recycle(engine->rt, engine->scratch_buffer);
+    memset(engine, 0, sizeof(*engine));
+}
+
+cl_int iir_engine_reserve(iir_engine* engine, int width, int height)
+{
+    cl_int err;
+    size_t pixels = (size_t)width * height;
+    if (pixels <= engine->buffer_pixels)
+        return CL_SUCCESS;
+
+    cl_mem* buffers[4] = {&engine->input_buffer, &engine->output_buffer, &engine->temp_buffer, &engine->scratch_buffer};
+    for (int i = 0; i < 4; i++)
+    {
+        ocl_runtime_recycle(engine->rt, *buffers[i]);
+        *buffers[i] = NULL;
+    }
+    engine->buffer_pixels = 0;
+    size_t image_bytes = pixels * engine->channels * sizeof(cl_uchar);
+    size_t float_bytes = pixels * engine->channels * sizeof(cl_float);
+    engine->input_buffer = ocl_runtime_acquire(engine->rt, CL_MEM_READ_ONLY, image_bytes, &err);
+    if (!engine->input_buffer)
+        return err;
+    engine->output_buffer = ocl_runtime_acquire(engine->rt, CL_MEM_WRITE_ONLY, image_bytes, &err);
+    if (!engine->output_buffer)
+        return err;
+    engine->temp_buffer = ocl_runtime_acquire(engine->rt, CL_MEM_READ_WRITE, float_bytes, &err);
+    if (!engine->temp_buffer)
+        return err;
+    engine->scratch_buffer = ocl_runtime_acquire(engine->rt, CL_MEM_READ_WRITE, float_bytes, &err);
+    if (!engine->scratch_buffer)
+        return err;
+    engine->buffer_pixels = pixels;
+    return CL_SUCCESS;
+}
+
+static cl_int set_pass_args(iir_engine* engine, cl_kernel kernel, cl_mem input, cl_mem scratch, cl_mem output, int width, int height)
+{
+    cl_float16 coeffs;
+    memset(&coeffs, 0, sizeof(coeffs));
+    coeffs.s[0] = engine->coeffs.b;
+    coeffs.s[1] = engine->coeffs.a1;
+    coeffs.s[2] = engine->coeffs.a2;
+    coeffs.s[3] = engine->coeffs.a3;
+    memcpy(&coeffs.s[4], engine->coeffs.boundary, sizeof(engine->coeffs.boundary));
+    size_t tile_bytes = engine->group_size * (engine->group_size + 1) * engine->tile_element_size;
+    OCL_CHECK(clSetKernelArg(kernel, 0, sizeof(cl_mem), &input));
+    OCL_CHECK(clSetKernelArg(kernel, 1, sizeof(cl_mem), &scratch));
+    OCL_CHECK(clSetKernelArg(kernel, 2, sizeof(cl_mem), &output));
+    OCL_CHECK(clSetKernelArg(kernel, 3, sizeof(int), &width));
+    OCL_CHECK(clSetKernelArg(kernel, 4, sizeof(int), &height));
+    OCL_CHECK(clSetKernelArg(kernel, 5, sizeof(cl_float16), &coeffs));
+    OCL_CHECK(clSetKernelArg(kernel, 6, tile_bytes, NULL));
+    return CL_SUCCESS;
+}
+
+cl_int iir_engine_enqueue(iir_engine* engine, cl_command_queue queue, cl_mem input, cl_mem output, cl_mem temp, cl_mem scratch,
+                          int width, int height, cl_uint num_wait_events, const cl_event* wait_events, blur_events* events)
+{
+    cl_int err;
+    size_t local = engine->group_size;
+    size_t columns_global = round_up(width, local);
+    size_t rows_global = round_up(height, local);
+    cl_event first_event;
+    cl_event* second_event = events ? &events->kernel_events[1] : NULL;
+
+    // Pass 1 filters the columns of the width x height image; pass 2 the columns of the height x width result
+    err = set_pass_args(engine, engine->kernel_first, input, scratch, temp, width, height);
+    if (err != CL_SUCCESS)
+        return err;
+    err = set_pass_args(engine, engine->kernel_second, temp, scratch, output, height, width);
+    if (err != CL_SUCCESS)
+        return err;
+
+    OCL_CHECK(clEnqueueNDRangeKernel(queue, engine->kernel_first, 1, NULL, &columns_global, &local, num_wait_events, wait_events, &first_event));
+    err = clEnqueueNDRangeKernel(queue, engine->kernel_second, 1, NULL, &rows_global, &local, 1, &first_event, second_event);
+    if (events)
+        events->kernel_events[0] = first_event;
+    else
+        clReleaseEvent(first_event);
+    if (err != CL_SUCCESS)
+    {
+        ocl_report_error("clEnqueueNDRangeKernel(iir_columns)", err, __FILE__, __LINE__);
+        return err;
+    }
+    if (events)
+        events->num_kernel_events = 2;
+    return CL_SUCCESS;
+}
+
+cl_int iir_engine_run(iir_engine* engine, const unsigned char* input, unsigned char* output, int width, int height, blur_events* events)
+{
+    cl_command_queue queue = engine->rt->queue;
+    size_t image_bytes = (size_t)width * height * engine->channels * sizeof(cl_uchar);
+    blur_events local_events;
+    blur_events* ev = events ? events : &local_events;
+    memset(ev, 0, sizeof(*ev));
+
+    cl_int err = iir_engine_reserve(engine, width, height);
+    if (err != CL_SUCCESS)
+        return err;
+
+    OCL_CHECK_GOTO(clEnqueueWriteBuffer(queue, engine->input_buffer, CL_FALSE, 0, image_bytes, input, 0, NULL, &ev->write_event), err, done);
+    err = iir_engine_enqueue(engine, queue, engine->input_buffer, engine->output_buffer, engine->temp_buffer, engine->scratch_buffer,
+                             width, height, 1, &ev->write_event, ev);
+    if (err != CL_SUCCESS)
+        goto done;
+    OCL_CHECK_GOTO(clEnqueueReadBuffer(queue, engine->output_buffer, CL_FALSE, 0, image_bytes, output,
+                                       1, &ev->kernel_events[1], &ev->read_event), err, done);
+    OCL_CHECK_GOTO(clWaitForEvents(1, &ev->read_event), err, done);
+
+done:
+    if (!events || err != CL_SUCCESS)
+    {
+        // Drain whatever was enqueued before dropping the events
+        clFinish(queue);
+        blur_events_release(ev);
+    }
+    return err;
+}
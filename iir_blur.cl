@@ -0,0 +1,114 @@
+// Young-van Vliet recursive Gaussian, one pass per launch. The host builds this file twice per channel
+// count: with -D IIR_FIRST_PASS (uchar input, float output) and without (float input, uchar output).
+// Each work-item filters one column: a causal recursion down the column into scratch, then an
+// anticausal recursion back up. The work-group collects group_size rows of its columns in local memory
+// and writes them transposed, so consecutive work-items write consecutive output pixels.
+// FP contraction is off so the device follows the host arithmetic (iir_blur_host) step by step.
+#pragma OPENCL FP_CONTRACT OFF
+
+#ifndef CHANNELS
+#define CHANNELS 1
+#endif
+
+#if CHANNELS == 4
+typedef float4 pixel_t;
+#define LOAD_PIXEL(p, i) convert_float4(vload4((i), (p)))
+#define STORE_PIXEL(v, p, i) vstore4(convert_uchar4_sat(v), (i), (p))
+#define LOAD_SUM(p, i) vload4((i), (p))
+#define STORE_SUM(v, p, i) vstore4((v), (i), (p))
+#elif CHANNELS == 3
+typedef float3 pixel_t;
+#define LOAD_PIXEL(p, i) convert_float3(vload3((i), (p)))
+#define STORE_PIXEL(v, p, i) vstore3(convert_uchar3_sat(v), (i), (p))
+#define LOAD_SUM(p, i) vload3((i), (p))
+#define STORE_SUM(v, p, i) vstore3((v), (i), (p))
+#else
+typedef float pixel_t;
+#define LOAD_PIXEL(p, i) ((float)(p)[i])
+#define STORE_PIXEL(v, p, i) ((p)[i] = convert_uchar_sat(v))
+#define LOAD_SUM(p, i) ((p)[i])
+#define STORE_SUM(v, p, i) ((p)[i] = (v))
+#endif
+
+#ifdef IIR_FIRST_PASS
+typedef uchar input_t;
+typedef float output_t;
+#define LOAD_INPUT(p, i) LOAD_PIXEL(p, i)
+#define STORE_OUTPUT(v, p, i) STORE_SUM(v, p, i)
+#else
+typedef float input_t;
+typedef uchar output_t;
+#define LOAD_INPUT(p, i) LOAD_SUM(p, i)
+#define STORE_OUTPUT(v, p, i) STORE_PIXEL(v, p, i)
+#endif
+
+
+
+// input is width x height, output height x width. coeffs holds b, a1, a2, a3, then the row-major 3x3
+// boundary map that starts the anticausal pass from the causal end state (iir_coefficients).
+// tile holds group_size x (group_size + 1) pixels (the extra column avoids bank conflicts).
+__kernel void iir_columns(__global const input_t* input, __global float* scratch, __global output_t* output, int width, int height,
+                          float16 coeffs, __local pixel_t* tile)
+{
+    int x = get_global_id(0);
+    int lx = get_local_id(0);
+    int group_size = get_local_size(0);
+    int group_x = get_group_id(0) * group_size;
+    int tile_width = group_size + 1;
+    int active = x < width;
+
+    // Causal pass; the state starts as if the first pixel extended forever above the image
+    pixel_t w1 = 0.0f;
+    pixel_t w2 = 0.0f;
+    pixel_t w3 = 0.0f;
+    pixel_t last = 0.0f;
+    if (active)
+    {
+        w1 = LOAD_INPUT(input, x);
+        w2 = w1;
+        w3 = w1;
+        for (int y = 0; y < height; y++)
+        {
+            last = LOAD_INPUT(input, (y * width) + x);
+            pixel_t w0 = (coeffs.s0 * last) + (coeffs.s1 * w1) + (coeffs.s2 * w2) + (coeffs.s3 * w3);
+            STORE_SUM(w0, scratch, (y * width) + x);
+            w3 = w2;
+            w2 = w1;
+            w1 = w0;
+        }
+    }
+
+    // Anticausal pass, bottom block first, starting as if the last pixel extended forever below.
+    // Every work-item runs every block so the barriers match.
+    pixel_t d1 = w1 - last;
+    pixel_t d2 = w2 - last;
+    pixel_t d3 = w3 - last;
+    pixel_t v1 = last + ((coeffs.s4 * d1) + (coeffs.s5 * d2) + (coeffs.s6 * d3));
+    pixel_t v2 = last + ((coeffs.s7 * d1) + (coeffs.s8 * d2) + (coeffs.s9 * d3));
+    pixel_t v3 = last + ((coeffs.sa * d1) + (coeffs.sb * d2) + (coeffs.sc * d3));
+    for (int block = ((height - 1) / group_size) * group_size; block >= 0; block -= group_size)
+    {
+        int block_end = min(block + group_size, height);
+        if (active)
+        {
+            for (int y = block_end - 1; y >= block; y--)
+            {
+                pixel_t v0 = (coeffs.s0 * LOAD_SUM(scratch, (y * width) + x)) + (coeffs.s1 * v1) + (coeffs.s2 * v2) + (coeffs.s3 * v3);
+                tile[((y - block) * tile_width) + lx] = v0;
+                v3 = v2;
+                v2 = v1;
+                v1 = v0;
+            }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        // Output row group_x + j holds column group_x + j; work-item lx writes its pixel block + lx
+        int oy = block + lx;
+        for (int j = 0; j < group_size && group_x + j < width; j++)
+        {
+            if (oy < block_end)
+                STORE_OUTPUT(tile[(lx * tile_width) + j], output, ((group_x + j) * height) + oy);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+}
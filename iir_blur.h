@@ -0,0 +1,79 @@
+#ifndef IIR_BLUR_H
+#define IIR_BLUR_H
+
+#include <CL/cl.h>
+
+#include "ocl_runtime.h"
+#include "cpu_blur.h"
+#include "blur_engine.h"
+
+// Approximate Gaussian blur with the Young-van Vliet recursive filter: a third-order causal pass down
+// each column followed by an anticausal pass back up, so the cost per pixel is constant whatever sigma
+// (the direct paths grow with the radius). Each 1D pass writes its result transposed, so running it
+// twice filters the columns, then the rows, and leaves the image the right way round. Edges behave
+// like clamp-to-edge: the causal recursion starts from the steady state of the first pixel, and the
+// anticausal one from the exact state of the replicated last pixel (Triggs and Sdika, 2006).
+// The result approximates the exact Gaussian to within a few levels for sigma above a few pixels;
+// use it for large sigma, where the exact mask becomes too wide.
+
+#define IIR_MIN_SIGMA 0.5f
+
+// Recursion coefficients for one sigma: w[n] = b * x[n] + a1 * w[n-1] + a2 * w[n-2] + a3 * w[n-3]
+// down the column, then v[n] = b * w[n] + a1 * v[n+1] + a2 * v[n+2] + a3 * v[n+3] back up
+typedef struct
+{
+    float sigma;
+    float b;
+    float a1;
+    float a2;
+    float a3;
+    // Row-major 3x3 map from the end of the causal pass (w[N-1], w[N-2], w[N-3], minus the last input)
+    // to the start of the anticausal pass (v[N], v[N+1], v[N+2], minus the last input)
+    float boundary[9];
+} iir_coefficients;
+
+// Prints an error and returns -1 when sigma is below IIR_MIN_SIGMA (the approximation breaks down)
+int iir_gaussian_coefficients(float sigma, iir_coefficients* coeffs);
+
+// Both passes on the thread pool, in blocks of columns whose recursion state stays in cache
+void iir_blur_host(cpu_thread_pool* pool, const unsigned char* input, unsigned char* output, int width, int height, int channels,
+                   const iir_coefficients* coeffs);
+
+// Device side: one program per channel count and pass (iir_blur.cl), with a work-item per column.
+// Work-groups transpose their results through local memory so the writes stay coalesced.
+typedef struct
+{
+    ocl_runtime* rt;
+    iir_coefficients coeffs;
+    int channels;
+    size_t group_size;           // Columns per work-group (and rows per transposed block)
+    size_t tile_element_size;    // Local memory per staged pixel (float, or float4 for RGB/RGBA)
+
+    cl_kernel kernel_first;      // uchar -> float, transposed
+    cl_kernel kernel_second;     // float -> uchar, transposed back
+
+    // Frame buffers, reused while large enough
+    cl_mem input_buffer;
+    cl_mem output_buffer;
+    cl_mem temp_buffer;          // Float result of the first pass (height x width)
+    cl_mem scratch_buffer;       // Float causal pass of either pass
+    size_t buffer_pixels;
+} iir_engine;
+
+// Returns CL_SUCCESS or the failing OpenCL error (CL_INVALID_VALUE for an unusable sigma or channel count)
+cl_int iir_engine_init(iir_engine* engine, ocl_runtime* rt, float sigma, int channels);
+void iir_engine_release(iir_engine* engine);
+
+// Makes sure the frame buffers hold width * height pixels
+cl_int iir_engine_reserve(iir_engine* engine, int width, int height);
+
+// Enqueues both passes from input to output after the wait list. temp and scratch hold width * height
+// float pixels. Kernel events go to events->kernel_events when events is not NULL.
+cl_int iir_engine_enqueue(iir_engine* engine, cl_command_queue queue, cl_mem input, cl_mem output, cl_mem temp, cl_mem scratch,
+                          int width, int height, cl_uint num_wait_events, const cl_event* wait_events, blur_events* events);
+
+// Blurs one image: write, kernels and read on the runtime queue, then waits for the read.
+// When events is not NULL it receives the events of every stage (release with blur_events_release).
+cl_int iir_engine_run(iir_engine* engine, const unsigned char* input, unsigned char* output, int width, int height, blur_events* events);
+
+#endif
@@ -0,0 +1,194 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "image_io.h"
+
+#define IMAGE_HEADER_LEN 64
+
+
+
+image_file_format image_file_format_from_path(const char* path)
+{
+    const char* dot = strrchr(path, '.');
+    if (dot && strcmp(dot, ".pgm") == 0)
+        return IMAGE_FILE_PGM;
+    if (dot && strcmp(dot, ".ppm") == 0)
+        return IMAGE_FILE_PPM;
+    return IMAGE_FILE_RAW;
+}
+
+// Skips whitespace and '#' comments, then reads one decimal header field
+static int read_header_field(const unsigned char* data, size_t size, size_t* pos, int* value)
+{
+    while (*pos < size)
+    {
+        if (data[*pos] == '#')
+        {
+            while (*pos < size && data[*pos] != '\n')
+                (*pos)++;
+        }
+        else if (data[*pos] == ' ' || data[*pos] == '\t' || data[*pos] == '\n' || data[*pos] == '\r')
+        {
+            (*pos)++;
+        }
+        else
+        {
+            break;
+        }
+    }
+    if (*pos >= size || data[*pos] < '0' || data[*pos] > '9')
+        return -1;
+    long long parsed = 0;
+    while (*pos < size && data[*pos] >= '0' && data[*pos] <= '9' && parsed <= 0x7fffffff)
+        parsed = (parsed * 10) + (data[(*pos)++] - '0');
+    if (parsed > 0x7fffffff)
+        return -1;
+    *value = (int)parsed;
+    return 0;
+}
+
+// Parses a P5/P6 header; returns the offset of the first pixel, or 0 when the header is invalid
+static size_t parse_pnm_header(const unsigned char* data, size_t size, int* width, int* height, int* channels)
+{
+    size_t pos = 2;
+    int maxval;
+    if (size < 3 || data[0] != 'P' || (data[1] != '5' && data[1] != '6'))
+        return 0;
+    *channels = (data[1] == '5') ? 1 : 3;
+    if (read_header_field(data, size, &pos, width) != 0 || read_header_field(data, size, &pos, height) != 0 ||
+        read_header_field(data, size, &pos, &maxval) != 0 || maxval <= 0 || maxval > 255 || pos >= size)
+        return 0;
+    // A single whitespace byte separates the header from the pixels
+    return pos + 1;
+}
+
+static void close_mapping(mapped_image* image)
+{
+    if (image->map)
+        munmap(image->map, image->map_size);
+    if (image->fd >= 0)
+        close(image->fd);
+    memset(image, 0, sizeof(*image));
+    image->fd = -1;
+}
+
+int image_file_open(const char* path, int raw_width, int raw_height, int raw_channels, mapped_image* image)
+{
+    struct stat st;
+    memset(image, 0, sizeof(*image));
+    image->fd = open(path, O_RDONLY);
+    if (image->fd < 0 || fstat(image->fd, &st) != 0)
+    {
+        fprintf(stderr, "Error: Could not open %s: %s\n", path, strerror(errno));
+        close_mapping(image);
+        return -1;
+    }
+    image->map_size = (size_t)st.st_size;
+    image->map = (image->map_size > 0) ? mmap(NULL, image->map_size, PROT_READ, MAP_PRIVATE, image->fd, 0) : MAP_FAILED;
+    if (image->map == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: Could not map %s: %s\n", path, image->map_size ? strerror(errno) : "empty file");
+        image->map = NULL;
+        close_mapping(image);
+        return -1;
+    }
+    // Frames are read front to back once: let the kernel read ahead aggressively
+    madvise(image->map, image->map_size, MADV_SEQUENTIAL);
+
+    size_t offset = 0;
+    if (image_file_format_from_path(path) == IMAGE_FILE_RAW)
+    {
+        image->width = raw_width;
+        image->height = raw_height;
+        image->channels = raw_channels;
+    }
+    else
+    {
+        offset = parse_pnm_header((const unsigned char*)image->map, image->map_size, &image->width, &image->height, &image->channels);
+        if (offset == 0)
+        {
+            fprintf(stderr, "Error: %s is not a binary PGM/PPM file with 8-bit samples\n", path);
+            close_mapping(image);
+            return -1;
+        }
+    }
+    if (image->width <= 0 || image->height <= 0 || (image->channels != 1 && image->channels != 3 && image->channels != 4))
+    {
+        fprintf(stderr, "Error: %s needs a size and 1, 3 or 4 channels (raw files: WIDTHxHEIGHTxCHANNELS)\n", path);
+        close_mapping(image);
+        return -1;
+    }
+
+    image->pixel_bytes = (size_t)image->width * image->height * image->channels;
+    if (offset + image->pixel_bytes > image->map_size)
+    {
+        fprintf(stderr, "Error: %s holds %zu pixel bytes, %dx%dx%d needs %zu\n", path, image->map_size - offset,
+                image->width, image->height, image->channels, image->pixel_bytes);
+        close_mapping(image);
+        return -1;
+    }
+    image->pixels = (unsigned char*)image->map + offset;
+    return 0;
+}
+
+int image_file_create(const char* path, image_file_format format, int width, int height, int channels, mapped_image* image)
+{
+    char header[IMAGE_HEADER_LEN] = "";
+    memset(image, 0, sizeof(*image));
+    image->fd = -1;
+    if ((format == IMAGE_FILE_PGM && channels != 1) || (format == IMAGE_FILE_PPM && channels != 3))
+    {
+        fprintf(stderr, "Error: %s cannot hold %d channel(s); use .pgm for 1, .ppm for 3 or a raw file\n", path, channels);
+        return -1;
+    }
+    if (format != IMAGE_FILE_RAW)
+        snprintf(header, sizeof(header), "P%c\n%d %d\n255\n", (format == IMAGE_FILE_PGM) ? '5' : '6', width, height);
+
+    size_t header_size = strlen(header);
+    image->width = width;
+    image->height = height;
+    image->channels = channels;
+    image->pixel_bytes = (size_t)width * height * channels;
+    image->map_size = header_size + image->pixel_bytes;
+
+    image->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (image->fd < 0 || ftruncate(image->fd, (off_t)image->map_size) != 0)
+    {
+        fprintf(stderr, "Error: Could not create %s: %s\n", path, strerror(errno));
+        close_mapping(image);
+        return -1;
+    }
+    // Reserve the blocks now: running out of disk later would fault inside the device read instead
+    int err = posix_fallocate(image->fd, 0, (off_t)image->map_size);
+    if (err != 0 && err != EINVAL && err != EOPNOTSUPP)
+    {
+        fprintf(stderr, "Error: Could not allocate %zu bytes for %s: %s\n", image->map_size, path, strerror(err));
+        close_mapping(image);
+        return -1;
+    }
+    image->map = mmap(NULL, image->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, image->fd, 0);
+    if (image->map == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: Could not map %s: %s\n", path, strerror(errno));
+        image->map = NULL;
+        close_mapping(image);
+        return -1;
+    }
+    madvise(image->map, image->map_size, MADV_SEQUENTIAL);
+    memcpy(image->map, header, header_size);
+    image->pixels = (unsigned char*)image->map + header_size;
+    return 0;
+}
+
+void image_file_close(mapped_image* image)
+{
+    close_mapping(image);
+}
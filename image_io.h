@@ -0,0 +1,45 @@
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include <stddef.h>
+
+// Memory-mapped image files: binary PGM (P5, grayscale), binary PPM (P6, RGB) and headerless raw
+// interleaved 8-bit pixels (1, 3 or 4 channels, size given by the caller).
+// Inputs are mapped read-only and outputs are created at their final size and mapped shared, so the
+// pixels can be passed straight to the OpenCL transfers (clEnqueueWriteBuffer from the input pages,
+// clEnqueueReadBuffer into the output pages) without a staging copy. The page cache does the I/O.
+
+typedef enum
+{
+    IMAGE_FILE_RAW,
+    IMAGE_FILE_PGM,
+    IMAGE_FILE_PPM
+} image_file_format;
+
+typedef struct
+{
+    unsigned char* pixels;  // First pixel, inside the mapping (rows of width * channels bytes)
+    int width;
+    int height;
+    int channels;
+    size_t pixel_bytes;     // width * height * channels
+    void* map;              // Whole mapping, header included
+    size_t map_size;
+    int fd;
+} mapped_image;
+
+// Format from the file extension (.pgm, .ppm, anything else is raw)
+image_file_format image_file_format_from_path(const char* path);
+
+// Maps an image file for reading. Raw files need raw_width x raw_height x raw_channels; PGM/PPM take
+// their size from the header (maxval 255 only). Returns 0 on success, -1 with a message on stderr.
+int image_file_open(const char* path, int raw_width, int raw_height, int raw_channels, mapped_image* image);
+
+// Creates (or truncates) an image file of the given size, writes the PGM/PPM header and maps the pixels for
+// writing. PGM needs 1 channel and PPM 3. Returns 0 on success, -1 with a message on stderr.
+int image_file_create(const char* path, image_file_format format, int width, int height, int channels, mapped_image* image);
+
+// Unmaps and closes the file; pixels written to an output mapping reach the file through the page cache
+void image_file_close(mapped_image* image);
+
+#endif
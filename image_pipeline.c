@@ -0,0 +1,535 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image_pipeline.h"
+#include "conv_engine.h"
+
+
+
+void image_pipeline_init(image_pipeline* pipeline)
+{
+    memset(pipeline, 0, sizeof(*pipeline));
+    pipeline->factor = 1;
+}
+
+void image_pipeline_release(image_pipeline* pipeline)
+{
+    for (int i = 0; i < pipeline->num_stages; i++)
+    {
+        if (pipeline->stages[i].type == PIPE_STAGE_FILTER)
+            conv_filter_release(&pipeline->stages[i].filter);
+    }
+    image_pipeline_init(pipeline);
+}
+
+int image_pipeline_add(image_pipeline* pipeline, const char* spec)
+{
+    if (pipeline->num_stages == IMAGE_PIPELINE_MAX_STAGES)
+    {
+        fprintf(stderr, "Error: A pipeline has at most %d stages\n", IMAGE_PIPELINE_MAX_STAGES);
+        return -1;
+    }
+    pipe_stage* stage = &pipeline->stages[pipeline->num_stages];
+    memset(stage, 0, sizeof(*stage));
+    const char* args = strchr(spec, ':');
+
+    if (strncmp(spec, "threshold:", 10) == 0)
+    {
+        stage->type = PIPE_STAGE_THRESHOLD;
+        stage->a = strtof(args + 1, NULL);
+    }
+    else if (strncmp(spec, "scale:", 6) == 0)
+    {
+        const char* offset = strchr(args + 1, ':');
+        stage->type = PIPE_STAGE_SCALE;
+        stage->a = strtof(args + 1, NULL);
+        stage->b = offset ? strtof(offset + 1, NULL) : 0.0f;
+    }
+    else if (strcmp(spec, "invert") == 0)
+    {
+        stage->type = PIPE_STAGE_INVERT;
+    }
+    else if (strncmp(spec, "downsample:", 11) == 0)
+    {
+        stage->type = PIPE_STAGE_DOWNSAMPLE;
+        stage->factor = atoi(args + 1);
+        if (stage->factor != 2 && stage->factor != 4)
+        {
+            fprintf(stderr, "Error: downsample takes a factor of 2 or 4\n");
+            return -1;
+        }
+        if (pipeline->factor != 1)
+        {
+            fprintf(stderr, "Error: A pipeline has at most one downsample stage\n");
+            return -1;
+        }
+        pipeline->factor = stage->factor;
+    }
+    else
+    {
+        // The filter runs at the input resolution inside the fused tiles
+        if (pipeline->factor != 1)
+        {
+            fprintf(stderr, "Error: Filter stages must come before the downsample stage\n");
+            return -1;
+        }
+        stage->type = PIPE_STAGE_FILTER;
+        if (conv_filter_parse(&stage->filter, spec) != 0)
+            return -1;
+        pipeline->halo += stage->filter.radius;
+    }
+    pipeline->num_stages++;
+    return 0;
+}
+
+void image_pipeline_stage_view(const image_pipeline* pipeline, int index, image_pipeline* view)
+{
+    const pipe_stage* stage = &pipeline->stages[index];
+    image_pipeline_init(view);
+    view->stages[0] = *stage;
+    view->num_stages = 1;
+    view->halo = (stage->type == PIPE_STAGE_FILTER) ? stage->filter.radius : 0;
+    view->factor = (stage->type == PIPE_STAGE_DOWNSAMPLE) ? stage->factor : 1;
+}
+
+void image_pipeline_output_size(const image_pipeline* pipeline, int width, int height, int* out_width, int* out_height)
+{
+    *out_width = width / pipeline->factor;
+    *out_height = height / pipeline->factor;
+    if (*out_width == 0 || *out_height == 0)
+    {
+        *out_width = 0;
+        *out_height = 0;
+    }
+}
+
+void image_pipeline_describe(const image_pipeline* pipeline, char* text, size_t text_size)
+{
+    size_t length = 0;
+    text[0] = '\0';
+    for (int i = 0; i < pipeline->num_stages && length < text_size; i++)
+    {
+        const pipe_stage* stage = &pipeline->stages[i];
+        const char* separator = (i > 0) ? " -> " : "";
+        switch (stage->type)
+        {
+        case PIPE_STAGE_FILTER:
+            length += snprintf(text + length, text_size - length, "%s%s r%d", separator, stage->filter.name, stage->filter.radius);
+            break;
+        case PIPE_STAGE_THRESHOLD:
+            length += snprintf(text + length, text_size - length, "%sthreshold %g", separator, stage->a);
+            break;
+        case PIPE_STAGE_SCALE:
+            length += snprintf(text + length, text_size - length, "%sscale %g %+g", separator, stage->a, stage->b);
+            break;
+        case PIPE_STAGE_INVERT:
+            length += snprintf(text + length, text_size - length, "%sinvert", separator);
+            break;
+        case PIPE_STAGE_DOWNSAMPLE:
+            length += snprintf(text + length, text_size - length, "%sdownsample x%d", separator, stage->factor);
+            break;
+        }
+    }
+}
+
+//------------------------------------------------------
+// CPU equivalent
+//------------------------------------------------------
+
+static unsigned char quantize(float value)
+{
+    return (unsigned char)((value < 0.0f) ? 0.0f : (value > 255.0f) ? 255.0f : value);
+}
+
+static void apply_pointwise_host(const pipe_stage* stage, unsigned char* pixels, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        float value = pixels[i];
+        if (stage->type == PIPE_STAGE_THRESHOLD)
+            pixels[i] = (value >= stage->a) ? 255 : 0;
+        else if (stage->type == PIPE_STAGE_SCALE)
+            pixels[i] = quantize((value * stage->a) + stage->b);
+        else
+            pixels[i] = (unsigned char)(255 - pixels[i]);
+    }
+}
+
+// Block means, summed row by row like the fused kernel
+static void downsample_host(const unsigned char* input, unsigned char* output, int width, int channels, int out_width, int out_height, int factor)
+{
+    float scale = 1.0f / (float)(factor * factor);
+    for (int y = 0; y < out_height; y++)
+    {
+        for (int x = 0; x < out_width; x++)
+        {
+            for (int c = 0; c < channels; c++)
+            {
+                float sum = 0.0f;
+                for (int j = 0; j < factor; j++)
+                {
+                    for (int i = 0; i < factor; i++)
+                        sum += input[((((size_t)y * factor + j) * width) + (x * factor + i)) * channels + c];
+                }
+                output[(((size_t)y * out_width) + x) * channels + c] = quantize(sum * scale);
+            }
+        }
+    }
+}
+
+void image_pipeline_apply_host(cpu_thread_pool* pool, const image_pipeline* pipeline, const unsigned char* input, unsigned char* output,
+                               int width, int height, int channels)
+{
+    size_t bytes = (size_t)width * height * channels;
+    unsigned char* current = (unsigned char*)malloc(bytes);
+    unsigned char* next = (unsigned char*)malloc(bytes);
+    memcpy(current, input, bytes);
+
+    for (int i = 0; i < pipeline->num_stages; i++)
+    {
+        const pipe_stage* stage = &pipeline->stages[i];
+        if (stage->type == PIPE_STAGE_FILTER)
+        {
+            conv_filter_apply_host(pool, &stage->filter, current, next, width, height, channels);
+            unsigned char* swap = current;
+            current = next;
+            next = swap;
+        }
+        else if (stage->type == PIPE_STAGE_DOWNSAMPLE)
+        {
+            int out_width = width / stage->factor;
+            int out_height = height / stage->factor;
+            downsample_host(current, next, width, channels, out_width, out_height, stage->factor);
+            unsigned char* swap = current;
+            current = next;
+            next = swap;
+            width = out_width;
+            height = out_height;
+        }
+        else
+        {
+            apply_pointwise_host(stage, current, (size_t)width * height * channels);
+        }
+    }
+    memcpy(output, current, (size_t)width * height * channels);
+    free(current);
+    free(next);
+}
+
+//------------------------------------------------------
+// Fused kernel generation
+//------------------------------------------------------
+
+// Pointwise stages run on v in registers; each result is rounded to 8 bits like a separate pass would store it
+static void emit_pointwise(conv_source* text, const pipe_stage* stage, const char* indent)
+{
+    if (stage->type == PIPE_STAGE_THRESHOLD)
+        conv_emit(text, "%sv = select((pixel_t)(0.0f), (pixel_t)(255.0f), isgreaterequal(v, (pixel_t)(%.9ef)));\n", indent, stage->a);
+    else if (stage->type == PIPE_STAGE_SCALE)
+        conv_emit(text, "%sv = QUANTIZE((v * %.9ef) + %.9ef);\n", indent, stage->a, stage->b);
+    else if (stage->type == PIPE_STAGE_INVERT)
+        conv_emit(text, "%sv = 255.0f - v;\n", indent);
+}
+
+// Emits the pointwise stages from first up to the next filter or downsample stage; returns the index of that stage
+static int emit_pointwise_run(conv_source* text, const image_pipeline* pipeline, int first, const char* indent)
+{
+    int i = first;
+    for (; i < pipeline->num_stages; i++)
+    {
+        const pipe_stage* stage = &pipeline->stages[i];
+        if (stage->type == PIPE_STAGE_FILTER || stage->type == PIPE_STAGE_DOWNSAMPLE)
+            break;
+        conv_emit(text, "%s// %d. %s\n", indent, i + 1, (stage->type == PIPE_STAGE_THRESHOLD) ? "threshold" : (stage->type == PIPE_STAGE_SCALE) ? "scale" : "invert");
+        emit_pointwise(text, stage, indent);
+    }
+    return i;
+}
+
+static int count_filters(const image_pipeline* pipeline)
+{
+    int filters = 0;
+    for (int i = 0; i < pipeline->num_stages; i++)
+        filters += pipeline->stages[i].type == PIPE_STAGE_FILTER;
+    return filters;
+}
+
+size_t image_pipeline_local_bytes(const image_pipeline* pipeline, int channels, int group_x, int group_y)
+{
+    size_t tile_width = (size_t)group_x * pipeline->factor + (2 * pipeline->halo);
+    size_t tile_height = (size_t)group_y * pipeline->factor + (2 * pipeline->halo);
+    size_t element = (channels == 1) ? sizeof(cl_float) : sizeof(cl_float4);
+    return (count_filters(pipeline) > 0 ? 2 : 1) * tile_width * tile_height * element;
+}
+
+char* image_pipeline_generate_source(const image_pipeline* pipeline, int channels, int group_x, int group_y)
+{
+    conv_source text = {NULL, 0, 0};
+    char description[512];
+    int factor = pipeline->factor;
+    int halo = pipeline->halo;
+    int block_x = group_x * factor;
+    int block_y = group_y * factor;
+    int num_filters = count_filters(pipeline);
+
+    image_pipeline_describe(pipeline, description, sizeof(description));
+    conv_emit(&text, "// Generated pipeline: %s\n", description);
+    conv_emit(&text, "#pragma OPENCL FP_CONTRACT OFF\n");
+    conv_emit(&text, "#define GX %d\n#define GY %d\n\n", group_x, group_y);
+    conv_emit_pixel_types(&text, channels);
+
+    conv_emit(&text, "__kernel __attribute__((reqd_work_group_size(GX, GY, 1)))\n"
+                     "void pipeline(__global const uchar* input, __global uchar* output, int width, int height, int out_width, int out_height)\n{\n");
+    conv_emit(&text, "    __local pixel_t tile_a[%d];\n", (block_x + 2 * halo) * (block_y + 2 * halo));
+    if (num_filters > 0)
+        conv_emit(&text, "    __local pixel_t tile_b[%d];\n", (block_x + 2 * halo) * (block_y + 2 * halo));
+    conv_emit(&text, "    int lx = get_local_id(0);\n"
+                     "    int ly = get_local_id(1);\n"
+                     "    int lid = (ly * GX) + lx;\n"
+                     "    int ox = get_group_id(0) * %d;\n"
+                     "    int oy = get_group_id(1) * %d;\n"
+                     "    pixel_t v;\n\n", block_x, block_y);
+
+    // Load the block and the whole halo once, edges clamped
+    int tile_width = block_x + (2 * halo);
+    int tile_height = block_y + (2 * halo);
+    conv_emit(&text, "    // Input block with a %d pixel halo\n", halo);
+    conv_emit(&text, "    for (int i = lid; i < %d; i += GX * GY)\n    {\n", tile_width * tile_height);
+    conv_emit(&text, "        int ix = clamp(ox - %d + (i %% %d), 0, width - 1);\n"
+                     "        int iy = clamp(oy - %d + (i / %d), 0, height - 1);\n"
+                     "        v = LOAD_PIXEL(input, (iy * width) + ix);\n", halo, tile_width, halo, tile_width);
+    int stage_index = emit_pointwise_run(&text, pipeline, 0, "        ");
+    conv_emit(&text, "        tile_a[i] = v;\n    }\n    barrier(CLK_LOCAL_MEM_FENCE);\n\n");
+
+    // Filter stages: each computes a region smaller by its radius. Positions outside the image take the
+    // value at the clamped position, which is what a separate pass with clamped edges would read there.
+    const char* source_tile = "tile_a";
+    const char* target_tile = "tile_b";
+    int source_halo = halo;
+    int source_width = tile_width;
+    while (stage_index < pipeline->num_stages && pipeline->stages[stage_index].type == PIPE_STAGE_FILTER)
+    {
+        const conv_filter* filter = &pipeline->stages[stage_index].filter;
+        int r = filter->radius;
+        int target_halo = source_halo - r;
+        int target_width = block_x + (2 * target_halo);
+        int target_height = block_y + (2 * target_halo);
+        conv_emit(&text, "    // %d. %s, radius %d\n", stage_index + 1, filter->name, r);
+        conv_emit(&text, "    for (int i = lid; i < %d; i += GX * GY)\n    {\n", target_width * target_height);
+        conv_emit(&text, "        int cx = clamp(ox - %d + (i %% %d), 0, width - 1) - (ox - %d);\n"
+                         "        int cy = clamp(oy - %d + (i / %d), 0, height - 1) - (oy - %d);\n"
+                         "        __local const pixel_t* window = %s + ((cy - %d) * %d) + (cx - %d);\n"
+                         "        pixel_t sum = 0.0f;\n",
+                  target_halo, target_width, source_halo, target_halo, target_width, source_halo, source_tile, r, source_width, r);
+        for (int ky = 0; ky < filter->size; ky++)
+        {
+            for (int kx = 0; kx < filter->size; kx++)
+            {
+                float weight = filter->mask[(ky * filter->size) + kx];
+                if (weight != 0.0f)
+                    conv_emit(&text, "        sum += window[%d] * %.9ef;\n", (ky * source_width) + kx, weight);
+            }
+        }
+        if (filter->bias != 0.0f)
+            conv_emit(&text, "        sum += %.9ef;\n", filter->bias);
+        if (filter->output == CONV_OUTPUT_ABS)
+            conv_emit(&text, "        sum = fabs(sum);\n");
+        conv_emit(&text, "        v = QUANTIZE(sum);\n");
+        stage_index = emit_pointwise_run(&text, pipeline, stage_index + 1, "        ");
+        conv_emit(&text, "        %s[i] = v;\n    }\n    barrier(CLK_LOCAL_MEM_FENCE);\n\n", target_tile);
+
+        const char* swap = source_tile;
+        source_tile = target_tile;
+        target_tile = swap;
+        source_halo = target_halo;
+        source_width = target_width;
+    }
+
+    // Output pixels: the final tile (no halo left), averaged over factor x factor blocks when downsampling
+    conv_emit(&text, "    int x = get_global_id(0);\n"
+                     "    int y = get_global_id(1);\n"
+                     "    if (x >= out_width || y >= out_height)\n"
+                     "        return;\n");
+    if (factor == 1)
+    {
+        conv_emit(&text, "    v = %s[(ly * %d) + lx];\n", source_tile, source_width);
+    }
+    else
+    {
+        conv_emit(&text, "    // %d. downsample x%d\n", stage_index + 1, factor);
+        conv_emit(&text, "    pixel_t sum = 0.0f;\n");
+        for (int j = 0; j < factor; j++)
+        {
+            for (int i = 0; i < factor; i++)
+                conv_emit(&text, "    sum += %s[(((ly * %d) + %d) * %d) + (lx * %d) + %d];\n", source_tile, factor, j, source_width, factor, i);
+        }
+        conv_emit(&text, "    v = QUANTIZE(sum * %.9ef);\n", 1.0f / (float)(factor * factor));
+        stage_index = emit_pointwise_run(&text, pipeline, stage_index + 1, "    ");
+    }
+    conv_emit(&text, "    STORE_PIXEL(v, output, (y * out_width) + x);\n}\n");
+    return text.data;
+}
+
+//------------------------------------------------------
+// Device engine
+//------------------------------------------------------
+
+static size_t round_up(size_t value, size_t multiple)
+{
+    return ((value + multiple - 1) / multiple) * multiple;
+}
+
+// FNV-1a of the generated source, to give each pipeline its own name in the program registry
+static unsigned long long source_hash(const char* source)
+{
+    unsigned long long hash = 1469598103934665603ULL;
+    for (const char* p = source; *p; p++)
+    {
+        hash ^= (unsigned char)*p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Gives the program and kernel of a group size that did not fit, or of the released engine, back to the runtime
+static void release_kernel(pipeline_engine* engine)
+{
+    ocl_runtime_release_kernel(engine->rt, engine->kernel);
+    ocl_runtime_release_program(engine->rt, engine->program);
+    engine->kernel = NULL;
+    engine->program = NULL;
+}
+
+cl_int pipeline_engine_init(pipeline_engine* engine, ocl_runtime* rt, const image_pipeline* pipeline, int channels)
+{
+    cl_int err;
+    memset(engine, 0, sizeof(*engine));
+    engine->rt = rt;
+    engine->pipeline = pipeline;
+    engine->channels = (channels > 1) ? channels : 1;
+    if (engine->channels != 1 && engine->channels != 3 && engine->channels != 4)
+    {
+        fprintf(stderr, "Error: Unsupported channel count %d (use 1, 3 or 4)\n", engine->channels);
+        return CL_INVALID_VALUE;
+    }
+
+    // The largest square group up to 16x16 whose tiles fit local memory, then whatever the compiled kernel takes
+    size_t group = 16;
+    while (group > 1 && (group * group > rt->max_work_group_size ||
+                         image_pipeline_local_bytes(pipeline, engine->channels, (int)group, (int)group) > rt->local_mem_size))
+    {
+        group /= 2;
+    }
+    for (;;)
+    {
+        if (image_pipeline_local_bytes(pipeline, engine->channels, (int)group, (int)group) > rt->local_mem_size)
+        {
+            fprintf(stderr, "Error: The pipeline tiles (halo %d) do not fit the device's local memory\n", pipeline->halo);
+            return CL_OUT_OF_RESOURCES;
+        }
+        char name[64];
+        free(engine->source);
+        engine->source = image_pipeline_generate_source(pipeline, engine->channels, (int)group, (int)group);
+        snprintf(name, sizeof(name), "pipeline_%016llx", source_hash(engine->source));
+        release_kernel(engine);
+        engine->program = ocl_runtime_program(rt, name, engine->source, "", &err);
+        if (!engine->program)
+            return err;
+        engine->kernel = ocl_runtime_kernel(rt, engine->program, "pipeline", &err);
+        if (!engine->kernel)
+            return err;
+
+        size_t limit = 0;
+        if (group == 1 || clGetKernelWorkGroupInfo(engine->kernel, rt->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(limit), &limit, NULL) != CL_SUCCESS ||
+            group * group <= limit)
+            break;
+        group /= 2;
+    }
+    engine->local_work_size[0] = group;
+    engine->local_work_size[1] = group;
+    return CL_SUCCESS;
+}
+
+void pipeline_engine_release(pipeline_engine* engine)
+{
+    release_kernel(engine);
+    ocl_runtime_recycle(engine->rt, engine->input_buffer);
+    ocl_runtime_recycle(engine->rt, engine->output_buffer);
+    free(engine->source);
+    memset(engine, 0, sizeof(*engine));
+}
+
+cl_int pipeline_engine_enqueue(pipeline_engine* engine, cl_command_queue queue, cl_mem input, cl_mem output, int width, int height,
+                               cl_uint num_wait_events, const cl_event* wait_events, cl_event* event)
+{
+    int out_width, out_height;
+    image_pipeline_output_size(engine->pipeline, width, height, &out_width, &out_height);
+    if (out_width == 0)
+    {
+        fprintf(stderr, "Error: A %dx%d image is smaller than the downsampling factor\n", width, height);
+        return CL_INVALID_IMAGE_SIZE;
+    }
+    size_t global_work_size[2] = {round_up(out_width, engine->local_work_size[0]), round_up(out_height, engine->local_work_size[1])};
+    cl_kernel k = engine->kernel;
+    OCL_CHECK(clSetKernelArg(k, 0, sizeof(cl_mem), &input));
+    OCL_CHECK(clSetKernelArg(k, 1, sizeof(cl_mem), &output));
+    OCL_CHECK(clSetKernelArg(k, 2, sizeof(int), &width));
+    OCL_CHECK(clSetKernelArg(k, 3, sizeof(int), &height));
+    OCL_CHECK(clSetKernelArg(k, 4, sizeof(int), &out_width));
+    OCL_CHECK(clSetKernelArg(k, 5, sizeof(int), &out_height));
+    OCL_CHECK(clEnqueueNDRangeKernel(queue, k, 2, NULL, global_work_size, engine->local_work_size, num_wait_events, wait_events, event));
+    return CL_SUCCESS;
+}
+
+static cl_int reserve_buffer(pipeline_engine* engine, cl_mem* buffer, size_t* capacity, size_t bytes, cl_mem_flags flags)
+{
+    cl_int err;
+    if (bytes <= *capacity)
+        return CL_SUCCESS;
+    ocl_runtime_recycle(engine->rt, *buffer);
+    *capacity = 0;
+    *buffer = ocl_runtime_acquire(engine->rt, flags, bytes, &err);
+    if (!*buffer)
+        return err;
+    *capacity = bytes;
+    return CL_SUCCESS;
+}
+
+cl_int pipeline_engine_run(pipeline_engine* engine, const unsigned char* input, unsigned char* output, int width, int height,
+                           cl_event* kernel_event)
+{
+    cl_command_queue queue = engine->rt->queue;
+    cl_event write_event = NULL, run_event = NULL, read_event = NULL;
+    int out_width, out_height;
+    image_pipeline_output_size(engine->pipeline, width, height, &out_width, &out_height);
+    size_t input_bytes = (size_t)width * height * engine->channels;
+    size_t output_bytes = (size_t)out_width * out_height * engine->channels;
+
+    cl_int err = reserve_buffer(engine, &engine->input_buffer, &engine->input_bytes, input_bytes, CL_MEM_READ_ONLY);
+    if (err == CL_SUCCESS)
+        err = reserve_buffer(engine, &engine->output_buffer, &engine->output_bytes, output_bytes > 0 ? output_bytes : 1, CL_MEM_WRITE_ONLY);
+    if (err != CL_SUCCESS)
+        return err;
+
+    OCL_CHECK_GOTO(clEnqueueWriteBuffer(queue, engine->input_buffer, CL_FALSE, 0, input_bytes, input, 0, NULL, &write_event), err, done);
+    err = pipeline_engine_enqueue(engine, queue, engine->input_buffer, engine->output_buffer, width, height, 1, &write_event, &run_event);
+    if (err != CL_SUCCESS)
+        goto done;
+    OCL_CHECK_GOTO(clEnqueueReadBuffer(queue, engine->output_buffer, CL_FALSE, 0, output_bytes, output, 1, &run_event, &read_event), err, done);
+    OCL_CHECK_GOTO(clWaitForEvents(1, &read_event), err, done);
+
+done:
+    if (err != CL_SUCCESS)
+        clFinish(queue);
+    if (write_event)
+        clReleaseEvent(write_event);
+    if (read_event)
+        clReleaseEvent(read_event);
+    if (kernel_event && err == CL_SUCCESS)
+        *kernel_event = run_event;
+    else if (run_event)
+        clReleaseEvent(run_event);
+    return err;
+}
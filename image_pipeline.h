@@ -0,0 +1,104 @@
+#ifndef IMAGE_PIPELINE_H
+#define IMAGE_PIPELINE_H
+
+#include <CL/cl.h>
+
+#include "ocl_runtime.h"
+#include "conv_filter.h"
+
+// Multi-stage image pipelines (for example blur -> threshold -> downsample) fused into one generated
+// OpenCL kernel. A work-group loads its block of the input once, with a halo covering the radii of every
+// filter stage, then runs the stages in local memory: each filter stage reads one tile and writes the
+// next, smaller one, and pointwise stages are applied in registers on the way. Only the final pixels
+// go back to global memory, so an N-stage chain costs one read and one write of the image instead of N.
+// Every stage rounds its result to 8 bits (clamp and truncate), exactly like a chain of separate
+// passes, so the fused kernel matches image_pipeline_apply_host bit for bit.
+
+#define IMAGE_PIPELINE_MAX_STAGES 16
+
+typedef enum
+{
+    PIPE_STAGE_FILTER,       // Convolution with a conv_filter (edges clamped)
+    PIPE_STAGE_THRESHOLD,    // 255 where v >= a, 0 elsewhere
+    PIPE_STAGE_SCALE,        // v * a + b
+    PIPE_STAGE_INVERT,       // 255 - v
+    PIPE_STAGE_DOWNSAMPLE    // Mean of factor x factor blocks (the image shrinks to floor(size / factor))
+} pipe_stage_type;
+
+typedef struct
+{
+    pipe_stage_type type;
+    conv_filter filter;
+    float a;
+    float b;
+    int factor;
+} pipe_stage;
+
+typedef struct
+{
+    pipe_stage stages[IMAGE_PIPELINE_MAX_STAGES];
+    int num_stages;
+    int halo;      // Sum of the filter radii: input pixels needed around each output block
+    int factor;    // Downsampling factor (1 without a downsample stage)
+} image_pipeline;
+
+void image_pipeline_init(image_pipeline* pipeline);
+void image_pipeline_release(image_pipeline* pipeline);
+
+// Appends a stage from a spec: any conv_filter_parse filter, threshold:T, scale:GAIN[:OFFSET], invert
+// or downsample:F (2 or 4). Filters cannot follow a downsample stage. Prints an error and returns -1 on failure.
+int image_pipeline_add(image_pipeline* pipeline, const char* spec);
+
+// Single-stage pipeline made of stage index of pipeline (to run the stages as separate passes).
+// The view borrows the stage's filter: do not release it.
+void image_pipeline_stage_view(const image_pipeline* pipeline, int index, image_pipeline* view);
+
+// Size of the result for a width x height input (0 x 0 when the input is smaller than the downsampling factor)
+void image_pipeline_output_size(const image_pipeline* pipeline, int width, int height, int* out_width, int* out_height);
+
+// Text description of the stages ("gaussian -> threshold -> downsample x2")
+void image_pipeline_describe(const image_pipeline* pipeline, char* text, size_t text_size);
+
+// CPU equivalent: runs the stages one after the other on whole images (filters through
+// conv_filter_apply_host, the generalization of gaussian_blur_host). output holds the output size.
+void image_pipeline_apply_host(cpu_thread_pool* pool, const image_pipeline* pipeline, const unsigned char* input, unsigned char* output,
+                               int width, int height, int channels);
+
+// Generated OpenCL source of the fused kernel "pipeline" for group_x x group_y work-groups (malloc'd)
+char* image_pipeline_generate_source(const image_pipeline* pipeline, int channels, int group_x, int group_y);
+
+// Local memory of the fused kernel for a group_x x group_y work-group
+size_t image_pipeline_local_bytes(const image_pipeline* pipeline, int channels, int group_x, int group_y);
+
+// Device side of one pipeline: the fused program, built for the largest work-group whose tiles fit
+// local memory, and input/output buffers that grow on demand
+typedef struct
+{
+    ocl_runtime* rt;
+    const image_pipeline* pipeline;   // Owned by the caller, must outlive the engine
+    int channels;
+    size_t local_work_size[2];
+    char* source;
+    cl_program program;
+    cl_kernel kernel;
+    cl_mem input_buffer;
+    cl_mem output_buffer;
+    size_t input_bytes;
+    size_t output_bytes;
+} pipeline_engine;
+
+// Returns CL_SUCCESS, the failing OpenCL error, or CL_OUT_OF_RESOURCES when not even a 1x1 group fits
+cl_int pipeline_engine_init(pipeline_engine* engine, ocl_runtime* rt, const image_pipeline* pipeline, int channels);
+
+// Releases the engine's buffers and gives its program and kernel back to the runtime
+void pipeline_engine_release(pipeline_engine* engine);
+
+// Enqueues the fused kernel from input (width x height) to output (output size) after the wait list
+cl_int pipeline_engine_enqueue(pipeline_engine* engine, cl_command_queue queue, cl_mem input, cl_mem output, int width, int height,
+                               cl_uint num_wait_events, const cl_event* wait_events, cl_event* event);
+
+// Write, kernel and read on the runtime queue; waits for the read. kernel_event (optional) receives the kernel event.
+cl_int pipeline_engine_run(pipeline_engine* engine, const unsigned char* input, unsigned char* output, int width, int height,
+                           cl_event* kernel_event);
+
+#endif
@@ -0,0 +1,287 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// OpenCL Include
+#include <CL/cl.h>
+
+#include "commons.h"
+#include "gaussian_mask.h"
+#include "cpu_blur.h"
+#include "blur_engine.h"
+#include "multi_device.h"
+#include "image_io.h"
+#include "verify.h"
+
+
+
+// Function to return a monotonic wall-clock time in seconds
+static double wall_time_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+static int parse_device_types(const char* name, cl_device_type* types)
+{
+    if (strcmp(name, "all") == 0)
+        *types = CL_DEVICE_TYPE_ALL;
+    else if (strcmp(name, "gpu") == 0)
+        *types = CL_DEVICE_TYPE_GPU;
+    else if (strcmp(name, "cpu") == 0)
+        *types = CL_DEVICE_TYPE_CPU;
+    else if (strcmp(name, "accelerator") == 0)
+        *types = CL_DEVICE_TYPE_ACCELERATOR;
+    else if (strcmp(name, "none") == 0)
+        *types = 0;
+    else
+        return -1;
+    return 0;
+}
+
+// Main Code
+int main(int argc, char** argv)
+{
+    // --devices all|gpu|cpu|accelerator|none   OpenCL devices to use (default all)
+    // --host             adds the host CPU engine as one more worker; --threads N sets its thread count
+    // --frames N         blurs a batch of N frames instead of one image split into row bands
+    // --sigma, --radius, --channels, --size, --reference, --jit   as in run
+    // --input file, --output file   as in run (one image only)
+    // --repeat N         runs N times; devices keep their measured speed between runs (default 3)
+    // --chunk-ms N       target duration of one chunk (default 20)
+    // --tolerance N, --max-mismatches N   comparison settings, as in run (default tolerance 1)
+    cl_device_type device_types = CL_DEVICE_TYPE_ALL;
+    int use_host = 0;
+    int num_threads = 0;
+    int num_frames = 0;
+    int image_width = 1024;
+    int image_height = 1024;
+    int image_channels = 1;
+    int repeat = 3;
+    double chunk_sec = MULTI_CHUNK_SEC;
+    const char* input_path = NULL;
+    const char* output_path = NULL;
+    blur_params params = { 1.0f, 0, 0, 0, 1, BLUR_STORAGE_BUFFER, BLUR_PRECISION_FLOAT };
+    verify_options verify;
+    verify_default_options(&verify);
+    verify.tolerance = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--devices") == 0 && i + 1 < argc)
+        {
+            if (parse_device_types(argv[++i], &device_types) != 0)
+            {
+                fprintf(stderr, "Error: Unknown device type %s (all, gpu, cpu, accelerator or none)\n", argv[i]);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--host") == 0)
+        {
+            use_host = 1;
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            num_threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            num_frames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--sigma") == 0 && i + 1 < argc)
+        {
+            params.sigma = (float)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--radius") == 0 && i + 1 < argc)
+        {
+            params.kernel_radius = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--channels") == 0 && i + 1 < argc)
+        {
+            image_channels = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%dx%d", &image_width, &image_height) != 2 || image_width <= 0 || image_height <= 0)
+            {
+                fprintf(stderr, "Error: --size takes WxH\n");
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--reference") == 0)
+        {
+            params.use_reference = 1;
+        }
+        else if (strcmp(argv[i], "--jit") == 0)
+        {
+            params.use_jit = 1;
+        }
+        else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc)
+        {
+            input_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            output_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+        {
+            repeat = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--chunk-ms") == 0 && i + 1 < argc)
+        {
+            chunk_sec = atof(argv[++i]) / 1000.0;
+        }
+        else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+        {
+            verify.tolerance = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-mismatches") == 0 && i + 1 < argc)
+        {
+            verify.max_mismatches = (size_t)strtoull(argv[++i], NULL, 10);
+        }
+    }
+    if (params.sigma <= 0.0f)
+    {
+        fprintf(stderr, "Error: sigma must be positive\n");
+        return -1;
+    }
+    if (image_channels != 1 && image_channels != 3 && image_channels != 4)
+    {
+        fprintf(stderr, "Error: --channels must be 1, 3 or 4\n");
+        return -1;
+    }
+    if (num_frames > 0 && (input_path || output_path))
+    {
+        fprintf(stderr, "Error: --input and --output take one image, not --frames\n");
+        return -1;
+    }
+    if (repeat < 1)
+    {
+        repeat = 1;
+    }
+
+    //------------------------------------------------------
+    // Image or frames
+    //------------------------------------------------------
+    mapped_image input_file, output_file;
+    if (input_path)
+    {
+        if (image_file_open(input_path, image_width, image_height, image_channels, &input_file) != 0)
+            return -1;
+        image_width = input_file.width;
+        image_height = input_file.height;
+        image_channels = input_file.channels;
+        printf("Input image                                         : %s (%dx%d, %d channel(s))\n", input_path, image_width, image_height, image_channels);
+    }
+    if (output_path && image_file_create(output_path, image_file_format_from_path(output_path), image_width, image_height, image_channels, &output_file) != 0)
+    {
+        if (input_path)
+            image_file_close(&input_file);
+        return -1;
+    }
+    params.channels = image_channels;
+    size_t image_bytes = (size_t)image_width * image_height * image_channels;
+    int num_images = (num_frames > 0) ? num_frames : 1;
+    unsigned char** inputs = (unsigned char**)calloc(num_images, sizeof(unsigned char*));
+    unsigned char** outputs = (unsigned char**)calloc(num_images, sizeof(unsigned char*));
+    for (int i = 0; i < num_images; i++)
+    {
+        inputs[i] = input_path ? input_file.pixels : (unsigned char*)malloc(image_bytes);
+        outputs[i] = output_path ? output_file.pixels : (unsigned char*)malloc(image_bytes);
+        if (!input_path)
+            generate_noisy_image(inputs[i], image_width, image_height, image_channels);
+    }
+
+    //------------------------------------------------------
+    // Workers
+    //------------------------------------------------------
+    cpu_thread_pool* pool = cpu_thread_pool_create(num_threads);
+    multi_blur multi;
+    int status = -1;
+    if (multi_blur_init(&multi, &params, device_types, use_host ? pool : NULL) < 0)
+    {
+        multi_blur_release(&multi);
+        goto cleanup;
+    }
+    multi.chunk_sec = chunk_sec;
+    printf("\n######### Workers ################\n");
+    for (int i = 0; i < multi.num_workers; i++)
+        printf("Worker %-2d                                           : %s\n", i, multi.workers[i].name);
+
+    double wall_sec = 0.0;
+    for (int r = 0; r < repeat; r++)
+    {
+        double start = wall_time_sec();
+        cl_int err = (num_frames > 0) ? multi_blur_frames(&multi, (const unsigned char* const*)inputs, outputs, num_frames, image_width, image_height)
+                                      : multi_blur_image(&multi, inputs[0], outputs[0], image_width, image_height);
+        wall_sec = wall_time_sec() - start;
+        if (err != CL_SUCCESS)
+        {
+            fprintf(stderr, "Error: Multi-device blur failed\n");
+            multi_blur_release(&multi);
+            goto cleanup;
+        }
+    }
+
+    const char* unit_name = (num_frames > 0) ? "frames" : "rows";
+    double fastest = 0.0;
+    for (int i = 0; i < multi.num_workers; i++)
+    {
+        double rate = (multi.workers[i].busy_sec > 0.0) ? multi.workers[i].units / multi.workers[i].busy_sec : 0.0;
+        fastest = (rate > fastest) ? rate : fastest;
+    }
+    printf("\n######### Work Split (run %d of %d) ################\n", repeat, repeat);
+    multi_blur_print_stats(&multi, unit_name, wall_sec);
+    printf("Time taken on all workers                           : %f seconds\n", wall_sec);
+    printf("Aggregate throughput                                : %.1f %s/s (%.2fx the fastest worker alone)\n", multi.total_units / wall_sec,
+           unit_name, (fastest > 0.0) ? (multi.total_units / wall_sec) / fastest : 0.0);
+    multi_blur_release(&multi);
+
+    //------------------------------------------------------
+    // Comparison with the host engine
+    //------------------------------------------------------
+    // Bands or frames may come from the 2D or the separable path of different devices, so the default tolerance is 1
+    printf("\n######### Comparison: Workers vs Host ################\n");
+    int kernel_radius = (params.kernel_radius > 0) ? params.kernel_radius : gaussian_kernel_radius(params.sigma);
+    int kernel_size = (2 * kernel_radius) + 1;
+    float* mask = (float*)malloc(kernel_size * kernel_size * sizeof(float));
+    unsigned char* expected = (unsigned char*)malloc(image_bytes);
+    generate_gaussian_kernel(mask, params.sigma, kernel_radius);
+    status = 0;
+    for (int i = 0; i < num_images; i += (num_images > 1) ? num_images - 1 : 1)
+    {
+        verify_result comparison;
+        cpu_gaussian_blur(pool, inputs[i], expected, image_width, image_height, image_channels, mask, kernel_radius);
+        if (num_frames > 0)
+            printf("Frame %d: ", i);
+        verify_images(pool, expected, outputs[i], image_bytes, &verify, &comparison);
+        verify_print(&comparison, &verify, expected, outputs[i], image_bytes, image_width, image_channels);
+        status = (comparison.passed && status == 0) ? 0 : 1;
+    }
+    free(mask);
+    free(expected);
+
+cleanup:
+    for (int i = 0; i < num_images; i++)
+    {
+        if (!input_path)
+            free(inputs[i]);
+        if (!output_path)
+            free(outputs[i]);
+    }
+    free(inputs);
+    free(outputs);
+    if (input_path)
+        image_file_close(&input_file);
+    if (output_path)
+    {
+        image_file_close(&output_file);
+        if (status == 0)
+            printf("Result written to %s\n", output_path);
+    }
+    cpu_thread_pool_destroy(pool);
+    return status;
+}
@@ -0,0 +1,330 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "multi_device.h"
+#include "gaussian_mask.h"
+
+#define MULTI_MIN_ROWS 64   // Smallest row band (the first chunk of every device, and the floor after that)
+
+
+
+static double wall_clock_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+int multi_blur_init(multi_blur* multi, const blur_params* params, cl_device_type device_types, cpu_thread_pool* host_pool)
+{
+    memset(multi, 0, sizeof(*multi));
+    multi->params = *params;
+    multi->host_pool = host_pool;
+    multi->chunk_sec = MULTI_CHUNK_SEC;
+    multi->kernel_radius = (params->kernel_radius > 0) ? params->kernel_radius : gaussian_kernel_radius(params->sigma);
+    pthread_mutex_init(&multi->lock, NULL);
+
+    device_candidate candidates[MULTI_DEVICE_MAX];
+    int num_candidates = enumerate_devices(candidates, host_pool ? MULTI_DEVICE_MAX - 1 : MULTI_DEVICE_MAX);
+    for (int i = 0; i < num_candidates; i++)
+    {
+        if (!(candidates[i].type & device_types))
+            continue;
+        multi_worker* worker = &multi->workers[multi->num_workers];
+        snprintf(worker->name, sizeof(worker->name), "%s", candidates[i].device_name);
+        if (ocl_runtime_init_device(&worker->rt, &candidates[i], 0) != CL_SUCCESS)
+        {
+            printf("Skipping %s: no context or queue\n", candidates[i].device_name);
+            continue;
+        }
+        if (blur_engine_init(&worker->engine, &worker->rt, params) != CL_SUCCESS)
+        {
+            printf("Skipping %s: the blur kernels did not build\n", candidates[i].device_name);
+            blur_engine_release(&worker->engine);
+            ocl_runtime_release(&worker->rt);
+            continue;
+        }
+        multi->num_workers++;
+    }
+
+    if (host_pool)
+    {
+        int size = (2 * multi->kernel_radius) + 1;
+        multi->mask = (float*)malloc(size * size * sizeof(float));
+        multi->row_weights = (float*)malloc(size * sizeof(float));
+        multi->col_weights = (float*)malloc(size * sizeof(float));
+        if (!multi->mask || !multi->row_weights || !multi->col_weights)
+        {
+            fprintf(stderr, "Error: Could not allocate the host engine's %dx%d mask\n", size, size);
+            return -1;
+        }
+        multi_worker* worker = &multi->workers[multi->num_workers++];
+        snprintf(worker->name, sizeof(worker->name), "Host CPU engine (%d threads, %s)", cpu_thread_pool_size(host_pool), cpu_blur_simd_name());
+        worker->is_host = 1;
+        generate_gaussian_kernel(multi->mask, params->sigma, multi->kernel_radius);
+        multi->host_separable = extract_separable_kernel(multi->mask, multi->kernel_radius, multi->row_weights, multi->col_weights) &&
+                                !params->use_reference;
+    }
+
+    if (multi->num_workers == 0)
+    {
+        fprintf(stderr, "Error: No device to schedule work on\n");
+        return -1;
+    }
+    return multi->num_workers;
+}
+
+void multi_blur_release(multi_blur* multi)
+{
+    for (int i = 0; i < multi->num_workers; i++)
+    {
+        multi_worker* worker = &multi->workers[i];
+        if (worker->is_host)
+        {
+            free(worker->host_strip);
+            continue;
+        }
+        blur_engine_release(&worker->engine);
+        ocl_runtime_release(&worker->rt);
+    }
+    free(multi->mask);
+    free(multi->row_weights);
+    free(multi->col_weights);
+    pthread_mutex_destroy(&multi->lock);
+    memset(multi, 0, sizeof(*multi));
+}
+
+//------------------------------------------------------
+// Scheduling
+//------------------------------------------------------
+
+// Takes the next chunk for a worker: a probe of min_units until its rate is known, then about
+// chunk_sec of work at that rate, capped at the worker's throughput share of the remaining units.
+// Returns the chunk size (0 when the queue is empty) and its first unit.
+static int claim_chunk(multi_blur* multi, const multi_worker* worker, int min_units, int max_units, int* first)
+{
+    pthread_mutex_lock(&multi->lock);
+    int remaining = multi->total_units - multi->next_unit;
+    int count = 0;
+    if (remaining > 0)
+    {
+        count = min_units;
+        if (worker->rate > 0.0)
+        {
+            double total_rate = 0.0;
+            for (int i = 0; i < multi->num_workers; i++)
+                total_rate += multi->workers[i].rate;
+            double share = (remaining * worker->rate) / total_rate;
+            double target = worker->rate * multi->chunk_sec;
+            double size = (target < share) ? target : share;
+            count = (size > min_units) ? (int)size : min_units;
+        }
+        if (count > max_units)
+            count = max_units;
+        if (count > remaining)
+            count = remaining;
+        *first = multi->next_unit;
+        multi->next_unit += count;
+    }
+    pthread_mutex_unlock(&multi->lock);
+    return count;
+}
+
+static cl_int host_blur(multi_blur* multi, const unsigned char* input, unsigned char* output, int width, int height)
+{
+    int channels = (multi->params.channels > 1) ? multi->params.channels : 1;
+    int status;
+    if (multi->host_separable)
+        status = cpu_gaussian_blur_separable(multi->host_pool, input, output, width, height, channels, multi->row_weights, multi->col_weights, multi->kernel_radius);
+    else
+        status = cpu_gaussian_blur(multi->host_pool, input, output, width, height, channels, multi->mask, multi->kernel_radius);
+    return (status == 0) ? CL_SUCCESS : CL_OUT_OF_HOST_MEMORY;
+}
+
+// Rows y0 to y1 - 1 on the host: the band with its halos goes through the CPU engine into host_strip
+static cl_int host_blur_rows(multi_blur* multi, multi_worker* worker, int y0, int y1)
+{
+    int channels = (multi->params.channels > 1) ? multi->params.channels : 1;
+    size_t row_bytes = (size_t)multi->width * channels;
+    int radius = multi->kernel_radius;
+    int halo_y0 = (y0 - radius > 0) ? y0 - radius : 0;
+    int halo_y1 = (y1 + radius < multi->height) ? y1 + radius : multi->height;
+    size_t strip_bytes = (size_t)(halo_y1 - halo_y0) * row_bytes;
+    if (strip_bytes > worker->host_strip_bytes)
+    {
+        free(worker->host_strip);
+        worker->host_strip = (unsigned char*)malloc(strip_bytes);
+        worker->host_strip_bytes = worker->host_strip ? strip_bytes : 0;
+        if (!worker->host_strip)
+            return CL_OUT_OF_HOST_MEMORY;
+    }
+    cl_int err = host_blur(multi, multi->image_input + (halo_y0 * row_bytes), worker->host_strip, multi->width, halo_y1 - halo_y0);
+    if (err != CL_SUCCESS)
+        return err;
+    memcpy(multi->image_output + (y0 * row_bytes), worker->host_strip + ((y0 - halo_y0) * row_bytes), (size_t)(y1 - y0) * row_bytes);
+    return CL_SUCCESS;
+}
+
+static cl_int process_chunk(multi_blur* multi, multi_worker* worker, int first, int count)
+{
+    cl_int err = CL_SUCCESS;
+    if (multi->image_input)
+    {
+        if (worker->is_host)
+            return host_blur_rows(multi, worker, first, first + count);
+        return blur_engine_run_rows(&worker->engine, multi->image_input, multi->image_output, multi->width, multi->height, first, first + count);
+    }
+    for (int f = first; f < first + count && err == CL_SUCCESS; f++)
+    {
+        if (worker->is_host)
+            err = host_blur(multi, multi->frame_inputs[f], multi->frame_outputs[f], multi->width, multi->height);
+        else
+            err = blur_engine_run(&worker->engine, multi->frame_inputs[f], multi->frame_outputs[f], multi->width, multi->height, NULL);
+    }
+    return err;
+}
+
+typedef struct
+{
+    multi_blur* multi;
+    multi_worker* worker;
+} worker_args;
+
+static void* worker_main(void* arg)
+{
+    worker_args* args = (worker_args*)arg;
+    multi_blur* multi = args->multi;
+    multi_worker* worker = args->worker;
+
+    // Row bands must fit the device with their halos; frames are taken one or more at a time
+    int min_units = 1;
+    int max_units = multi->total_units;
+    if (multi->image_input)
+    {
+        min_units = (MULTI_MIN_ROWS > 2 * multi->kernel_radius) ? MULTI_MIN_ROWS : 2 * multi->kernel_radius;
+        if (!worker->is_host)
+        {
+            max_units = blur_engine_strip_rows(&worker->engine, multi->width, 0) - (2 * multi->kernel_radius);
+            // Too small for one band: the other workers take the rows (run_queue fails when none can)
+            if (max_units < 1)
+            {
+                printf("Skipping %s: it cannot hold a %d pixel wide band with its halos\n", worker->name, multi->width);
+                return NULL;
+            }
+            if (min_units > max_units)
+                min_units = max_units;
+        }
+    }
+
+    int first;
+    int count;
+    while ((count = claim_chunk(multi, worker, min_units, max_units, &first)) > 0)
+    {
+        double start = wall_clock_sec();
+        cl_int err = process_chunk(multi, worker, first, count);
+        double elapsed = wall_clock_sec() - start;
+        if (err != CL_SUCCESS)
+        {
+            fprintf(stderr, "Error: %s failed on units %d to %d\n", worker->name, first, first + count - 1);
+            worker->error = err;
+            break;
+        }
+        double rate = count / ((elapsed > 1e-9) ? elapsed : 1e-9);
+        pthread_mutex_lock(&multi->lock);
+        worker->rate = (worker->rate > 0.0) ? (0.5 * worker->rate) + (0.5 * rate) : rate;
+        worker->chunks++;
+        worker->units += count;
+        worker->busy_sec += elapsed;
+        pthread_mutex_unlock(&multi->lock);
+    }
+    return NULL;
+}
+
+// Starts a thread per worker on the queue set up by the caller and waits for all of them.
+// Measured rates are kept from run to run, so later runs start with well-sized chunks.
+static cl_int run_queue(multi_blur* multi)
+{
+    pthread_t threads[MULTI_DEVICE_MAX];
+    worker_args args[MULTI_DEVICE_MAX];
+    multi->next_unit = 0;
+    for (int i = 0; i < multi->num_workers; i++)
+    {
+        multi_worker* worker = &multi->workers[i];
+        worker->chunks = 0;
+        worker->units = 0;
+        worker->busy_sec = 0.0;
+        worker->error = CL_SUCCESS;
+        args[i].multi = multi;
+        args[i].worker = worker;
+    }
+    // Workers already started finish the queue on their own; only those are joined
+    int started = 0;
+    cl_int err = CL_SUCCESS;
+    while (started < multi->num_workers)
+    {
+        if (pthread_create(&threads[started], NULL, worker_main, &args[started]) != 0)
+        {
+            fprintf(stderr, "Error: Could not start the thread of %s\n", multi->workers[started].name);
+            err = CL_OUT_OF_RESOURCES;
+            break;
+        }
+        started++;
+    }
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    if (err != CL_SUCCESS)
+        return err;
+
+    // A failed chunk leaves a hole in the result, so any worker error fails the run
+    for (int i = 0; i < multi->num_workers; i++)
+    {
+        if (multi->workers[i].error != CL_SUCCESS)
+            return multi->workers[i].error;
+    }
+    // Without errors, units are only left over when every worker dropped out
+    if (multi->next_unit < multi->total_units)
+    {
+        fprintf(stderr, "Error: No worker can hold a %d pixel wide band with its halos\n", multi->width);
+        return CL_INVALID_BUFFER_SIZE;
+    }
+    return CL_SUCCESS;
+}
+
+cl_int multi_blur_image(multi_blur* multi, const unsigned char* input, unsigned char* output, int width, int height)
+{
+    multi->image_input = input;
+    multi->image_output = output;
+    multi->frame_inputs = NULL;
+    multi->frame_outputs = NULL;
+    multi->width = width;
+    multi->height = height;
+    multi->total_units = height;
+    return run_queue(multi);
+}
+
+cl_int multi_blur_frames(multi_blur* multi, const unsigned char* const* inputs, unsigned char** outputs, int num_frames, int width, int height)
+{
+    multi->image_input = NULL;
+    multi->image_output = NULL;
+    multi->frame_inputs = inputs;
+    multi->frame_outputs = outputs;
+    multi->width = width;
+    multi->height = height;
+    multi->total_units = num_frames;
+    return run_queue(multi);
+}
+
+void multi_blur_print_stats(const multi_blur* multi, const char* unit_name, double wall_sec)
+{
+    for (int i = 0; i < multi->num_workers; i++)
+    {
+        const multi_worker* worker = &multi->workers[i];
+        double share = (multi->total_units > 0) ? (100.0 * worker->units) / multi->total_units : 0.0;
+        double rate = (worker->busy_sec > 0.0) ? worker->units / worker->busy_sec : 0.0;
+        printf("%-52.52s: %5.1f%% of the %s, %d chunk(s), busy %f seconds (%.0f%%), %.1f %s/s\n", worker->name, share, unit_name,
+               worker->chunks, worker->busy_sec, (wall_sec > 0.0) ? (100.0 * worker->busy_sec) / wall_sec : 0.0, rate, unit_name);
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef MULTI_DEVICE_H
+#define MULTI_DEVICE_H
+
+#include <pthread.h>
+#include <CL/cl.h>
+
+#include "device_select.h"
+#include "ocl_runtime.h"
+#include "blur_engine.h"
+#include "cpu_blur.h"
+
+// Gaussian blur spread over every OpenCL device (each with its own runtime and blur_engine) and,
+// optionally, the host CPU engine. One thread drives each device and takes work from a shared queue:
+// the row bands of one image (uploaded with their halos, so the result matches a single pass) or the
+// frames of a batch. Chunks are sized from each device's measured throughput: after a small first
+// chunk that measures it, a device takes about chunk_sec of work at its rate, capped at its
+// throughput share of what is left, so fast devices take large chunks and all of them finish together.
+
+#define MULTI_DEVICE_MAX 16
+#define MULTI_CHUNK_SEC 0.02   // Default target duration of one chunk
+
+typedef struct
+{
+    char name[DEVICE_SELECT_NAME_LEN];
+    int is_host;                // The CPU engine on host_pool instead of an OpenCL device
+    ocl_runtime rt;
+    blur_engine engine;
+    unsigned char* host_strip;  // Host worker: output of the current band with its halos
+    size_t host_strip_bytes;
+
+    // Statistics of the last run
+    int chunks;
+    long long units;            // Rows or frames
+    double busy_sec;
+    double rate;                // Units per second, averaged over the chunks (0 before the first one)
+    cl_int error;
+} multi_worker;
+
+typedef struct
+{
+    multi_worker workers[MULTI_DEVICE_MAX];
+    int num_workers;
+    blur_params params;
+    cpu_thread_pool* host_pool; // Owned by the caller; NULL without a host worker
+    int kernel_radius;
+    float* mask;                // Host worker weights
+    float* row_weights;
+    float* col_weights;
+    int host_separable;
+    double chunk_sec;
+
+    // Queue of the current run
+    pthread_mutex_t lock;
+    int next_unit;
+    int total_units;
+    int width;
+    int height;
+    const unsigned char* image_input;
+    unsigned char* image_output;
+    const unsigned char* const* frame_inputs;
+    unsigned char** frame_outputs;
+} multi_blur;
+
+// Sets up a worker for every device whose type is in device_types (CL_DEVICE_TYPE_ALL for all of them),
+// plus a host worker when host_pool is not NULL. Devices that fail to set up are skipped with a message.
+// Returns the number of workers, or -1 when there is none or the host worker's mask cannot be allocated.
+int multi_blur_init(multi_blur* multi, const blur_params* params, cl_device_type device_types, cpu_thread_pool* host_pool);
+void multi_blur_release(multi_blur* multi);
+
+// Blurs one image, split into row bands across the workers. A device that cannot hold one band with
+// its halos sits the image out; the run fails only when no worker can take a band.
+cl_int multi_blur_image(multi_blur* multi, const unsigned char* input, unsigned char* output, int width, int height);
+
+// Blurs num_frames frames of width x height, split across the workers
+cl_int multi_blur_frames(multi_blur* multi, const unsigned char* const* inputs, unsigned char** outputs, int num_frames, int width, int height);
+
+// Prints the share, chunk count, busy time and throughput of every worker for the last run
+void multi_blur_print_stats(const multi_blur* multi, const char* unit_name, double wall_sec);
+
+#endif
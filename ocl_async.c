@@ -0,0 +1,303 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ocl_async.h"
+
+
+
+struct ocl_future
+{
+    pthread_mutex_t lock;
+    pthread_cond_t done_cond;
+    int refs;                       // The submitter's, until its cleanup has run, and the caller's
+    int done;
+    cl_int status;
+
+    ocl_async* async;
+    cl_event event;                 // Last command of the submission
+    ocl_async_cleanup_fn cleanup;
+    void* ctx;
+    ocl_async_complete_fn on_complete;
+    void* user;
+    ocl_future* next;               // Link in the submitter's completed list
+};
+
+static double wall_clock_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+static cl_command_queue create_async_queue(ocl_runtime* rt, cl_int* err)
+{
+    cl_command_queue_properties properties = 0;
+    clGetCommandQueueInfo(rt->queue, CL_QUEUE_PROPERTIES, sizeof(properties), &properties, NULL);
+    cl_command_queue queue = clCreateCommandQueue(rt->context, rt->device, properties, err);
+    if (!queue)
+        ocl_report_error("clCreateCommandQueue", *err, __FILE__, __LINE__);
+    return queue;
+}
+
+cl_int ocl_async_init(ocl_async* async, ocl_runtime* rt, int max_in_flight, int num_queues)
+{
+    cl_int err;
+    memset(async, 0, sizeof(*async));
+    async->rt = rt;
+    async->max_in_flight = (max_in_flight < 1) ? 1 : max_in_flight;
+    async->num_queues = (num_queues < 1) ? 1 : (num_queues > OCL_ASYNC_MAX_QUEUES) ? OCL_ASYNC_MAX_QUEUES : num_queues;
+    async->first_error = CL_SUCCESS;
+    pthread_mutex_init(&async->lock, NULL);
+    pthread_cond_init(&async->slot_free, NULL);
+    pthread_mutex_init(&async->submit_lock, NULL);
+
+    for (int i = 0; i < async->num_queues; i++)
+    {
+        if (!(async->queues[i] = create_async_queue(rt, &err)))
+            return err;
+    }
+    return CL_SUCCESS;
+}
+
+void ocl_async_release(ocl_async* async)
+{
+    if (!async->rt)
+        return;
+    ocl_async_drain(async);
+    for (int i = 0; i < async->num_queues; i++)
+    {
+        if (async->queues[i])
+            clReleaseCommandQueue(async->queues[i]);
+    }
+    pthread_mutex_destroy(&async->submit_lock);
+    pthread_cond_destroy(&async->slot_free);
+    pthread_mutex_destroy(&async->lock);
+    memset(async, 0, sizeof(*async));
+}
+
+// Takes an in-flight slot, waiting for one when wait is set. Returns 0 when none is free and wait is not set.
+static int acquire_slot(ocl_async* async, int wait)
+{
+    pthread_mutex_lock(&async->lock);
+    if (async->in_flight >= async->max_in_flight)
+    {
+        if (!wait)
+        {
+            pthread_mutex_unlock(&async->lock);
+            return 0;
+        }
+        double start = wall_clock_sec();
+        async->stats.stalls++;
+        while (async->in_flight >= async->max_in_flight)
+            pthread_cond_wait(&async->slot_free, &async->lock);
+        async->stats.stall_sec += wall_clock_sec() - start;
+    }
+    async->in_flight++;
+    if (async->in_flight > async->stats.peak_in_flight)
+        async->stats.peak_in_flight = async->in_flight;
+    pthread_mutex_unlock(&async->lock);
+    return 1;
+}
+
+static void release_slot(ocl_async* async)
+{
+    pthread_mutex_lock(&async->lock);
+    async->in_flight--;
+    pthread_cond_broadcast(&async->slot_free);
+    pthread_mutex_unlock(&async->lock);
+}
+
+// Runs on a driver thread when the submission's last command completes or fails. The future is
+// completed here; the cleanup waits on the completed list for a submitting thread.
+static void CL_CALLBACK on_event_complete(cl_event event, cl_int exec_status, void* data)
+{
+    (void)event;
+    ocl_future* future = (ocl_future*)data;
+    ocl_async* async = future->async;
+    cl_int status = (exec_status < 0) ? exec_status : CL_SUCCESS;
+
+    if (future->on_complete)
+        future->on_complete(future->user, status);
+
+    pthread_mutex_lock(&future->lock);
+    future->status = status;
+    future->done = 1;
+    pthread_cond_broadcast(&future->done_cond);
+    pthread_mutex_unlock(&future->lock);
+
+    pthread_mutex_lock(&async->lock);
+    async->in_flight--;
+    async->stats.completed++;
+    if (status != CL_SUCCESS)
+    {
+        async->stats.failed++;
+        if (async->first_error == CL_SUCCESS)
+            async->first_error = status;
+    }
+    future->next = async->completed;
+    async->completed = future;
+    pthread_cond_broadcast(&async->slot_free);
+    pthread_mutex_unlock(&async->lock);
+}
+
+static cl_int submit(ocl_async* async, ocl_async_enqueue_fn enqueue, ocl_async_cleanup_fn cleanup, void* ctx,
+                     ocl_async_complete_fn on_complete, void* user, ocl_future** future_out, int wait)
+{
+    cl_int err;
+    if (future_out)
+        *future_out = NULL;
+
+    // Cleanup first, so buffers of finished submissions go back to the pool before this one takes its own
+    ocl_async_poll(async);
+    if (!acquire_slot(async, wait))
+        return CL_OUT_OF_RESOURCES;
+
+    ocl_future* future = (ocl_future*)calloc(1, sizeof(ocl_future));
+    if (!future)
+    {
+        release_slot(async);
+        if (cleanup)
+            cleanup(ctx);
+        return CL_OUT_OF_HOST_MEMORY;
+    }
+    pthread_mutex_init(&future->lock, NULL);
+    pthread_cond_init(&future->done_cond, NULL);
+    future->refs = future_out ? 2 : 1;
+    future->status = CL_SUCCESS;
+    future->async = async;
+    future->cleanup = cleanup;
+    future->ctx = ctx;
+    future->on_complete = on_complete;
+    future->user = user;
+
+    pthread_mutex_lock(&async->submit_lock);
+    cl_command_queue queue = async->queues[async->next_queue];
+    async->next_queue = (async->next_queue + 1) % async->num_queues;
+    err = enqueue(ctx, queue, &future->event);
+    if (err == CL_SUCCESS && !future->event)
+        err = CL_INVALID_EVENT;
+    if (err == CL_SUCCESS && (err = clFlush(queue)) != CL_SUCCESS)
+        ocl_report_error("clFlush", err, __FILE__, __LINE__);
+    pthread_mutex_unlock(&async->submit_lock);
+    if (err != CL_SUCCESS)
+    {
+        // Commands enqueued before the failure may still use ctx
+        clFinish(queue);
+        if (future->event)
+            clReleaseEvent(future->event);
+        if (cleanup)
+            cleanup(ctx);
+        pthread_cond_destroy(&future->done_cond);
+        pthread_mutex_destroy(&future->lock);
+        free(future);
+        release_slot(async);
+        return err;
+    }
+
+    pthread_mutex_lock(&async->lock);
+    async->stats.submitted++;
+    pthread_mutex_unlock(&async->lock);
+
+    // The caller's reference is handed out first: the callback may complete the future at any time from here
+    if (future_out)
+        *future_out = future;
+    err = clSetEventCallback(future->event, CL_COMPLETE, on_event_complete, future);
+    if (err != CL_SUCCESS)
+    {
+        // Without callbacks the submission completes synchronously
+        ocl_report_error("clSetEventCallback", err, __FILE__, __LINE__);
+        cl_int exec_status = CL_SUCCESS;
+        clWaitForEvents(1, &future->event);
+        clGetEventInfo(future->event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(exec_status), &exec_status, NULL);
+        on_event_complete(future->event, exec_status, future);
+    }
+    return CL_SUCCESS;
+}
+
+cl_int ocl_async_submit(ocl_async* async, ocl_async_enqueue_fn enqueue, ocl_async_cleanup_fn cleanup, void* ctx,
+                        ocl_async_complete_fn on_complete, void* user, ocl_future** future)
+{
+    return submit(async, enqueue, cleanup, ctx, on_complete, user, future, 1);
+}
+
+cl_int ocl_async_try_submit(ocl_async* async, ocl_async_enqueue_fn enqueue, ocl_async_cleanup_fn cleanup, void* ctx,
+                            ocl_async_complete_fn on_complete, void* user, ocl_future** future)
+{
+    return submit(async, enqueue, cleanup, ctx, on_complete, user, future, 0);
+}
+
+int ocl_async_poll(ocl_async* async)
+{
+    pthread_mutex_lock(&async->lock);
+    ocl_future* completed = async->completed;
+    async->completed = NULL;
+    int in_flight = async->in_flight;
+    pthread_mutex_unlock(&async->lock);
+
+    while (completed)
+    {
+        ocl_future* next = completed->next;
+        clReleaseEvent(completed->event);
+        completed->event = NULL;
+        if (completed->cleanup)
+            completed->cleanup(completed->ctx);
+        ocl_future_release(completed);
+        completed = next;
+    }
+    return in_flight;
+}
+
+cl_int ocl_async_drain(ocl_async* async)
+{
+    pthread_mutex_lock(&async->lock);
+    while (async->in_flight > 0)
+        pthread_cond_wait(&async->slot_free, &async->lock);
+    cl_int err = async->first_error;
+    async->first_error = CL_SUCCESS;
+    pthread_mutex_unlock(&async->lock);
+
+    ocl_async_poll(async);
+    return err;
+}
+
+void ocl_async_get_stats(ocl_async* async, ocl_async_stats* stats)
+{
+    pthread_mutex_lock(&async->lock);
+    *stats = async->stats;
+    pthread_mutex_unlock(&async->lock);
+}
+
+int ocl_future_done(ocl_future* future)
+{
+    pthread_mutex_lock(&future->lock);
+    int done = future->done;
+    pthread_mutex_unlock(&future->lock);
+    return done;
+}
+
+cl_int ocl_future_wait(ocl_future* future)
+{
+    pthread_mutex_lock(&future->lock);
+    while (!future->done)
+        pthread_cond_wait(&future->done_cond, &future->lock);
+    cl_int status = future->status;
+    pthread_mutex_unlock(&future->lock);
+    return status;
+}
+
+void ocl_future_release(ocl_future* future)
+{
+    if (!future)
+        return;
+    pthread_mutex_lock(&future->lock);
+    int refs = --future->refs;
+    pthread_mutex_unlock(&future->lock);
+    if (refs > 0)
+        return;
+    pthread_cond_destroy(&future->done_cond);
+    pthread_mutex_destroy(&future->lock);
+    free(future);
+}
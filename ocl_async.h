@@ -0,0 +1,97 @@
+#ifndef OCL_ASYNC_H
+#define OCL_ASYNC_H
+
+#include <pthread.h>
+#include <CL/cl.h>
+
+#include "ocl_runtime.h"
+
+// Non-blocking submission on top of an ocl_runtime, for services where request threads should not
+// park in the driver. A submission enqueues its commands on one of the submitter's own in-order
+// queues, flushes them and returns at once with a future; clSetEventCallback on the submission's last
+// event completes the future and calls an optional completion callback. At most max_in_flight
+// submissions are outstanding: a further submit blocks until one completes (backpressure), or fails
+// with CL_OUT_OF_RESOURCES through ocl_async_try_submit.
+// Completion callbacks run on a driver thread: they must be short and must not call blocking OpenCL
+// functions. Per-submission cleanup (buffers back to the pool, host context freed) runs later on a
+// submitting thread, in the next submit, ocl_async_poll or ocl_async_drain.
+// Submits from several threads are serialized, because they set arguments on the runtime's shared kernels.
+
+#define OCL_ASYNC_MAX_QUEUES 4
+
+typedef struct ocl_future ocl_future;
+
+// Enqueues the commands of one submission on queue (non-blocking) and returns the event of the last
+// one in *done_event; the in-order queue completes every earlier command before it
+typedef cl_int (*ocl_async_enqueue_fn)(void* ctx, cl_command_queue queue, cl_event* done_event);
+
+// Releases what a submission held once its commands have completed (or failed to enqueue)
+typedef void (*ocl_async_cleanup_fn)(void* ctx);
+
+// Called on completion with CL_SUCCESS or the failing command's status (see the note above)
+typedef void (*ocl_async_complete_fn)(void* user, cl_int status);
+
+typedef struct
+{
+    unsigned long long submitted;
+    unsigned long long completed;
+    unsigned long long failed;      // Completed with an error status
+    unsigned long long stalls;      // Submits that had to wait for a free slot
+    double stall_sec;               // Time submitting threads spent waiting for slots
+    int peak_in_flight;
+} ocl_async_stats;
+
+typedef struct
+{
+    ocl_runtime* rt;
+    cl_command_queue queues[OCL_ASYNC_MAX_QUEUES];
+    int num_queues;
+    int next_queue;
+    int max_in_flight;
+
+    pthread_mutex_t lock;           // Guards the fields below
+    pthread_cond_t slot_free;
+    int in_flight;
+    ocl_future* completed;          // Completed submissions whose cleanup has not run yet
+    cl_int first_error;             // First failure since the last drain
+    ocl_async_stats stats;
+
+    pthread_mutex_t submit_lock;    // Serializes enqueues
+} ocl_async;
+
+// Creates num_queues in-order queues (1..OCL_ASYNC_MAX_QUEUES, with the runtime queue's properties;
+// 2 or more let the transfers of one submission overlap the kernels of another) and allows
+// max_in_flight outstanding submissions (at least 1)
+cl_int ocl_async_init(ocl_async* async, ocl_runtime* rt, int max_in_flight, int num_queues);
+
+// Drains the submitter and releases its queues
+void ocl_async_release(ocl_async* async);
+
+// Enqueues a submission, waiting for a free slot first. ctx must stay valid until cleanup(ctx) runs
+// (cleanup may be NULL). on_complete and future are optional; a returned future is released by the
+// caller. On failure nothing is left in flight, cleanup has run and *future is NULL.
+cl_int ocl_async_submit(ocl_async* async, ocl_async_enqueue_fn enqueue, ocl_async_cleanup_fn cleanup, void* ctx,
+                        ocl_async_complete_fn on_complete, void* user, ocl_future** future);
+
+// Same, but returns CL_OUT_OF_RESOURCES instead of waiting when max_in_flight submissions are
+// outstanding (cleanup is not called then: ctx still belongs to the caller)
+cl_int ocl_async_try_submit(ocl_async* async, ocl_async_enqueue_fn enqueue, ocl_async_cleanup_fn cleanup, void* ctx,
+                            ocl_async_complete_fn on_complete, void* user, ocl_future** future);
+
+// Runs the cleanup of completed submissions. Returns the number still in flight.
+int ocl_async_poll(ocl_async* async);
+
+// Waits for every submission and runs their cleanup. Returns CL_SUCCESS or the first failure since the last drain.
+cl_int ocl_async_drain(ocl_async* async);
+
+void ocl_async_get_stats(ocl_async* async, ocl_async_stats* stats);
+
+// Nonzero once the submission has completed
+int ocl_future_done(ocl_future* future);
+
+// Blocks until the submission has completed and returns its status
+cl_int ocl_future_wait(ocl_future* future);
+
+void ocl_future_release(ocl_future* future);
+
+#endif
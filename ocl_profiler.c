@@ -0,0 +1,300 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ocl_profiler.h"
+#include "ocl_runtime.h"
+
+#define PROFILER_INITIAL_CAPACITY 256
+
+
+
+void ocl_profiler_init(ocl_profiler* profiler)
+{
+    memset(profiler, 0, sizeof(*profiler));
+}
+
+void ocl_profiler_release(ocl_profiler* profiler)
+{
+    free(profiler->records);
+    memset(profiler, 0, sizeof(*profiler));
+}
+
+static int lane_index(ocl_profiler* profiler, cl_command_queue queue)
+{
+    for (int i = 0; i < profiler->num_lanes; i++)
+    {
+        if (profiler->lanes[i] == queue)
+            return i;
+    }
+    if (profiler->num_lanes == OCL_PROFILER_MAX_LANES)
+        return OCL_PROFILER_MAX_LANES - 1;
+    int lane = profiler->num_lanes++;
+    profiler->lanes[lane] = queue;
+    snprintf(profiler->lane_names[lane], OCL_PROFILER_NAME_LEN, "queue %d", lane);
+    return lane;
+}
+
+void ocl_profiler_name_queue(ocl_profiler* profiler, cl_command_queue queue, const char* name)
+{
+    int lane = lane_index(profiler, queue);
+    snprintf(profiler->lane_names[lane], OCL_PROFILER_NAME_LEN, "%s", name);
+}
+
+cl_int ocl_profiler_record(ocl_profiler* profiler, const char* stage, int iteration, cl_event event)
+{
+    ocl_profile_record record;
+    cl_command_queue queue = NULL;
+    if (!event)
+        return CL_SUCCESS;
+
+    memset(&record, 0, sizeof(record));
+    snprintf(record.stage, sizeof(record.stage), "%s", stage);
+    record.iteration = iteration;
+    OCL_CHECK(clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &record.queued, NULL));
+    OCL_CHECK(clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &record.submit, NULL));
+    OCL_CHECK(clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &record.start, NULL));
+    OCL_CHECK(clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &record.end, NULL));
+    clGetEventInfo(event, CL_EVENT_COMMAND_QUEUE, sizeof(queue), &queue, NULL);
+    record.lane = lane_index(profiler, queue);
+
+    if (profiler->num_records == profiler->capacity)
+    {
+        int capacity = profiler->capacity ? profiler->capacity * 2 : PROFILER_INITIAL_CAPACITY;
+        ocl_profile_record* records = (ocl_profile_record*)realloc(profiler->records, capacity * sizeof(ocl_profile_record));
+        if (!records)
+            return CL_OUT_OF_HOST_MEMORY;
+        profiler->records = records;
+        profiler->capacity = capacity;
+    }
+    profiler->records[profiler->num_records++] = record;
+    return CL_SUCCESS;
+}
+
+static cl_ulong first_queued(const ocl_profiler* profiler)
+{
+    cl_ulong origin = 0;
+    for (int i = 0; i < profiler->num_records; i++)
+    {
+        if (i == 0 || profiler->records[i].queued < origin)
+            origin = profiler->records[i].queued;
+    }
+    return origin;
+}
+
+// Writes a stage or lane name as a quoted JSON or CSV field (names come from callers and drivers)
+static void write_quoted(FILE* file, const char* text, int json)
+{
+    fputc('"', file);
+    for (const unsigned char* p = (const unsigned char*)text; *p; p++)
+    {
+        if (!json)
+        {
+            if (*p == '"')
+                fputc('"', file);
+            fputc(*p, file);
+        }
+        else if (*p == '"' || *p == '\\')
+            fprintf(file, "\\%c", *p);
+        else if (*p < 0x20)
+            fprintf(file, "\\u%04x", *p);
+        else
+            fputc(*p, file);
+    }
+    fputc('"', file);
+}
+
+// Starts a trace event: the separator goes before every event but the first, so any mix of lanes
+// and records (including lanes without records) gives valid JSON
+static void begin_event(FILE* file, int* num_events, const char* name)
+{
+    fprintf(file, "%s{\"name\": ", (*num_events)++ > 0 ? ",\n" : "");
+    write_quoted(file, name, 1);
+}
+
+int ocl_profiler_write_chrome_trace(const ocl_profiler* profiler, const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        fprintf(stderr, "Error: Could not write %s\n", path);
+        return -1;
+    }
+    cl_ulong origin = first_queued(profiler);
+    int num_events = 0;
+
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    for (int lane = 0; lane < profiler->num_lanes; lane++)
+    {
+        char wait_name[OCL_PROFILER_NAME_LEN + 8];
+        snprintf(wait_name, sizeof(wait_name), "%s wait", profiler->lane_names[lane]);
+        begin_event(file, &num_events, "thread_name");
+        fprintf(file, ", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": ", lane);
+        write_quoted(file, profiler->lane_names[lane], 1);
+        fprintf(file, "}}");
+        begin_event(file, &num_events, "thread_name");
+        fprintf(file, ", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": ", lane + OCL_PROFILER_MAX_LANES);
+        write_quoted(file, wait_name, 1);
+        fprintf(file, "}}");
+    }
+    for (int i = 0; i < profiler->num_records; i++)
+    {
+        const ocl_profile_record* r = &profiler->records[i];
+        begin_event(file, &num_events, r->stage);
+        fprintf(file, ", \"cat\": \"wait\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, "
+                      "\"args\": {\"iteration\": %d, \"launch_us\": %.3f, \"device_wait_us\": %.3f}}",
+                r->lane + OCL_PROFILER_MAX_LANES, (r->queued - origin) * 1e-3, (r->start - r->queued) * 1e-3,
+                r->iteration, (r->submit - r->queued) * 1e-3, (r->start - r->submit) * 1e-3);
+        begin_event(file, &num_events, r->stage);
+        fprintf(file, ", \"cat\": \"command\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, "
+                      "\"args\": {\"iteration\": %d}}",
+                r->lane, (r->start - origin) * 1e-3, (r->end - r->start) * 1e-3, r->iteration);
+    }
+    fprintf(file, "%s]}\n", (num_events > 0) ? "\n" : "");
+    return (fclose(file) == 0) ? 0 : -1;
+}
+
+int ocl_profiler_write_csv(const ocl_profiler* profiler, const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        fprintf(stderr, "Error: Could not write %s\n", path);
+        return -1;
+    }
+    fprintf(file, "stage,lane,iteration,queued_ns,submit_ns,start_ns,end_ns,launch_ns,device_wait_ns,duration_ns\n");
+    for (int i = 0; i < profiler->num_records; i++)
+    {
+        const ocl_profile_record* r = &profiler->records[i];
+        write_quoted(file, r->stage, 0);
+        fputc(',', file);
+        write_quoted(file, profiler->lane_names[r->lane], 0);
+        fprintf(file, ",%d,%llu,%llu,%llu,%llu,%llu,%llu,%llu\n", r->iteration,
+                (unsigned long long)r->queued, (unsigned long long)r->submit, (unsigned long long)r->start, (unsigned long long)r->end,
+                (unsigned long long)(r->submit - r->queued), (unsigned long long)(r->start - r->submit), (unsigned long long)(r->end - r->start));
+    }
+    return (fclose(file) == 0) ? 0 : -1;
+}
+
+int ocl_profiler_write(const ocl_profiler* profiler, const char* path)
+{
+    const char* dot = strrchr(path, '.');
+    if (dot && strcmp(dot, ".json") == 0)
+        return ocl_profiler_write_chrome_trace(profiler, path);
+    return ocl_profiler_write_csv(profiler, path);
+}
+
+static int compare_ulong(const void* a, const void* b)
+{
+    cl_ulong x = *(const cl_ulong*)a;
+    cl_ulong y = *(const cl_ulong*)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_start(const void* a, const void* b)
+{
+    const ocl_profile_record* x = *(const ocl_profile_record* const*)a;
+    const ocl_profile_record* y = *(const ocl_profile_record* const*)b;
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+// Nearest-rank percentile of sorted values, in microseconds
+static double percentile_us(const cl_ulong* sorted, int count, int percent)
+{
+    int rank = (percent * count + 99) / 100;
+    return sorted[(rank > 0) ? rank - 1 : 0] * 1e-3;
+}
+
+static void print_percentiles(const char* label, cl_ulong* values, int count)
+{
+    qsort(values, count, sizeof(cl_ulong), compare_ulong);
+    printf("  %-10s p50 %10.2f  p90 %10.2f  p99 %10.2f  max %10.2f us\n", label,
+           percentile_us(values, count, 50), percentile_us(values, count, 90), percentile_us(values, count, 99), values[count - 1] * 1e-3);
+}
+
+void ocl_profiler_print_summary(const ocl_profiler* profiler)
+{
+    int n = profiler->num_records;
+    if (n == 0)
+        return;
+    cl_ulong* values = (cl_ulong*)malloc(n * sizeof(cl_ulong));
+    const ocl_profile_record** lane_records = (const ocl_profile_record**)malloc(n * sizeof(ocl_profile_record*));
+
+    // Stages in the order they first appear
+    for (int i = 0; i < n; i++)
+    {
+        const char* stage = profiler->records[i].stage;
+        int seen = 0;
+        for (int j = 0; j < i && !seen; j++)
+            seen = strcmp(profiler->records[j].stage, stage) == 0;
+        if (seen)
+            continue;
+
+        int count = 0;
+        for (int j = i; j < n; j++)
+        {
+            if (strcmp(profiler->records[j].stage, stage) == 0)
+                values[count++] = profiler->records[j].end - profiler->records[j].start;
+        }
+        printf("%s (%d commands)\n", stage, count);
+        print_percentiles("execution", values, count);
+        count = 0;
+        for (int j = i; j < n; j++)
+        {
+            if (strcmp(profiler->records[j].stage, stage) == 0)
+                values[count++] = profiler->records[j].submit - profiler->records[j].queued;
+        }
+        print_percentiles("launch", values, count);
+        count = 0;
+        for (int j = i; j < n; j++)
+        {
+            if (strcmp(profiler->records[j].stage, stage) == 0)
+                values[count++] = profiler->records[j].start - profiler->records[j].submit;
+        }
+        print_percentiles("wait", values, count);
+    }
+
+    // Idle gaps between the (merged) command intervals of each queue show pipeline bubbles
+    for (int lane = 0; lane < profiler->num_lanes; lane++)
+    {
+        int count = 0;
+        for (int i = 0; i < n; i++)
+        {
+            if (profiler->records[i].lane == lane)
+                lane_records[count++] = &profiler->records[i];
+        }
+        if (count == 0)
+            continue;
+        qsort(lane_records, count, sizeof(lane_records[0]), compare_start);
+
+        cl_ulong busy = 0, idle = 0, largest_gap = 0;
+        cl_ulong span_start = lane_records[0]->start;
+        cl_ulong interval_start = lane_records[0]->start;
+        cl_ulong interval_end = lane_records[0]->end;
+        for (int i = 1; i <= count; i++)
+        {
+            if (i < count && lane_records[i]->start <= interval_end)
+            {
+                if (lane_records[i]->end > interval_end)
+                    interval_end = lane_records[i]->end;
+                continue;
+            }
+            busy += interval_end - interval_start;
+            if (i < count)
+            {
+                cl_ulong gap = lane_records[i]->start - interval_end;
+                idle += gap;
+                if (gap > largest_gap)
+                    largest_gap = gap;
+                interval_start = lane_records[i]->start;
+                interval_end = lane_records[i]->end;
+            }
+        }
+        cl_ulong span = interval_end - span_start;
+        printf("Lane %-12s : busy %f s, idle %f s (largest gap %.2f us), utilization %.1f%%\n", profiler->lane_names[lane],
+               busy * 1e-9, idle * 1e-9, largest_gap * 1e-3, span ? (100.0 * busy) / span : 100.0);
+    }
+    free(values);
+    free(lane_records);
+}
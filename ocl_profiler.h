@@ -0,0 +1,60 @@
+#ifndef OCL_PROFILER_H
+#define OCL_PROFILER_H
+
+#include <CL/cl.h>
+
+// Command timeline from OpenCL profiling events. Every recorded command keeps all four timestamps:
+// QUEUED (host enqueue), SUBMIT (handed to the device), START and END, so launch latency
+// (SUBMIT - QUEUED), device wait (START - SUBMIT) and execution time (END - START) are all visible.
+// Commands are grouped by the queue they ran on (one lane per queue) and by stage name.
+// Records can be dumped as Chrome trace JSON (chrome://tracing, Perfetto) or CSV, and summarized
+// as per-stage percentiles over many iterations. The queues must have CL_QUEUE_PROFILING_ENABLE.
+
+#define OCL_PROFILER_NAME_LEN 48
+#define OCL_PROFILER_MAX_LANES 16
+
+typedef struct
+{
+    char stage[OCL_PROFILER_NAME_LEN];
+    int lane;            // Index of the queue in the profiler's lane table
+    int iteration;       // Request or frame number given by the caller
+    cl_ulong queued;     // Device timestamps in nanoseconds
+    cl_ulong submit;
+    cl_ulong start;
+    cl_ulong end;
+} ocl_profile_record;
+
+typedef struct
+{
+    ocl_profile_record* records;
+    int num_records;
+    int capacity;
+    cl_command_queue lanes[OCL_PROFILER_MAX_LANES];
+    char lane_names[OCL_PROFILER_MAX_LANES][OCL_PROFILER_NAME_LEN];
+    int num_lanes;
+} ocl_profiler;
+
+void ocl_profiler_init(ocl_profiler* profiler);
+void ocl_profiler_release(ocl_profiler* profiler);
+
+// Names the lane of a queue in the exports (queues seen first in ocl_profiler_record are "queue N")
+void ocl_profiler_name_queue(ocl_profiler* profiler, cl_command_queue queue, const char* name);
+
+// Records a completed command. NULL events are ignored. Returns the clGetEventProfilingInfo error, if any.
+cl_int ocl_profiler_record(ocl_profiler* profiler, const char* stage, int iteration, cl_event event);
+
+// Chrome trace JSON: one slice per command on its queue's lane, plus its QUEUED -> START wait on a
+// "<lane> wait" lane. Timestamps are microseconds from the first QUEUED. Returns 0 on success.
+int ocl_profiler_write_chrome_trace(const ocl_profiler* profiler, const char* path);
+
+// CSV: one row per command with the raw nanosecond timestamps and the derived durations. Returns 0 on success.
+int ocl_profiler_write_csv(const ocl_profiler* profiler, const char* path);
+
+// Writes Chrome trace JSON for .json paths, CSV otherwise
+int ocl_profiler_write(const ocl_profiler* profiler, const char* path);
+
+// Prints, per stage, the p50/p90/p99/max of the execution time, launch latency and device wait,
+// and per lane the busy time, the idle gaps between commands and the utilization over the timeline
+void ocl_profiler_print_summary(const ocl_profiler* profiler);
+
+#endif
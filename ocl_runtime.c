@@ -0,0 +1,367 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ocl_runtime.h"
+#include "program_cache.h"
+
+#ifndef OCL_KERNEL_DIR
+#define OCL_KERNEL_DIR ".."
+#endif
+
+#define KERNEL_PATH_LEN 1024
+
+
+
+const char* ocl_error_string(cl_int err)
+{
+    switch (err)
+    {
+    case CL_SUCCESS: return "CL_SUCCESS";
+    case CL_DEVICE_NOT_FOUND: return "CL_DEVICE_NOT_FOUND";
+    case CL_DEVICE_NOT_AVAILABLE: return "CL_DEVICE_NOT_AVAILABLE";
+    case CL_COMPILER_NOT_AVAILABLE: return "CL_COMPILER_NOT_AVAILABLE";
+    case CL_MEM_OBJECT_ALLOCATION_FAILURE: return "CL_MEM_OBJECT_ALLOCATION_FAILURE";
+    case CL_OUT_OF_RESOURCES: return "CL_OUT_OF_RESOURCES";
+    case CL_OUT_OF_HOST_MEMORY: return "CL_OUT_OF_HOST_MEMORY";
+    case CL_PROFILING_INFO_NOT_AVAILABLE: return "CL_PROFILING_INFO_NOT_AVAILABLE";
+    case CL_MEM_COPY_OVERLAP: return "CL_MEM_COPY_OVERLAP";
+    case CL_IMAGE_FORMAT_MISMATCH: return "CL_IMAGE_FORMAT_MISMATCH";
+    case CL_IMAGE_FORMAT_NOT_SUPPORTED: return "CL_IMAGE_FORMAT_NOT_SUPPORTED";
+    case CL_BUILD_PROGRAM_FAILURE: return "CL_BUILD_PROGRAM_FAILURE";
+    case CL_MAP_FAILURE: return "CL_MAP_FAILURE";
+    case CL_MISALIGNED_SUB_BUFFER_OFFSET: return "CL_MISALIGNED_SUB_BUFFER_OFFSET";
+    case CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST: return "CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST";
+    case CL_INVALID_VALUE: return "CL_INVALID_VALUE";
+    case CL_INVALID_DEVICE_TYPE: return "CL_INVALID_DEVICE_TYPE";
+    case CL_INVALID_PLATFORM: return "CL_INVALID_PLATFORM";
+    case CL_INVALID_DEVICE: return "CL_INVALID_DEVICE";
+    case CL_INVALID_CONTEXT: return "CL_INVALID_CONTEXT";
+    case CL_INVALID_QUEUE_PROPERTIES: return "CL_INVALID_QUEUE_PROPERTIES";
+    case CL_INVALID_COMMAND_QUEUE: return "CL_INVALID_COMMAND_QUEUE";
+    case CL_INVALID_HOST_PTR: return "CL_INVALID_HOST_PTR";
+    case CL_INVALID_MEM_OBJECT: return "CL_INVALID_MEM_OBJECT";
+    case CL_INVALID_IMAGE_FORMAT_DESCRIPTOR: return "CL_INVALID_IMAGE_FORMAT_DESCRIPTOR";
+    case CL_INVALID_IMAGE_SIZE: return "CL_INVALID_IMAGE_SIZE";
+    case CL_INVALID_SAMPLER: return "CL_INVALID_SAMPLER";
+    case CL_INVALID_BINARY: return "CL_INVALID_BINARY";
+    case CL_INVALID_BUILD_OPTIONS: return "CL_INVALID_BUILD_OPTIONS";
+    case CL_INVALID_PROGRAM: return "CL_INVALID_PROGRAM";
+    case CL_INVALID_PROGRAM_EXECUTABLE: return "CL_INVALID_PROGRAM_EXECUTABLE";
+    case CL_INVALID_KERNEL_NAME: return "CL_INVALID_KERNEL_NAME";
+    case CL_INVALID_KERNEL_DEFINITION: return "CL_INVALID_KERNEL_DEFINITION";
+    case CL_INVALID_KERNEL: return "CL_INVALID_KERNEL";
+    case CL_INVALID_ARG_INDEX: return "CL_INVALID_ARG_INDEX";
+    case CL_INVALID_ARG_VALUE: return "CL_INVALID_ARG_VALUE";
+    case CL_INVALID_ARG_SIZE: return "CL_INVALID_ARG_SIZE";
+    case CL_INVALID_KERNEL_ARGS: return "CL_INVALID_KERNEL_ARGS";
+    case CL_INVALID_WORK_DIMENSION: return "CL_INVALID_WORK_DIMENSION";
+    case CL_INVALID_WORK_GROUP_SIZE: return "CL_INVALID_WORK_GROUP_SIZE";
+    case CL_INVALID_WORK_ITEM_SIZE: return "CL_INVALID_WORK_ITEM_SIZE";
+    case CL_INVALID_GLOBAL_OFFSET: return "CL_INVALID_GLOBAL_OFFSET";
+    case CL_INVALID_EVENT_WAIT_LIST: return "CL_INVALID_EVENT_WAIT_LIST";
+    case CL_INVALID_EVENT: return "CL_INVALID_EVENT";
+    case CL_INVALID_OPERATION: return "CL_INVALID_OPERATION";
+    case CL_INVALID_BUFFER_SIZE: return "CL_INVALID_BUFFER_SIZE";
+    case CL_INVALID_GLOBAL_WORK_SIZE: return "CL_INVALID_GLOBAL_WORK_SIZE";
+    case CL_INVALID_PROPERTY: return "CL_INVALID_PROPERTY";
+    default: return "CL_UNKNOWN_ERROR";
+    }
+}
+
+void ocl_report_error(const char* call, cl_int err, const char* file, int line)
+{
+    fprintf(stderr, "%s:%d: %s failed: %s (%d)\n", file, line, call, ocl_error_string(err), err);
+}
+
+cl_int ocl_runtime_init(ocl_runtime* rt, const char* device_spec, cl_command_queue_properties queue_properties)
+{
+    device_candidate selected;
+    memset(rt, 0, sizeof(*rt));
+    if (select_device(device_spec, &selected) != 0)
+        return CL_DEVICE_NOT_FOUND;
+    return ocl_runtime_init_device(rt, &selected, queue_properties);
+}
+
+cl_int ocl_runtime_init_device(ocl_runtime* rt, const device_candidate* device, cl_command_queue_properties queue_properties)
+{
+    cl_int err;
+    memset(rt, 0, sizeof(*rt));
+    rt->selected = *device;
+    rt->platform = device->platform;
+    rt->device = device->device;
+
+    // Cached capabilities; the device is only queried when it has no profile yet (measuring is left to device selection)
+    OCL_CHECK(device_profile_get(rt->device, &rt->profile, 0, 0));
+    rt->max_work_group_size = rt->profile.max_work_group_size;
+    rt->local_mem_size = rt->profile.local_mem_size;
+    rt->max_mem_alloc_size = rt->profile.max_mem_alloc_size;
+    rt->global_mem_size = rt->profile.global_mem_size;
+    rt->host_unified_memory = rt->profile.host_unified_memory;
+
+    rt->context = clCreateContext(NULL, 1, &rt->device, NULL, NULL, &err);
+    if (!rt->context)
+    {
+        ocl_report_error("clCreateContext", err, __FILE__, __LINE__);
+        return err;
+    }
+    rt->queue = clCreateCommandQueue(rt->context, rt->device, queue_properties, &err);
+    if (!rt->queue)
+    {
+        ocl_report_error("clCreateCommandQueue", err, __FILE__, __LINE__);
+        clReleaseContext(rt->context);
+        rt->context = NULL;
+        return err;
+    }
+
+    // Free buffers are kept up to a quarter of device memory, at most BUFFER_POOL_DEFAULT_CACHE_MB
+    size_t cache_limit = (size_t)BUFFER_POOL_DEFAULT_CACHE_MB * 1024 * 1024;
+    if (rt->global_mem_size / 4 < cache_limit)
+        cache_limit = (size_t)(rt->global_mem_size / 4);
+    buffer_pool_init(&rt->buffers, rt->context, cache_limit, (size_t)rt->max_mem_alloc_size);
+    return CL_SUCCESS;
+}
+
+void ocl_runtime_release(ocl_runtime* rt)
+{
+    for (int i = 0; i < rt->num_kernels; i++)
+    {
+        clReleaseKernel(rt->kernels[i].kernel);
+        free(rt->kernels[i].name);
+    }
+    for (int i = 0; i < rt->num_programs; i++)
+    {
+        clReleaseProgram(rt->programs[i].program);
+        free(rt->programs[i].key);
+    }
+    buffer_pool_release(&rt->buffers);
+    if (rt->queue)
+        clReleaseCommandQueue(rt->queue);
+    if (rt->context)
+        clReleaseContext(rt->context);
+    memset(rt, 0, sizeof(*rt));
+}
+
+cl_program ocl_runtime_program(ocl_runtime* rt, const char* name, const char* source, const char* options, cl_int* err)
+{
+    size_t key_length = strlen(name) + (options ? strlen(options) : 0) + 2;
+    char* key = (char*)malloc(key_length);
+    snprintf(key, key_length, "%s\n%s", name, options ? options : "");
+
+    for (int i = 0; i < rt->num_programs; i++)
+    {
+        if (strcmp(rt->programs[i].key, key) == 0)
+        {
+            free(key);
+            rt->programs[i].refs++;
+            if (err)
+                *err = CL_SUCCESS;
+            return rt->programs[i].program;
+        }
+    }
+
+    if (rt->num_programs == OCL_RUNTIME_MAX_PROGRAMS)
+    {
+        fprintf(stderr, "Error: Program registry is full (%d programs)\n", OCL_RUNTIME_MAX_PROGRAMS);
+        free(key);
+        if (err)
+            *err = CL_OUT_OF_HOST_MEMORY;
+        return NULL;
+    }
+
+    cl_program program = build_program_cached(rt->context, rt->device, source, options, NULL, err);
+    if (!program)
+    {
+        free(key);
+        return NULL;
+    }
+    rt->programs[rt->num_programs].key = key;
+    rt->programs[rt->num_programs].program = program;
+    rt->programs[rt->num_programs].refs = 1;
+    rt->num_programs++;
+    return program;
+}
+
+cl_program ocl_runtime_program_file(ocl_runtime* rt, const char* filename, const char* options, cl_int* err)
+{
+    // Registered programs are found by name without touching the file again
+    size_t key_length = strlen(filename) + (options ? strlen(options) : 0) + 2;
+    char* key = (char*)malloc(key_length);
+    snprintf(key, key_length, "%s\n%s", filename, options ? options : "");
+    for (int i = 0; i < rt->num_programs; i++)
+    {
+        if (strcmp(rt->programs[i].key, key) == 0)
+        {
+            free(key);
+            rt->programs[i].refs++;
+            if (err)
+                *err = CL_SUCCESS;
+            return rt->programs[i].program;
+        }
+    }
+    free(key);
+
+    char path[KERNEL_PATH_LEN];
+    ocl_kernel_path(filename, path, sizeof(path));
+    char* source = read_kernel_source(path);
+    if (!source)
+    {
+        if (err)
+            *err = CL_INVALID_VALUE;
+        return NULL;
+    }
+    cl_program program = ocl_runtime_program(rt, filename, source, options, err);
+    free(source);
+    return program;
+}
+
+static ocl_program_entry* find_program(ocl_runtime* rt, cl_program program)
+{
+    for (int i = 0; i < rt->num_programs; i++)
+    {
+        if (rt->programs[i].program == program)
+            return &rt->programs[i];
+    }
+    return NULL;
+}
+
+cl_kernel ocl_runtime_kernel(ocl_runtime* rt, cl_program program, const char* name, cl_int* err)
+{
+    ocl_program_entry* owner = find_program(rt, program);
+    for (int i = 0; i < rt->num_kernels; i++)
+    {
+        if (rt->kernels[i].program == program && strcmp(rt->kernels[i].name, name) == 0)
+        {
+            rt->kernels[i].refs++;
+            if (owner)
+                owner->refs++;
+            if (err)
+                *err = CL_SUCCESS;
+            return rt->kernels[i].kernel;
+        }
+    }
+
+    if (rt->num_kernels == OCL_RUNTIME_MAX_KERNELS)
+    {
+        fprintf(stderr, "Error: Kernel registry is full (%d kernels)\n", OCL_RUNTIME_MAX_KERNELS);
+        if (err)
+            *err = CL_OUT_OF_HOST_MEMORY;
+        return NULL;
+    }
+
+    cl_int status;
+    cl_kernel kernel = clCreateKernel(program, name, &status);
+    if (err)
+        *err = status;
+    if (!kernel)
+    {
+        fprintf(stderr, "Error: Could not create kernel %s: %s (%d)\n", name, ocl_error_string(status), status);
+        return NULL;
+    }
+    rt->kernels[rt->num_kernels].program = program;
+    rt->kernels[rt->num_kernels].name = strdup(name);
+    rt->kernels[rt->num_kernels].kernel = kernel;
+    rt->kernels[rt->num_kernels].refs = 1;
+    rt->num_kernels++;
+    if (owner)
+        owner->refs++;
+    return kernel;
+}
+
+void ocl_runtime_release_program(ocl_runtime* rt, cl_program program)
+{
+    ocl_program_entry* entry = program ? find_program(rt, program) : NULL;
+    if (!entry || --entry->refs > 0)
+        return;
+    clReleaseProgram(entry->program);
+    free(entry->key);
+    // Entries are unordered: the last one takes the free slot
+    *entry = rt->programs[--rt->num_programs];
+}
+
+void ocl_runtime_release_kernel(ocl_runtime* rt, cl_kernel kernel)
+{
+    for (int i = 0; kernel && i < rt->num_kernels; i++)
+    {
+        if (rt->kernels[i].kernel != kernel)
+            continue;
+        cl_program program = rt->kernels[i].program;
+        if (--rt->kernels[i].refs == 0)
+        {
+            clReleaseKernel(kernel);
+            free(rt->kernels[i].name);
+            rt->kernels[i] = rt->kernels[--rt->num_kernels];
+        }
+        ocl_runtime_release_program(rt, program);
+        return;
+    }
+}
+
+cl_mem ocl_runtime_buffer(ocl_runtime* rt, cl_mem_flags flags, size_t size, void* host_ptr, cl_int* err)
+{
+    cl_int status;
+    cl_mem buffer = clCreateBuffer(rt->context, flags, size, host_ptr, &status);
+    if (err)
+        *err = status;
+    if (!buffer)
+    {
+        fprintf(stderr, "Error: Could not create a %zu byte buffer: %s (%d)\n", size, ocl_error_string(status), status);
+    }
+    return buffer;
+}
+
+cl_mem ocl_runtime_acquire(ocl_runtime* rt, cl_mem_flags flags, size_t size, cl_int* err)
+{
+    return buffer_pool_acquire(&rt->buffers, flags, size, err);
+}
+
+void ocl_runtime_recycle(ocl_runtime* rt, cl_mem buffer)
+{
+    buffer_pool_recycle(&rt->buffers, buffer);
+}
+
+void ocl_kernel_path(const char* filename, char* path, size_t path_size)
+{
+    const char* env_dir = getenv("OCL_KERNEL_DIR");
+    const char* dirs[3] = { env_dir, OCL_KERNEL_DIR, ".." };
+    for (int i = 0; i < 3; i++)
+    {
+        if (!dirs[i] || !dirs[i][0])
+            continue;
+        snprintf(path, path_size, "%s/%s", dirs[i], filename);
+        if (access(path, R_OK) == 0)
+            return;
+    }
+    snprintf(path, path_size, "../%s", filename);
+}
+
+// Function to read kernel source from file
+char* read_kernel_source(const char* filename)
+{
+    FILE* file = fopen(filename, "r");
+    if (!file)
+    {
+        fprintf(stderr, "Error: Could not open kernel file %s\n", filename);
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char* source = (char*)malloc(length + 1);
+    if (!source)
+    {
+        fprintf(stderr, "Error: Could not allocate memory for kernel source\n");
+        fclose(file);
+        return NULL;
+    }
+
+    size_t read_length = fread(source, 1, length, file);
+    source[read_length] = '\0'; // Null-terminate the string
+
+    fclose(file);
+    return source;
+}
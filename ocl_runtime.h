@@ -0,0 +1,133 @@
+#ifndef OCL_RUNTIME_H
+#define OCL_RUNTIME_H
+
+#include <stdio.h>
+#include <CL/cl.h>
+
+#include "device_select.h"
+#include "device_profile.h"
+#include "buffer_pool.h"
+
+// Long-lived OpenCL runtime: one device, context and in-order queue, plus a registry of built
+// programs and kernels so repeated requests reuse them instead of rebuilding, and a pool that
+// recycles buffers between requests (buffer_pool.h).
+// Kernels from the registry are shared: setting their arguments is not thread-safe.
+// Registry entries are reference counted: every lookup takes a reference that the caller gives back
+// with ocl_runtime_release_program/ocl_runtime_release_kernel, so engines created per request
+// (a sweep, a filter per call) do not fill the registry. ocl_runtime_release drops whatever is left.
+
+#define OCL_RUNTIME_MAX_PROGRAMS 32     // Programs in use at the same time
+#define OCL_RUNTIME_MAX_KERNELS 64
+
+typedef struct
+{
+    char* key;             // "<name>\n<options>"
+    cl_program program;
+    int refs;              // Lookups not yet released, plus one per registered kernel of the program
+} ocl_program_entry;
+
+typedef struct
+{
+    cl_program program;
+    char* name;
+    cl_kernel kernel;
+    int refs;
+} ocl_kernel_entry;
+
+typedef struct
+{
+    device_candidate selected;
+    cl_platform_id platform;
+    cl_device_id device;
+    cl_context context;
+    cl_command_queue queue;
+
+    // Device capabilities from the cached profile (device_profile.h), and the limits used most, read once at startup
+    device_profile profile;
+    size_t max_work_group_size;
+    cl_ulong local_mem_size;
+    cl_ulong max_mem_alloc_size;
+    cl_ulong global_mem_size;
+    cl_bool host_unified_memory;   // Device shares physical memory with the host (integrated GPU, CPU device)
+
+    ocl_program_entry programs[OCL_RUNTIME_MAX_PROGRAMS];
+    int num_programs;
+    ocl_kernel_entry kernels[OCL_RUNTIME_MAX_KERNELS];
+    int num_kernels;
+
+    buffer_pool buffers;           // Recycled buffers of the context; thread-safe
+} ocl_runtime;
+
+// Human-readable name of an OpenCL error code
+const char* ocl_error_string(cl_int err);
+
+// Prints "file:line: call failed: CL_..." to stderr
+void ocl_report_error(const char* call, cl_int err, const char* file, int line);
+
+// Evaluates an OpenCL call returning cl_int; on failure reports it and returns the error from the enclosing function
+#define OCL_CHECK(call)                                                 \
+    do                                                                  \
+    {                                                                   \
+        cl_int ocl_check_err_ = (call);                                 \
+        if (ocl_check_err_ != CL_SUCCESS)                               \
+        {                                                               \
+            ocl_report_error(#call, ocl_check_err_, __FILE__, __LINE__); \
+            return ocl_check_err_;                                      \
+        }                                                               \
+    } while (0)
+
+// Same as OCL_CHECK, but jumps to label instead of returning (for functions that own resources).
+// err must be a cl_int in scope; it keeps the failing code.
+#define OCL_CHECK_GOTO(call, err, label)                                \
+    do                                                                  \
+    {                                                                   \
+        (err) = (call);                                                 \
+        if ((err) != CL_SUCCESS)                                        \
+        {                                                               \
+            ocl_report_error(#call, (err), __FILE__, __LINE__);         \
+            goto label;                                                 \
+        }                                                               \
+    } while (0)
+
+// Selects a device (see select_device for device_spec) and creates the context and queue.
+// Returns CL_SUCCESS or an OpenCL error (CL_DEVICE_NOT_FOUND when no device matches).
+cl_int ocl_runtime_init(ocl_runtime* rt, const char* device_spec, cl_command_queue_properties queue_properties);
+
+// Same, on an already chosen device
+cl_int ocl_runtime_init_device(ocl_runtime* rt, const device_candidate* device, cl_command_queue_properties queue_properties);
+
+// Releases every registered kernel and program, the pooled buffers, the queue and the context
+void ocl_runtime_release(ocl_runtime* rt);
+
+// Returns the program registered under (name, options), building it from source (through the
+// program binary cache) on first use. The runtime owns the returned program; the caller holds a
+// reference until ocl_runtime_release_program.
+cl_program ocl_runtime_program(ocl_runtime* rt, const char* name, const char* source, const char* options, cl_int* err);
+
+// Same, reading the source from a .cl file looked up in the kernel directory (see ocl_kernel_path)
+cl_program ocl_runtime_program_file(ocl_runtime* rt, const char* filename, const char* options, cl_int* err);
+
+// Returns the kernel registered for (program, name), creating it on first use. The runtime owns it;
+// the caller holds a reference until ocl_runtime_release_kernel, and the kernel keeps its program alive.
+cl_kernel ocl_runtime_kernel(ocl_runtime* rt, cl_program program, const char* name, cl_int* err);
+
+// Give back a reference taken by ocl_runtime_program(_file) or ocl_runtime_kernel. The last one
+// releases the OpenCL object and frees its registry slot. NULL and unregistered objects are ignored.
+void ocl_runtime_release_program(ocl_runtime* rt, cl_program program);
+void ocl_runtime_release_kernel(ocl_runtime* rt, cl_kernel kernel);
+
+// Creates a buffer, reporting failures. Returns NULL on error.
+cl_mem ocl_runtime_buffer(ocl_runtime* rt, cl_mem_flags flags, size_t size, void* host_ptr, cl_int* err);
+
+// Buffers that come and go with requests: taken from and given back to the runtime's pool.
+// ocl_runtime_recycle also releases objects the pool did not hand out.
+cl_mem ocl_runtime_acquire(ocl_runtime* rt, cl_mem_flags flags, size_t size, cl_int* err);
+void ocl_runtime_recycle(ocl_runtime* rt, cl_mem buffer);
+
+// Resolves a kernel file name: $OCL_KERNEL_DIR, then the source directory baked in at build time, then "..".
+void ocl_kernel_path(const char* filename, char* path, size_t path_size);
+
+// Reads a whole text file into a malloc'd, null-terminated string. Returns NULL on error.
+char* read_kernel_source(const char* filename);
+
+#endif
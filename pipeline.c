@@ -0,0 +1,398 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// OpenCL Include
+#include <CL/cl.h>
+
+#include "commons.h"
+#include "cpu_blur.h"
+#include "ocl_runtime.h"
+#include "blur_engine.h"
+#include "image_pipeline.h"
+#include "image_io.h"
+#include "verify.h"
+
+
+
+// Function to return a monotonic wall-clock time in seconds
+static double wall_time_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+// The same stages as separate launches, one single-stage fused kernel per stage, chained through
+// device buffers: what the pipeline would cost without fusion
+typedef struct
+{
+    ocl_runtime* rt;
+    int num_stages;
+    image_pipeline views[IMAGE_PIPELINE_MAX_STAGES];
+    pipeline_engine engines[IMAGE_PIPELINE_MAX_STAGES];
+    cl_mem buffers[IMAGE_PIPELINE_MAX_STAGES + 1];   // Stage i reads buffers[i] and writes buffers[i + 1]
+    int widths[IMAGE_PIPELINE_MAX_STAGES + 1];
+    int heights[IMAGE_PIPELINE_MAX_STAGES + 1];
+    size_t traffic_bytes;                            // Global memory read and written by all the stages
+} stage_chain;
+
+static void stage_chain_release(stage_chain* chain)
+{
+    for (int i = 0; i < chain->num_stages; i++)
+        pipeline_engine_release(&chain->engines[i]);
+    for (int i = 0; i <= chain->num_stages; i++)
+        ocl_runtime_recycle(chain->rt, chain->buffers[i]);
+    memset(chain, 0, sizeof(*chain));
+}
+
+static cl_int stage_chain_init(stage_chain* chain, ocl_runtime* rt, const image_pipeline* pipeline, int width, int height, int channels)
+{
+    cl_int err;
+    memset(chain, 0, sizeof(*chain));
+    chain->rt = rt;
+    chain->widths[0] = width;
+    chain->heights[0] = height;
+    for (int i = 0; i < pipeline->num_stages; i++)
+    {
+        image_pipeline_stage_view(pipeline, i, &chain->views[i]);
+        image_pipeline_output_size(&chain->views[i], chain->widths[i], chain->heights[i], &chain->widths[i + 1], &chain->heights[i + 1]);
+    }
+    for (int i = 0; i < pipeline->num_stages; i++)
+    {
+        err = pipeline_engine_init(&chain->engines[i], rt, &chain->views[i], channels);
+        chain->num_stages = i + 1;
+        if (err != CL_SUCCESS)
+        {
+            stage_chain_release(chain);
+            return err;
+        }
+    }
+    for (int i = 0; i <= chain->num_stages; i++)
+    {
+        size_t bytes = (size_t)chain->widths[i] * chain->heights[i] * channels;
+        chain->buffers[i] = ocl_runtime_acquire(rt, CL_MEM_READ_WRITE, bytes, &err);
+        if (!chain->buffers[i])
+        {
+            stage_chain_release(chain);
+            return err;
+        }
+        chain->traffic_bytes += ((i == 0 || i == chain->num_stages) ? 1 : 2) * bytes;
+    }
+    return CL_SUCCESS;
+}
+
+// Write, every stage kernel and read; returns the summed kernel time through kernel_time_sec
+static cl_int stage_chain_run(stage_chain* chain, ocl_runtime* rt, const unsigned char* input, unsigned char* output, int channels,
+                              double* kernel_time_sec)
+{
+    cl_command_queue queue = rt->queue;
+    cl_event events[IMAGE_PIPELINE_MAX_STAGES + 2] = {NULL};
+    int n = chain->num_stages;
+    size_t input_bytes = (size_t)chain->widths[0] * chain->heights[0] * channels;
+    size_t output_bytes = (size_t)chain->widths[n] * chain->heights[n] * channels;
+    cl_int err;
+
+    OCL_CHECK_GOTO(clEnqueueWriteBuffer(queue, chain->buffers[0], CL_FALSE, 0, input_bytes, input, 0, NULL, &events[0]), err, done);
+    for (int i = 0; i < n; i++)
+    {
+        err = pipeline_engine_enqueue(&chain->engines[i], queue, chain->buffers[i], chain->buffers[i + 1], chain->widths[i], chain->heights[i],
+                                      1, &events[i], &events[i + 1]);
+        if (err != CL_SUCCESS)
+            goto done;
+    }
+    OCL_CHECK_GOTO(clEnqueueReadBuffer(queue, chain->buffers[n], CL_FALSE, 0, output_bytes, output, 1, &events[n], &events[n + 1]), err, done);
+    OCL_CHECK_GOTO(clWaitForEvents(1, &events[n + 1]), err, done);
+    for (int i = 1; i <= n; i++)
+        *kernel_time_sec += event_time_sec(events[i]);
+
+done:
+    if (err != CL_SUCCESS)
+        clFinish(queue);
+    for (int i = 0; i < n + 2; i++)
+    {
+        if (events[i])
+            clReleaseEvent(events[i]);
+    }
+    return err;
+}
+
+// Main Code
+int main(int argc, char** argv)
+{
+    // --stage spec       appends a stage (repeatable): a convolve filter, threshold:T, scale:GAIN[:OFFSET], invert or downsample:2|4
+    // --size WxH, --channels 1|3|4, --input file, --output file   as in run (the output has the pipeline's output size)
+    // --device spec      device override, as in run (or OCL_DEVICE)
+    // --cpu              host pipeline only; --threads N sets its thread count
+    // --repeat N         device requests to time (default 1)
+    // --unfused          also runs the stages as separate launches for comparison
+    // --tolerance N, --max-mismatches N   comparison settings, as in run
+    // --print-source     prints the generated OpenCL source
+    image_pipeline pipeline;
+    const char* device_spec = NULL;
+    const char* input_path = NULL;
+    const char* output_path = NULL;
+    int image_width = 1024;
+    int image_height = 1024;
+    int image_channels = 1;
+    int cpu_only = 0;
+    int num_threads = 0;
+    int repeat = 1;
+    int unfused = 0;
+    int print_source = 0;
+    verify_options verify;
+    verify_default_options(&verify);
+    image_pipeline_init(&pipeline);
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--stage") == 0 && i + 1 < argc)
+        {
+            if (image_pipeline_add(&pipeline, argv[++i]) != 0)
+            {
+                image_pipeline_release(&pipeline);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%dx%d", &image_width, &image_height) != 2 || image_width <= 0 || image_height <= 0)
+            {
+                fprintf(stderr, "Error: --size takes WxH\n");
+                image_pipeline_release(&pipeline);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "--channels") == 0 && i + 1 < argc)
+        {
+            image_channels = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc)
+        {
+            input_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            output_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc)
+        {
+            device_spec = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cpu") == 0)
+        {
+            cpu_only = 1;
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            num_threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+        {
+            repeat = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--unfused") == 0)
+        {
+            unfused = 1;
+        }
+        else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+        {
+            verify.tolerance = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-mismatches") == 0 && i + 1 < argc)
+        {
+            verify.max_mismatches = (size_t)strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--print-source") == 0)
+        {
+            print_source = 1;
+        }
+    }
+    if (image_channels != 1 && image_channels != 3 && image_channels != 4)
+    {
+        fprintf(stderr, "Error: --channels must be 1, 3 or 4\n");
+        image_pipeline_release(&pipeline);
+        return -1;
+    }
+    if (repeat < 1)
+    {
+        repeat = 1;
+    }
+    if (pipeline.num_stages == 0)
+    {
+        image_pipeline_add(&pipeline, "gaussian:1.0");
+        image_pipeline_add(&pipeline, "threshold:128");
+        image_pipeline_add(&pipeline, "downsample:2");
+    }
+    char description[256];
+    image_pipeline_describe(&pipeline, description, sizeof(description));
+    printf("Pipeline                                            : %s (halo %d)\n", description, pipeline.halo);
+
+    //------------------------------------------------------
+    // Image: a file or noise
+    //------------------------------------------------------
+    mapped_image input_file, output_file;
+    if (input_path)
+    {
+        if (image_file_open(input_path, image_width, image_height, image_channels, &input_file) != 0)
+        {
+            image_pipeline_release(&pipeline);
+            return -1;
+        }
+        image_width = input_file.width;
+        image_height = input_file.height;
+        image_channels = input_file.channels;
+        printf("Input image                                         : %s (%dx%d, %d channel(s))\n", input_path, image_width, image_height, image_channels);
+    }
+    int out_width, out_height;
+    image_pipeline_output_size(&pipeline, image_width, image_height, &out_width, &out_height);
+    if (out_width == 0)
+    {
+        fprintf(stderr, "Error: A %dx%d image is smaller than the downsampling factor %d\n", image_width, image_height, pipeline.factor);
+        if (input_path)
+            image_file_close(&input_file);
+        image_pipeline_release(&pipeline);
+        return -1;
+    }
+    if (output_path && image_file_create(output_path, image_file_format_from_path(output_path), out_width, out_height, image_channels, &output_file) != 0)
+    {
+        if (input_path)
+            image_file_close(&input_file);
+        image_pipeline_release(&pipeline);
+        return -1;
+    }
+    size_t image_bytes = (size_t)image_width * image_height * image_channels;
+    size_t output_bytes = (size_t)out_width * out_height * image_channels;
+    unsigned char* image = input_path ? input_file.pixels : (unsigned char*)malloc(image_bytes);
+    unsigned char* result_host = (unsigned char*)malloc(output_bytes);
+    unsigned char* result_device = NULL;
+    if (!input_path)
+    {
+        generate_noisy_image(image, image_width, image_height, image_channels);
+    }
+
+    //------------------------------------------------------
+    // Device pipeline
+    //------------------------------------------------------
+    ocl_runtime rt;
+    pipeline_engine engine;
+    int device_ready = 0;
+    if (!cpu_only && ocl_runtime_init(&rt, device_spec, CL_QUEUE_PROFILING_ENABLE) != CL_SUCCESS)
+    {
+        printf("No usable OpenCL device, running the host pipeline only\n");
+        cpu_only = 1;
+    }
+    if (!cpu_only)
+    {
+        if (pipeline_engine_init(&engine, &rt, &pipeline, image_channels) == CL_SUCCESS)
+        {
+            device_ready = 1;
+        }
+        else
+        {
+            fprintf(stderr, "Error: Could not set up the fused pipeline\n");
+            pipeline_engine_release(&engine);
+            ocl_runtime_release(&rt);
+            cpu_only = 1;
+        }
+    }
+    if (device_ready)
+    {
+        if (print_source)
+            printf("\n%s\n", engine.source);
+        result_device = output_path ? output_file.pixels : (unsigned char*)malloc(output_bytes);
+
+        printf("\n######### Device Profiling ################\n");
+        printf("Device                                              : %s\n", rt.selected.device_name);
+        printf("Work-group                                          : %zux%zu, %zu bytes of local memory\n", engine.local_work_size[0],
+               engine.local_work_size[1], image_pipeline_local_bytes(&pipeline, image_channels, (int)engine.local_work_size[0], (int)engine.local_work_size[1]));
+        double kernel_time_sec = 0.0;
+        double start = wall_time_sec();
+        for (int r = 0; r < repeat; r++)
+        {
+            cl_event kernel_event = NULL;
+            if (pipeline_engine_run(&engine, image, result_device, image_width, image_height, &kernel_event) != CL_SUCCESS)
+            {
+                fprintf(stderr, "Error: Device pipeline failed\n");
+                break;
+            }
+            kernel_time_sec += event_time_sec(kernel_event);
+            clReleaseEvent(kernel_event);
+        }
+        double wall_time_sec_device = (wall_time_sec() - start) / repeat;
+        printf("Fused Kernel Execution Time                         : %f seconds\n", kernel_time_sec / repeat);
+        printf("Fused Global Memory Traffic                         : %.1f MB\n", (image_bytes + output_bytes) / 1e6);
+        printf("Time taken for the pipeline on device               : %f seconds\n", wall_time_sec_device);
+
+        stage_chain chain;
+        if (unfused && stage_chain_init(&chain, &rt, &pipeline, image_width, image_height, image_channels) == CL_SUCCESS)
+        {
+            unsigned char* result_chain = (unsigned char*)malloc(output_bytes);
+            double chain_time_sec = 0.0;
+            for (int r = 0; r < repeat; r++)
+            {
+                if (stage_chain_run(&chain, &rt, image, result_chain, image_channels, &chain_time_sec) != CL_SUCCESS)
+                {
+                    fprintf(stderr, "Error: Unfused device pipeline failed\n");
+                    break;
+                }
+            }
+            printf("Unfused Kernel Execution Time (%2d launches)         : %f seconds\n", chain.num_stages, chain_time_sec / repeat);
+            printf("Unfused Global Memory Traffic                       : %.1f MB\n", chain.traffic_bytes / 1e6);
+            if (memcmp(result_chain, result_device, output_bytes) != 0)
+                printf("Warning: The unfused and fused results differ\n");
+            free(result_chain);
+            stage_chain_release(&chain);
+        }
+        else if (unfused)
+        {
+            fprintf(stderr, "Error: Could not set up the unfused pipeline\n");
+        }
+    }
+
+    //------------------------------------------------------
+    // Host pipeline and comparison
+    //------------------------------------------------------
+    printf("\n######### Host Profiling ################\n");
+    cpu_thread_pool* pool = cpu_thread_pool_create(num_threads);
+    double start = wall_time_sec();
+    image_pipeline_apply_host(pool, &pipeline, image, result_host, image_width, image_height, image_channels);
+    printf("Time taken for the pipeline on host                 : %f seconds (%d threads)\n", wall_time_sec() - start,
+           cpu_thread_pool_size(pool));
+
+    int passed = 1;
+    if (device_ready)
+    {
+        verify_result comparison;
+        printf("\n######### Comparison: Device vs Host ################\n");
+        passed = verify_images(pool, result_host, result_device, output_bytes, &verify, &comparison);
+        verify_print(&comparison, &verify, result_host, result_device, output_bytes, out_width, image_channels);
+    }
+    else if (output_path)
+    {
+        memcpy(output_file.pixels, result_host, output_bytes);
+    }
+
+    // Clean up
+    if (device_ready)
+    {
+        pipeline_engine_release(&engine);
+        ocl_runtime_release(&rt);
+        if (!output_path)
+            free(result_device);
+    }
+    if (output_path)
+    {
+        image_file_close(&output_file);
+        printf("Result written to %s (%dx%d)\n", output_path, out_width, out_height);
+    }
+    if (input_path)
+        image_file_close(&input_file);
+    else
+        free(image);
+    cpu_thread_pool_destroy(pool);
+    free(result_host);
+    image_pipeline_release(&pipeline);
+    return passed ? 0 : 1;
+}
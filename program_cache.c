@@ -0,0 +1,243 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "program_cache.h"
+
+#define CACHE_MAGIC "OCLBIN01"
+#define CACHE_PATH_LEN 1024
+#define INFO_STRING_LEN 1024
+
+
+
+// FNV-1a, 64 bit. Strings are hashed with their terminator so ("ab", "c") and ("a", "bc") differ.
+static unsigned long long hash_string(unsigned long long hash, const char* text)
+{
+    const unsigned char* p = (const unsigned char*)(text ? text : "");
+    do
+    {
+        hash ^= *p;
+        hash *= 0x100000001b3ULL;
+    } while (*p++);
+    return hash;
+}
+
+// Device identity: name plus driver, device and platform versions
+static unsigned long long hash_device(unsigned long long hash, cl_device_id device)
+{
+    char info[INFO_STRING_LEN];
+    cl_platform_id platform;
+
+    clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(info), info, NULL);
+    hash = hash_string(hash, info);
+    clGetDeviceInfo(device, CL_DRIVER_VERSION, sizeof(info), info, NULL);
+    hash = hash_string(hash, info);
+    clGetDeviceInfo(device, CL_DEVICE_VERSION, sizeof(info), info, NULL);
+    hash = hash_string(hash, info);
+    clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(platform), &platform, NULL);
+    clGetPlatformInfo(platform, CL_PLATFORM_VERSION, sizeof(info), info, NULL);
+    hash = hash_string(hash, info);
+    return hash;
+}
+
+static unsigned long long cache_key(cl_device_id device, const char* source, const char* options)
+{
+    unsigned long long hash = 0xcbf29ce484222325ULL;
+    hash = hash_string(hash, source);
+    hash = hash_string(hash, options);
+    return hash_device(hash, device);
+}
+
+unsigned long long device_cache_key(cl_device_id device)
+{
+    return hash_device(0xcbf29ce484222325ULL, device);
+}
+
+void program_cache_dir(char* path, size_t path_size)
+{
+    const char* disable = getenv("OCL_CACHE_DISABLE");
+    const char* dir = getenv("OCL_CACHE_DIR");
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+
+    path[0] = '\0';
+    if (disable && strcmp(disable, "0") != 0)
+        return;
+    if (dir && dir[0])
+        snprintf(path, path_size, "%s", dir);
+    else if (xdg && xdg[0])
+        snprintf(path, path_size, "%s/opencl_basics", xdg);
+    else if (home && home[0])
+        snprintf(path, path_size, "%s/.cache/opencl_basics", home);
+}
+
+// mkdir -p
+int program_cache_make_dirs(const char* path)
+{
+    char partial[CACHE_PATH_LEN];
+    size_t length = strlen(path);
+    if (length == 0 || length >= sizeof(partial))
+        return -1;
+    memcpy(partial, path, length + 1);
+    for (size_t i = 1; i <= length; i++)
+    {
+        if (partial[i] == '/' || partial[i] == '\0')
+        {
+            char saved = partial[i];
+            partial[i] = '\0';
+            if (mkdir(partial, 0755) != 0 && errno != EEXIST)
+                return -1;
+            partial[i] = saved;
+        }
+    }
+    return 0;
+}
+
+// Reads a cache entry. Returns a malloc'd binary and its size, or NULL on a miss.
+static unsigned char* read_cache_entry(const char* path, unsigned long long key, size_t* binary_size)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+
+    char magic[8];
+    unsigned long long stored_key = 0;
+    unsigned long long stored_size = 0;
+    unsigned char* binary = NULL;
+    if (fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, CACHE_MAGIC, sizeof(magic)) == 0 &&
+        fread(&stored_key, sizeof(stored_key), 1, file) == 1 && stored_key == key &&
+        fread(&stored_size, sizeof(stored_size), 1, file) == 1 && stored_size > 0)
+    {
+        binary = (unsigned char*)malloc(stored_size);
+        if (binary && fread(binary, 1, stored_size, file) == stored_size)
+        {
+            *binary_size = stored_size;
+        }
+        else
+        {
+            free(binary);
+            binary = NULL;
+        }
+    }
+    fclose(file);
+    return binary;
+}
+
+// Writes a cache entry through a temporary file and rename, so concurrent jobs never read a partial binary
+static void write_cache_entry(const char* dir, const char* path, unsigned long long key, const unsigned char* binary, size_t binary_size)
+{
+    char temp_path[CACHE_PATH_LEN + 32];
+    if (program_cache_make_dirs(dir) != 0)
+        return;
+    snprintf(temp_path, sizeof(temp_path), "%s.%ld.tmp", path, (long)getpid());
+
+    FILE* file = fopen(temp_path, "wb");
+    if (!file)
+        return;
+    unsigned long long stored_size = binary_size;
+    int ok = fwrite(CACHE_MAGIC, 1, 8, file) == 8 &&
+             fwrite(&key, sizeof(key), 1, file) == 1 &&
+             fwrite(&stored_size, sizeof(stored_size), 1, file) == 1 &&
+             fwrite(binary, 1, binary_size, file) == binary_size;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(temp_path, path) != 0)
+        remove(temp_path);
+}
+
+// Stores the binary of a freshly built single-device program
+static void store_program_binary(cl_program program, const char* dir, const char* path, unsigned long long key)
+{
+    size_t binary_size = 0;
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(binary_size), &binary_size, NULL) != CL_SUCCESS || binary_size == 0)
+        return;
+    unsigned char* binary = (unsigned char*)malloc(binary_size);
+    if (!binary)
+        return;
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binary), &binary, NULL) == CL_SUCCESS)
+        write_cache_entry(dir, path, key, binary, binary_size);
+    free(binary);
+}
+
+static void print_build_log(cl_program program, cl_device_id device)
+{
+    size_t log_size = 0;
+    clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+    char* log = (char*)malloc(log_size + 1);
+    if (!log)
+        return;
+    log[0] = '\0';
+    clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size, log, NULL);
+    log[log_size] = '\0';
+    fprintf(stderr, "Error: Kernel build failed:\n%s\n", log);
+    free(log);
+}
+
+cl_program build_program_cached(cl_context context, cl_device_id device, const char* source, const char* options,
+                                int* cache_hit, cl_int* err)
+{
+    char dir[CACHE_PATH_LEN];
+    char path[CACHE_PATH_LEN + 32];
+    unsigned long long key = cache_key(device, source, options);
+    cl_int status;
+
+    if (cache_hit)
+        *cache_hit = 0;
+    program_cache_dir(dir, sizeof(dir));
+    snprintf(path, sizeof(path), "%s/%016llx.bin", dir, key);
+
+    // Warm path: load the stored binary. A rejected binary (e.g. stale after a driver change
+    // that kept the version string) falls through to a source build, which overwrites it.
+    if (dir[0])
+    {
+        size_t binary_size = 0;
+        unsigned char* binary = read_cache_entry(path, key, &binary_size);
+        if (binary)
+        {
+            cl_int binary_status;
+            cl_program program = clCreateProgramWithBinary(context, 1, &device, &binary_size,
+                                                           (const unsigned char**)&binary, &binary_status, &status);
+            free(binary);
+            if (program && status == CL_SUCCESS && binary_status == CL_SUCCESS &&
+                clBuildProgram(program, 1, &device, options, NULL, NULL) == CL_SUCCESS)
+            {
+                if (cache_hit)
+                    *cache_hit = 1;
+                if (err)
+                    *err = CL_SUCCESS;
+                return program;
+            }
+            if (program)
+                clReleaseProgram(program);
+        }
+    }
+
+    // Cold path: build from source and store the result
+    cl_program program = clCreateProgramWithSource(context, 1, &source, NULL, &status);
+    if (!program)
+    {
+        fprintf(stderr, "Error: Could not create program from source (%d)\n", status);
+        if (err)
+            *err = status;
+        return NULL;
+    }
+    status = clBuildProgram(program, 1, &device, options, NULL, NULL);
+    if (status != CL_SUCCESS)
+    {
+        print_build_log(program, device);
+        clReleaseProgram(program);
+        if (err)
+            *err = status;
+        return NULL;
+    }
+
+    if (dir[0])
+        store_program_binary(program, dir, path, key);
+    if (err)
+        *err = CL_SUCCESS;
+    return program;
+}
@@ -0,0 +1,28 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <CL/cl.h>
+
+// On-disk cache of compiled program binaries (CL_PROGRAM_BINARIES).
+// Entries are keyed by a hash of the source, the build options, the device name and
+// the driver/device/platform versions, so a driver update or a source edit misses cleanly.
+// The cache lives in $OCL_CACHE_DIR, else $XDG_CACHE_HOME/opencl_basics, else ~/.cache/opencl_basics.
+// OCL_CACHE_DISABLE=1 always builds from source.
+
+// Builds source for one device. A cached binary is loaded through clCreateProgramWithBinary when
+// present; otherwise the program is built from source and its binary is stored for the next run.
+// On failure the build log is printed, NULL is returned and *err holds the OpenCL error.
+// cache_hit (optional) is set to 1 when the binary came from the cache.
+cl_program build_program_cached(cl_context context, cl_device_id device, const char* source, const char* options,
+                                int* cache_hit, cl_int* err);
+
+// Hash of the device identity (name, driver/device/platform versions) for other per-device cache files
+unsigned long long device_cache_key(cl_device_id device);
+
+// Writes the cache directory in use into path (empty string when the cache is disabled)
+void program_cache_dir(char* path, size_t path_size);
+
+// Creates path and its missing parents (mkdir -p). Returns 0 on success.
+int program_cache_make_dirs(const char* path);
+
+#endif
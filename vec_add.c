@@ -1,194 +1,244 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <CL/cl.h>
 
+#include "ocl_runtime.h"
+#include "host_buffer.h"
+#include "autotune.h"
+#include "vec_ops.h"
+
 #define STRING_BUFFER_LEN 1024
 
-//-------------------
-// 1. Kernel Code
-//-------------------
-const char* kernelSource =
-"__kernel void vector_add(__global const float* A,          \n"
-"                         __global const float* B,          \n"
-"                         __global float* C,                \n"
-"                         __local float* localA,            \n"
-"                         __local float* localB)            \n"
-"{                                                          \n"
-"    int global_id = get_global_id(0);                      \n"
-"    int local_id  = get_local_id(0);                       \n"
-"    int group_size = get_local_size(0);                    \n"
-"                                                          \n"
-"    // Load from global memory into local memory           \n"
-"    localA[local_id] = A[global_id];                       \n"
-"    localB[local_id] = B[global_id];                       \n"
-"                                                          \n"
-"    // Synchronize to make sure data is in local memory    \n"
-"    barrier(CLK_LOCAL_MEM_FENCE);                          \n"
-"                                                          \n"
-"    // Perform the addition                                \n"
-"    C[global_id] = localA[local_id] + localB[local_id];    \n"
-"}                                                          \n";
-
-
-
-int main()
+
+
+// Runs C = A + B on the runtime's device with the vec_add primitive of vec_ops.cl (float4 loads in a
+// grid-stride loop, any N). Every OpenCL call is checked and the first failure is returned after the
+// buffers are released.
+// Zero-copy host buffers are used by the kernel in place; staging ones are copied to device buffers.
+// kernel_event (optional) receives the kernel's event, for profiling.
+cl_int run_vector_add(ocl_runtime* rt, vec_engine* engine, ocl_host_buffer* A, ocl_host_buffer* B, ocl_host_buffer* C, int N,
+                      cl_event* kernel_event)
 {
+    cl_int err = CL_SUCCESS;
+    cl_mem bufferA = NULL, bufferB = NULL, bufferC = NULL;
+
     //------------------------------------------------------
-    // 2. Initialize data on the HOST
+    // 5. Create memory buffers on the DEVICE
     //------------------------------------------------------
-    int N = 1024; // Number of elements
-    float* A = (float*)malloc(N * sizeof(float));
-    float* B = (float*)malloc(N * sizeof(float));
-    float* C = (float*)malloc(N * sizeof(float));
-
-    // Initialize A and B
-    for (int i = 0; i < N; i++) {
-        A[i] = (float)i;
-        B[i] = (float)i;
+    // Allocating memory for variables in the Global Memory --> VRAM (discrete devices only).
+    // The runtime's pool hands back the buffers of the previous call, so repeated calls skip clCreateBuffer.
+    if (!A->zero_copy) {
+        bufferA = ocl_runtime_acquire(rt, CL_MEM_READ_ONLY,  N * sizeof(float), &err);
+        if (!bufferA) goto cleanup;
+    }
+    if (!B->zero_copy) {
+        bufferB = ocl_runtime_acquire(rt, CL_MEM_READ_ONLY,  N * sizeof(float), &err);
+        if (!bufferB) goto cleanup;
     }
+    if (!C->zero_copy) {
+        bufferC = ocl_runtime_acquire(rt, CL_MEM_WRITE_ONLY, N * sizeof(float), &err);
+        if (!bufferC) goto cleanup;
+    }
+    cl_mem memA = ocl_host_buffer_device_mem(A, bufferA);
+    cl_mem memB = ocl_host_buffer_device_mem(B, bufferB);
+    cl_mem memC = ocl_host_buffer_device_mem(C, bufferC);
 
     //------------------------------------------------------
-    // 3. Platform and device setup
+    // 6. Write data from HOST to DEVICE
     //------------------------------------------------------
-    cl_platform_id platform;
-    cl_device_id device;
-    cl_uint numPlatforms, numDevices;
-    cl_int err;
+    // Unmap for zero-copy, a copy from pinned memory otherwise (the in-order queue orders it before the kernel)
+    OCL_CHECK_GOTO(ocl_host_buffer_upload(rt, A, memA, N * sizeof(float), NULL), err, cleanup);
+    OCL_CHECK_GOTO(ocl_host_buffer_upload(rt, B, memB, N * sizeof(float), NULL), err, cleanup);
+    OCL_CHECK_GOTO(ocl_host_buffer_unmap(rt, C, NULL), err, cleanup);
 
-    // Get the platform
-    err = clGetPlatformIDs(1, &platform, &numPlatforms);
-    if (err != CL_SUCCESS) {
-        printf("Failed to find an OpenCL platform!\n");
-        return -1;
-    }
-
-    // Get a GPU device (or CPU if no GPU)
-    err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, &numDevices);
-    if (err != CL_SUCCESS) {
-        printf("Failed to get an OpenCL GPU device!\n");
-        return -1;
-    }
+    //------------------------------------------------------
+    // 7. - 9. Set the arguments and execute the kernel
+    //------------------------------------------------------
+    // The engine built vec_ops.cl once; each work-item adds float4s in steps of the global size
+    err = vec_engine_add(engine, rt->queue, memA, memB, memC, N, 0, NULL, kernel_event);
+    if (err != CL_SUCCESS) goto cleanup;
 
     //------------------------------------------------------
-    // 4. Create a context and command queue
+    // 10. Read the result from DEVICE to HOST
     //------------------------------------------------------
-    //This binds the context to the specified device, allowing memory allocation, kernel execution, and command queue creation.
-    cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
-    if (!context) {
-        printf("Failed to create OpenCL context!\n");
-        return -1;
+    // The in-order queue runs the blocking map/read after the kernel
+    OCL_CHECK_GOTO(ocl_host_buffer_download(rt, C, memC, N * sizeof(float), 0, NULL, NULL), err, cleanup);
+
+cleanup:
+    // Make sure the kernel is done with the host memory before the caller touches it again
+    clFinish(rt->queue);
+    ocl_runtime_recycle(rt, bufferA);
+    ocl_runtime_recycle(rt, bufferB);
+    ocl_runtime_recycle(rt, bufferC);
+    return err;
+}
+
+typedef struct {
+    ocl_runtime* rt;
+    vec_engine* engine;
+    ocl_host_buffer *A, *B, *C;
+    int N;
+} vector_add_job;
+
+// autotune_run_fn: one vector add, timed by the kernel's profiling event
+static cl_int time_vector_add(void* ctx, const tune_config* config, double* time_sec)
+{
+    vector_add_job* job = (vector_add_job*)ctx;
+    cl_event event = NULL;
+    cl_ulong start = 0, end = 0;
+    cl_int err = vec_engine_set_group_size(job->engine, config->local_size[0]);
+    if (err == CL_SUCCESS)
+        err = run_vector_add(job->rt, job->engine, job->A, job->B, job->C, job->N, &event);
+    if (err == CL_SUCCESS) {
+        clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+        clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+        *time_sec = (end - start) * 1e-9;
     }
+    if (event) clReleaseEvent(event);
+    return err;
+}
 
-    /*  Creates a command queue to submit tasks to the GPU/CPU/NPU. Binds the queue to the specified device inside the context.
-        Commands like memory transfer, kernel execution, and synchronization will be sent through this queue. */
-    cl_command_queue queue = clCreateCommandQueue(context, device, 0, &err);
-    if (!queue) {
-        printf("Failed to create command queue!\n");
-        clReleaseContext(context);
-        return -1;
+// Picks the work-group size: a fresh sweep when asked for, else the size stored for this device,
+// else the engine's default. Every size must fit the device and the kernels.
+static size_t choose_local_size(vector_add_job* job, int autotune, int* tuned)
+{
+    tune_config candidates[AUTOTUNE_MAX_CANDIDATES];
+    size_t default_size = job->engine->group_size;
+    *tuned = 0;
+    int count = autotune_candidates(job->rt, job->engine->add, 1, 1, candidates, 0);
+
+    tune_config config;
+    if (autotune) {
+        int best = autotune_sweep(candidates, count, 3, time_vector_add, job, 1);
+        if (best >= 0) {
+            autotune_store(job->rt, "vec_add", &candidates[best]);
+            *tuned = 1;
+            return candidates[best].local_size[0];
+        }
+    } else if (autotune_load(job->rt, "vec_add", &config)) {
+        for (int i = 0; i < count; i++) {
+            if (candidates[i].local_size[0] == config.local_size[0]) {
+                *tuned = 1;
+                return config.local_size[0];
+            }
+        }
     }
+    return default_size;
+}
 
-    //------------------------------------------------------
-    // 5. Create memory buffers on the DEVICE
-    //------------------------------------------------------
-    // Allocating memory for variables in the Global Memory --> VRAM
-    cl_mem bufferA = clCreateBuffer(context, CL_MEM_READ_ONLY,  N * sizeof(float), NULL, &err);
-    cl_mem bufferB = clCreateBuffer(context, CL_MEM_READ_ONLY,  N * sizeof(float), NULL, &err);
-    cl_mem bufferC = clCreateBuffer(context, CL_MEM_WRITE_ONLY, N * sizeof(float), NULL, &err);
 
-    //------------------------------------------------------
-    // 6. Write data from HOST to DEVICE
-    //------------------------------------------------------
-    err = clEnqueueWriteBuffer(queue, bufferA, CL_TRUE, 0, N * sizeof(float), A, 0, NULL, NULL);
-    err = clEnqueueWriteBuffer(queue, bufferB, CL_TRUE, 0, N * sizeof(float), B, 0, NULL, NULL);
+
+int main(int argc, char** argv)
+{
+    int N = 1024; // Number of elements
 
     //------------------------------------------------------
-    // 7. Build the program and create the kernel
+    // 3. Platform and device setup
+    // 4. Create a context and command queue
     //------------------------------------------------------
-    cl_program program = clCreateProgramWithSource(context, 1, &kernelSource, NULL, &err);
-    if (!program) {
-        printf("Failed to create CL program from source.\n");
+    // Picks the best device on any platform (GPU, then accelerator, then CPU);
+    // --device or OCL_DEVICE overrides the choice. The queue profiles so --autotune can time the kernel.
+    // --n N sets the number of elements (any N; the kernel handles the tail).
+    int autotune = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--autotune") == 0) autotune = 1;
+        else if (strcmp(argv[i], "--n") == 0 && i + 1 < argc) N = atoi(argv[++i]);
+    }
+    if (N < 1) {
+        printf("--n must be positive\n");
         return -1;
     }
-
-    err = clBuildProgram(program, 1, &device, NULL, NULL, NULL);
+    ocl_runtime rt;
+    cl_int err = ocl_runtime_init(&rt, find_device_flag(argc, argv), CL_QUEUE_PROFILING_ENABLE);
     if (err != CL_SUCCESS) {
-        // Print build error log
-        char log[4096];
-        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, sizeof(log), log, NULL);
-        printf("Build Log:\n%s\n", log);
+        printf("Failed to set up OpenCL: %s\n", ocl_error_string(err));
         return -1;
     }
-
-    cl_kernel kernel = clCreateKernel(program, "vector_add", &err);
-    if (!kernel || err != CL_SUCCESS) {
-        printf("Failed to create kernel.\n");
+    printf("Using %s / %s\n", rt.selected.platform_name, rt.selected.device_name);
+    vec_engine engine;
+    err = vec_engine_init(&engine, &rt);
+    if (err != CL_SUCCESS) {
+        printf("Failed to build the vector kernels: %s\n", ocl_error_string(err));
+        ocl_runtime_release(&rt);
         return -1;
     }
 
     //------------------------------------------------------
-    // 8. Set kernel arguments
+    // 2. Initialize data on the HOST
     //------------------------------------------------------
-    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &bufferA);
-    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &bufferB);
-    err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &bufferC);
-
-    // We'll allocate local memory for localA and localB.
-    // Let's define the local size (work-group size).
-    size_t localSize = 64;
-    err |= clSetKernelArg(kernel, 3, localSize * sizeof(float), NULL);  // localA
-    err |= clSetKernelArg(kernel, 4, localSize * sizeof(float), NULL);  // localB
-
-    if (err != CL_SUCCESS) {
-        printf("Failed to set kernel arguments.\n");
+    // A, B and C are host buffers the device can use: zero-copy on unified memory, pinned staging otherwise
+    ocl_host_buffer hostA, hostB, hostC;
+    if (ocl_host_buffer_create(&rt, N * sizeof(float), &hostA) != CL_SUCCESS ||
+        ocl_host_buffer_create(&rt, N * sizeof(float), &hostB) != CL_SUCCESS ||
+        ocl_host_buffer_create(&rt, N * sizeof(float), &hostC) != CL_SUCCESS) {
+        printf("Failed to allocate the host buffers\n");
+        vec_engine_release(&engine);
+        ocl_runtime_release(&rt);
         return -1;
     }
+    printf("Host buffers: %s\n", hostA.zero_copy ? "zero-copy" : "pinned staging");
 
-    //------------------------------------------------------
-    // 9. Execute the kernel
-    //------------------------------------------------------
-    size_t globalSize = N;
-    cl_event kernel_event;
-    err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &globalSize, &localSize, 0, NULL, &kernel_event);
-    if (err != CL_SUCCESS) {
-        printf("Failed to enqueue kernel.\n");
-        return -1;
+    // Initialize A and B in place
+    float* A = (float*)hostA.host_ptr;
+    float* B = (float*)hostB.host_ptr;
+    for (int i = 0; i < N; i++) {
+        A[i] = (float)i;
+        B[i] = (float)i;
     }
 
-    // Wait for the kernel to finish
-    clWaitForEvents(1, &kernel_event);
+    vector_add_job job = { &rt, &engine, &hostA, &hostB, &hostC, N };
+    int tuned;
+    size_t localSize = choose_local_size(&job, autotune, &tuned);
+    if (vec_engine_set_group_size(&engine, localSize) != CL_SUCCESS) {
+        localSize = engine.group_size;
+        tuned = 0;
+    }
+    printf("Work-group size: %zu (%s)\n", localSize, tuned ? "tuned" : "default");
 
-    //------------------------------------------------------
-    // 10. Read the result from DEVICE to HOST
-    //------------------------------------------------------
-    err = clEnqueueReadBuffer(queue, bufferC, CL_TRUE, 0, N * sizeof(float), C, 0, NULL, NULL);
+    err = run_vector_add(&rt, &engine, &hostA, &hostB, &hostC, N, NULL);
     if (err != CL_SUCCESS) {
-        printf("Failed to read bufferC.\n");
+        printf("Vector add failed: %s\n", ocl_error_string(err));
+        vec_engine_release(&engine);
+        ocl_runtime_release(&rt);
         return -1;
     }
 
     //------------------------------------------------------
     // 11. Print the result (first 10 elements)
     //------------------------------------------------------
+    float* C = (float*)hostC.host_ptr;
     printf("First 10 results:\n");
-    for (int i = 0; i < 10; i++) {
+    for (int i = 0; i < 10 && i < N; i++) {
         printf("C[%d] = %f\n", i, C[i]);
     }
 
+    // The threaded SIMD host add gives the same floats (one rounding per element either way)
+    cpu_thread_pool* pool = cpu_thread_pool_create(0);
+    float* expected = (float*)malloc(N * sizeof(float));
+    vec_host_add(pool, A, B, expected, N);
+    int mismatch = -1;
+    for (int i = 0; i < N && mismatch < 0; i++) {
+        if (C[i] != expected[i]) mismatch = i;
+    }
+    if (mismatch < 0)
+        printf("Verification: PASSED (%d elements)\n", N);
+    else
+        printf("Verification: FAILED at C[%d] = %f, expected %f\n", mismatch, C[mismatch], expected[mismatch]);
+    free(expected);
+    cpu_thread_pool_destroy(pool);
+
+    // Every call after the first (the autotuning sweep runs many) reuses the pooled device buffers
+    buffer_pool_print_stats(&rt.buffers);
+
     //------------------------------------------------------
     // 12. Cleanup
     //------------------------------------------------------
-    clReleaseMemObject(bufferA);
-    clReleaseMemObject(bufferB);
-    clReleaseMemObject(bufferC);
-    clReleaseKernel(kernel);
-    clReleaseProgram(program);
-    clReleaseCommandQueue(queue);
-    clReleaseContext(context);
-
-    free(A);
-    free(B);
-    free(C);
+    ocl_host_buffer_release(&rt, &hostA);
+    ocl_host_buffer_release(&rt, &hostB);
+    ocl_host_buffer_release(&rt, &hostC);
+    vec_engine_release(&engine);
+    ocl_runtime_release(&rt);
 
-    return 0;
+    return (mismatch < 0) ? 0 : 1;
 }
@@ -0,0 +1,445 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+// OpenCL Include
+#include <CL/cl.h>
+
+#include "ocl_runtime.h"
+#include "vec_ops.h"
+
+#define VEC_BENCH_CHECK_TOLERANCE 1e-3   // Relative, for sums and scans (elementwise ops allow 1e-6)
+
+
+
+typedef enum
+{
+    OP_ADD,
+    OP_MUL,
+    OP_SAXPY,
+    OP_SCALE,
+    OP_SUM,
+    OP_MIN,
+    OP_MAX,
+    OP_SCAN,
+    OP_COUNT
+} bench_op;
+
+// Minimum traffic of each primitive in arrays of n floats: every input read once, every output written once
+static const struct
+{
+    const char* name;
+    int arrays;
+} op_info[OP_COUNT] = {
+    {"add", 3}, {"mul", 3}, {"saxpy", 3}, {"scale", 2}, {"sum", 1}, {"min", 1}, {"max", 1}, {"scan", 2}
+};
+
+typedef struct
+{
+    int n;
+    int iterations;   // Launches per timed trial
+    int trials;
+    cpu_thread_pool* pool;
+    const float* a;
+    const float* b;
+    float* y;
+    float host_value;
+
+    // Device side, NULL without a device
+    ocl_runtime* rt;
+    vec_engine* engine;
+    cl_mem a_buffer;
+    cl_mem b_buffer;
+    cl_mem y_buffer;
+    cl_mem value_buffer;
+} bench_context;
+
+// Function to return a monotonic wall-clock time in seconds
+static double wall_time_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec * 1e-9);
+}
+
+static int compare_double(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+//------------------------------------------------------
+// One launch of each primitive
+//------------------------------------------------------
+
+static void run_host(bench_context* ctx, bench_op op)
+{
+    switch (op)
+    {
+    case OP_ADD: vec_host_add(ctx->pool, ctx->a, ctx->b, ctx->y, ctx->n); break;
+    case OP_MUL: vec_host_mul(ctx->pool, ctx->a, ctx->b, ctx->y, ctx->n); break;
+    case OP_SAXPY: vec_host_saxpy(ctx->pool, 0.5f, ctx->a, ctx->y, ctx->n); break;
+    case OP_SCALE: vec_host_scale_offset(ctx->pool, ctx->a, ctx->y, 2.0f, -1.0f, ctx->n); break;
+    case OP_SUM: ctx->host_value = vec_host_reduce(ctx->pool, VEC_REDUCE_SUM, ctx->a, ctx->n); break;
+    case OP_MIN: ctx->host_value = vec_host_reduce(ctx->pool, VEC_REDUCE_MIN, ctx->a, ctx->n); break;
+    case OP_MAX: ctx->host_value = vec_host_reduce(ctx->pool, VEC_REDUCE_MAX, ctx->a, ctx->n); break;
+    case OP_SCAN: vec_host_scan(ctx->pool, ctx->a, ctx->y, ctx->n); break;
+    default: break;
+    }
+}
+
+static cl_int enqueue_device(bench_context* ctx, bench_op op)
+{
+    vec_engine* e = ctx->engine;
+    cl_command_queue q = ctx->rt->queue;
+    switch (op)
+    {
+    case OP_ADD: return vec_engine_add(e, q, ctx->a_buffer, ctx->b_buffer, ctx->y_buffer, ctx->n, 0, NULL, NULL);
+    case OP_MUL: return vec_engine_mul(e, q, ctx->a_buffer, ctx->b_buffer, ctx->y_buffer, ctx->n, 0, NULL, NULL);
+    case OP_SAXPY: return vec_engine_saxpy(e, q, 0.5f, ctx->a_buffer, ctx->y_buffer, ctx->n, 0, NULL, NULL);
+    case OP_SCALE: return vec_engine_scale_offset(e, q, ctx->a_buffer, ctx->y_buffer, 2.0f, -1.0f, ctx->n, 0, NULL, NULL);
+    case OP_SUM: return vec_engine_enqueue_reduce(e, q, VEC_REDUCE_SUM, ctx->a_buffer, ctx->n, ctx->value_buffer, 0, NULL, NULL);
+    case OP_MIN: return vec_engine_enqueue_reduce(e, q, VEC_REDUCE_MIN, ctx->a_buffer, ctx->n, ctx->value_buffer, 0, NULL, NULL);
+    case OP_MAX: return vec_engine_enqueue_reduce(e, q, VEC_REDUCE_MAX, ctx->a_buffer, ctx->n, ctx->value_buffer, 0, NULL, NULL);
+    case OP_SCAN: return vec_engine_scan(e, q, ctx->a_buffer, ctx->y_buffer, ctx->n, 0, NULL, NULL);
+    default: return CL_INVALID_VALUE;
+    }
+}
+
+// Device copy of a into y: the bandwidth the device's own copy engine reaches, the roof for the primitives
+static cl_int enqueue_copy(bench_context* ctx)
+{
+    OCL_CHECK(clEnqueueCopyBuffer(ctx->rt->queue, ctx->a_buffer, ctx->y_buffer, 0, 0, (size_t)ctx->n * sizeof(float), 0, NULL, NULL));
+    return CL_SUCCESS;
+}
+
+typedef struct
+{
+    const float* src;
+    float* dst;
+    size_t n;
+} copy_job;
+
+#define COPY_CHUNK (64 * 1024)
+
+static void copy_task(void* ctx, int item, int thread_index)
+{
+    copy_job* job = (copy_job*)ctx;
+    size_t begin = (size_t)item * COPY_CHUNK;
+    size_t count = (begin + COPY_CHUNK < job->n) ? COPY_CHUNK : job->n - begin;
+    (void)thread_index;
+    memcpy(job->dst + begin, job->src + begin, count * sizeof(float));
+}
+
+static void host_copy(bench_context* ctx)
+{
+    copy_job job = { ctx->a, ctx->y, (size_t)ctx->n };
+    cpu_thread_pool_run(ctx->pool, copy_task, &job, (int)((job.n + COPY_CHUNK - 1) / COPY_CHUNK));
+}
+
+//------------------------------------------------------
+// Timing
+//------------------------------------------------------
+
+// Median seconds per launch over the trials, after one warm-up launch; -1 on error.
+// op is a bench_op, or OP_COUNT for the copy roof.
+static double time_op(bench_context* ctx, int op, int device)
+{
+    double* samples = (double*)malloc(ctx->trials * sizeof(double));
+    double result = -1.0;
+    for (int t = -1; t < ctx->trials; t++)
+    {
+        int launches = (t < 0) ? 1 : ctx->iterations;
+        double start = wall_time_sec();
+        for (int i = 0; i < launches; i++)
+        {
+            if (!device)
+            {
+                if (op == OP_COUNT)
+                    host_copy(ctx);
+                else
+                    run_host(ctx, (bench_op)op);
+            }
+            else if (((op == OP_COUNT) ? enqueue_copy(ctx) : enqueue_device(ctx, (bench_op)op)) != CL_SUCCESS)
+            {
+                goto cleanup;
+            }
+        }
+        if (device && clFinish(ctx->rt->queue) != CL_SUCCESS)
+            goto cleanup;
+        if (t >= 0)
+            samples[t] = (wall_time_sec() - start) / launches;
+    }
+    qsort(samples, ctx->trials, sizeof(double), compare_double);
+    result = samples[ctx->trials / 2];
+
+cleanup:
+    free(samples);
+    return result;
+}
+
+static double gb_per_sec(const bench_context* ctx, int arrays, double seconds)
+{
+    return (seconds > 0.0) ? ((double)arrays * ctx->n * sizeof(float)) / seconds * 1e-9 : 0.0;
+}
+
+//------------------------------------------------------
+// Checking the device against the host
+//------------------------------------------------------
+
+static int close_enough(float actual, float expected, double tolerance)
+{
+    double scale = fabs(expected) > 1.0 ? fabs(expected) : 1.0;
+    return fabs((double)actual - expected) <= tolerance * scale;
+}
+
+// One fresh launch on each side; returns 1 when the device matches the host
+static int check_device(bench_context* ctx, bench_op op, float* device_result)
+{
+    size_t bytes = (size_t)ctx->n * sizeof(float);
+    int reduction = (op == OP_SUM || op == OP_MIN || op == OP_MAX);
+    double tolerance = (op == OP_SUM || op == OP_SCAN) ? VEC_BENCH_CHECK_TOLERANCE : (op == OP_MIN || op == OP_MAX) ? 0.0 : 1e-6;
+
+    // saxpy accumulates into y, so both sides start from b
+    if (op == OP_SAXPY)
+    {
+        memcpy(ctx->y, ctx->b, bytes);
+        if (clEnqueueWriteBuffer(ctx->rt->queue, ctx->y_buffer, CL_TRUE, 0, bytes, ctx->b, 0, NULL, NULL) != CL_SUCCESS)
+            return 0;
+    }
+    run_host(ctx, op);
+    if (enqueue_device(ctx, op) != CL_SUCCESS)
+        return 0;
+    if (reduction)
+    {
+        float value;
+        if (clEnqueueReadBuffer(ctx->rt->queue, ctx->value_buffer, CL_TRUE, 0, sizeof(float), &value, 0, NULL, NULL) != CL_SUCCESS)
+            return 0;
+        return close_enough(value, ctx->host_value, tolerance);
+    }
+    if (clEnqueueReadBuffer(ctx->rt->queue, ctx->y_buffer, CL_TRUE, 0, bytes, device_result, 0, NULL, NULL) != CL_SUCCESS)
+        return 0;
+    for (int i = 0; i < ctx->n; i++)
+    {
+        if (!close_enough(device_result[i], ctx->y[i], tolerance))
+        {
+            fprintf(stderr, "%s: element %d is %g on the device, %g on the host\n", op_info[op].name, i, device_result[i], ctx->y[i]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int parse_ops(const char* list, int* selected)
+{
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "%s", list);
+    memset(selected, 0, OP_COUNT * sizeof(int));
+    for (char* name = strtok(buffer, ","); name; name = strtok(NULL, ","))
+    {
+        int found = 0;
+        for (int op = 0; op < OP_COUNT; op++)
+        {
+            if (strcmp(name, op_info[op].name) == 0)
+                selected[op] = found = 1;
+        }
+        if (!found)
+        {
+            fprintf(stderr, "Error: Unknown primitive %s (add, mul, saxpy, scale, sum, min, max, scan)\n", name);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static cl_int setup_device(bench_context* ctx, ocl_runtime* rt, vec_engine* engine, const char* device_spec)
+{
+    cl_int err;
+    size_t bytes = (size_t)ctx->n * sizeof(float);
+    OCL_CHECK(ocl_runtime_init(rt, device_spec, 0));
+    ctx->rt = rt;
+    if ((err = vec_engine_init(engine, rt)) != CL_SUCCESS)
+        return err;
+    ctx->engine = engine;
+    if (!(ctx->a_buffer = ocl_runtime_acquire(rt, CL_MEM_READ_ONLY, bytes, &err)) ||
+        !(ctx->b_buffer = ocl_runtime_acquire(rt, CL_MEM_READ_ONLY, bytes, &err)) ||
+        !(ctx->y_buffer = ocl_runtime_acquire(rt, CL_MEM_READ_WRITE, bytes, &err)) ||
+        !(ctx->value_buffer = ocl_runtime_acquire(rt, CL_MEM_READ_WRITE, sizeof(float), &err)))
+        return err;
+    OCL_CHECK(clEnqueueWriteBuffer(rt->queue, ctx->a_buffer, CL_FALSE, 0, bytes, ctx->a, 0, NULL, NULL));
+    OCL_CHECK(clEnqueueWriteBuffer(rt->queue, ctx->b_buffer, CL_FALSE, 0, bytes, ctx->b, 0, NULL, NULL));
+    OCL_CHECK(clFinish(rt->queue));
+    return CL_SUCCESS;
+}
+
+static void release_device(bench_context* ctx)
+{
+    if (!ctx->rt)
+        return;
+    ocl_runtime_recycle(ctx->rt, ctx->a_buffer);
+    ocl_runtime_recycle(ctx->rt, ctx->b_buffer);
+    ocl_runtime_recycle(ctx->rt, ctx->y_buffer);
+    ocl_runtime_recycle(ctx->rt, ctx->value_buffer);
+    if (ctx->engine)
+        vec_engine_release(ctx->engine);
+    ocl_runtime_release(ctx->rt);
+    ctx->rt = NULL;
+    ctx->engine = NULL;
+}
+
+// Main Code
+int main(int argc, char** argv)
+{
+    // --n N              floats per array (default 16M, 64 MB)
+    // --ops a,b,...      primitives to run: add, mul, saxpy, scale, sum, min, max, scan (default all)
+    // --iterations N     launches per timed trial (default 10); --trials N timed trials, the median is kept (default 5)
+    // --peak-gbs X       the device's rated memory bandwidth; without it device numbers are relative to its copy roof
+    // --device spec      as in run; --cpu runs the host engine only; --threads N sets its thread count
+    bench_context ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.n = 16 * 1024 * 1024;
+    ctx.iterations = 10;
+    ctx.trials = 5;
+    int selected[OP_COUNT];
+    for (int op = 0; op < OP_COUNT; op++)
+        selected[op] = 1;
+    double peak_gbs = 0.0;
+    int host_only = 0;
+    int num_threads = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--n") == 0 && i + 1 < argc)
+        {
+            ctx.n = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--ops") == 0 && i + 1 < argc)
+        {
+            if (parse_ops(argv[++i], selected) != 0)
+                return -1;
+        }
+        else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+        {
+            ctx.iterations = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--trials") == 0 && i + 1 < argc)
+        {
+            ctx.trials = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--peak-gbs") == 0 && i + 1 < argc)
+        {
+            peak_gbs = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--cpu") == 0)
+        {
+            host_only = 1;
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            num_threads = atoi(argv[++i]);
+        }
+    }
+    if (ctx.n < 1 || ctx.iterations < 1 || ctx.trials < 1)
+    {
+        fprintf(stderr, "Error: --n, --iterations and --trials must be positive\n");
+        return -1;
+    }
+
+    //------------------------------------------------------
+    // Data
+    //------------------------------------------------------
+    size_t bytes = (size_t)ctx.n * sizeof(float);
+    float* a = (float*)malloc(bytes);
+    float* b = (float*)malloc(bytes);
+    float* device_result = (float*)malloc(bytes);
+    ctx.y = (float*)malloc(bytes);
+    if (!a || !b || !device_result || !ctx.y)
+    {
+        fprintf(stderr, "Error: Could not allocate 4 arrays of %zu bytes\n", bytes);
+        return -1;
+    }
+    srand(1);
+    for (int i = 0; i < ctx.n; i++)
+    {
+        a[i] = (float)rand() / (float)RAND_MAX;
+        b[i] = (float)rand() / (float)RAND_MAX;
+    }
+    ctx.a = a;
+    ctx.b = b;
+    memcpy(ctx.y, b, bytes);
+    ctx.pool = cpu_thread_pool_create(num_threads);
+
+    ocl_runtime rt;
+    vec_engine engine;
+    int use_device = 0;
+    if (!host_only)
+    {
+        use_device = setup_device(&ctx, &rt, &engine, find_device_flag(argc, argv)) == CL_SUCCESS;
+        if (!use_device)
+        {
+            printf("No usable OpenCL device, timing the host engine only\n");
+            release_device(&ctx);
+        }
+    }
+
+    //------------------------------------------------------
+    // Roofs
+    //------------------------------------------------------
+    printf("\n######### Vector Primitives (n = %d, %.1f MB per array) ################\n", ctx.n, bytes / (1024.0 * 1024.0));
+    double host_roof = gb_per_sec(&ctx, 2, time_op(&ctx, OP_COUNT, 0));
+    printf("Host copy roof                                      : %.2f GB/s (%d threads, %s)\n", host_roof,
+           cpu_thread_pool_size(ctx.pool), cpu_blur_simd_name());
+    double device_roof = 0.0;
+    if (use_device)
+    {
+        printf("Device                                              : %s (work-groups of %zu, %zu groups per launch)\n",
+               rt.selected.device_name, engine.group_size, engine.max_groups);
+        device_roof = gb_per_sec(&ctx, 2, time_op(&ctx, OP_COUNT, 1));
+        printf("Device copy roof                                    : %.2f GB/s (clEnqueueCopyBuffer)\n", device_roof);
+        if (peak_gbs > 0.0)
+            printf("Device rated peak                                   : %.2f GB/s\n", peak_gbs);
+    }
+    double device_peak = (peak_gbs > 0.0) ? peak_gbs : device_roof;
+
+    //------------------------------------------------------
+    // Primitives
+    //------------------------------------------------------
+    printf("\n%-6s %12s %10s %12s %10s  %s\n", "op", "device GB/s", use_device && peak_gbs > 0.0 ? "% of peak" : "% of roof",
+           "host GB/s", "% of roof", "device vs host");
+    int status = 0;
+    for (int op = 0; op < OP_COUNT; op++)
+    {
+        if (!selected[op])
+            continue;
+        double host_gbs = gb_per_sec(&ctx, op_info[op].arrays, time_op(&ctx, op, 0));
+        if (!use_device)
+        {
+            printf("%-6s %12s %10s %12.2f %9.1f%%  -\n", op_info[op].name, "-", "-", host_gbs, host_roof > 0.0 ? 100.0 * host_gbs / host_roof : 0.0);
+            continue;
+        }
+        double device_sec = time_op(&ctx, op, 1);
+        if (device_sec < 0.0)
+        {
+            fprintf(stderr, "Error: %s failed on the device\n", op_info[op].name);
+            status = 1;
+            continue;
+        }
+        double device_gbs = gb_per_sec(&ctx, op_info[op].arrays, device_sec);
+        int matches = check_device(&ctx, (bench_op)op, device_result);
+        status = matches ? status : 1;
+        printf("%-6s %12.2f %9.1f%% %12.2f %9.1f%%  %s\n", op_info[op].name, device_gbs, device_peak > 0.0 ? 100.0 * device_gbs / device_peak : 0.0,
+               host_gbs, host_roof > 0.0 ? 100.0 * host_gbs / host_roof : 0.0, matches ? "match" : "MISMATCH");
+    }
+    printf("GB/s counts the minimum traffic: every input array read once, every output written once\n");
+
+    release_device(&ctx);
+    cpu_thread_pool_destroy(ctx.pool);
+    free(a);
+    free(b);
+    free(ctx.y);
+    free(device_result);
+    return status;
+}
@@ -0,0 +1,639 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VEC_X86 1
+#endif
+
+#include "vec_ops.h"
+
+#define VEC_KERNEL_FILE "vec_ops.cl"
+#define VEC_HOST_CHUNK (64 * 1024)   // Floats per host task (256 KB, several per thread on large arrays)
+
+
+
+static const char* reduce_kernel_names[VEC_REDUCE_COUNT] = { "vec_reduce_sum", "vec_reduce_min", "vec_reduce_max" };
+
+const char* vec_reduce_name(vec_reduce_op op)
+{
+    static const char* names[VEC_REDUCE_COUNT] = { "sum", "min", "max" };
+    return (op >= 0 && op < VEC_REDUCE_COUNT) ? names[op] : "unknown";
+}
+
+static float reduce_identity(vec_reduce_op op)
+{
+    return (op == VEC_REDUCE_MIN) ? INFINITY : (op == VEC_REDUCE_MAX) ? -INFINITY : 0.0f;
+}
+
+//------------------------------------------------------
+// Device engine
+//------------------------------------------------------
+
+static int kernels_take(const vec_engine* engine, size_t group_size)
+{
+    cl_kernel kernels[8] = {engine->add, engine->mul, engine->saxpy, engine->scale_offset,
+                            engine->reduce[0], engine->reduce[1], engine->reduce[2], engine->scan_blocks};
+    if (group_size > engine->rt->max_work_group_size)
+        return 0;
+    for (int i = 0; i < 8; i++)
+    {
+        size_t limit = 0;
+        if (clGetKernelWorkGroupInfo(kernels[i], engine->rt->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(limit), &limit, NULL) == CL_SUCCESS &&
+            group_size > limit)
+            return 0;
+    }
+    return 1;
+}
+
+static cl_int create_kernels(vec_engine* engine, cl_program program)
+{
+    cl_int err;
+    ocl_runtime* rt = engine->rt;
+    const char* names[4] = { "vec_add", "vec_mul", "vec_saxpy", "vec_scale_offset" };
+    cl_kernel* kernels[4] = { &engine->add, &engine->mul, &engine->saxpy, &engine->scale_offset };
+    for (int i = 0; i < 4; i++)
+    {
+        if (!(*kernels[i] = ocl_runtime_kernel(rt, program, names[i], &err)))
+            return err;
+    }
+    for (int op = 0; op < VEC_REDUCE_COUNT; op++)
+    {
+        if (!(engine->reduce[op] = ocl_runtime_kernel(rt, program, reduce_kernel_names[op], &err)))
+            return err;
+    }
+    if (!(engine->scan_blocks = ocl_runtime_kernel(rt, program, "vec_scan_blocks", &err)) ||
+        !(engine->scan_add = ocl_runtime_kernel(rt, program, "vec_scan_add", &err)))
+        return err;
+    return CL_SUCCESS;
+}
+
+cl_int vec_engine_init(vec_engine* engine, ocl_runtime* rt)
+{
+    cl_int err;
+    memset(engine, 0, sizeof(*engine));
+    engine->rt = rt;
+
+    cl_program program = ocl_runtime_program_file(rt, VEC_KERNEL_FILE, NULL, &err);
+    if (!program)
+        return err;
+    // The kernels keep the program alive, so the engine does not hold on to it
+    err = create_kernels(engine, program);
+    ocl_runtime_release_program(rt, program);
+    if (err != CL_SUCCESS)
+        return err;
+
+    size_t group = VEC_DEFAULT_GROUP_SIZE;
+    while (group > 1 && !kernels_take(engine, group))
+        group /= 2;
+    engine->group_size = group;
+    engine->max_groups = (rt->selected.compute_units > 0 ? rt->selected.compute_units : 1) * VEC_GROUPS_PER_COMPUTE_UNIT;
+    return CL_SUCCESS;
+}
+
+void vec_engine_release(vec_engine* engine)
+{
+    cl_kernel kernels[6] = { engine->add, engine->mul, engine->saxpy, engine->scale_offset, engine->scan_blocks, engine->scan_add };
+    for (int i = 0; i < 6; i++)
+        ocl_runtime_release_kernel(engine->rt, kernels[i]);
+    for (int op = 0; op < VEC_REDUCE_COUNT; op++)
+        ocl_runtime_release_kernel(engine->rt, engine->reduce[op]);
+    memset(engine, 0, sizeof(*engine));
+}
+
+cl_int vec_engine_set_group_size(vec_engine* engine, size_t group_size)
+{
+    if (group_size == 0 || (group_size & (group_size - 1)) != 0 || !kernels_take(engine, group_size))
+    {
+        fprintf(stderr, "Error: Work-group size %zu is not a power of two the vector kernels take\n", group_size);
+        return CL_INVALID_WORK_GROUP_SIZE;
+    }
+    engine->group_size = group_size;
+    return CL_SUCCESS;
+}
+
+// Global size of a grid-stride launch over work_items items: whole groups, at most max_groups of them
+static size_t grid_size(const vec_engine* engine, size_t work_items)
+{
+    size_t groups = (work_items + engine->group_size - 1) / engine->group_size;
+    if (groups > engine->max_groups)
+        groups = engine->max_groups;
+    return ((groups > 0) ? groups : 1) * engine->group_size;
+}
+
+static cl_int enqueue_grid(vec_engine* engine, cl_command_queue queue, cl_kernel kernel, int n,
+                           cl_uint num_wait_events, const cl_event* wait_events, cl_event* event)
+{
+    size_t global_work_size = grid_size(engine, ((size_t)n + 3) / 4);
+    OCL_CHECK(clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global_work_size, &engine->group_size, num_wait_events, wait_events, event));
+    return CL_SUCCESS;
+}
+
+static cl_int enqueue_binary(vec_engine* engine, cl_command_queue queue, cl_kernel kernel, cl_mem a, cl_mem b, cl_mem c, int n,
+                             cl_uint num_wait_events, const cl_event* wait_events, cl_event* event)
+{
+    OCL_CHECK(clSetKernelArg(kernel, 0, sizeof(cl_mem), &a));
+    OCL_CHECK(clSetKernelArg(kernel, 1, sizeof(cl_mem), &b));
+    OCL_CHECK(clSetKernelArg(kernel, 2, sizeof(cl_mem), &c));
+    OCL_CHECK(clSetKernelArg(kernel, 3, sizeof(int), &n));
+    return enqueue_grid(engine, queue, kernel, n, num_wait_events, wait_events, event);
+}
+
+cl_int vec_engine_add(vec_engine* engine, cl_command_queue queue, cl_mem a, cl_mem b, cl_mem c, int n,
+                      cl_uint num_wait_events, const cl_event* wait_events, cl_event* event)
+{
+    return enqueue_binary(engine, queue, engine->add, a, b, c, n, num_wait_events, wait_events, event);
+}
+
+cl_int vec_engine_mul(vec_engine* engine, cl_command_queue queue, cl_mem a, cl_mem b, cl_mem c, int n,
+                      cl_uint num_wait_events, const cl_event* wait_events, cl_event* event)
+{
+    return enqueue_binary(engine, queue, engine->mul, a, b, c, n, num_wait_events, wait_events, event);
+}
+
+cl_int vec_engine_saxpy(vec_engine* engine, cl_command_queue queue, float alpha, cl_mem x, cl_mem y, int n,
+                        cl_uint num_wait_events, const cl_event* wait_events, cl_event* event)
+{
+    cl_kernel k = engine->saxpy;
+    OCL_CHECK(clSetKernelArg(k, 0, sizeof(float), &alpha));
+    OCL_CHECK(clSetKernelArg(k, 1, sizeof(cl_mem), &x));
+    OCL_CHECK(clSetKernelArg(k, 2, sizeof(cl_mem), &y));
+    OCL_CHECK(clSetKernelArg(k, 3, sizeof(int), &n));
+    return enqueue_grid(engine, queue, k, n, num_wait_events, wait_events, event);
+}
+
+cl_int vec_engine_scale_offset(vec_engine* engine, cl_command_queue queue, cl_mem x, cl_mem y, float scale, float offset, int n,
+                               cl_uint num_wait_events, const cl_event* wait_events, cl_event* event)
+{
+    cl_kernel k = engine->scale_offset;
+    OCL_CHECK(clSetKernelArg(k, 0, sizeof(cl_mem), &x));
+    OCL_CHECK(clSetKernelArg(k, 1, sizeof(cl_mem), &y));
+    OCL_CHECK(clSetKernelArg(k, 2, sizeof(float), &scale));
+    OCL_CHECK(clSetKernelArg(k, 3, sizeof(float), &offset));
+    OCL_CHECK(clSetKernelArg(k, 4, sizeof(int), &n));
+    return enqueue_grid(engine, queue, k, n, num_wait_events, wait_events, event);
+}
+
+// One reduce launch of groups work-groups over n floats of x, group g writing out[g]
+static cl_int enqueue_reduce_pass(vec_engine* engine, cl_command_queue queue, cl_kernel k, cl_mem x, int n, cl_mem out, size_t groups,
+                                  cl_uint num_wait_events, const cl_event* wait_events, cl_event* event)
+{
+    size_t global_work_size = groups * engine->group_size;
+    OCL_CHECK(clSetKernelArg(k, 0, sizeof(cl_mem), &x));
+    OCL_CHECK(clSetKernelArg(k, 1, sizeof(cl_mem), &out));
+    OCL_CHECK(clSetKernelArg(k, 2, sizeof(int), &n));
+    OCL_CHECK(clSetKernelArg(k, 3, engine->group_size * sizeof(float), NULL));
+    OCL_CHECK(clEnqueueNDRangeKernel(queue, k, 1, NULL, &global_work_size, &engine->group_size, num_wait_events, wait_events, event));
+    return CL_SUCCESS;
+}
+
+cl_int vec_engine_enqueue_reduce(vec_engine* engine, cl_command_queue queue, vec_reduce_op op, cl_mem x, int n, cl_mem result,
+                                 cl_uint num_wait_events, const cl_event* wait_events, cl_event* event)
+{
+    cl_int err;
+    if (op < 0 || op >= VEC_REDUCE_COUNT)
+        return CL_INVALID_VALUE;
+    cl_kernel k = engine->reduce[op];
+    size_t groups = grid_size(engine, ((size_t)n + 3) / 4) / engine->group_size;
+    if (groups == 1)
+        return enqueue_reduce_pass(engine, queue, k, x, n, result, 1, num_wait_events, wait_events, event);
+
+    // The partials only live between the two launches on this queue, so the pool can hand them out again at once
+    cl_mem partials = ocl_runtime_acquire(engine->rt, CL_MEM_READ_WRITE, groups * sizeof(float), &err);
+    if (!partials)
+        return err;
+    err = enqueue_reduce_pass(engine, queue, k, x, n, partials, groups, num_wait_events, wait_events, NULL);
+    if (err == CL_SUCCESS)
+        err = enqueue_reduce_pass(engine, queue, k, partials, (int)groups, result, 1, 0, NULL, event);
+    ocl_runtime_recycle(engine->rt, partials);
+    return err;
+}
+
+cl_int vec_engine_reduce(vec_engine* engine, cl_command_queue queue, vec_reduce_op op, cl_mem x, int n, float* result)
+{
+    cl_int err;
+    cl_mem value = ocl_runtime_acquire(engine->rt, CL_MEM_READ_WRITE, sizeof(float), &err);
+    if (!value)
+        return err;
+    err = vec_engine_enqueue_reduce(engine, queue, op, x, n, value, 0, NULL, NULL);
+    if (err == CL_SUCCESS)
+    {
+        err = clEnqueueReadBuffer(queue, value, CL_TRUE, 0, sizeof(float), result, 0, NULL, NULL);
+        if (err != CL_SUCCESS)
+            ocl_report_error("clEnqueueReadBuffer", err, __FILE__, __LINE__);
+    }
+    ocl_runtime_recycle(engine->rt, value);
+    return err;
+}
+
+// Block scan of x into y, then, when there is more than one block, a scan of the block totals
+// (the same way, one level down) and the pass that adds them
+static cl_int scan_level(vec_engine* engine, cl_command_queue queue, cl_mem x, cl_mem y, int n,
+                         cl_uint num_wait_events, const cl_event* wait_events, cl_event* event)
+{
+    cl_int err;
+    size_t block = 4 * engine->group_size;
+    size_t blocks = ((size_t)n + block - 1) / block;
+    blocks = (blocks > 0) ? blocks : 1;
+    size_t global_work_size = blocks * engine->group_size;
+
+    cl_mem sums = ocl_runtime_acquire(engine->rt, CL_MEM_READ_WRITE, blocks * sizeof(float), &err);
+    if (!sums)
+        return err;
+    cl_kernel k = engine->scan_blocks;
+    OCL_CHECK_GOTO(clSetKernelArg(k, 0, sizeof(cl_mem), &x), err, cleanup);
+    OCL_CHECK_GOTO(clSetKernelArg(k, 1, sizeof(cl_mem), &y), err, cleanup);
+    OCL_CHECK_GOTO(clSetKernelArg(k, 2, sizeof(cl_mem), &sums), err, cleanup);
+    OCL_CHECK_GOTO(clSetKernelArg(k, 3, sizeof(int), &n), err, cleanup);
+    OCL_CHECK_GOTO(clSetKernelArg(k, 4, engine->group_size * sizeof(float), NULL), err, cleanup);
+    OCL_CHECK_GOTO(clEnqueueNDRangeKernel(queue, k, 1, NULL, &global_work_size, &engine->group_size, num_wait_events, wait_events,
+                                          (blocks == 1) ? event : NULL), err, cleanup);
+    if (blocks > 1)
+    {
+        err = scan_level(engine, queue, sums, sums, (int)blocks, 0, NULL, NULL);
+        if (err != CL_SUCCESS)
+            goto cleanup;
+        k = engine->scan_add;
+        OCL_CHECK_GOTO(clSetKernelArg(k, 0, sizeof(cl_mem), &y), err, cleanup);
+        OCL_CHECK_GOTO(clSetKernelArg(k, 1, sizeof(cl_mem), &sums), err, cleanup);
+        OCL_CHECK_GOTO(clSetKernelArg(k, 2, sizeof(int), &n), err, cleanup);
+        OCL_CHECK_GOTO(clEnqueueNDRangeKernel(queue, k, 1, NULL, &global_work_size, &engine->group_size, 0, NULL, event), err, cleanup);
+    }
+
+cleanup:
+    // Only later commands of this in-order queue can touch the totals, so they go back to the pool now
+    ocl_runtime_recycle(engine->rt, sums);
+    return err;
+}
+
+cl_int vec_engine_scan(vec_engine* engine, cl_command_queue queue, cl_mem x, cl_mem y, int n,
+                       cl_uint num_wait_events, const cl_event* wait_events, cl_event* event)
+{
+    return scan_level(engine, queue, x, y, n, num_wait_events, wait_events, event);
+}
+
+//------------------------------------------------------
+// Host loops
+//------------------------------------------------------
+
+typedef enum
+{
+    MAP_ADD,
+    MAP_MUL,
+    MAP_SAXPY,          // out = alpha * a + b
+    MAP_SCALE_OFFSET    // out = a * alpha + beta
+} map_op;
+
+typedef void (*map_fn)(map_op op, const float* a, const float* b, float* out, size_t n, float alpha, float beta);
+typedef float (*reduce_fn)(vec_reduce_op op, const float* x, size_t n);
+typedef float (*scan_fn)(const float* x, float* y, size_t n, float carry);   // Returns the running total
+
+static void map_scalar(map_op op, const float* a, const float* b, float* out, size_t n, float alpha, float beta)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        switch (op)
+        {
+        case MAP_ADD: out[i] = a[i] + b[i]; break;
+        case MAP_MUL: out[i] = a[i] * b[i]; break;
+        case MAP_SAXPY: out[i] = (alpha * a[i]) + b[i]; break;
+        case MAP_SCALE_OFFSET: out[i] = (a[i] * alpha) + beta; break;
+        }
+    }
+}
+
+static float reduce_scalar(vec_reduce_op op, const float* x, size_t n)
+{
+    float acc = reduce_identity(op);
+    for (size_t i = 0; i < n; i++)
+        acc = (op == VEC_REDUCE_SUM) ? acc + x[i] : (op == VEC_REDUCE_MIN) ? fminf(acc, x[i]) : fmaxf(acc, x[i]);
+    return acc;
+}
+
+static float scan_scalar(const float* x, float* y, size_t n, float carry)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        carry += x[i];
+        y[i] = carry;
+    }
+    return carry;
+}
+
+#ifdef VEC_X86
+__attribute__((target("sse4.1")))
+static void map_sse(map_op op, const float* a, const float* b, float* out, size_t n, float alpha, float beta)
+{
+    const __m128 va = _mm_set1_ps(alpha);
+    const __m128 vb = _mm_set1_ps(beta);
+    size_t i = 0;
+    switch (op)
+    {
+    case MAP_ADD:
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        break;
+    case MAP_MUL:
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        break;
+    case MAP_SAXPY:
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(va, _mm_loadu_ps(a + i)), _mm_loadu_ps(b + i)));
+        break;
+    case MAP_SCALE_OFFSET:
+        for (; i + 4 <= n; i += 4)
+            _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a + i), va), vb));
+        break;
+    }
+    map_scalar(op, a + i, b ? b + i : NULL, out + i, n - i, alpha, beta);
+}
+
+// Four independent accumulators, so the adds do not wait on each other
+__attribute__((target("sse4.1")))
+static float reduce_sse(vec_reduce_op op, const float* x, size_t n)
+{
+    __m128 acc[4];
+    for (int k = 0; k < 4; k++)
+        acc[k] = _mm_set1_ps(reduce_identity(op));
+    size_t i = 0;
+#define REDUCE_LOOP_SSE(fold)                                                \
+    for (; i + 16 <= n; i += 16)                                             \
+    {                                                                        \
+        for (int k = 0; k < 4; k++)                                          \
+            acc[k] = fold(acc[k], _mm_loadu_ps(x + i + (4 * k)));            \
+    }
+    switch (op)
+    {
+    case VEC_REDUCE_MIN: REDUCE_LOOP_SSE(_mm_min_ps) break;
+    case VEC_REDUCE_MAX: REDUCE_LOOP_SSE(_mm_max_ps) break;
+    default: REDUCE_LOOP_SSE(_mm_add_ps) break;
+    }
+#undef REDUCE_LOOP_SSE
+    float lanes[16];
+    for (int k = 0; k < 4; k++)
+        _mm_storeu_ps(lanes + (4 * k), acc[k]);
+    float value = reduce_scalar(op, lanes, 16);
+    float tail = reduce_scalar(op, x + i, n - i);
+    return (op == VEC_REDUCE_SUM) ? value + tail : (op == VEC_REDUCE_MIN) ? fminf(value, tail) : fmaxf(value, tail);
+}
+
+// In-register prefix sum of four floats (two shifted adds), plus the carry from the previous ones
+__attribute__((target("sse4.1")))
+static float scan_sse(const float* x, float* y, size_t n, float carry)
+{
+    __m128 vcarry = _mm_set1_ps(carry);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 v = _mm_loadu_ps(x + i);
+        v = _mm_add_ps(v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 4)));
+        v = _mm_add_ps(v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 8)));
+        v = _mm_add_ps(v, vcarry);
+        _mm_storeu_ps(y + i, v);
+        vcarry = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    return scan_scalar(x + i, y + i, n - i, _mm_cvtss_f32(vcarry));
+}
+
+__attribute__((target("avx2")))
+static void map_avx2(map_op op, const float* a, const float* b, float* out, size_t n, float alpha, float beta)
+{
+    const __m256 va = _mm256_set1_ps(alpha);
+    const __m256 vb = _mm256_set1_ps(beta);
+    size_t i = 0;
+    switch (op)
+    {
+    case MAP_ADD:
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        break;
+    case MAP_MUL:
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        break;
+    case MAP_SAXPY:
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_mul_ps(va, _mm256_loadu_ps(a + i)), _mm256_loadu_ps(b + i)));
+        break;
+    case MAP_SCALE_OFFSET:
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(a + i), va), vb));
+        break;
+    }
+    map_scalar(op, a + i, b ? b + i : NULL, out + i, n - i, alpha, beta);
+}
+
+__attribute__((target("avx2")))
+static float reduce_avx2(vec_reduce_op op, const float* x, size_t n)
+{
+    __m256 acc[4];
+    for (int k = 0; k < 4; k++)
+        acc[k] = _mm256_set1_ps(reduce_identity(op));
+    size_t i = 0;
+#define REDUCE_LOOP_AVX2(fold)                                               \
+    for (; i + 32 <= n; i += 32)                                             \
+    {                                                                        \
+        for (int k = 0; k < 4; k++)                                          \
+            acc[k] = fold(acc[k], _mm256_loadu_ps(x + i + (8 * k)));         \
+    }
+    switch (op)
+    {
+    case VEC_REDUCE_MIN: REDUCE_LOOP_AVX2(_mm256_min_ps) break;
+    case VEC_REDUCE_MAX: REDUCE_LOOP_AVX2(_mm256_max_ps) break;
+    default: REDUCE_LOOP_AVX2(_mm256_add_ps) break;
+    }
+#undef REDUCE_LOOP_AVX2
+    float lanes[32];
+    for (int k = 0; k < 4; k++)
+        _mm256_storeu_ps(lanes + (8 * k), acc[k]);
+    float value = reduce_scalar(op, lanes, 32);
+    float tail = reduce_scalar(op, x + i, n - i);
+    return (op == VEC_REDUCE_SUM) ? value + tail : (op == VEC_REDUCE_MIN) ? fminf(value, tail) : fmaxf(value, tail);
+}
+
+// Prefix sum within each 128-bit lane, then the low lane's total is added to the high lane
+__attribute__((target("avx2")))
+static float scan_avx2(const float* x, float* y, size_t n, float carry)
+{
+    __m256 vcarry = _mm256_set1_ps(carry);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 v = _mm256_loadu_ps(x + i);
+        v = _mm256_add_ps(v, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(v), 4)));
+        v = _mm256_add_ps(v, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(v), 8)));
+        __m256 lane_totals = _mm256_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+        v = _mm256_add_ps(v, _mm256_permute2f128_ps(lane_totals, lane_totals, 0x08));   // (0, low total)
+        v = _mm256_add_ps(v, vcarry);
+        _mm256_storeu_ps(y + i, v);
+        lane_totals = _mm256_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+        vcarry = _mm256_permute2f128_ps(lane_totals, lane_totals, 0x11);                  // y[i + 7] everywhere
+    }
+    return scan_scalar(x + i, y + i, n - i, _mm256_cvtss_f32(vcarry));
+}
+#endif
+
+typedef struct
+{
+    map_fn map;
+    reduce_fn reduce;
+    scan_fn scan;
+} vec_simd;
+
+// Follows the CPU blur engine's choice, so CPU_BLUR_SIMD caps both
+static const vec_simd* select_simd(void)
+{
+    static const vec_simd scalar = { map_scalar, reduce_scalar, scan_scalar };
+#ifdef VEC_X86
+    static const vec_simd sse = { map_sse, reduce_sse, scan_sse };
+    static const vec_simd avx2 = { map_avx2, reduce_avx2, scan_avx2 };
+    const char* simd = cpu_blur_simd_name();
+    if (strcmp(simd, "avx2") == 0)
+        return &avx2;
+    if (strcmp(simd, "sse4.1") == 0)
+        return &sse;
+#endif
+    return &scalar;
+}
+
+//------------------------------------------------------
+// Host engine
+//------------------------------------------------------
+
+typedef struct
+{
+    const vec_simd* simd;
+    map_op op;
+    vec_reduce_op reduce_op;
+    const float* a;
+    const float* b;
+    float* out;
+    float alpha;
+    float beta;
+    size_t n;
+    float* chunk_values;   // Reduce and scan: one value per chunk
+} host_job;
+
+static size_t chunk_length(const host_job* job, int item)
+{
+    size_t begin = (size_t)item * VEC_HOST_CHUNK;
+    return (begin + VEC_HOST_CHUNK < job->n) ? VEC_HOST_CHUNK : job->n - begin;
+}
+
+static void map_task(void* ctx, int item, int thread_index)
+{
+    host_job* job = (host_job*)ctx;
+    size_t begin = (size_t)item * VEC_HOST_CHUNK;
+    (void)thread_index;
+    job->simd->map(job->op, job->a + begin, job->b ? job->b + begin : NULL, job->out + begin, chunk_length(job, item), job->alpha, job->beta);
+}
+
+static void reduce_task(void* ctx, int item, int thread_index)
+{
+    host_job* job = (host_job*)ctx;
+    (void)thread_index;
+    job->chunk_values[item] = job->simd->reduce(job->reduce_op, job->a + ((size_t)item * VEC_HOST_CHUNK), chunk_length(job, item));
+}
+
+// Second scan pass: chunk_values holds the total of every chunk before this one
+static void scan_task(void* ctx, int item, int thread_index)
+{
+    host_job* job = (host_job*)ctx;
+    size_t begin = (size_t)item * VEC_HOST_CHUNK;
+    (void)thread_index;
+    job->simd->scan(job->a + begin, job->out + begin, chunk_length(job, item), job->chunk_values[item]);
+}
+
+static void run_chunks(cpu_thread_pool* pool, cpu_task_fn task, host_job* job)
+{
+    int num_chunks = (int)((job->n + VEC_HOST_CHUNK - 1) / VEC_HOST_CHUNK);
+    if (pool)
+    {
+        cpu_thread_pool_run(pool, task, job, num_chunks);
+    }
+    else
+    {
+        for (int i = 0; i < num_chunks; i++)
+            task(job, i, 0);
+    }
+}
+
+static void host_map(cpu_thread_pool* pool, map_op op, const float* a, const float* b, float* out, size_t n, float alpha, float beta)
+{
+    host_job job;
+    memset(&job, 0, sizeof(job));
+    job.simd = select_simd();
+    job.op = op;
+    job.a = a;
+    job.b = b;
+    job.out = out;
+    job.alpha = alpha;
+    job.beta = beta;
+    job.n = n;
+    run_chunks(pool, map_task, &job);
+}
+
+void vec_host_add(cpu_thread_pool* pool, const float* a, const float* b, float* c, size_t n)
+{
+    host_map(pool, MAP_ADD, a, b, c, n, 0.0f, 0.0f);
+}
+
+void vec_host_mul(cpu_thread_pool* pool, const float* a, const float* b, float* c, size_t n)
+{
+    host_map(pool, MAP_MUL, a, b, c, n, 0.0f, 0.0f);
+}
+
+void vec_host_saxpy(cpu_thread_pool* pool, float alpha, const float* x, float* y, size_t n)
+{
+    host_map(pool, MAP_SAXPY, x, y, y, n, alpha, 0.0f);
+}
+
+void vec_host_scale_offset(cpu_thread_pool* pool, const float* x, float* y, float scale, float offset, size_t n)
+{
+    host_map(pool, MAP_SCALE_OFFSET, x, NULL, y, n, scale, offset);
+}
+
+// Per-chunk results are folded in chunk order, so the result does not depend on the thread count
+float vec_host_reduce(cpu_thread_pool* pool, vec_reduce_op op, const float* x, size_t n)
+{
+    host_job job;
+    int num_chunks = (int)((n + VEC_HOST_CHUNK - 1) / VEC_HOST_CHUNK);
+    memset(&job, 0, sizeof(job));
+    job.simd = select_simd();
+    job.reduce_op = op;
+    job.a = x;
+    job.n = n;
+    job.chunk_values = (float*)malloc((num_chunks > 0 ? num_chunks : 1) * sizeof(float));
+    run_chunks(pool, reduce_task, &job);
+    float value = reduce_scalar(op, job.chunk_values, num_chunks);
+    free(job.chunk_values);
+    return value;
+}
+
+// Two passes: the chunk totals, then every chunk scanned from the sum of the totals before it
+void vec_host_scan(cpu_thread_pool* pool, const float* x, float* y, size_t n)
+{
+    host_job job;
+    int num_chunks = (int)((n + VEC_HOST_CHUNK - 1) / VEC_HOST_CHUNK);
+    memset(&job, 0, sizeof(job));
+    job.simd = select_simd();
+    job.reduce_op = VEC_REDUCE_SUM;
+    job.a = x;
+    job.out = y;
+    job.n = n;
+    job.chunk_values = (float*)malloc((num_chunks > 0 ? num_chunks : 1) * sizeof(float));
+    run_chunks(pool, reduce_task, &job);
+    float carry = 0.0f;
+    for (int i = 0; i < num_chunks; i++)
+    {
+        float total = job.chunk_values[i];
+        job.chunk_values[i] = carry;
+        carry += total;
+    }
+    run_chunks(pool, scan_task, &job);
+    free(job.chunk_values);
+}
@@ -0,0 +1,166 @@
+// Bandwidth-bound vector primitives. Elementwise kernels and reductions use grid-stride loops over
+// float4: the host launches a few work-groups per compute unit and each work-item walks the array
+// in steps of the global size, so every launch is as wide as the device whatever n is, and
+// consecutive work-items touch consecutive 16-byte words. Buffers start on CL_DEVICE_MEM_BASE_ADDR_ALIGN,
+// so the float4 views are aligned; the n % 4 trailing floats are handled one per work-item.
+// Reductions and scans need a power-of-two work-group size.
+
+#define GRID_STRIDE(i, count) for (int i = get_global_id(0); i < (count); i += get_global_size(0))
+
+
+
+//------------------------------------------------------
+// Elementwise
+//------------------------------------------------------
+
+__kernel void vec_add(__global const float* a, __global const float* b, __global float* c, int n)
+{
+    int n4 = n / 4;
+    GRID_STRIDE(i, n4)
+        ((__global float4*)c)[i] = ((__global const float4*)a)[i] + ((__global const float4*)b)[i];
+    for (int i = (n4 * 4) + get_global_id(0); i < n; i += get_global_size(0))
+        c[i] = a[i] + b[i];
+}
+
+__kernel void vec_mul(__global const float* a, __global const float* b, __global float* c, int n)
+{
+    int n4 = n / 4;
+    GRID_STRIDE(i, n4)
+        ((__global float4*)c)[i] = ((__global const float4*)a)[i] * ((__global const float4*)b)[i];
+    for (int i = (n4 * 4) + get_global_id(0); i < n; i += get_global_size(0))
+        c[i] = a[i] * b[i];
+}
+
+// y = alpha * x + y
+__kernel void vec_saxpy(float alpha, __global const float* x, __global float* y, int n)
+{
+    int n4 = n / 4;
+    GRID_STRIDE(i, n4)
+        ((__global float4*)y)[i] = (alpha * ((__global const float4*)x)[i]) + ((__global float4*)y)[i];
+    for (int i = (n4 * 4) + get_global_id(0); i < n; i += get_global_size(0))
+        y[i] = (alpha * x[i]) + y[i];
+}
+
+// y = x * scale + offset, the normalization step once min / max or mean are known
+__kernel void vec_scale_offset(__global const float* x, __global float* y, float scale, float offset, int n)
+{
+    int n4 = n / 4;
+    GRID_STRIDE(i, n4)
+        ((__global float4*)y)[i] = (((__global const float4*)x)[i] * scale) + offset;
+    for (int i = (n4 * 4) + get_global_id(0); i < n; i += get_global_size(0))
+        y[i] = (x[i] * scale) + offset;
+}
+
+//------------------------------------------------------
+// Reductions
+//------------------------------------------------------
+
+// Each work-item folds its grid-stride share into a float4, then the work-group folds the
+// work-item results as a tree in local memory and partial[group] receives the group's result.
+// A second launch with a single work-group over the partials gives the final value.
+#define REDUCE_ADD(a, b) ((a) + (b))
+#define REDUCE_MIN(a, b) fmin((a), (b))
+#define REDUCE_MAX(a, b) fmax((a), (b))
+
+#define DEFINE_REDUCE(name, OP, identity)                                                              \
+__kernel void name(__global const float* x, __global float* partial, int n, __local float* scratch)    \
+{                                                                                                      \
+    int lid = get_local_id(0);                                                                         \
+    int n4 = n / 4;                                                                                    \
+    float4 acc = (float4)(identity);                                                                   \
+    GRID_STRIDE(i, n4)                                                                                 \
+        acc = OP(acc, ((__global const float4*)x)[i]);                                                 \
+    float value = OP(OP(acc.x, acc.y), OP(acc.z, acc.w));                                              \
+    for (int i = (n4 * 4) + get_global_id(0); i < n; i += get_global_size(0))                          \
+        value = OP(value, x[i]);                                                                       \
+    scratch[lid] = value;                                                                              \
+    barrier(CLK_LOCAL_MEM_FENCE);                                                                      \
+    for (int s = get_local_size(0) / 2; s > 0; s /= 2)                                                 \
+    {                                                                                                  \
+        if (lid < s)                                                                                   \
+            scratch[lid] = OP(scratch[lid], scratch[lid + s]);                                         \
+        barrier(CLK_LOCAL_MEM_FENCE);                                                                  \
+    }                                                                                                  \
+    if (lid == 0)                                                                                      \
+        partial[get_group_id(0)] = scratch[0];                                                         \
+}
+
+DEFINE_REDUCE(vec_reduce_sum, REDUCE_ADD, 0.0f)
+DEFINE_REDUCE(vec_reduce_min, REDUCE_MIN, INFINITY)
+DEFINE_REDUCE(vec_reduce_max, REDUCE_MAX, -INFINITY)
+
+//------------------------------------------------------
+// Inclusive prefix sum
+//------------------------------------------------------
+
+// Each work-group scans one block of 4 * group_size floats: every work-item scans its float4 in
+// registers, the work-item totals are scanned in local memory (Hillis-Steele, log2(group_size) steps)
+// and each float4 is offset by the totals before it. block_sums[group] receives the block total;
+// x and y may be the same buffer.
+__kernel void vec_scan_blocks(__global const float* x, __global float* y, __global float* block_sums, int n, __local float* scratch)
+{
+    int lid = get_local_id(0);
+    int group_size = get_local_size(0);
+    int base = 4 * get_global_id(0);
+    float4 v = 0.0f;
+    if (base + 3 < n)
+    {
+        v = vload4(0, x + base);
+    }
+    else
+    {
+        v.x = (base < n) ? x[base] : 0.0f;
+        v.y = (base + 1 < n) ? x[base + 1] : 0.0f;
+        v.z = (base + 2 < n) ? x[base + 2] : 0.0f;
+    }
+    v.y += v.x;
+    v.z += v.y;
+    v.w += v.z;
+
+    scratch[lid] = v.w;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int offset = 1; offset < group_size; offset *= 2)
+    {
+        float before = (lid >= offset) ? scratch[lid - offset] : 0.0f;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        scratch[lid] += before;
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    v += scratch[lid] - v.w;
+
+    if (base + 3 < n)
+    {
+        vstore4(v, 0, y + base);
+    }
+    else
+    {
+        if (base < n)
+            y[base] = v.x;
+        if (base + 1 < n)
+            y[base + 1] = v.y;
+        if (base + 2 < n)
+            y[base + 2] = v.z;
+    }
+    if (lid == group_size - 1)
+        block_sums[get_group_id(0)] = scratch[lid];
+}
+
+// Adds the scanned totals of the blocks before each block (block_offsets is the inclusive scan of
+// block_sums, so block b adds block_offsets[b - 1]). Launched with the same block layout.
+__kernel void vec_scan_add(__global float* y, __global const float* block_offsets, int n)
+{
+    int group = get_group_id(0);
+    int base = 4 * get_global_id(0);
+    if (group == 0)
+        return;
+    float offset = block_offsets[group - 1];
+    if (base + 3 < n)
+    {
+        vstore4(vload4(0, y + base) + offset, 0, y + base);
+    }
+    else
+    {
+        for (int i = base; i < n; i++)
+            y[i] += offset;
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef VEC_OPS_H
+#define VEC_OPS_H
+
+#include <stddef.h>
+#include <CL/cl.h>
+
+#include "ocl_runtime.h"
+#include "cpu_blur.h"
+
+// Bandwidth-bound float vector primitives on the device (vec_ops.cl) and on the host:
+// elementwise add, multiply, saxpy and scale-offset, sum / min / max reductions and an inclusive
+// prefix sum. Device kernels load float4 in grid-stride loops sized to the device; reductions fold a
+// tree per work-group, then the partials in a second launch; scans run a block scan per work-group and
+// add the scanned block totals (recursively, so any n works). Host versions split the array into
+// chunks on the thread pool and run SSE4.1/AVX2 loops (the level cpu_blur_simd_name reports).
+// Floating-point sums are not associative, so reductions and scans match across engines only to
+// within rounding.
+
+#define VEC_DEFAULT_GROUP_SIZE 256
+#define VEC_GROUPS_PER_COMPUTE_UNIT 8   // Grid-stride launches: enough groups to hide latency, no more
+
+typedef enum
+{
+    VEC_REDUCE_SUM,
+    VEC_REDUCE_MIN,
+    VEC_REDUCE_MAX,
+    VEC_REDUCE_COUNT
+} vec_reduce_op;
+
+typedef struct
+{
+    ocl_runtime* rt;
+    size_t group_size;   // Power of two
+    size_t max_groups;   // Groups of a grid-stride launch
+    cl_kernel add;
+    cl_kernel mul;
+    cl_kernel saxpy;
+    cl_kernel scale_offset;
+    cl_kernel reduce[VEC_REDUCE_COUNT];
+    cl_kernel scan_blocks;
+    cl_kernel scan_add;
+} vec_engine;
+
+const char* vec_reduce_name(vec_reduce_op op);
+
+//------------------------------------------------------
+// Device
+//------------------------------------------------------
+
+// Builds vec_ops.cl and picks the group size: VEC_DEFAULT_GROUP_SIZE halved until the device and every kernel take it
+cl_int vec_engine_init(vec_engine* engine, ocl_runtime* rt);
+void vec_engine_release(vec_engine* engine);
+
+// Uses group_size work-items per group (a power of two the kernels accept), e.g. an autotuning result
+cl_int vec_engine_set_group_size(vec_engine* engine, size_t group_size);
+
+// Buffers hold at least n floats. event (optional) is the event of the launch, or of the last launch
+// for the operations that take several; wait lists apply to the first. Reductions and scans take their
+// temporaries from the runtime's buffer pool and recycle them once enqueued, which is safe on the
+// runtime's queue; with another queue, finish it before the runtime's queue is used again.
+cl_int vec_engine_add(vec_engine* engine, cl_command_queue queue, cl_mem a, cl_mem b, cl_mem c, int n,
+                      cl_uint num_wait_events, const cl_event* wait_events, cl_event* event);
+cl_int vec_engine_mul(vec_engine* engine, cl_command_queue queue, cl_mem a, cl_mem b, cl_mem c, int n,
+                      cl_uint num_wait_events, const cl_event* wait_events, cl_event* event);
+// y = alpha * x + y
+cl_int vec_engine_saxpy(vec_engine* engine, cl_command_queue queue, float alpha, cl_mem x, cl_mem y, int n,
+                        cl_uint num_wait_events, const cl_event* wait_events, cl_event* event);
+// y = x * scale + offset (x and y may be the same buffer)
+cl_int vec_engine_scale_offset(vec_engine* engine, cl_command_queue queue, cl_mem x, cl_mem y, float scale, float offset, int n,
+                               cl_uint num_wait_events, const cl_event* wait_events, cl_event* event);
+
+// Leaves the reduction of x in result[0] (a buffer of at least one float); the identity (0, +inf, -inf) when n is 0
+cl_int vec_engine_enqueue_reduce(vec_engine* engine, cl_command_queue queue, vec_reduce_op op, cl_mem x, int n, cl_mem result,
+                                 cl_uint num_wait_events, const cl_event* wait_events, cl_event* event);
+
+// Same, and blocks until *result is on the host
+cl_int vec_engine_reduce(vec_engine* engine, cl_command_queue queue, vec_reduce_op op, cl_mem x, int n, float* result);
+
+// y[i] = x[0] + ... + x[i] (x and y may be the same buffer)
+cl_int vec_engine_scan(vec_engine* engine, cl_command_queue queue, cl_mem x, cl_mem y, int n,
+                       cl_uint num_wait_events, const cl_event* wait_events, cl_event* event);
+
+//------------------------------------------------------
+// Host
+//------------------------------------------------------
+
+void vec_host_add(cpu_thread_pool* pool, const float* a, const float* b, float* c, size_t n);
+void vec_host_mul(cpu_thread_pool* pool, const float* a, const float* b, float* c, size_t n);
+void vec_host_saxpy(cpu_thread_pool* pool, float alpha, const float* x, float* y, size_t n);
+void vec_host_scale_offset(cpu_thread_pool* pool, const float* x, float* y, float scale, float offset, size_t n);
+float vec_host_reduce(cpu_thread_pool* pool, vec_reduce_op op, const float* x, size_t n);
+void vec_host_scan(cpu_thread_pool* pool, const float* x, float* y, size_t n);
+
+#endif
@@ -0,0 +1,301 @@
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VERIFY_X86 1
+#endif
+
+#include "verify.h"
+
+// Bytes per task: large enough to amortize the pool, small enough for early exit to skip most of the work
+#define VERIFY_CHUNK_BYTES (256 * 1024)
+#define VERIFY_NO_MISMATCH ((size_t)-1)
+
+
+
+// Statistics of one contiguous range
+typedef struct
+{
+    size_t mismatches;
+    size_t first_mismatch;        // Offset within the range
+    unsigned long long sum_error;
+    unsigned long long sum_sq_error;
+    int max_error;
+    int checked;
+} chunk_stats;
+
+typedef void (*compare_fn)(const unsigned char* a, const unsigned char* b, size_t n, int tolerance, chunk_stats* stats);
+
+static void compare_scalar(const unsigned char* a, const unsigned char* b, size_t n, int tolerance, chunk_stats* stats)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        int error = abs((int)a[i] - (int)b[i]);
+        stats->sum_error += error;
+        stats->sum_sq_error += (unsigned long long)(error * error);
+        if (error > stats->max_error)
+            stats->max_error = error;
+        if (error > tolerance)
+        {
+            if (stats->mismatches == 0)
+                stats->first_mismatch = i;
+            stats->mismatches++;
+        }
+    }
+}
+
+#ifdef VERIFY_X86
+// |a - b| per byte, the errors above the tolerance as a bit mask, and sum / sum of squares folded into
+// 64-bit lanes: psadbw gives the plain sums, pmaddwd on the zero-extended errors the squares
+__attribute__((target("sse4.1")))
+static void compare_sse(const unsigned char* a, const unsigned char* b, size_t n, int tolerance, chunk_stats* stats)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i limit = _mm_set1_epi8((char)(tolerance > 255 ? 255 : tolerance));
+    __m128i max_error = zero, sum = zero, sum_sq = zero;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        __m128i error = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+        max_error = _mm_max_epu8(max_error, error);
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(error, zero));
+        __m128i lo = _mm_unpacklo_epi8(error, zero);
+        __m128i hi = _mm_unpackhi_epi8(error, zero);
+        __m128i squares = _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi));
+        sum_sq = _mm_add_epi64(sum_sq, _mm_add_epi64(_mm_unpacklo_epi32(squares, zero), _mm_unpackhi_epi32(squares, zero)));
+
+        unsigned int over = ~(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(error, limit), zero)) & 0xffffu;
+        if (over)
+        {
+            if (stats->mismatches == 0)
+                stats->first_mismatch = i + __builtin_ctz(over);
+            stats->mismatches += __builtin_popcount(over);
+        }
+    }
+    // Stored rather than extracted: _mm_extract_epi64 only exists on x86-64
+    unsigned char lanes[16];
+    unsigned long long sums[2], sums_sq[2];
+    _mm_storeu_si128((__m128i*)lanes, max_error);
+    _mm_storeu_si128((__m128i*)sums, sum);
+    _mm_storeu_si128((__m128i*)sums_sq, sum_sq);
+    for (int k = 0; k < 16; k++)
+    {
+        if (lanes[k] > stats->max_error)
+            stats->max_error = lanes[k];
+    }
+    stats->sum_error += sums[0] + sums[1];
+    stats->sum_sq_error += sums_sq[0] + sums_sq[1];
+
+    chunk_stats tail;
+    memset(&tail, 0, sizeof(tail));
+    compare_scalar(a + i, b + i, n - i, tolerance, &tail);
+    if (tail.mismatches && stats->mismatches == 0)
+        stats->first_mismatch = i + tail.first_mismatch;
+    stats->mismatches += tail.mismatches;
+    stats->sum_error += tail.sum_error;
+    stats->sum_sq_error += tail.sum_sq_error;
+    if (tail.max_error > stats->max_error)
+        stats->max_error = tail.max_error;
+}
+
+__attribute__((target("avx2")))
+static void compare_avx2(const unsigned char* a, const unsigned char* b, size_t n, int tolerance, chunk_stats* stats)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i limit = _mm256_set1_epi8((char)(tolerance > 255 ? 255 : tolerance));
+    __m256i max_error = zero, sum = zero, sum_sq = zero;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+        __m256i error = _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va));
+        max_error = _mm256_max_epu8(max_error, error);
+        sum = _mm256_add_epi64(sum, _mm256_sad_epu8(error, zero));
+        __m256i lo = _mm256_unpacklo_epi8(error, zero);
+        __m256i hi = _mm256_unpackhi_epi8(error, zero);
+        __m256i squares = _mm256_add_epi32(_mm256_madd_epi16(lo, lo), _mm256_madd_epi16(hi, hi));
+        sum_sq = _mm256_add_epi64(sum_sq, _mm256_add_epi64(_mm256_unpacklo_epi32(squares, zero), _mm256_unpackhi_epi32(squares, zero)));
+
+        unsigned int over = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_subs_epu8(error, limit), zero));
+        if (over)
+        {
+            if (stats->mismatches == 0)
+                stats->first_mismatch = i + __builtin_ctz(over);
+            stats->mismatches += __builtin_popcount(over);
+        }
+    }
+    unsigned char lanes[32];
+    unsigned long long sums[4], sums_sq[4];
+    _mm256_storeu_si256((__m256i*)lanes, max_error);
+    _mm256_storeu_si256((__m256i*)sums, sum);
+    _mm256_storeu_si256((__m256i*)sums_sq, sum_sq);
+    for (int k = 0; k < 32; k++)
+    {
+        if (lanes[k] > stats->max_error)
+            stats->max_error = lanes[k];
+    }
+    stats->sum_error += sums[0] + sums[1] + sums[2] + sums[3];
+    stats->sum_sq_error += sums_sq[0] + sums_sq[1] + sums_sq[2] + sums_sq[3];
+
+    chunk_stats tail;
+    memset(&tail, 0, sizeof(tail));
+    compare_scalar(a + i, b + i, n - i, tolerance, &tail);
+    if (tail.mismatches && stats->mismatches == 0)
+        stats->first_mismatch = i + tail.first_mismatch;
+    stats->mismatches += tail.mismatches;
+    stats->sum_error += tail.sum_error;
+    stats->sum_sq_error += tail.sum_sq_error;
+    if (tail.max_error > stats->max_error)
+        stats->max_error = tail.max_error;
+}
+#endif
+
+// Follows the CPU blur engine's choice, so CPU_BLUR_SIMD caps both
+static compare_fn select_compare(void)
+{
+#ifdef VERIFY_X86
+    const char* simd = cpu_blur_simd_name();
+    if (strcmp(simd, "avx2") == 0)
+        return compare_avx2;
+    if (strcmp(simd, "sse4.1") == 0)
+        return compare_sse;
+#endif
+    return compare_scalar;
+}
+
+typedef struct
+{
+    const unsigned char* expected;
+    const unsigned char* actual;
+    size_t size;
+    int tolerance;
+    size_t max_mismatches;
+    size_t found;        // Mismatches so far across all threads (atomic)
+    compare_fn compare;
+    chunk_stats* chunks;
+} verify_job;
+
+static void verify_chunk(void* ctx, int item, int thread_index)
+{
+    verify_job* job = (verify_job*)ctx;
+    (void)thread_index;
+    if (job->max_mismatches && __atomic_load_n(&job->found, __ATOMIC_RELAXED) >= job->max_mismatches)
+        return;
+
+    size_t begin = (size_t)item * VERIFY_CHUNK_BYTES;
+    size_t n = (begin + VERIFY_CHUNK_BYTES < job->size) ? VERIFY_CHUNK_BYTES : job->size - begin;
+    chunk_stats* stats = &job->chunks[item];
+    job->compare(job->expected + begin, job->actual + begin, n, job->tolerance, stats);
+    stats->checked = 1;
+    if (stats->mismatches)
+        __atomic_add_fetch(&job->found, stats->mismatches, __ATOMIC_RELAXED);
+}
+
+// A negative tolerance accepts nothing but exact matches, the same as 0, on every compare path
+static int effective_tolerance(const verify_options* options)
+{
+    return (options->tolerance > 0) ? options->tolerance : 0;
+}
+
+void verify_default_options(verify_options* options)
+{
+    options->tolerance = 0;
+    options->max_mismatches = 1000;
+    options->max_reported = 10;
+}
+
+int verify_images(cpu_thread_pool* pool, const unsigned char* expected, const unsigned char* actual, size_t size,
+                  const verify_options* options, verify_result* result)
+{
+    verify_job job;
+    int num_chunks = (int)((size + VERIFY_CHUNK_BYTES - 1) / VERIFY_CHUNK_BYTES);
+    memset(&job, 0, sizeof(job));
+    job.expected = expected;
+    job.actual = actual;
+    job.size = size;
+    job.tolerance = effective_tolerance(options);
+    job.max_mismatches = options->max_mismatches;
+    job.compare = select_compare();
+    job.chunks = (chunk_stats*)calloc(num_chunks > 0 ? num_chunks : 1, sizeof(chunk_stats));
+
+    if (pool)
+    {
+        cpu_thread_pool_run(pool, verify_chunk, &job, num_chunks);
+    }
+    else
+    {
+        for (int i = 0; i < num_chunks; i++)
+            verify_chunk(&job, i, 0);
+    }
+
+    unsigned long long sum_error = 0, sum_sq_error = 0;
+    memset(result, 0, sizeof(*result));
+    result->first_mismatch = VERIFY_NO_MISMATCH;
+    for (int i = 0; i < num_chunks; i++)
+    {
+        const chunk_stats* stats = &job.chunks[i];
+        if (!stats->checked)
+        {
+            result->stopped_early = 1;
+            continue;
+        }
+        size_t begin = (size_t)i * VERIFY_CHUNK_BYTES;
+        result->samples += (begin + VERIFY_CHUNK_BYTES < size) ? VERIFY_CHUNK_BYTES : size - begin;
+        if (stats->mismatches && result->first_mismatch == VERIFY_NO_MISMATCH)
+            result->first_mismatch = begin + stats->first_mismatch;
+        result->mismatches += stats->mismatches;
+        sum_error += stats->sum_error;
+        sum_sq_error += stats->sum_sq_error;
+        if (stats->max_error > result->max_error)
+            result->max_error = stats->max_error;
+    }
+    free(job.chunks);
+
+    result->mean_abs_error = result->samples ? (double)sum_error / result->samples : 0.0;
+    double mse = result->samples ? (double)sum_sq_error / result->samples : 0.0;
+    result->psnr_db = (mse > 0.0) ? 10.0 * log10((255.0 * 255.0) / mse) : INFINITY;
+    result->passed = result->mismatches == 0;
+    return result->passed;
+}
+
+void verify_print(const verify_result* result, const verify_options* options, const unsigned char* expected, const unsigned char* actual,
+                  size_t size, int width, int channels)
+{
+    if (result->passed)
+        printf("Output matches (tolerance %d): max error %d, mean abs error %.4f, PSNR ", effective_tolerance(options), result->max_error, result->mean_abs_error);
+    else
+        printf("Output DOES NOT match (tolerance %d): %zu mismatched samples%s, max error %d, mean abs error %.4f, PSNR ", effective_tolerance(options),
+               result->mismatches, result->stopped_early ? " (stopped early)" : "", result->max_error, result->mean_abs_error);
+    if (isinf(result->psnr_db))
+        printf("inf (identical)\n");
+    else
+        printf("%.2f dB\n", result->psnr_db);
+    if (result->passed)
+        return;
+
+    // The first mismatches, found again from the first known position
+    int reported = 0;
+    for (size_t i = result->first_mismatch; i < size && reported < options->max_reported; i++)
+    {
+        int error = abs((int)expected[i] - (int)actual[i]);
+        if (error <= effective_tolerance(options))
+            continue;
+        if (width > 0 && channels > 0)
+        {
+            size_t pixel = i / channels;
+            printf("  (%zu, %zu) channel %zu: expected %d, got %d\n", pixel % width, pixel / width, i % channels, expected[i], actual[i]);
+        }
+        else
+        {
+            printf("  [%zu]: expected %d, got %d\n", i, expected[i], actual[i]);
+        }
+        reported++;
+    }
+}
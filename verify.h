@@ -0,0 +1,46 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stddef.h>
+
+#include "cpu_blur.h"
+
+// Comparison of 8-bit images (or any byte arrays) against a reference.
+// The arrays are split in chunks across a CPU thread pool and compared with SSE/AVX2 (same
+// instruction set choice and CPU_BLUR_SIMD override as the CPU blur engine). Samples whose absolute
+// difference exceeds the tolerance are mismatches; once max_mismatches of them are found the
+// remaining chunks are skipped, so a broken result costs little and a good one costs one pass.
+
+typedef struct
+{
+    int tolerance;          // Largest accepted absolute difference per sample (negative counts as 0)
+    size_t max_mismatches;  // Stop after this many mismatches (0: always compare everything)
+    int max_reported;       // Mismatches printed with their position by verify_print
+} verify_options;
+
+typedef struct
+{
+    size_t samples;          // Samples compared (less than the size when stopped early)
+    size_t mismatches;       // Samples over the tolerance among them
+    size_t first_mismatch;   // Index of the first mismatch, (size_t)-1 when there is none
+    int max_error;           // Largest absolute difference seen
+    double mean_abs_error;
+    double psnr_db;          // Peak signal-to-noise ratio over the compared samples (INFINITY when identical)
+    int stopped_early;
+    int passed;              // No mismatch
+} verify_result;
+
+// Tolerance 0, stop after 1000 mismatches, report the first 10
+void verify_default_options(verify_options* options);
+
+// Compares size bytes of actual against expected. pool may be NULL (single-threaded).
+// Returns result->passed.
+int verify_images(cpu_thread_pool* pool, const unsigned char* expected, const unsigned char* actual, size_t size,
+                  const verify_options* options, verify_result* result);
+
+// Prints the statistics and, on failure, the first mismatched samples (as pixel and channel when
+// width and channels are given, plain indices when width is 0)
+void verify_print(const verify_result* result, const verify_options* options, const unsigned char* expected, const unsigned char* actual,
+                  size_t size, int width, int channels);
+
+#endif